@@ -47,6 +47,8 @@
 
 
 static void read_consoles_from_file(List consoles, char *file);
+static void read_script_from_file(List script, char *file);
+static void parse_filter_opts(req_t *req, char *str);
 static void display_client_help(client_conf_t *conf);
 
 
@@ -91,9 +93,16 @@ client_conf_t * create_client_conf(void)
     conf->escapeChar = DEFAULT_CLIENT_ESCAPE;
     conf->log = NULL;
     conf->logd = -1;
+    conf->offset = 0;
     conf->errnum = CONMAN_ERR_NONE;
     conf->errmsg = NULL;
+    conf->tlsCAFile = NULL;
+    conf->tlsSessionFile = NULL;
+#if WITH_ZLIB
+    conf->zstrm = NULL;
+#endif /* WITH_ZLIB */
     conf->enableVerbose = 0;
+    conf->gotOffset = 0;
     conf->isClosedByClient = 0;
 
     return(conf);
@@ -117,6 +126,16 @@ void destroy_client_conf(client_conf_t *conf)
     }
     if (conf->errmsg)
         free(conf->errmsg);
+    if (conf->tlsCAFile)
+        free(conf->tlsCAFile);
+    if (conf->tlsSessionFile)
+        free(conf->tlsSessionFile);
+#if WITH_ZLIB
+    if (conf->zstrm) {
+        (void) inflateEnd(conf->zstrm);
+        free(conf->zstrm);
+    }
+#endif /* WITH_ZLIB */
 
     free(conf);
     return;
@@ -147,6 +166,21 @@ void process_client_env_vars(client_conf_t *conf)
     if ((p = getenv("CONMAN_ESCAPE")) && (*p)) {
         conf->escapeChar = p[0];
     }
+    if ((p = getenv("CONMAN_TLS_CA")) && (*p)) {
+        conf->tlsCAFile = create_string(p);
+    }
+    /*  A TLS session is cached in the user's home directory for resumption
+     *    by the next connection unless CONMAN_TLS_SESSION specifies another
+     *    file, or is set to the empty string to disable caching.
+     */
+    if ((p = getenv("CONMAN_TLS_SESSION"))) {
+        if (*p)
+            conf->tlsSessionFile = create_string(p);
+    }
+    else if ((p = getenv("HOME")) && (*p)) {
+        conf->tlsSessionFile = create_format_string("%s/%s",
+            p, TLS_SESSION_FILE);
+    }
     return;
 }
 
@@ -162,11 +196,15 @@ void process_client_cmd_line(int argc, char *argv[], client_conf_t *conf)
         conf->prog = create_string(argv[0]);
 
     opterr = 0;
-    while ((c = getopt(argc, argv, "bd:e:fF:hjl:LmqQrvV")) != -1) {
+    while ((c = getopt(argc, argv, "bcd:e:fF:hjl:Lmn:o:O:qQrtvVx:z")) != -1) {
         switch(c) {
         case 'b':
             conf->req->enableBroadcast = 1;
             break;
+        case 'c':
+            conf->req->command = CONMAN_CMD_MONITOR;
+            conf->req->enableCoalesce = 1;
+            break;
         case 'd':
             if ((p = strchr(optarg, ':'))) {
                 *p++ = '\0';
@@ -206,9 +244,28 @@ void process_client_cmd_line(int argc, char *argv[], client_conf_t *conf)
             exit(0);
         case 'm':
             conf->req->command = CONMAN_CMD_MONITOR;
+            conf->req->enableCoalesce = 0;
+            break;
+        case 'n':
+            if ((optarg[strspn(optarg, "0123456789")] != '\0')
+                    || (atoi(optarg) <= 0))
+                log_err(0, "CMDLINE: invalid number of lines \"%s\"", optarg);
+            conf->req->numLines = atoi(optarg);
+            conf->req->enableResume = 0;
+            break;
+        case 'o':
+            if (optarg[strspn(optarg, "0123456789")] != '\0')
+                log_err(0, "CMDLINE: invalid offset \"%s\"", optarg);
+            conf->req->offset = strtoull(optarg, NULL, 10);
+            conf->req->enableResume = 1;
+            conf->req->numLines = 0;
+            break;
+        case 'O':
+            parse_filter_opts(conf->req, optarg);
             break;
         case 'q':
             conf->req->command = CONMAN_CMD_QUERY;
+            conf->req->enableCoalesce = 0;
             break;
         case 'Q':
             conf->req->enableQuiet = 1;
@@ -216,12 +273,33 @@ void process_client_cmd_line(int argc, char *argv[], client_conf_t *conf)
         case 'r':
             conf->req->enableRegex = 1;
             break;
+        case 't':
+#if WITH_OPENSSL
+            conf->req->enableTLS = 1;
+            break;
+#else /* !WITH_OPENSSL */
+            log_err(0, "CMDLINE: option \"%c\" requires OpenSSL support", c);
+            exit(1);
+#endif /* WITH_OPENSSL */
         case 'v':
             conf->enableVerbose = 1;
             break;
         case 'V':
             printf("%s-%s%s\n", PROJECT, VERSION, CLIENT_FEATURES);
             exit(0);
+        case 'x':
+            conf->req->command = CONMAN_CMD_EXECUTE;
+            conf->req->enableCoalesce = 0;
+            read_script_from_file(conf->req->script, optarg);
+            break;
+        case 'z':
+#if WITH_ZLIB
+            conf->req->enableCompress = 1;
+            break;
+#else /* !WITH_ZLIB */
+            log_err(0, "CMDLINE: option \"%c\" requires zlib support", c);
+            exit(1);
+#endif /* WITH_ZLIB */
         case '?':                       /* invalid option */
             log_err(0, "CMDLINE: invalid option \"%c\"", optopt);
             exit(1);
@@ -238,6 +316,13 @@ void process_client_cmd_line(int argc, char *argv[], client_conf_t *conf)
         conf->req->enableForce = 0;
         conf->req->enableJoin = 0;
     }
+    /*  An EXECUTE script shares consoles with existing writers (if joined),
+     *    but can neither steal them nor be run in write-only mode.
+     */
+    if (conf->req->command == CONMAN_CMD_EXECUTE) {
+        conf->req->enableBroadcast = 0;
+        conf->req->enableForce = 0;
+    }
 
     for (i=optind; i<argc; i++) {
 
@@ -312,6 +397,114 @@ static void read_consoles_from_file(List consoles, char *file)
 }
 
 
+static void read_script_from_file(List script, char *file)
+{
+/*  Reads an EXECUTE script from 'file', appending its steps to 'script'.
+ *  The format of the file is as follows:
+ *    - one step per line: a keyword followed by its (optionally quoted) arg
+ *    - "send STR" writes STR to the console; C-style escapes such as
+ *        \r, \n, \t, \e, \xHH, and \NNN are expanded by the server
+ *    - "expect REGEX" waits for console output matching the extended REGEX
+ *    - "timeout SECS" sets the secs to wait on subsequent expects (0=forever)
+ *    - "capture on|off" toggles returning the output matched by each expect
+ *    - leading/trailing whitespace, blank lines, and comments are ignored
+ */
+    FILE *fp;
+    char buf[MAX_LINE];
+    char *key, *arg, *ptr, *p;
+    int line = 0;
+    int val;
+
+    assert(script != NULL);
+    assert(file != NULL);
+
+    if (!(fp = fopen(file, "r")))
+        log_err(errno, "Unable to open \"%s\"", file);
+
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+
+        line++;
+        for (p = buf; *p; p++) {
+            if (*p & 0x80)
+                log_err(0, "SCRIPT: non-ASCII char at \"%s\" line %d",
+                    file, line);
+        }
+        ptr = NULL;
+        if (parse_string(buf, &key, &ptr, NULL) <= 0)
+            continue;
+        if (*key == '#')
+            continue;
+        if (parse_string(buf, &arg, &ptr, NULL) <= 0)
+            log_err(0, "SCRIPT: missing argument for \"%s\" at \"%s\" line %d",
+                key, file, line);
+
+        if (!strcasecmp(key, "send")) {
+            list_append(script,
+                create_step(CONMAN_STEP_SEND, create_string(arg), 0));
+        }
+        else if (!strcasecmp(key, "expect")) {
+            if (*arg == '\0')
+                log_err(0, "SCRIPT: empty expect at \"%s\" line %d",
+                    file, line);
+            list_append(script,
+                create_step(CONMAN_STEP_EXPECT, create_string(arg), 0));
+        }
+        else if (!strcasecmp(key, "timeout")) {
+            if ((*arg == '\0') || (arg[strspn(arg, "0123456789")] != '\0'))
+                log_err(0, "SCRIPT: invalid timeout \"%s\" at \"%s\" line %d",
+                    arg, file, line);
+            val = atoi(arg);
+            list_append(script, create_step(CONMAN_STEP_TIMEOUT, NULL, val));
+        }
+        else if (!strcasecmp(key, "capture")) {
+            val = !strcasecmp(arg, "on");
+            if (!val && strcasecmp(arg, "off"))
+                log_err(0, "SCRIPT: invalid capture \"%s\" at \"%s\" line %d",
+                    arg, file, line);
+            list_append(script, create_step(CONMAN_STEP_CAPTURE, NULL, val));
+        }
+        else {
+            log_err(0, "SCRIPT: invalid keyword \"%s\" at \"%s\" line %d",
+                key, file, line);
+        }
+    }
+
+    if (fclose(fp) == EOF)
+        log_err(errno, "Unable to close \"%s\"", file);
+
+    if (list_is_empty(script))
+        log_err(0, "SCRIPT: no steps found in \"%s\"", file);
+
+    return;
+}
+
+
+static void parse_filter_opts(req_t *req, char *str)
+{
+/*  Parses the comma-separated list of output filters in (str),
+ *    updating the request (req) accordingly.
+ */
+    const char *separators = " \t\n,";
+    char *tok;
+
+    tok = strtok(str, separators);
+    while (tok != NULL) {
+        if (!strcasecmp(tok, "newline"))
+            req->filter |= CONMAN_FILTER_NEWLINE;
+        else if (!strcasecmp(tok, "noansi"))
+            req->filter |= CONMAN_FILTER_NOANSI;
+        else if (!strcasecmp(tok, "sanitize"))
+            req->filter |= CONMAN_FILTER_SANITIZE;
+        else if (!strcasecmp(tok, "timestamp"))
+            req->filter |= CONMAN_FILTER_TIMESTAMP;
+        else
+            log_err(0, "CMDLINE: invalid output filter \"%s\"", tok);
+        tok = strtok(NULL, separators);
+    }
+    return;
+}
+
+
 static void display_client_help(client_conf_t *conf)
 {
     char esc[3];
@@ -321,6 +514,7 @@ static void display_client_help(client_conf_t *conf)
     printf("Usage: %s [OPTIONS] [CONSOLES]\n", conf->prog);
     printf("\n");
     printf("  -b        Broadcast to multiple consoles (write-only).\n");
+    printf("  -c        Coalesce identical output from multiple consoles.\n");
     printf("  -d HOST   Specify server destination. [%s:%d]\n",
         conf->req->host, conf->req->port);
     printf("  -e CHAR   Specify escape character. [%s]\n", esc);
@@ -331,11 +525,22 @@ static void display_client_help(client_conf_t *conf)
     printf("  -l FILE   Log connection output to file.\n");
     printf("  -L        Display license information.\n");
     printf("  -m        Monitor connection (read-only).\n");
+    printf("  -n NUM    Replay the last NUM lines of console output.\n");
+    printf("  -o NUM    Resume console output at stream offset.\n");
+    printf("  -O LIST   Filter console output (newline,noansi,sanitize,"
+        "timestamp).\n");
     printf("  -q        Query server about specified console(s).\n");
     printf("  -Q        Be quiet and suppress informational messages.\n");
     printf("  -r        Match console names via regex instead of globbing.\n");
+#if WITH_OPENSSL
+    printf("  -t        Encrypt connection to server via TLS.\n");
+#endif /* WITH_OPENSSL */
     printf("  -v        Be verbose.\n");
     printf("  -V        Display version information.\n");
+    printf("  -x FILE   Execute send/expect script on console(s).\n");
+#if WITH_ZLIB
+    printf("  -z        Compress console output sent by the server.\n");
+#endif /* WITH_ZLIB */
     printf("\n");
     printf("  Once a connection is established, enter \"%s%c\""
            " to close the session,\n", esc, ESC_CHAR_CLOSE);
@@ -26,14 +26,25 @@
 #  include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#if WITH_OPENSSL
+#  include <openssl/err.h>
+#  include <openssl/pem.h>
+#  include <openssl/ssl.h>
+#  include <openssl/x509v3.h>
+#endif /* WITH_OPENSSL */
+
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <sys/types.h>                  /* include before in.h for bsd */
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include "client.h"
 #include "common.h"
@@ -42,8 +53,14 @@
 #include "util-file.h"
 #include "util-net.h"
 #include "util-str.h"
+#include "util.h"
 
 
+#if WITH_OPENSSL
+static int connect_tls(client_conf_t *conf, const char *host);
+static SSL_SESSION * load_tls_session(client_conf_t *conf, const char *host);
+static void save_tls_session(client_conf_t *conf);
+#endif /* WITH_OPENSSL */
 static void parse_rsp_ok(Lex l, client_conf_t *conf);
 static void parse_rsp_err(Lex l, client_conf_t *conf);
 
@@ -53,11 +70,17 @@ int connect_to_server(client_conf_t *conf)
     int sd;
     struct sockaddr_in saddr;
     char buf[MAX_LINE];
+    char host[MAX_LINE];
     char *p;
 
     assert(conf->req->host != NULL);
     assert(conf->req->port > 0);
 
+    /*  Save the host as specified for verifying the server's TLS certificate
+     *    since it is replaced below by its shortened canonical name.
+     */
+    strlcpy(host, conf->req->host, sizeof(host));
+
     if ((sd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
         log_err(errno, "Unable to create socket");
 
@@ -92,10 +115,204 @@ int connect_to_server(client_conf_t *conf)
         return(-1);
     }
     conf->req->sd = sd;
+
+#if WITH_OPENSSL
+    if (conf->req->enableTLS) {
+        return(connect_tls(conf, host));
+    }
+#endif /* WITH_OPENSSL */
     return(0);
 }
 
 
+#if WITH_OPENSSL
+static int connect_tls(client_conf_t *conf, const char *host)
+{
+/*  Establishes a TLS session over the connected socket, verifying the
+ *    server's certificate for (host) against the CA certificates in
+ *    CONMAN_TLS_CA (or the system's default trust store).
+ *  A session cached by a previous connection to the same host is offered
+ *    for resumption, thereby avoiding a full handshake.
+ *  Returns 0 on success, or -1 on error.
+ */
+    SSL_CTX *ctx;
+    SSL *ssl;
+    SSL_SESSION *sess;
+    struct in_addr addr;
+    int isAddr;
+    int rc;
+    long verify;
+    unsigned long e;
+    char buf[MAX_LINE];
+
+    assert(conf->req->sd >= 0);
+    assert(conf->req->ssl == NULL);
+
+    if (!(ctx = SSL_CTX_new(TLS_client_method()))) {
+        log_err(0, "Unable to create TLS context");
+    }
+    (void) SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    (void) SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+
+    if (conf->tlsCAFile) {
+        rc = SSL_CTX_load_verify_locations(ctx, conf->tlsCAFile, NULL);
+    }
+    else {
+        rc = SSL_CTX_set_default_verify_paths(ctx);
+    }
+    if (rc != 1) {
+        SSL_CTX_free(ctx);
+        conf->errnum = CONMAN_ERR_LOCAL;
+        conf->errmsg = create_format_string(
+            "Unable to load TLS CA certificates%s%s",
+            (conf->tlsCAFile ? " from " : ""),
+            (conf->tlsCAFile ? conf->tlsCAFile : ""));
+        return(-1);
+    }
+    ssl = SSL_new(ctx);
+    SSL_CTX_free(ctx);                  /* ctx is ref-counted by ssl */
+    if (!ssl) {
+        log_err(0, "Unable to create TLS session");
+    }
+    conf->req->ssl = ssl;
+    (void) SSL_set_fd(ssl, conf->req->sd);
+
+    isAddr = (inet_pton(AF_INET, host, &addr) == 1);
+    if (isAddr) {
+        rc = X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host);
+    }
+    else {
+        rc = SSL_set_tlsext_host_name(ssl, host) && SSL_set1_host(ssl, host);
+    }
+    if (rc != 1) {
+        log_err(0, "Unable to set TLS server name \"%s\"", host);
+    }
+    if ((sess = load_tls_session(conf, host))) {
+        (void) SSL_set_session(ssl, sess);
+        SSL_SESSION_free(sess);
+    }
+    for (;;) {
+        ERR_clear_error();
+        errno = 0;
+        if ((rc = SSL_connect(ssl)) == 1) {
+            break;
+        }
+        if ((SSL_get_error(ssl, rc) == SSL_ERROR_SYSCALL) && (errno == EINTR)) {
+            continue;
+        }
+        if ((verify = SSL_get_verify_result(ssl)) != X509_V_OK) {
+            strlcpy(buf, X509_verify_cert_error_string(verify), sizeof(buf));
+        }
+        else if ((e = ERR_get_error()) != 0) {
+            ERR_error_string_n(e, buf, sizeof(buf));
+        }
+        else {
+            strlcpy(buf, (errno ? strerror(errno)
+                : "connection closed during handshake"), sizeof(buf));
+        }
+        conf->errnum = CONMAN_ERR_LOCAL;
+        conf->errmsg = create_format_string(
+            "Unable to establish TLS with <%s:%d>: %s",
+            conf->req->fqdn, conf->req->port, buf);
+        return(-1);
+    }
+    if (conf->enableVerbose) {
+        fprintf(stderr, "Established %s (%s%s) with <%s:%d>\n",
+            SSL_get_version(ssl), SSL_get_cipher_name(ssl),
+            (SSL_session_reused(ssl) ? ", resumed" : ""),
+            conf->req->fqdn, conf->req->port);
+    }
+    return(0);
+}
+
+
+static SSL_SESSION * load_tls_session(client_conf_t *conf, const char *host)
+{
+/*  Loads the TLS session cached by a previous connection.
+ *  Returns the session if it was established with (host), or NULL.
+ */
+    FILE *fp;
+    SSL_SESSION *sess;
+    const char *name;
+
+    if (!conf->tlsSessionFile) {
+        return(NULL);
+    }
+    if (!(fp = fopen(conf->tlsSessionFile, "r"))) {
+        return(NULL);
+    }
+    sess = PEM_read_SSL_SESSION(fp, NULL, NULL, NULL);
+    (void) fclose(fp);
+    ERR_clear_error();
+
+    if (!sess) {
+        return(NULL);
+    }
+    name = SSL_SESSION_get0_hostname(sess);
+    if (!SSL_SESSION_is_resumable(sess)
+            || ((name != NULL) && (strcasecmp(name, host) != 0))) {
+        SSL_SESSION_free(sess);
+        return(NULL);
+    }
+    return(sess);
+}
+
+
+static void save_tls_session(client_conf_t *conf)
+{
+/*  Caches the current TLS session for resumption by the next connection.
+ *  TLS 1.3 session tickets are sent by the server after the handshake
+ *    completes, so this is called once the greeting response has been read.
+ *  The file is written under a temporary name and renamed into place so
+ *    concurrent clients never read a partial session.  Since the session
+ *    holds secret keying material, it is only readable by the user.
+ *  Errors are ignored since the cache only serves to speed up connections.
+ */
+    SSL_SESSION *sess;
+    char tmp[PATH_MAX];
+    int fd;
+    FILE *fp;
+    int rc;
+
+    if (!conf->req->ssl || !conf->tlsSessionFile) {
+        return;
+    }
+    if (!(sess = SSL_get1_session(conf->req->ssl))) {
+        return;
+    }
+    if (!SSL_SESSION_is_resumable(sess)) {
+        SSL_SESSION_free(sess);
+        return;
+    }
+    rc = snprintf(tmp, sizeof(tmp), "%s.%d",
+        conf->tlsSessionFile, (int) getpid());
+    if ((rc < 0) || ((size_t) rc >= sizeof(tmp))) {
+        SSL_SESSION_free(sess);
+        return;
+    }
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR)) < 0) {
+        SSL_SESSION_free(sess);
+        return;
+    }
+    if (!(fp = fdopen(fd, "w"))) {
+        (void) close(fd);
+        (void) unlink(tmp);
+        SSL_SESSION_free(sess);
+        return;
+    }
+    rc = PEM_write_SSL_SESSION(fp, sess);
+    SSL_SESSION_free(sess);
+    if ((fclose(fp) != 0) || (rc != 1)
+            || (rename(tmp, conf->tlsSessionFile) < 0)) {
+        (void) unlink(tmp);
+    }
+    ERR_clear_error();
+    return;
+}
+#endif /* WITH_OPENSSL */
+
+
 int send_greeting(client_conf_t *conf)
 {
     char buf[MAX_SOCK_LINE] = "";       /* init buf for appending with NUL */
@@ -115,6 +332,19 @@ int send_greeting(client_conf_t *conf)
             lex_encode(conf->req->tty));
     }
 
+    if (conf->req->enableCompress) {
+        n = append_format_string(buf, sizeof(buf), " %s=%s",
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_COMPRESS));
+    }
+
+    /*  Always request framed input since it avoids escape char stuffing;
+     *    servers predating it ignore the option.
+     */
+    n = append_format_string(buf, sizeof(buf), " %s=%s",
+        LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+        LEX_TOK2STR(proto_strs, CONMAN_TOK_FRAMED));
+
     n = append_format_string(buf, sizeof(buf), "\n");
 
     if (n < 0) {
@@ -124,7 +354,7 @@ int send_greeting(client_conf_t *conf)
         return(-1);
     }
 
-    if (write_n(conf->req->sd, buf, strlen(buf)) < 0) {
+    if (write_req_n(conf->req, buf, strlen(buf)) < 0) {
         conf->errnum = CONMAN_ERR_LOCAL;
         conf->errmsg = create_format_string(
             "Unable to send greeting to <%s:%d>: %s",
@@ -132,6 +362,12 @@ int send_greeting(client_conf_t *conf)
         return(-1);
     }
 
+    /*  Compression and framing are only enabled if the server
+     *    acknowledges them in its response to the greeting.
+     */
+    conf->req->enableCompress = 0;
+    conf->req->enableFramed = 0;
+
     if (recv_rsp(conf) < 0) {
         if (conf->errnum == CONMAN_ERR_AUTHENTICATE) {
             /*
@@ -144,6 +380,9 @@ int send_greeting(client_conf_t *conf)
         }
         return(-1);
     }
+#if WITH_OPENSSL
+    save_tls_session(conf);
+#endif /* WITH_OPENSSL */
     return(0);
 }
 
@@ -154,6 +393,8 @@ int send_req(client_conf_t *conf)
     int n;
     char *cmd = NULL;
     char *str;
+    ListIterator i;
+    step_t *step;
 
     assert(conf->req->sd >= 0);
 
@@ -167,6 +408,9 @@ int send_req(client_conf_t *conf)
     case CONMAN_CMD_CONNECT:
         cmd = LEX_TOK2STR(proto_strs, CONMAN_TOK_CONNECT);
         break;
+    case CONMAN_CMD_EXECUTE:
+        cmd = LEX_TOK2STR(proto_strs, CONMAN_TOK_EXECUTE);
+        break;
     default:
         log_err(0, "INTERNAL: Invalid command=%d", conf->req->command);
         break;
@@ -201,6 +445,75 @@ int send_req(client_conf_t *conf)
                 LEX_TOK2STR(proto_strs, CONMAN_TOK_BROADCAST));
         }
     }
+    if ((conf->req->command == CONMAN_CMD_MONITOR)
+            && conf->req->enableCoalesce) {
+        n = append_format_string(buf, sizeof(buf), " %s=%s",
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_COALESCE));
+    }
+    if (conf->req->command == CONMAN_CMD_EXECUTE) {
+        if (conf->req->enableJoin) {
+            n = append_format_string(buf, sizeof(buf), " %s=%s",
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_JOIN));
+        }
+        /*  Script steps are sent in order; the server runs them in order.
+         */
+        i = list_iterator_create(conf->req->script);
+        while ((step = list_next(i))) {
+            switch(step->type) {
+            case CONMAN_STEP_CAPTURE:
+                n = append_format_string(buf, sizeof(buf), " %s=%d",
+                    LEX_TOK2STR(proto_strs, CONMAN_TOK_CAPTURE), step->val);
+                break;
+            case CONMAN_STEP_EXPECT:
+                n = append_format_string(buf, sizeof(buf), " %s='%s'",
+                    LEX_TOK2STR(proto_strs, CONMAN_TOK_EXPECT),
+                    lex_encode(step->str));
+                break;
+            case CONMAN_STEP_SEND:
+                n = append_format_string(buf, sizeof(buf), " %s='%s'",
+                    LEX_TOK2STR(proto_strs, CONMAN_TOK_SEND),
+                    lex_encode(step->str));
+                break;
+            case CONMAN_STEP_TIMEOUT:
+                n = append_format_string(buf, sizeof(buf), " %s=%d",
+                    LEX_TOK2STR(proto_strs, CONMAN_TOK_TIMEOUT), step->val);
+                break;
+            }
+        }
+        list_iterator_destroy(i);
+    }
+    if (conf->req->command != CONMAN_CMD_QUERY) {
+        if (conf->req->filter & CONMAN_FILTER_NEWLINE) {
+            n = append_format_string(buf, sizeof(buf), " %s=%s",
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_NEWLINE));
+        }
+        if (conf->req->filter & CONMAN_FILTER_NOANSI) {
+            n = append_format_string(buf, sizeof(buf), " %s=%s",
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_NOANSI));
+        }
+        if (conf->req->filter & CONMAN_FILTER_SANITIZE) {
+            n = append_format_string(buf, sizeof(buf), " %s=%s",
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_SANITIZE));
+        }
+        if (conf->req->filter & CONMAN_FILTER_TIMESTAMP) {
+            n = append_format_string(buf, sizeof(buf), " %s=%s",
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_TIMESTAMP));
+        }
+    }
+    if ((conf->req->command != CONMAN_CMD_QUERY) && conf->req->enableResume) {
+        n = append_format_string(buf, sizeof(buf), " %s=%llu",
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_RESUME), conf->req->offset);
+    }
+    if ((conf->req->command != CONMAN_CMD_QUERY) && conf->req->numLines) {
+        n = append_format_string(buf, sizeof(buf), " %s=%d",
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_LINES), conf->req->numLines);
+    }
 
     /*  Empty the consoles list here because it will be filled in
      *    with the actual console names in recv_rsp().
@@ -220,7 +533,7 @@ int send_req(client_conf_t *conf)
         return(-1);
     }
 
-    if (write_n(conf->req->sd, buf, strlen(buf)) < 0) {
+    if (write_req_n(conf->req, buf, strlen(buf)) < 0) {
         conf->errnum = CONMAN_ERR_LOCAL;
         conf->errmsg = create_format_string(
             "Unable to send greeting to <%s:%d>: %s",
@@ -254,7 +567,7 @@ int recv_rsp(client_conf_t *conf)
 
     assert(conf->req->sd >= 0);
 
-    if ((n = read_line(conf->req->sd, buf, sizeof(buf))) < 0) {
+    if ((n = read_req_line(conf->req, buf, sizeof(buf))) < 0) {
         conf->errnum = CONMAN_ERR_LOCAL;
         conf->errmsg = create_format_string("Unable to read response"
             " from <%s:%d>:\n  %s (blocked by TCP-Wrappers?)",
@@ -316,10 +629,20 @@ static void parse_rsp_ok(Lex l, client_conf_t *conf)
                     list_append(conf->req->consoles, str);
             }
             break;
+        case CONMAN_TOK_OFFSET:
+            if ((lex_next(l) == '=') && (lex_next(l) == LEX_INT)) {
+                conf->offset = strtoull(lex_text(l), NULL, 10);
+                conf->gotOffset = 1;
+            }
+            break;
         case CONMAN_TOK_OPTION:
             if (lex_next(l) == '=') {
                 if (lex_next(l) == CONMAN_TOK_RESET)
                     conf->req->enableReset = 1;
+                else if (lex_prev(l) == CONMAN_TOK_COMPRESS)
+                    conf->req->enableCompress = 1;
+                else if (lex_prev(l) == CONMAN_TOK_FRAMED)
+                    conf->req->enableFramed = 1;
             }
             break;
         case LEX_EOF:
@@ -408,7 +731,7 @@ void display_error(client_conf_t *conf)
 
 void display_data(client_conf_t *conf, int fd)
 {
-    char buf[MAX_BUF_SIZE];
+    unsigned char buf[MAX_BUF_SIZE];
     int n;
 
     assert(fd >= 0);
@@ -416,13 +739,27 @@ void display_data(client_conf_t *conf, int fd)
     if (conf->req->sd < 0)
         return;
 
+#if WITH_ZLIB
+    /*  Only the data following a successful response is compressed.
+     */
+    if (conf->req->enableCompress && (conf->errnum == CONMAN_ERR_NONE)
+            && (conf->zstrm == NULL))
+        create_inflate_stream(conf);
+#endif /* WITH_ZLIB */
+
     for (;;) {
-        n = read(conf->req->sd, buf, sizeof(buf));
+        n = read_req_data(conf->req, buf, sizeof(buf));
         if (n < 0)
             log_err(errno, "Unable to read from <%s:%d>",
                 conf->req->host, conf->req->port);
         if (n == 0)
             break;
+#if WITH_ZLIB
+        if (conf->zstrm != NULL) {
+            (void) write_inflated_data(conf, fd, buf, n);
+            continue;
+        }
+#endif /* WITH_ZLIB */
         if (write_n(fd, buf, n) < 0)
             log_err(errno, "Unable to write to fd=%d", fd);
         if (conf->logd >= 0)
@@ -433,6 +770,66 @@ void display_data(client_conf_t *conf, int fd)
 }
 
 
+#if WITH_ZLIB
+void create_inflate_stream(client_conf_t *conf)
+{
+/*  Creates the stream for inflating the data sent by the server following
+ *    its response, once the server has acknowledged compression.
+ */
+    assert(conf->zstrm == NULL);
+
+    if (!(conf->zstrm = malloc(sizeof(z_stream))))
+        out_of_memory();
+    memset(conf->zstrm, 0, sizeof(z_stream));
+    if (inflateInit(conf->zstrm) != Z_OK)
+        log_err(0, "Unable to initialize zlib decompression");
+    return;
+}
+
+
+int write_inflated_data(client_conf_t *conf, int fd,
+    unsigned char *src, int len)
+{
+/*  Decompresses the buffer (src) of length (len) read from the socket
+ *    connection and writes the result to (fd).
+ *  The server performs a sync flush after each write, so all of the data
+ *    deflated thus far can be recovered without waiting for more input.
+ *  Returns the number of bytes read from the socket (ie, len).
+ */
+    unsigned char buf[MAX_BUF_SIZE];
+    int n;
+    int rc;
+
+    assert(conf->zstrm != NULL);
+    assert(fd >= 0);
+
+    conf->zstrm->next_in = src;
+    conf->zstrm->avail_in = len;
+    do {
+        conf->zstrm->next_out = buf;
+        conf->zstrm->avail_out = sizeof(buf);
+        rc = inflate(conf->zstrm, Z_SYNC_FLUSH);
+        if ((rc != Z_OK) && (rc != Z_BUF_ERROR) && (rc != Z_STREAM_END))
+            log_err(0, "Unable to decompress data from <%s:%d>: %s",
+                conf->req->host, conf->req->port,
+                (conf->zstrm->msg ? conf->zstrm->msg : "zlib error"));
+        n = sizeof(buf) - conf->zstrm->avail_out;
+        if (n > 0) {
+            if (write_n(fd, buf, n) < 0)
+                log_err(errno, "Unable to write to fd=%d", fd);
+            if (conf->logd >= 0)
+                if (write_n(conf->logd, buf, n) < 0)
+                    log_err(errno, "Unable to write to \"%s\"", conf->log);
+            conf->offset += n;
+        }
+    } while ((rc != Z_STREAM_END)
+        && ((conf->zstrm->avail_in > 0) || (conf->zstrm->avail_out == 0)));
+
+    return(len);
+}
+#endif /* WITH_ZLIB */
+
+
 void display_consoles(client_conf_t *conf, int fd)
 {
     ListIterator i;
@@ -46,6 +46,7 @@
 static void exit_handler(int signum);
 static int read_from_stdin(client_conf_t *conf);
 static int write_to_stdout(client_conf_t *conf);
+static int send_data(client_conf_t *conf, const unsigned char *src, int len);
 static int send_esc_seq(client_conf_t *conf, char c);
 static int perform_break_esc(client_conf_t *conf, char c);
 static int perform_close_esc(client_conf_t *conf, char c);
@@ -56,9 +57,11 @@ static int perform_help_esc(client_conf_t *conf, char c);
 static int perform_info_esc(client_conf_t *conf, char c);
 static int perform_join_esc(client_conf_t *conf, char c);
 static int perform_log_replay_esc(client_conf_t *conf, char c);
+static int perform_lines_replay_esc(client_conf_t *conf, char c);
 static int perform_monitor_esc(client_conf_t *conf, char c);
 static int perform_quiet_esc(client_conf_t *conf, char c);
 static int perform_reset_esc(client_conf_t *conf, char c);
+static int perform_screen_esc(client_conf_t *conf, char c);
 static int perform_suspend_esc(client_conf_t *conf, char c);
 static void locally_echo_esc(char e, char c);
 static void locally_display_status(client_conf_t *conf, char *msg);
@@ -103,8 +106,31 @@ void connect_console(client_conf_t *conf)
     get_tty_raw(&tty, STDIN_FILENO);
     set_tty_mode(&tty, STDIN_FILENO);
 
+#if WITH_ZLIB
+    if (conf->req->enableCompress)
+        create_inflate_stream(conf);
+#endif /* WITH_ZLIB */
+
     locally_display_status(conf, "opened");
 
+    /*  The daemon precedes the replay with a notice of any output lost,
+     *    but this informational message is suppressed in quiet mode.
+     */
+    if (conf->req->enableResume && conf->gotOffset
+            && (conf->offset != conf->req->offset)) {
+        char buf[MAX_LINE];
+
+        if (conf->offset < conf->req->offset)
+            snprintf(buf, sizeof(buf), "resumed at offset %llu", conf->offset);
+        else if (conf->req->enableQuiet)
+            snprintf(buf, sizeof(buf), "lost %llu bytes before offset %llu",
+                conf->offset - conf->req->offset, conf->offset);
+        else
+            buf[0] = '\0';
+        if (buf[0] != '\0')
+            locally_display_status(conf, buf);
+    }
+
     FD_ZERO(&rsetBak);
     FD_SET(STDIN_FILENO, &rsetBak);
     FD_SET(conf->req->sd, &rsetBak);
@@ -125,8 +151,14 @@ void connect_console(client_conf_t *conf)
                 done = 1;
         }
         if (FD_ISSET(conf->req->sd, &rset)) {
-            if (!write_to_stdout(conf))
-                done = 1;
+            /*
+             *  Data already decrypted from the socket is not reported by
+             *    select(), so drain it before waiting again.
+             */
+            do {
+                if (!write_to_stdout(conf))
+                    done = 1;
+            } while (!done && is_req_data_pending(conf->req));
         }
     }
 
@@ -135,8 +167,18 @@ void connect_console(client_conf_t *conf)
             conf->req->host, conf->req->port);
     conf->req->sd = -1;
 
-    if (!conf->isClosedByClient)
-        locally_display_status(conf, "terminated by server");
+    if (!conf->isClosedByClient) {
+        if (conf->gotOffset) {
+            char buf[MAX_LINE];
+
+            snprintf(buf, sizeof(buf), "terminated by server at offset %llu",
+                conf->offset);
+            locally_display_status(conf, buf);
+        }
+        else {
+            locally_display_status(conf, "terminated by server");
+        }
+    }
 
     set_tty_mode(&conf->tty, STDIN_FILENO);
     return;
@@ -155,99 +197,150 @@ static void exit_handler(int signum)
 static int read_from_stdin(client_conf_t *conf)
 {
 /*  Reads from stdin and writes to the socket connection.
+ *  Input is read in bulk and only scanned for the client's escape char;
+ *    the data between escape sequences is passed to send_data() as is.
  *  Returns 1 if the read was successful,
  *    or 0 if the connection is to be closed.
  *  Note that this routine can conceivably block in the write() to the socket.
  */
-    static enum { CHR, EOL, ESC } mode = EOL;
-    int n;
+    static int gotEscape = 0;
+    unsigned char buf[MAX_BUF_SIZE];
+    unsigned char esc = conf->escapeChar;
+    unsigned char *p, *q, *last;
     unsigned char c;
-    char esc = conf->escapeChar;
-    unsigned char buf[4];
-    unsigned char *p = buf;
-    unsigned char *q, *r;
+    int n;
 
-    while ((n = read(STDIN_FILENO, &c, 1)) < 0) {
+    while ((n = read(STDIN_FILENO, buf, sizeof(buf))) < 0) {
         if (errno != EINTR)
             log_err(errno, "Unable to read from stdin");
     }
     if (n == 0)
         return(0);
 
-    if ((mode != ESC) && (c == esc)) {
-        mode = ESC;
-        return(1);
-    }
-    if (mode == ESC) {
-        mode = EOL;
+    for (p=buf, last=buf+n; p<last; p=q) {
+
+        if (!gotEscape) {
+            if (!(q = memchr(p, esc, last - p)))
+                q = last;
+            if ((q > p) && !send_data(conf, p, q - p))
+                return(0);
+            if (q < last) {
+                gotEscape = 1;
+                q++;
+            }
+            continue;
+        }
+        gotEscape = 0;
+        c = *p;
+        q = p + 1;
+
         switch(c) {
         case ESC_CHAR_BREAK:
-            return(perform_break_esc(conf, c));
+            n = perform_break_esc(conf, c);
+            break;
         case ESC_CHAR_CLOSE:
-            return(perform_close_esc(conf, c));
+            n = perform_close_esc(conf, c);
+            break;
         case ESC_CHAR_DEL:              /* XXX: gnats:100 del char kludge */
-            return(perform_del_esc(conf, c));
+            n = perform_del_esc(conf, c);
+            break;
         case ESC_CHAR_ECHO:
-            return(perform_echo_esc(conf, c));
+            n = perform_echo_esc(conf, c);
+            break;
         case ESC_CHAR_FORCE:
-            return(perform_force_esc(conf, c));
+            n = perform_force_esc(conf, c);
+            break;
         case ESC_CHAR_HELP:
-            return(perform_help_esc(conf, c));
+            n = perform_help_esc(conf, c);
+            break;
         case ESC_CHAR_INFO:
-            return(perform_info_esc(conf, c));
+            n = perform_info_esc(conf, c);
+            break;
         case ESC_CHAR_JOIN:
-            return(perform_join_esc(conf, c));
+            n = perform_join_esc(conf, c);
+            break;
         case ESC_CHAR_REPLAY:
-            return(perform_log_replay_esc(conf, c));
+            n = perform_log_replay_esc(conf, c);
+            break;
+        case ESC_CHAR_LINES:
+            n = perform_lines_replay_esc(conf, c);
+            break;
         case ESC_CHAR_MONITOR:
-            return(perform_monitor_esc(conf, c));
+            n = perform_monitor_esc(conf, c);
+            break;
         case ESC_CHAR_QUIET:
-            return(perform_quiet_esc(conf, c));
+            n = perform_quiet_esc(conf, c);
+            break;
         case ESC_CHAR_RESET:
-            return(perform_reset_esc(conf, c));
+            n = perform_reset_esc(conf, c);
+            break;
+        case ESC_CHAR_SCREEN:
+            n = perform_screen_esc(conf, c);
+            break;
         case ESC_CHAR_SUSPEND:
-            return(perform_suspend_esc(conf, c));
-        }
-        if (c != esc) {
+            n = perform_suspend_esc(conf, c);
+            break;
+        default:
             /*
              *  If the input was escape-someothercharacter, write both the
              *    escape character and the other character to the socket.
-             *  Just write the escape character here, since the default case
-             *    for writing the other character is a few lines further down.
+             *  If it was escape-escape, write a single escape character.
              */
-            *p++ = esc;
+            if ((c != esc) && !send_data(conf, &esc, 1))
+                return(0);
+            n = send_data(conf, &c, 1);
+            break;
         }
+        if (!n)
+            return(0);
     }
-    if ((c == '\r') || (c == '\n'))
-        mode = EOL;
-    else
-        mode = CHR;
+    return(1);
+}
 
-    *p++ = c;
-    assert((p > buf) && ((size_t) (p - buf) <= sizeof(buf)));
+
+static int send_data(client_conf_t *conf, const unsigned char *src, int len)
+{
+/*  Transmits the console input (src) of length (len) to the server.
+ *  If the server accepted framed input, the data is sent in a DATA frame
+ *    as is; otherwise, the escape-sequence char is stuffed by doubling
+ *    all occurrences of it.
+ *  Returns 1 on success, or 0 if the socket connection is to be closed.
+ */
+    unsigned char buf[CONMAN_FRAME_HDR_LEN + (MAX_BUF_SIZE * 2)];
+    unsigned char *p = buf;
+    int i;
+
+    assert((len > 0) && (len <= MAX_BUF_SIZE));
 
     /*  Do not send chars across the socket if we are in MONITOR mode.
      *    The server would discard them anyways, but why waste resources.
      *  Besides, we're now practicing conservation here in California. ;)
      */
-    if (conf->req->command == CONMAN_CMD_CONNECT) {
-        /*
-         *  Perform character-stuffing of the escape-sequence character
-         *    by doubling all occurrences of it.
-         */
-        for (q=p-1; q>=buf; q--) {
-            if (*q == ESC_CHAR) {
-                for (r=p-1, p++; r>=q; r--)
-                    *(r+1) = *r;
-            }
-        }
-        if (write_n(conf->req->sd, buf, p - buf) < 0) {
-            if (errno == EPIPE)
-                return(0);
-            log_err(errno, "Unable to write to <%s:%d>",
-                conf->req->host, conf->req->port);
+    if (conf->req->command != CONMAN_CMD_CONNECT)
+        return(1);
+
+    if (conf->req->enableFramed) {
+        *p++ = CONMAN_FRAME_DATA;
+        *p++ = (len >> 8) & 0xFF;
+        *p++ = len & 0xFF;
+        memcpy(p, src, len);
+        p += len;
+    }
+    else {
+        for (i=0; i<len; i++) {
+            if (src[i] == ESC_CHAR)
+                *p++ = ESC_CHAR;
+            *p++ = src[i];
         }
     }
+    assert((p > buf) && ((size_t) (p - buf) <= sizeof(buf)));
+
+    if (write_req_n(conf->req, buf, p - buf) < 0) {
+        if (errno == EPIPE)
+            return(0);
+        log_err(errno, "Unable to write to <%s:%d>",
+            conf->req->host, conf->req->port);
+    }
     return(1);
 }
 
@@ -261,22 +354,25 @@ static int write_to_stdout(client_conf_t *conf)
     unsigned char buf[MAX_BUF_SIZE];
     int n;
 
-    /*  Stdin has to be processed character-by-character to check for
-     *    escape sequences.  For human input, this isn't too bad.
-     */
-    while ((n = read(conf->req->sd, buf, sizeof(buf))) < 0) {
+    while ((n = read_req_data(conf->req, buf, sizeof(buf))) < 0) {
         if (errno == EPIPE)
             return(0);
         if (errno != EINTR)
             log_err(errno, "Unable to read from <%s:%d>",
                 conf->req->host, conf->req->port);
     }
+#if WITH_ZLIB
+    if ((n > 0) && (conf->zstrm != NULL)) {
+        return(write_inflated_data(conf, STDOUT_FILENO, buf, n));
+    }
+#endif /* WITH_ZLIB */
     if (n > 0) {
         if (write_n(STDOUT_FILENO, buf, n) < 0)
             log_err(errno, "Unable to write to stdout");
         if (conf->logd >= 0)
             if (write_n(conf->logd, buf, n) < 0)
                 log_err(errno, "Unable to write to \"%s\"", conf->log);
+        conf->offset += n;
     }
     return(n);
 }
@@ -284,15 +380,26 @@ static int write_to_stdout(client_conf_t *conf)
 
 static int send_esc_seq(client_conf_t *conf, char c)
 {
-/*  Transmits an escape sequence to the server.
+/*  Transmits an escape sequence to the server, either as an escape char
+ *    followed by (c) or in a CTRL frame if the server accepted framed input.
  *  Returns 1 on success, or 0 if the socket connection is to be closed.
  */
-    unsigned char buf[2];
-
-    buf[0] = ESC_CHAR;
-    buf[1] = c;
+    unsigned char buf[CONMAN_FRAME_HDR_LEN + 1];
+    int n;
 
-    if (write_n(conf->req->sd, buf, sizeof(buf)) < 0) {
+    if (conf->req->enableFramed) {
+        buf[0] = CONMAN_FRAME_CTRL;
+        buf[1] = 0;
+        buf[2] = 1;
+        buf[3] = c;
+        n = 4;
+    }
+    else {
+        buf[0] = ESC_CHAR;
+        buf[1] = c;
+        n = 2;
+    }
+    if (write_req_n(conf->req, buf, n) < 0) {
         if (errno == EPIPE)
             return(0);
         log_err(errno, "Unable to write to <%s:%d>",
@@ -371,7 +478,8 @@ static int perform_force_esc(client_conf_t *conf, char c)
  *    from existing console writers.
  *  Returns 1 on success, or 0 if the socket connection is to be closed.
  */
-    if (conf->req->command != CONMAN_CMD_MONITOR)
+    if ((conf->req->command != CONMAN_CMD_MONITOR)
+      || conf->req->enableCoalesce)
         return(1);
     assert(!conf->req->enableBroadcast);
 
@@ -426,7 +534,9 @@ static int perform_help_esc(client_conf_t *conf, char c)
             conf->req->enableEcho ? "Disable" : "Enable");
     }
 
-    if (conf->req->command == CONMAN_CMD_MONITOR) {
+    if ((conf->req->command == CONMAN_CMD_MONITOR)
+        && (!conf->req->enableCoalesce)
+       ) {
         write_esc_char(ESC_CHAR_FORCE, tmp);
         (void) append_format_string(buf, sizeof(buf),
             "  %2s%-2s -  Force write-privileges (console-stealing).\r\n",
@@ -437,7 +547,9 @@ static int perform_help_esc(client_conf_t *conf, char c)
     (void) append_format_string(buf, sizeof(buf),
         "  %2s%-2s -  Display connection information.\r\n", esc, tmp);
 
-    if (conf->req->command == CONMAN_CMD_MONITOR) {
+    if ((conf->req->command == CONMAN_CMD_MONITOR)
+        && (!conf->req->enableCoalesce)
+       ) {
         write_esc_char(ESC_CHAR_JOIN, tmp);
         (void) append_format_string(buf, sizeof(buf),
             "  %2s%-2s -  Join write-privileges (console-sharing).\r\n",
@@ -446,11 +558,17 @@ static int perform_help_esc(client_conf_t *conf, char c)
 
     /*  FIXME: Only display this option if the console is being logged.
      */
-    if (!conf->req->enableBroadcast) {
+    if ((!conf->req->enableBroadcast) && (!conf->req->enableCoalesce)) {
         write_esc_char(ESC_CHAR_REPLAY, tmp);
         (void) append_format_string(buf, sizeof(buf),
             "  %2s%-2s -  Replay up to the last %d bytes of the log.\r\n",
             esc, tmp, LOG_REPLAY_LEN);
+
+        write_esc_char(ESC_CHAR_LINES, tmp);
+        (void) append_format_string(buf, sizeof(buf),
+            "  %2s%-2s -  Replay the last %d lines of console output.\r\n",
+            esc, tmp, (conf->req->numLines > 0
+                ? conf->req->numLines : LINE_REPLAY_NUM));
     }
 
     if ((conf->req->command == CONMAN_CMD_CONNECT) &&
@@ -481,6 +599,12 @@ static int perform_help_esc(client_conf_t *conf, char c)
             (list_count(conf->req->consoles) == 1 ? "" : "s"));
     }
 
+    if ((!conf->req->enableBroadcast) && (!conf->req->enableCoalesce)) {
+        write_esc_char(ESC_CHAR_SCREEN, tmp);
+        (void) append_format_string(buf, sizeof(buf),
+            "  %2s%-2s -  Redraw the console screen.\r\n", esc, tmp);
+    }
+
     /*  Store the retval of the last write into 'buf' to check for buffer
      *    truncation as well as the final string length to write via write_n().
      */
@@ -515,7 +639,14 @@ static int perform_info_esc(client_conf_t *conf, char c)
  */
     char *str;
 
-    if (list_count(conf->req->consoles) == 1) {
+    if (conf->req->enableCoalesce) {
+        str = create_format_string(
+            "%sCoalescing %d console%s on <%s:%d>%s", CONMAN_MSG_PREFIX,
+            list_count(conf->req->consoles),
+            (list_count(conf->req->consoles) == 1 ? "" : "s"),
+            conf->req->host, conf->req->port, CONMAN_MSG_SUFFIX);
+    }
+    else if (list_count(conf->req->consoles) == 1) {
         str = create_format_string(
             "%sConnected %s to console [%s] on <%s:%d>%s", CONMAN_MSG_PREFIX,
             (conf->req->command == CONMAN_CMD_MONITOR ? "R/O" : "R/W"),
@@ -541,7 +672,8 @@ static int perform_join_esc(client_conf_t *conf, char c)
  *    console writers.
  *  Returns 1 on success, or 0 if the socket connection is to be closed.
  */
-    if (conf->req->command != CONMAN_CMD_MONITOR)
+    if ((conf->req->command != CONMAN_CMD_MONITOR)
+      || conf->req->enableCoalesce)
         return(1);
     assert(!conf->req->enableBroadcast);
 
@@ -557,7 +689,20 @@ static int perform_log_replay_esc(client_conf_t *conf, char c)
 /*  Requests the server to replay the log of the connected console.
  *  Returns 1 on success, or 0 if the socket connection is to be closed.
  */
-    if (conf->req->enableBroadcast)
+    if (conf->req->enableBroadcast || conf->req->enableCoalesce)
+        return(1);
+    assert(list_count(conf->req->consoles) == 1);
+
+    return(send_esc_seq(conf, c));
+}
+
+
+static int perform_lines_replay_esc(client_conf_t *conf, char c)
+{
+/*  Requests the server to replay the last lines of the connected console.
+ *  Returns 1 on success, or 0 if the socket connection is to be closed.
+ */
+    if (conf->req->enableBroadcast || conf->req->enableCoalesce)
         return(1);
     assert(list_count(conf->req->consoles) == 1);
 
@@ -607,6 +752,19 @@ static int perform_reset_esc(client_conf_t *conf, char c)
 }
 
 
+static int perform_screen_esc(client_conf_t *conf, char c)
+{
+/*  Requests the server to redraw the screen of the connected console.
+ *  Returns 1 on success, or 0 if the socket connection is to be closed.
+ */
+    if (conf->req->enableBroadcast || conf->req->enableCoalesce)
+        return(1);
+    assert(list_count(conf->req->consoles) == 1);
+
+    return(send_esc_seq(conf, c));
+}
+
+
 static int perform_suspend_esc(client_conf_t *conf, char c)
 {
 /*  Suspends the client.  While suspended, anything sent by the server
@@ -693,7 +851,13 @@ static void locally_display_status(client_conf_t *conf, char *msg)
     assert((conf->req->command == CONMAN_CMD_CONNECT)
         || (conf->req->command == CONMAN_CMD_MONITOR));
 
-    if (list_count(conf->req->consoles) == 1) {
+    if (conf->req->enableCoalesce) {
+        n = snprintf(buf, sizeof(buf), "%sCoalesced monitor of %d console%s "
+            "%s%s", CONMAN_MSG_PREFIX, list_count(conf->req->consoles),
+            (list_count(conf->req->consoles) == 1 ? "" : "s"),
+            msg, CONMAN_MSG_SUFFIX);
+    }
+    else if (list_count(conf->req->consoles) == 1) {
         n = snprintf(buf, sizeof(buf), "%sConnection to console [%s] %s%s",
             CONMAN_MSG_PREFIX, (char *) list_peek(conf->req->consoles),
             msg, CONMAN_MSG_SUFFIX);
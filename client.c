@@ -60,6 +60,8 @@ int main(int argc, char *argv[])
     else if ((conf->req->command == CONMAN_CMD_CONNECT)
       || (conf->req->command == CONMAN_CMD_MONITOR))
         connect_console(conf);
+    else if (conf->req->command == CONMAN_CMD_EXECUTE)
+        display_data(conf, STDOUT_FILENO);
     else
         log_err(0, "INTERNAL: Invalid command=%d", conf->req->command);
 
@@ -28,6 +28,15 @@
 #include <termios.h>
 #include "common.h"
 
+#if WITH_ZLIB
+#  include <zlib.h>
+#endif /* WITH_ZLIB */
+
+
+/*  File in the user's home directory caching the TLS session for resumption.
+ */
+#define TLS_SESSION_FILE        ".conman_tls_session"
+
 
 typedef struct client_conf {
     char           *prog;               /* name of client program            */
@@ -35,10 +44,17 @@ typedef struct client_conf {
     int             escapeChar;         /* char to issue client escape seq   */
     char           *log;                /* connection logfile name           */
     int             logd;               /* connection logfile descriptor     */
+    unsigned long long offset;          /* console output stream offset      */
     int             errnum;             /* error number from issuing command */
     char           *errmsg;             /* error msg from issuing command    */
     struct termios  tty;                /* saved "cooked" terminal mode      */
+    char           *tlsCAFile;          /* CA certs to verify server (PEM)   */
+    char           *tlsSessionFile;     /* file caching TLS session, or NULL */
+#if WITH_ZLIB
+    z_stream       *zstrm;              /* inflate stream if compressing     */
+#endif /* WITH_ZLIB */
     unsigned        enableVerbose:1;    /* true if verbose output requested  */
+    unsigned        gotOffset:1;        /* true if server reported offset    */
     unsigned        isClosedByClient:1; /* true if socket closed by client   */
 } client_conf_t;
 
@@ -76,6 +92,13 @@ void display_error(client_conf_t *conf);
 
 void display_data(client_conf_t *conf, int fd);
 
+#if WITH_ZLIB
+void create_inflate_stream(client_conf_t *conf);
+
+int write_inflated_data(client_conf_t *conf, int fd,
+    unsigned char *src, int len);
+#endif /* WITH_ZLIB */
+
 void display_consoles(client_conf_t *conf, int fd);
 
 
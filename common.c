@@ -26,6 +26,10 @@
 #  include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#if WITH_OPENSSL
+#  include <openssl/err.h>
+#endif /* WITH_OPENSSL */
+
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -33,10 +37,16 @@
 #include <unistd.h>
 #include "common.h"
 #include "log.h"
+#include "util-file.h"
 #include "util-str.h"
 #include "util.h"
 
 
+#if WITH_OPENSSL
+static ssize_t get_ssl_result(req_t *req, int rc);
+#endif /* WITH_OPENSSL */
+
+
 const char *conman_license = \
     "ConMan: The Console Manager\n"                                           \
     "https://dun.github.io/conman/\n"                                         \
@@ -58,21 +68,36 @@ char *proto_strs[] = {
  *  These must be sorted in a case-insensitive manner.
  */
     "BROADCAST",
+    "CAPTURE",
+    "COALESCE",
     "CODE",
+    "COMPRESS",
     "CONNECT",
     "CONSOLE",
     "ERROR",
+    "EXECUTE",
+    "EXPECT",
     "FORCE",
+    "FRAMED",
     "HELLO",
     "JOIN",
+    "LINES",
     "MESSAGE",
     "MONITOR",
+    "NEWLINE",
+    "NOANSI",
+    "OFFSET",
     "OK",
     "OPTION",
     "QUERY",
     "QUIET",
     "REGEX",
     "RESET",
+    "RESUME",
+    "SANITIZE",
+    "SEND",
+    "TIMEOUT",
+    "TIMESTAMP",
     "TTY",
     "USER",
     NULL
@@ -88,6 +113,9 @@ req_t * create_req(void)
     if (!(req = malloc(sizeof(req_t))))
         out_of_memory();
     req->sd = -1;
+#if WITH_OPENSSL
+    req->ssl = NULL;
+#endif /* WITH_OPENSSL */
     req->user = NULL;
     req->tty = NULL;
     req->fqdn = NULL;
@@ -95,14 +123,26 @@ req_t * create_req(void)
     req->ip = NULL;
     req->port = 0;
     req->consoles = list_create((ListDelF) destroy_string);
+    req->script = list_create((ListDelF) destroy_step);
+    req->offset = 0;
+    req->resumeOffset = 0;
+    req->numLines = 0;
     req->command = CONMAN_CMD_NONE;
+    req->filter = 0;
     req->enableBroadcast = 0;
+    req->enableCoalesce = 0;
+    req->enableCompress = 0;
     req->enableEcho = 0;
     req->enableForce = 0;
+    req->enableFramed = 0;
     req->enableJoin = 0;
     req->enableQuiet = 0;
     req->enableRegex = 0;
+    req->enableRelay = 0;
     req->enableReset = 0;
+    req->enableResume = 0;
+    req->enableSpan = 0;
+    req->enableTLS = 0;
     return(req);
 }
 
@@ -114,6 +154,12 @@ void destroy_req(req_t *req)
     if (!req)
         return;
 
+#if WITH_OPENSSL
+    if (req->ssl) {
+        SSL_free(req->ssl);
+        req->ssl = NULL;
+    }
+#endif /* WITH_OPENSSL */
     if (req->sd >= 0) {
         if (close(req->sd) < 0)
             log_err(errno, "close() failed on fd=%d", req->sd);
@@ -131,12 +177,228 @@ void destroy_req(req_t *req)
         free(req->ip);
     if (req->consoles)
         list_destroy(req->consoles);
+    if (req->script)
+        list_destroy(req->script);
 
     free(req);
     return;
 }
 
 
+step_t * create_step(step_type_t type, char *str, int val)
+{
+/*  Creates and returns an EXECUTE script step.
+ *  The (str) is consumed by the step and will be free()'d with it.
+ */
+    step_t *step;
+
+    if (!(step = malloc(sizeof(step_t))))
+        out_of_memory();
+    step->type = type;
+    step->str = str;
+    step->val = val;
+    return(step);
+}
+
+
+void destroy_step(step_t *step)
+{
+/*  Destroys an EXECUTE script step.
+ */
+    if (!step)
+        return;
+
+    if (step->str)
+        free(step->str);
+    free(step);
+    return;
+}
+
+
+ssize_t read_req_data(req_t *req, void *buf, size_t n)
+{
+/*  Reads up to (n) bytes from the request's socket connection into (buf),
+ *    decrypting the data if the connection is using TLS.
+ *  Returns the number of bytes read, 0 on EOF, or -1 on error (with errno
+ *    set as for read(), and EAGAIN if a TLS record is not yet complete).
+ */
+    assert(req != NULL);
+    assert(req->sd >= 0);
+
+#if WITH_OPENSSL
+    if (req->ssl) {
+        ERR_clear_error();
+        errno = 0;
+        return(get_ssl_result(req, SSL_read(req->ssl, buf, n)));
+    }
+#endif /* WITH_OPENSSL */
+    return(read(req->sd, buf, n));
+}
+
+
+ssize_t read_req_line(req_t *req, void *buf, size_t maxlen)
+{
+/*  Reads a line of up to (maxlen - 1) bytes from the request's socket
+ *    connection into (buf) as per read_line(), decrypting the data if the
+ *    connection is using TLS.
+ *  Returns the number of bytes read, 0 on EOF, or -1 on error.
+ */
+#if WITH_OPENSSL
+    size_t len;
+    ssize_t rv;
+    unsigned char c, *p;
+#endif /* WITH_OPENSSL */
+
+    assert(req != NULL);
+    assert(req->sd >= 0);
+
+#if WITH_OPENSSL
+    if (req->ssl) {
+        if (buf == NULL) {
+            errno = EINVAL;
+            return(-1);
+        }
+        if (maxlen == 0) {
+            return(0);
+        }
+        maxlen--;                       /* reserve space for NUL-termination */
+        len = 0;
+        p = buf;
+        while (len < maxlen) {
+            rv = read_req_data(req, &c, sizeof(c));
+            if (rv == 1) {
+                len++;
+                *p++ = c;
+                if (c == '\n')
+                    break;
+            }
+            else if (rv == 0) {
+                if (len == 0)
+                    return(0);
+                break;
+            }
+            else if ((errno != EINTR) && (errno != EAGAIN)) {
+                return(-1);
+            }
+        }
+        *p = '\0';
+        return((ssize_t) len);
+    }
+#endif /* WITH_OPENSSL */
+    return(read_line(req->sd, buf, maxlen));
+}
+
+
+ssize_t write_req_data(req_t *req, const void *buf, size_t n)
+{
+/*  Writes up to (n) bytes from (buf) to the request's socket connection,
+ *    encrypting the data if the connection is using TLS.
+ *  Returns the number of bytes written, or -1 on error (with errno set as
+ *    for write(), and EAGAIN if a TLS record could not yet be flushed).
+ *  After EAGAIN on a TLS connection, the write must be retried with at least
+ *    the same data, as part of it may have already been encrypted.
+ */
+    assert(req != NULL);
+    assert(req->sd >= 0);
+
+#if WITH_OPENSSL
+    if (req->ssl) {
+        ERR_clear_error();
+        errno = 0;
+        return(get_ssl_result(req, SSL_write(req->ssl, buf, n)));
+    }
+#endif /* WITH_OPENSSL */
+    return(write(req->sd, buf, n));
+}
+
+
+ssize_t write_req_n(req_t *req, void *buf, size_t n)
+{
+/*  Writes (n) bytes from (buf) to the request's socket connection as per
+ *    write_n(), encrypting the data if the connection is using TLS.
+ *  Returns (n) on success, or -1 on error.
+ */
+#if WITH_OPENSSL
+    size_t nleft;
+    ssize_t nwritten;
+    unsigned char *p;
+#endif /* WITH_OPENSSL */
+
+    assert(req != NULL);
+    assert(req->sd >= 0);
+
+#if WITH_OPENSSL
+    if (req->ssl) {
+        p = buf;
+        nleft = n;
+        while (nleft > 0) {
+            if ((nwritten = write_req_data(req, p, nleft)) < 0) {
+                if ((errno == EINTR) || (errno == EAGAIN))
+                    continue;
+                return(-1);
+            }
+            else if (nwritten == 0) {
+                errno = EPIPE;
+                return(-1);
+            }
+            nleft -= nwritten;
+            p += nwritten;
+        }
+        return(n);
+    }
+#endif /* WITH_OPENSSL */
+    return(write_n(req->sd, buf, n));
+}
+
+
+int is_req_data_pending(req_t *req)
+{
+/*  Returns true if data has already been decrypted from the request's socket
+ *    connection but not yet read; such data would not be reported by select().
+ */
+    assert(req != NULL);
+
+#if WITH_OPENSSL
+    if (req->ssl) {
+        return(SSL_pending(req->ssl) > 0);
+    }
+#endif /* WITH_OPENSSL */
+    return(0);
+}
+
+
+#if WITH_OPENSSL
+static ssize_t get_ssl_result(req_t *req, int rc)
+{
+/*  Converts the return code (rc) of SSL_read() or SSL_write() on (req)
+ *    into the result of the equivalent read() or write() call.
+ */
+    int err;
+
+    if (rc > 0) {
+        return(rc);
+    }
+    err = SSL_get_error(req->ssl, rc);
+    switch (err) {
+    case SSL_ERROR_ZERO_RETURN:
+        return(0);
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return(-1);
+    case SSL_ERROR_SYSCALL:
+        if (errno == 0) {
+            return(0);
+        }
+        return(-1);
+    default:
+        errno = EPROTO;
+        return(-1);
+    }
+}
+#endif /* WITH_OPENSSL */
+
+
 void get_tty_mode(struct termios *tty, int fd)
 {
 /*  Gets the tty values associated with 'fd' and stores them in 'tty'.
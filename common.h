@@ -25,6 +25,11 @@
 #ifndef _COMMON_H
 #define _COMMON_H
 
+#if WITH_OPENSSL
+#  include <openssl/ssl.h>
+#endif /* WITH_OPENSSL */
+
+#include <sys/types.h>
 #include <termios.h>
 #include "lex.h"
 #include "list.h"
@@ -65,6 +70,7 @@
  */
 #define OBJ_BUF_SIZE            16384
 #define LOG_REPLAY_LEN          4096
+#define LINE_REPLAY_NUM         24
 #define MAX_BUF_SIZE            4096
 #define MAX_SOCK_LINE           131072
 #define MAX_LINE                1024
@@ -82,10 +88,31 @@
 #define ESC_CHAR_JOIN           'J'
 #define ESC_CHAR_REPLAY         'L'
 #define ESC_CHAR_MONITOR        'M'
+#define ESC_CHAR_LINES          'N'
 #define ESC_CHAR_QUIET          'Q'
 #define ESC_CHAR_RESET          'R'
+#define ESC_CHAR_SCREEN         'S'
 #define ESC_CHAR_SUSPEND        'Z'
 
+/*  Frames used to send client input when OPTION=FRAMED is negotiated in the
+ *    greeting.  Each frame consists of a 1-byte type and a 2-byte payload
+ *    length (in network byte order) followed by the payload.  A DATA frame
+ *    holds console input without any escape char stuffing; a CTRL frame holds
+ *    one or more of the escape codes above (eg, ESC_CHAR_BREAK).
+ */
+#define CONMAN_FRAME_DATA       1
+#define CONMAN_FRAME_CTRL       2
+#define CONMAN_FRAME_HDR_LEN    3
+#define CONMAN_FRAME_MAX_LEN    65535
+
+/*  Output filters a client may request be applied to console output.
+ */
+#define CONMAN_FILTER_NEWLINE   0x01    /* normalize CR/LF line terminations */
+#define CONMAN_FILTER_NOANSI    0x02    /* strip ANSI escape sequences       */
+#define CONMAN_FILTER_SANITIZE  0x04    /* strip data to printable 7-bit     */
+#define CONMAN_FILTER_TIMESTAMP 0x08    /* timestamp each line               */
+#define CONMAN_FILTER_MASK      0x0F
+
 /*  Version string information
  */
 #ifndef NDEBUG
@@ -106,31 +133,61 @@
 #  define FEATURE_FREEIPMI ""
 #endif /* WITH_FREEIPMI */
 
+#if WITH_OPENSSL
+#  define FEATURE_OPENSSL " OPENSSL"
+#else
+#  define FEATURE_OPENSSL ""
+#endif /* WITH_OPENSSL */
+
 #if WITH_TCP_WRAPPERS
 #  define FEATURE_TCP_WRAPPERS " TCP-WRAPPERS"
 #else
 #  define FEATURE_TCP_WRAPPERS ""
 #endif /* WITH_TCP_WRAPPERS */
 
+#if WITH_ZLIB
+#  define FEATURE_ZLIB " ZLIB"
+#else
+#  define FEATURE_ZLIB ""
+#endif /* WITH_ZLIB */
+
 #define CLIENT_FEATURES \
-    (FEATURE_DEBUG FEATURE_DMALLOC)
+    (FEATURE_DEBUG FEATURE_DMALLOC FEATURE_OPENSSL FEATURE_ZLIB)
 #define SERVER_FEATURES \
-    (FEATURE_DEBUG FEATURE_DMALLOC FEATURE_FREEIPMI FEATURE_TCP_WRAPPERS)
+    (FEATURE_DEBUG FEATURE_DMALLOC FEATURE_FREEIPMI FEATURE_OPENSSL \
+     FEATURE_TCP_WRAPPERS FEATURE_ZLIB)
 
 #if ! HAVE_SOCKLEN_T
 typedef int socklen_t;                  /* socklen_t is uint32_t in Posix.1g */
 #endif /* !HAVE_SOCKLEN_T */
 
 
-typedef enum cmd_type {                 /* ConMan command (2 bits)           */
+typedef enum cmd_type {                 /* ConMan command (3 bits)           */
     CONMAN_CMD_NONE,
     CONMAN_CMD_CONNECT,
+    CONMAN_CMD_EXECUTE,
     CONMAN_CMD_MONITOR,
     CONMAN_CMD_QUERY
 } cmd_t;
 
+typedef enum step_type {                /* EXECUTE script step type          */
+    CONMAN_STEP_CAPTURE,                /*  enable/disable output capture    */
+    CONMAN_STEP_EXPECT,                 /*  wait for output matching regex   */
+    CONMAN_STEP_SEND,                   /*  send string to console           */
+    CONMAN_STEP_TIMEOUT                 /*  set secs to wait on each expect  */
+} step_type_t;
+
+typedef struct step {                   /* EXECUTE script step               */
+    step_type_t type;                   /* type of step                      */
+    char     *str;                      /* send string or expect regex       */
+    int       val;                      /* capture flag or timeout secs      */
+} step_t;
+
 typedef struct request {
     int       sd;                       /* socket descriptor                 */
+#if WITH_OPENSSL
+    SSL      *ssl;                      /* TLS session if encrypting, or NULL*/
+#endif /* WITH_OPENSSL */
     char     *user;                     /* login name of client user         */
     char     *tty;                      /* device name of client terminal    */
     char     *fqdn;                     /* queried remote FQDN (or ip) str   */
@@ -138,14 +195,26 @@ typedef struct request {
     char     *ip;                       /* queried remote ip addr string     */
     int       port;                     /* remote port number                */
     List      consoles;                 /* list of consoles affected by cmd  */
-    unsigned  command:2;                /* ConMan command to perform (cmd_t) */
+    List      script;                   /* list of EXECUTE steps (step_t)    */
+    unsigned long long offset;          /* console output stream offset      */
+    unsigned long long resumeOffset;    /* stream offset client asked resume */
+    int       numLines;                 /* num lines of output to replay     */
+    unsigned  command:3;                /* ConMan command to perform (cmd_t) */
+    unsigned  filter:4;                 /* CONMAN_FILTER_* output filters    */
     unsigned  enableBroadcast:1;        /* true if b-casting to >1 consoles  */
+    unsigned  enableCoalesce:1;         /* true if coalescing output lines   */
+    unsigned  enableCompress:1;         /* true if compressing server output */
     unsigned  enableEcho:1;             /* true if echoing standard input    */
     unsigned  enableForce:1;            /* true if forcing console conn      */
+    unsigned  enableFramed:1;           /* true if client input is framed    */
     unsigned  enableJoin:1;             /* true if joining console conn      */
     unsigned  enableQuiet:1;            /* true if suppressing info messages */
     unsigned  enableRegex:1;            /* true if regex console matching    */
+    unsigned  enableRelay:1;            /* true if relaying for worker procs */
     unsigned  enableReset:1;            /* true if server supports reset cmd */
+    unsigned  enableResume:1;           /* true if resuming output at offset */
+    unsigned  enableSpan:1;             /* true if session spans worker procs*/
+    unsigned  enableTLS:1;              /* true if encrypting the connection */
 } req_t;
 
 
@@ -165,21 +234,36 @@ enum proto_toks {
  *  Keep enums in sync w/ common.c:proto_strs[].
  */
     CONMAN_TOK_BROADCAST = LEX_TOK_OFFSET,
+    CONMAN_TOK_CAPTURE,
+    CONMAN_TOK_COALESCE,
     CONMAN_TOK_CODE,
+    CONMAN_TOK_COMPRESS,
     CONMAN_TOK_CONNECT,
     CONMAN_TOK_CONSOLE,
     CONMAN_TOK_ERROR,
+    CONMAN_TOK_EXECUTE,
+    CONMAN_TOK_EXPECT,
     CONMAN_TOK_FORCE,
+    CONMAN_TOK_FRAMED,
     CONMAN_TOK_HELLO,
     CONMAN_TOK_JOIN,
+    CONMAN_TOK_LINES,
     CONMAN_TOK_MESSAGE,
     CONMAN_TOK_MONITOR,
+    CONMAN_TOK_NEWLINE,
+    CONMAN_TOK_NOANSI,
+    CONMAN_TOK_OFFSET,
     CONMAN_TOK_OK,
     CONMAN_TOK_OPTION,
     CONMAN_TOK_QUERY,
     CONMAN_TOK_QUIET,
     CONMAN_TOK_REGEX,
     CONMAN_TOK_RESET,
+    CONMAN_TOK_RESUME,
+    CONMAN_TOK_SANITIZE,
+    CONMAN_TOK_SEND,
+    CONMAN_TOK_TIMEOUT,
+    CONMAN_TOK_TIMESTAMP,
     CONMAN_TOK_TTY,
     CONMAN_TOK_USER
 };
@@ -197,6 +281,20 @@ req_t * create_req(void);
 
 void destroy_req(req_t *req);
 
+step_t * create_step(step_type_t type, char *str, int val);
+
+void destroy_step(step_t *step);
+
+ssize_t read_req_data(req_t *req, void *buf, size_t n);
+
+ssize_t read_req_line(req_t *req, void *buf, size_t maxlen);
+
+ssize_t write_req_data(req_t *req, const void *buf, size_t n);
+
+ssize_t write_req_n(req_t *req, void *buf, size_t n);
+
+int is_req_data_pending(req_t *req);
+
 void get_tty_mode(struct termios *tty, int fd);
 
 void set_tty_mode(struct termios *tty, int fd);
@@ -120,6 +120,9 @@ static void list_iterator_free(ListIterator i);
 static List freeLists = NULL;
 static ListNode freeListNodes = NULL;
 static ListIterator freeListIterators = NULL;
+static unsigned long freeListsSize = 0;
+static unsigned long freeListNodesSize = 0;
+static unsigned long freeListIteratorsSize = 0;
 #if WITH_PTHREADS
 static pthread_mutex_t freeListsLock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t freeListNodesLock = PTHREAD_MUTEX_INITIALIZER;
@@ -246,6 +249,23 @@ int list_count(List l)
 }
 
 
+unsigned long list_mem_size(void)
+{
+    unsigned long n;
+
+    list_mutex_lock(&freeListsLock);
+    n = freeListsSize;
+    list_mutex_unlock(&freeListsLock);
+    list_mutex_lock(&freeListNodesLock);
+    n += freeListNodesSize;
+    list_mutex_unlock(&freeListNodesLock);
+    list_mutex_lock(&freeListIteratorsLock);
+    n += freeListIteratorsSize;
+    list_mutex_unlock(&freeListIteratorsLock);
+    return(n);
+}
+
+
 void * list_append(List l, void *x)
 {
     void *v;
@@ -645,6 +665,7 @@ static List list_alloc(void)
             for (l=freeLists; l<last; l++)
                 l->iNext = (ListIterator) (l + 1);
             last->iNext = NULL;
+            freeListsSize += LIST_ALLOC * sizeof(struct list);
         }
     }
     if ((l = freeLists))
@@ -667,6 +688,7 @@ static ListNode list_node_alloc(void)
             for (p=freeListNodes; p<last; p++)
                 p->next = p + 1;
             last->next = NULL;
+            freeListNodesSize += LIST_ALLOC * sizeof(struct listNode);
         }
     }
     if ((p = freeListNodes))
@@ -689,6 +711,7 @@ static ListIterator list_iterator_alloc(void)
             for (i=freeListIterators; i<last; i++)
                 i->iNext = i + 1;
             last->iNext = NULL;
+            freeListIteratorsSize += LIST_ALLOC * sizeof(struct listIterator);
         }
     }
     if ((i = freeListIterators))
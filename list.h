@@ -104,6 +104,13 @@ int list_count(List l);
  *  Returns the number of items in list (l).
  */
 
+unsigned long list_mem_size(void);
+/*
+ *  Returns the number of bytes allocated for lists, list nodes, and list
+ *    iterators.  Since these are cached for reuse once freed, this is the
+ *    high-water mark of the memory used by all lists.
+ */
+
 
 /***************************\
 **  List Access Functions  **
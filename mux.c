@@ -0,0 +1,484 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "log.h"
+#include "mux.h"
+#include "util.h"
+#include "util-file.h"
+
+
+/*  conmanmux: a reference helper for mux consoles.
+ *
+ *  Serves any number of console sessions over its stdin & stdout using the
+ *    helper protocol described in "mux.h".  Each session echoes its input
+ *    back, and can be made to output numbered lines periodically, close
+ *    itself after a while, or refuse to open.  The session's behavior is
+ *    specified by the args following the helper in the console's dev string:
+ *
+ *      console name="foo" dev="mux:conmanmux lines=1000 life=60"
+ *
+ *  A helper is free to serve its sessions however it likes (eg, by holding
+ *    a network connection to a BMC for each one); this one is intended for
+ *    exercising the daemon and as an example of the protocol.
+ */
+
+#define HELPER_OUT_MAX          (1024 * 1024)
+#define HELPER_READ_SIZE        65536
+
+
+typedef struct helper_session {
+    char           *name;               /* console name                      */
+    long            msPeriod;           /* msecs between lines, or 0         */
+    long            msNextLine;         /* time at which next line is output */
+    long            msClose;            /* time at which to close, or 0      */
+    unsigned long   numLines;           /* num lines output                  */
+    int             rows;               /* terminal rows                     */
+    int             cols;               /* terminal columns                  */
+    unsigned        isOpen:1;           /* true if session is open           */
+} helper_session_t;
+
+typedef struct helper_conf {
+    helper_session_t *sessions;         /* ary of sessions indexed by id     */
+    unsigned long   numSessions;        /* num of sessions allocated in ary  */
+    unsigned char  *in;                 /* buf of frames read from stdin     */
+    int             inLen;              /* num bytes of frames in 'in'       */
+    unsigned char  *out;                /* buf of frames to write to stdout  */
+    int             outLen;             /* num bytes of frames in 'out'      */
+    int             outMax;             /* num bytes allocated for 'out'     */
+    unsigned        enableVerbose:1;    /* true if verbose output requested  */
+} helper_conf_t;
+
+
+static void process_cmdline(helper_conf_t *conf, int argc, char *argv[]);
+static void exit_handler(int signum);
+static void mux_io(helper_conf_t *conf);
+static long get_msecs(void);
+static int  read_frames(helper_conf_t *conf);
+static void process_frame(helper_conf_t *conf, int type, unsigned long id,
+    const unsigned char *src, int len);
+static void open_session(helper_conf_t *conf, unsigned long id,
+    const unsigned char *src, int len);
+static void close_session(helper_conf_t *conf, unsigned long id,
+    const char *reason);
+static void echo_session(helper_conf_t *conf, unsigned long id,
+    const unsigned char *src, int len);
+static long tick(helper_conf_t *conf);
+static void put_frame(helper_conf_t *conf, int type, unsigned long id,
+    const void *src, int len);
+static void put_str(helper_conf_t *conf, unsigned long id, const char *str);
+
+
+static volatile sig_atomic_t done = 0;
+
+
+int main(int argc, char *argv[])
+{
+    helper_conf_t conf;
+
+    log_set_file(stderr, LOG_NOTICE, 0);
+
+    memset(&conf, 0, sizeof(conf));
+    process_cmdline(&conf, argc, argv);
+    if (conf.enableVerbose) {
+        log_set_file(stderr, LOG_INFO, 0);
+    }
+    if (!(conf.in = malloc(HELPER_READ_SIZE + MUX_HDR_LEN + MUX_MAX_PAYLOAD))) {
+        out_of_memory();
+    }
+    posix_signal(SIGINT, exit_handler);
+    posix_signal(SIGPIPE, SIG_IGN);
+    posix_signal(SIGTERM, exit_handler);
+
+    set_fd_nonblocking(STDIN_FILENO);
+    set_fd_nonblocking(STDOUT_FILENO);
+
+    log_msg(LOG_INFO, "Helper started (pid %d)", (int) getpid());
+    mux_io(&conf);
+    log_msg(LOG_INFO, "Helper exiting");
+    return(0);
+}
+
+
+static void process_cmdline(helper_conf_t *conf, int argc, char *argv[])
+{
+    int c;
+
+    opterr = 0;
+    while ((c = getopt(argc, argv, "hv")) != -1) {
+        switch(c) {
+        case 'h':
+            printf("Usage: %s [-v]\n\n", argv[0]);
+            printf("Serves conmand mux console sessions on stdin & stdout.\n");
+            printf("Session args: lines=MSECS life=SECS refuse\n\n");
+            exit(0);
+        case 'v':
+            conf->enableVerbose = 1;
+            break;
+        case '?':                       /* invalid option */
+            log_err(0, "Invalid option \"%s\"", argv[optind - 1]);
+            break;
+        default:
+            log_err(0, "Unimplemented option \"%s\"", argv[optind - 1]);
+            break;
+        }
+    }
+    if (argv[optind]) {
+        log_err(0, "Unrecognized parameter \"%s\"", argv[optind]);
+    }
+    return;
+}
+
+
+static void exit_handler(int signum)
+{
+    done = signum;
+    return;
+}
+
+
+static void mux_io(helper_conf_t *conf)
+{
+/*  Services sessions until the daemon closes the connection.
+ */
+    struct pollfd pfd[2];
+    long          timeout;
+    int           n;
+
+    while (!done) {
+        timeout = tick(conf);
+
+        pfd[0].fd = STDIN_FILENO;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = STDOUT_FILENO;
+        pfd[1].events = (conf->outLen > 0) ? POLLOUT : 0;
+
+        if (poll(pfd, 2, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_err(errno, "Unable to multiplex I/O");
+        }
+        if (pfd[1].revents & (POLLOUT | POLLERR | POLLHUP)) {
+            n = write(STDOUT_FILENO, conf->out, conf->outLen);
+            if (n > 0) {
+                conf->outLen -= n;
+                memmove(conf->out, conf->out + n, conf->outLen);
+            }
+            else if ((n < 0) && (errno != EAGAIN) && (errno != EINTR)) {
+                log_err(errno, "Unable to write to daemon");
+            }
+        }
+        if (pfd[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+            if (read_frames(conf) <= 0) {
+                break;
+            }
+        }
+    }
+    return;
+}
+
+
+static long get_msecs(void)
+{
+    struct timeval tv;
+
+    if (gettimeofday(&tv, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    return((tv.tv_sec * 1000) + (tv.tv_usec / 1000));
+}
+
+
+static int read_frames(helper_conf_t *conf)
+{
+/*  Reads from stdin, processing each complete frame.
+ *  Returns the number of bytes read, or 0 on EOF.
+ */
+    unsigned char *p;
+    int            n;
+    int            len;
+
+    n = read(STDIN_FILENO, conf->in + conf->inLen, HELPER_READ_SIZE);
+    if (n < 0) {
+        if ((errno == EAGAIN) || (errno == EINTR)) {
+            return(1);
+        }
+        log_err(errno, "Unable to read from daemon");
+    }
+    if (n == 0) {
+        return(0);
+    }
+    conf->inLen += n;
+
+    p = conf->in;
+    while ((conf->in + conf->inLen - p) >= MUX_HDR_LEN) {
+        len = MUX_HDR_PAYLOAD_LEN(p);
+        if ((conf->in + conf->inLen - p) < MUX_HDR_LEN + len) {
+            break;
+        }
+        process_frame(conf, MUX_HDR_TYPE(p), MUX_HDR_ID(p),
+            p + MUX_HDR_LEN, len);
+        p += MUX_HDR_LEN + len;
+    }
+    conf->inLen -= p - conf->in;
+    memmove(conf->in, p, conf->inLen);
+    return(n);
+}
+
+
+static void process_frame(helper_conf_t *conf, int type, unsigned long id,
+    const unsigned char *src, int len)
+{
+    helper_session_t *s;
+
+    if (id >= conf->numSessions) {
+        conf->sessions = realloc(conf->sessions,
+            (id + 64) * sizeof(helper_session_t));
+        if (!conf->sessions) {
+            out_of_memory();
+        }
+        memset(conf->sessions + conf->numSessions, 0,
+            (id + 64 - conf->numSessions) * sizeof(helper_session_t));
+        conf->numSessions = id + 64;
+    }
+    s = &conf->sessions[id];
+
+    switch (type) {
+    case MUX_FRAME_OPEN:
+        open_session(conf, id, src, len);
+        break;
+    case MUX_FRAME_CLOSE:
+        if (s->isOpen) {
+            log_msg(LOG_INFO, "Session %lu [%s] closed by daemon", id,
+                s->name);
+        }
+        s->isOpen = 0;
+        break;
+    case MUX_FRAME_DATA:
+        if (s->isOpen) {
+            echo_session(conf, id, src, len);
+        }
+        break;
+    case MUX_FRAME_BREAK:
+        if (s->isOpen) {
+            put_str(conf, id, "\r\n<BREAK>\r\n");
+        }
+        break;
+    case MUX_FRAME_RESIZE:
+        if (len >= 4) {
+            s->rows = (src[0] << 8) | src[1];
+            s->cols = (src[2] << 8) | src[3];
+        }
+        break;
+    default:
+        log_msg(LOG_INFO, "Ignoring frame type=%d for session %lu", type, id);
+        break;
+    }
+    return;
+}
+
+
+static void open_session(helper_conf_t *conf, unsigned long id,
+    const unsigned char *src, int len)
+{
+/*  Opens session 'id' as specified by the OPEN frame payload 'src' of length
+ *    'len' (ie, the console name and args, each NUL-terminated).
+ */
+    helper_session_t *s = &conf->sessions[id];
+    const char       *p = (const char *) src;
+    const char       *end = (const char *) src + len;
+    int               isRefused = 0;
+    char              buf[256];
+
+    if ((len == 0) || (src[len - 1] != '\0')) {
+        close_session(conf, id, "malformed open frame");
+        return;
+    }
+    free(s->name);
+    memset(s, 0, sizeof(*s));
+    s->name = strdup(p);
+    if (!s->name) {
+        out_of_memory();
+    }
+    for (p += strlen(p) + 1; p < end; p += strlen(p) + 1) {
+        if (!strncmp(p, "lines=", 6)) {
+            s->msPeriod = atol(p + 6);
+        }
+        else if (!strncmp(p, "life=", 5)) {
+            s->msClose = get_msecs() + (atol(p + 5) * 1000);
+        }
+        else if (!strcmp(p, "refuse")) {
+            isRefused = 1;
+        }
+        else {
+            log_msg(LOG_NOTICE, "Ignoring session [%s] arg \"%s\"",
+                s->name, p);
+        }
+    }
+    if (isRefused) {
+        close_session(conf, id, "refused by request");
+        return;
+    }
+    s->isOpen = 1;
+    s->msNextLine = get_msecs() + s->msPeriod;
+    put_frame(conf, MUX_FRAME_OPEN, id, NULL, 0);
+    snprintf(buf, sizeof(buf), "conmanmux: session %lu [%s] opened\r\n",
+        id, s->name);
+    put_str(conf, id, buf);
+    log_msg(LOG_INFO, "Session %lu [%s] opened", id, s->name);
+    return;
+}
+
+
+static void close_session(helper_conf_t *conf, unsigned long id,
+    const char *reason)
+{
+/*  Closes session 'id', informing the daemon of the 'reason'.
+ */
+    conf->sessions[id].isOpen = 0;
+    put_frame(conf, MUX_FRAME_CLOSE, id, reason, strlen(reason));
+    log_msg(LOG_INFO, "Session %lu closed: %s", id, reason);
+    return;
+}
+
+
+static void echo_session(helper_conf_t *conf, unsigned long id,
+    const unsigned char *src, int len)
+{
+/*  Echoes the input 'src' of length 'len' back to session 'id',
+ *    translating CR into CR/LF.
+ */
+    unsigned char buf[MUX_MAX_PAYLOAD];
+    int           n = 0;
+
+    while (len-- > 0) {
+        if (n >= (int) sizeof(buf) - 1) {
+            put_frame(conf, MUX_FRAME_DATA, id, buf, n);
+            n = 0;
+        }
+        buf[n++] = *src;
+        if (*src++ == '\r') {
+            buf[n++] = '\n';
+        }
+    }
+    put_frame(conf, MUX_FRAME_DATA, id, buf, n);
+    return;
+}
+
+
+static long tick(helper_conf_t *conf)
+{
+/*  Outputs lines for sessions whose period has elapsed, and closes sessions
+ *    whose life has expired.  Lines are skipped while the daemon is not
+ *    keeping up with output.
+ *  Returns the number of msecs until the next session event, or -1.
+ */
+    helper_session_t *s;
+    unsigned long     id;
+    long              now;
+    long              next = -1;
+    char              buf[256];
+
+    now = get_msecs();
+    for (id = 0; id < conf->numSessions; id++) {
+        s = &conf->sessions[id];
+        if (!s->isOpen) {
+            continue;
+        }
+        if ((s->msClose > 0) && (s->msClose <= now)) {
+            close_session(conf, id, "session life expired");
+            continue;
+        }
+        if (s->msPeriod > 0) {
+            while (s->msNextLine <= now) {
+                if (conf->outLen < HELPER_OUT_MAX) {
+                    snprintf(buf, sizeof(buf), "%s: line %lu\r\n",
+                        s->name, ++s->numLines);
+                    put_str(conf, id, buf);
+                }
+                s->msNextLine += s->msPeriod;
+            }
+            if ((next < 0) || (s->msNextLine - now < next)) {
+                next = s->msNextLine - now;
+            }
+        }
+        if ((s->msClose > 0) && ((next < 0) || (s->msClose - now < next))) {
+            next = s->msClose - now;
+        }
+    }
+    return(next);
+}
+
+
+static void put_frame(helper_conf_t *conf, int type, unsigned long id,
+    const void *src, int len)
+{
+/*  Appends a frame of the given 'type' for session 'id' with the payload
+ *    'src' of length 'len' to the output buffer.
+ */
+    unsigned char *p;
+
+    assert((len >= 0) && (len <= MUX_MAX_PAYLOAD));
+
+    if (conf->outLen + MUX_HDR_LEN + len > conf->outMax) {
+        conf->outMax = (conf->outLen + MUX_HDR_LEN + len) * 2;
+        if (!(conf->out = realloc(conf->out, conf->outMax))) {
+            out_of_memory();
+        }
+    }
+    p = conf->out + conf->outLen;
+    p[0] = type;
+    p[1] = 0;
+    p[2] = (len >> 8) & 0xFF;
+    p[3] = len & 0xFF;
+    p[4] = (id >> 24) & 0xFF;
+    p[5] = (id >> 16) & 0xFF;
+    p[6] = (id >> 8) & 0xFF;
+    p[7] = id & 0xFF;
+    if (len > 0) {
+        memcpy(p + MUX_HDR_LEN, src, len);
+    }
+    conf->outLen += MUX_HDR_LEN + len;
+    return;
+}
+
+
+static void put_str(helper_conf_t *conf, unsigned long id, const char *str)
+{
+    put_frame(conf, MUX_FRAME_DATA, id, str, strlen(str));
+    return;
+}
@@ -0,0 +1,77 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#ifndef _MUX_H
+#define _MUX_H
+
+
+/*  The helper protocol multiplexes many console sessions over the stream
+ *    connecting the daemon to a single helper process (the helper's stdin
+ *    and stdout).  Each frame consists of an 8-byte header followed by
+ *    'len' bytes of payload:
+ *
+ *      byte 0:     frame type (MUX_FRAME_*)
+ *      byte 1:     reserved (must be 0)
+ *      bytes 2-3:  payload length (unsigned, network byte order)
+ *      bytes 4-7:  session id (unsigned, network byte order)
+ *
+ *  Frames sent by the daemon to the helper:
+ *    - OPEN:   starts session 'id'; the payload holds the console name
+ *              followed by each of its args, each terminated by a NUL
+ *    - CLOSE:  ends session 'id'; the payload is empty
+ *    - DATA:   input for session 'id' to be written to the console
+ *    - BREAK:  requests a serial-break on session 'id'; the payload is empty
+ *    - RESIZE: sets the terminal size of session 'id'; the payload holds
+ *              the number of rows and columns as 2-byte unsigned integers
+ *              in network byte order
+ *
+ *  Frames sent by the helper to the daemon:
+ *    - OPEN:   acknowledges the session is connected; the payload is empty
+ *    - CLOSE:  ends session 'id' (eg, if the connection failed or dropped);
+ *              the payload optionally holds a reason string (without a NUL)
+ *    - DATA:   output from session 'id' to be written to the console
+ *
+ *  The daemon reopens a session closed by the helper after a delay.
+ *    Session ids are reused, but frames received for a session that is not
+ *    open (eg, those sent by the helper before it received a CLOSE) are
+ *    discarded.  Unrecognized frame types are ignored in both directions.
+ */
+#define MUX_FRAME_OPEN          1
+#define MUX_FRAME_CLOSE         2
+#define MUX_FRAME_DATA          3
+#define MUX_FRAME_BREAK         4
+#define MUX_FRAME_RESIZE        5
+
+#define MUX_HDR_LEN             8
+#define MUX_MAX_PAYLOAD         65535
+
+#define MUX_HDR_TYPE(p)     ((p)[0])
+#define MUX_HDR_PAYLOAD_LEN(p) \
+    (((unsigned) (p)[2] << 8) | (unsigned) (p)[3])
+#define MUX_HDR_ID(p) \
+    (((unsigned long) (p)[4] << 24) | ((unsigned long) (p)[5] << 16) \
+    | ((unsigned long) (p)[6] << 8) | (unsigned long) (p)[7])
+
+
+#endif /* !_MUX_H */
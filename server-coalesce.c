@@ -0,0 +1,538 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "list.h"
+#include "log.h"
+#include "server.h"
+#include "tpoll.h"
+#include "util-str.h"
+#include "util.h"
+#include "wrapper.h"
+
+
+/*  A coalesced MONITOR request aggregates the output of its consoles in the
+ *    spirit of "dshbak -c".  Each console is linked into the console's history
+ *    as a member and fed the console's output as it is fanned out by
+ *    write_readers_data().  Complete lines are hashed into groups of identical
+ *    lines, with each group recording the set of consoles that output it.
+ *  Every COALESCE_FLUSH_MSECS, each distinct line of the interval is written
+ *    to the client once, prefixed by its compressed set of console names
+ *    (eg, "node[1-3,7]: ..."); lines on which consoles diverge thereby appear
+ *    once per variant with just the consoles that differ.  The bandwidth and
+ *    client processing thus scale with the amount of distinct output rather
+ *    than the number of consoles.
+ *  Results are queued and only moved into the client's buffer as there is
+ *    room; if the client falls too far behind, results are dropped and the
+ *    client is informed of the number lost.
+ *
+ *  A console's list of members is protected by its history lock.  The
+ *    remaining state is only accessed by the mux thread once started.
+ */
+
+static void start_coalesce_members(coalesce_t *co);
+static void append_coalesce_data(coalesce_member_t *m,
+    const void *src, int len);
+static void add_coalesce_line(coalesce_member_t *m);
+static void flush_coalesce_groups(coalesce_t *co);
+static char * format_coalesce_set(coalesce_t *co, coalesce_group_t *g);
+static int is_coalesce_range(coalesce_member_t *m1, coalesce_member_t *m2);
+static int next_coalesce_index(coalesce_group_t *g, int i, int n);
+static void destroy_coalesce_group(coalesce_group_t *g);
+static int find_coalesce_member(coalesce_member_t *m, coalesce_member_t *key);
+
+extern tpoll_t tp_global;               /* defined in server.c */
+
+
+coalesce_t * create_coalesce(req_t *req)
+{
+/*  Creates a coalesced monitor for the consoles of the request (req).
+ *  The request's consoles are sorted by name, so members are placed
+ *    in the order in which they will be displayed.
+ *  Returns the new coalesced monitor.
+ */
+    coalesce_t *co;
+    ListIterator i;
+    obj_t *console;
+    coalesce_member_t *m;
+    char *p, *q;
+
+    assert(req != NULL);
+    assert(req->command == CONMAN_CMD_MONITOR);
+    assert(!list_is_empty(req->consoles));
+
+    if (!(co = malloc(sizeof(coalesce_t)))) {
+        out_of_memory();
+    }
+    co->numMembers = list_count(req->consoles);
+    if (!(co->members = calloc(co->numMembers, sizeof(coalesce_member_t)))) {
+        out_of_memory();
+    }
+    co->client = NULL;
+    memset(co->hash, 0, sizeof(co->hash));
+    co->groups = list_create((ListDelF) destroy_coalesce_group);
+    co->results = list_create((ListDelF) destroy_string);
+    co->setLen = 1;
+    co->timer = -1;
+    co->numDropped = 0;
+    co->isStarted = 0;
+
+    m = co->members;
+    i = list_iterator_create(req->consoles);
+    while ((console = list_next(i))) {
+        assert(is_console_obj(console));
+        m->co = co;
+        m->console = console;
+        m->index = m - co->members;
+        m->len = 0;
+        m->isIdle = 1;
+        /*
+         *  Split the name into a prefix & trailing integer for compressing
+         *    runs of consecutively-numbered consoles into ranges.
+         */
+        for (p = console->name, q = NULL; *p; p++) {
+            if (!isdigit((int) *p))
+                q = NULL;
+            else if (!q)
+                q = p;
+        }
+        m->prefixLen = q ? q - console->name : p - console->name;
+        m->width = q ? p - q : 0;
+        m->num = q ? strtoul(q, NULL, 10) : 0;
+        /*
+         *  Reserve enough of the set buf to list every name in full
+         *    along with any separators & brackets.
+         */
+        co->setLen += strlen(console->name) + 3;
+        m++;
+    }
+    list_iterator_destroy(i);
+
+    if (!(co->set = malloc(co->setLen))) {
+        out_of_memory();
+    }
+    return(co);
+}
+
+
+void destroy_coalesce(coalesce_t *co)
+{
+/*  Destroys the coalesced monitor (co).
+ *  This does not touch the monitor's consoles since they may have already
+ *    been destroyed at exit; cancel_coalesce() unlinks them.
+ */
+    if (!co) {
+        return;
+    }
+    list_destroy(co->groups);
+    list_destroy(co->results);
+    free(co->members);
+    free(co->set);
+    free(co);
+    return;
+}
+
+
+void start_coalesce(coalesce_t *co, obj_t *client)
+{
+/*  Starts the coalesced monitor (co) for the (client).
+ *  This is invoked by create_client_obj() before the client is published.
+ *  The members are linked to their consoles by the mux thread,
+ *    which performs all subsequent processing of the monitor.
+ */
+    assert(co != NULL);
+    assert(is_client_obj(client));
+    assert(co->client == NULL);
+
+    co->client = client;
+    client->aux->client.coalesce = co;
+    co->timer = tpoll_timeout_relative(tp_global,
+        (callback_f) start_coalesce_members, co, 0);
+    if (co->timer < 0) {
+        log_err(0, "Unable to create timer to start monitor on [%s]",
+            client->name);
+    }
+    return;
+}
+
+
+void cancel_coalesce(coalesce_t *co)
+{
+/*  Cancels the coalesced monitor (co), unlinking its members from their
+ *    consoles and discarding any unwritten output.
+ *  This is invoked by the mux thread when the monitor's client is shut down.
+ */
+    coalesce_member_t *m;
+    int i;
+
+    assert(co != NULL);
+
+    if (co->timer > 0) {
+        (void) tpoll_timeout_cancel(tp_global, co->timer);
+        co->timer = -1;
+    }
+    if (co->isStarted) {
+        for (i = 0, m = co->members; i < co->numMembers; i++, m++) {
+            x_pthread_mutex_lock(&m->console->history->lock);
+            list_delete_all(m->console->history->coalesce,
+                (ListFindF) find_coalesce_member, m);
+            x_pthread_mutex_unlock(&m->console->history->lock);
+        }
+        co->isStarted = 0;
+    }
+    list_destroy(co->results);
+    co->results = list_create((ListDelF) destroy_string);
+    return;
+}
+
+
+void write_coalesce_data(obj_t *console, const void *src, int len)
+{
+/*  Writes the buffer (src) of length (len) read from the (console)
+ *    to each coalesced monitor member on that console.
+ *  The console's history lock must be held by the caller.
+ */
+    ListIterator i;
+    coalesce_member_t *m;
+
+    assert(is_console_obj(console));
+    assert(console->history != NULL);
+
+    i = list_iterator_create(console->history->coalesce);
+    while ((m = list_next(i))) {
+        append_coalesce_data(m, src, len);
+    }
+    list_iterator_destroy(i);
+    return;
+}
+
+
+void flush_coalesce_results(coalesce_t *co)
+{
+/*  Moves as many of the coalesced monitor (co) results into its client's
+ *    buffer as will fit without overwriting unwritten data.
+ */
+    obj_t *client;
+    char *str;
+    int avail;
+    int n;
+
+    assert(co != NULL);
+
+    client = co->client;
+    if (!client || !co->isStarted) {
+        return;
+    }
+    avail = get_obj_buf_avail(client);
+
+    if ((co->numDropped > 0) && !client->aux->client.req->enableQuiet) {
+        str = create_format_string("%sDropped %d line%s of output%s",
+            CONMAN_MSG_PREFIX, co->numDropped,
+            (co->numDropped == 1 ? "" : "s"), CONMAN_MSG_SUFFIX);
+        n = strlen(str);
+        if (n <= avail) {
+            avail -= write_obj_data(client, str, n, 0);
+            co->numDropped = 0;
+        }
+        free(str);
+        if (co->numDropped > 0) {
+            return;
+        }
+    }
+    while ((str = list_peek(co->results))) {
+        n = strlen(str);
+        if ((n > avail) && (avail < OBJ_BUF_SIZE - 1)) {
+            return;
+        }
+        avail -= write_obj_data(client, str, n, 0);
+        destroy_string(list_pop(co->results));
+    }
+    return;
+}
+
+
+static void start_coalesce_members(coalesce_t *co)
+{
+/*  Links each of the coalesced monitor's (co) members to its console,
+ *    and schedules the first flush.
+ *  This timer callback is invoked by the mux thread.
+ */
+    coalesce_member_t *m;
+    int i;
+
+    assert(co != NULL);
+    assert(co->client != NULL);
+
+    for (i = 0, m = co->members; i < co->numMembers; i++, m++) {
+        assert(is_console_obj(m->console));
+        assert(m->console->history != NULL);
+        x_pthread_mutex_lock(&m->console->history->lock);
+        list_append(m->console->history->coalesce, m);
+        x_pthread_mutex_unlock(&m->console->history->lock);
+    }
+    co->isStarted = 1;
+    co->timer = tpoll_timeout_relative(tp_global,
+        (callback_f) flush_coalesce_groups, co, COALESCE_FLUSH_MSECS);
+    return;
+}
+
+
+static void append_coalesce_data(coalesce_member_t *m,
+    const void *src, int len)
+{
+/*  Appends the buffer (src) of length (len) to the partial line of the
+ *    member (m), adding each completed line to its monitor's groups.
+ *    Carriage-returns and NULs are dropped, and overlong lines are split.
+ */
+    const char *p = src;
+    const char *q = p + len;
+
+    m->isIdle = 0;
+    for (; p < q; p++) {
+        if (*p == '\n') {
+            add_coalesce_line(m);
+        }
+        else if ((*p != '\r') && (*p != '\0')) {
+            if (m->len == COALESCE_LINE_SIZE) {
+                add_coalesce_line(m);
+            }
+            m->buf[m->len++] = *p;
+        }
+    }
+    return;
+}
+
+
+static void add_coalesce_line(coalesce_member_t *m)
+{
+/*  Adds the line in the buf of member (m) to the group of identical lines
+ *    in the current interval, creating the group if this is the first
+ *    console to output the line.
+ */
+    coalesce_t *co = m->co;
+    coalesce_group_t *g;
+    unsigned hash;
+    int i;
+
+    /*  FNV-1a hash.
+     */
+    for (i = 0, hash = 2166136261U; i < m->len; i++) {
+        hash = (hash ^ (unsigned char) m->buf[i]) * 16777619U;
+    }
+    for (g = co->hash[hash % COALESCE_HASH_SIZE]; g; g = g->next) {
+        if ((g->hash == hash) && (g->len == m->len)
+                && (memcmp(g->line, m->buf, m->len) == 0)) {
+            break;
+        }
+    }
+    if (!g) {
+        if (!(g = malloc(sizeof(coalesce_group_t)))) {
+            out_of_memory();
+        }
+        if (!(g->members = calloc((co->numMembers + 7) / 8, 1))) {
+            out_of_memory();
+        }
+        if (!(g->line = malloc(m->len + 1))) {
+            out_of_memory();
+        }
+        memcpy(g->line, m->buf, m->len);
+        g->hash = hash;
+        g->len = m->len;
+        g->count = 0;
+        g->next = co->hash[hash % COALESCE_HASH_SIZE];
+        co->hash[hash % COALESCE_HASH_SIZE] = g;
+        list_append(co->groups, g);
+    }
+    if (!(g->members[m->index / 8] & (1 << (m->index % 8)))) {
+        g->members[m->index / 8] |= (1 << (m->index % 8));
+        g->count++;
+    }
+    m->len = 0;
+    return;
+}
+
+
+static void flush_coalesce_groups(coalesce_t *co)
+{
+/*  Queues a result for each distinct line output during the interval
+ *    of the coalesced monitor (co), and starts the next interval.
+ *    Partial lines left idle for an entire interval (eg, prompts)
+ *    are flushed as lines.
+ *  This timer callback is invoked by the mux thread.
+ */
+    coalesce_member_t *m;
+    coalesce_group_t *g;
+    int i;
+
+    assert(co != NULL);
+    assert(co->isStarted);
+
+    for (i = 0, m = co->members; i < co->numMembers; i++, m++) {
+        if (m->isIdle && (m->len > 0)) {
+            add_coalesce_line(m);
+        }
+        m->isIdle = 1;
+    }
+    while ((g = list_pop(co->groups))) {
+        if (list_count(co->results) < COALESCE_MAX_RESULTS) {
+            list_append(co->results, create_format_string("%s: %.*s\r\n",
+                format_coalesce_set(co, g), g->len, g->line));
+        }
+        else {
+            co->numDropped++;
+        }
+        destroy_coalesce_group(g);
+    }
+    memset(co->hash, 0, sizeof(co->hash));
+    flush_coalesce_results(co);
+
+    co->timer = tpoll_timeout_relative(tp_global,
+        (callback_f) flush_coalesce_groups, co, COALESCE_FLUSH_MSECS);
+    return;
+}
+
+
+static char * format_coalesce_set(coalesce_t *co, coalesce_group_t *g)
+{
+/*  Formats the set of console names having output the line of group (g)
+ *    into the set buf of the coalesced monitor (co), compressing names that
+ *    differ only by a trailing integer into ranges (eg, "node[1-3,7]").
+ *  Returns a ptr to the NUL-terminated set buf.
+ */
+    coalesce_member_t *m, *p, *q;
+    char *s = co->set;
+    int i, j, k;
+    int n;
+
+    i = next_coalesce_index(g, 0, co->numMembers);
+    while (i < co->numMembers) {
+        m = &co->members[i];
+        /*
+         *  Find the extent of consoles in the set sharing this name prefix.
+         *    Since members are sorted by name, these are contiguous.
+         */
+        for (j = i, n = 1; m->width > 0; j = k, n++) {
+            k = next_coalesce_index(g, j + 1, co->numMembers);
+            if ((k == co->numMembers)
+                    || !is_coalesce_range(m, &co->members[k])) {
+                break;
+            }
+        }
+        if (s > co->set) {
+            *s++ = ',';
+        }
+        if (n == 1) {
+            s += sprintf(s, "%s", m->console->name);
+        }
+        else {
+            s += sprintf(s, "%.*s[", m->prefixLen, m->console->name);
+            for (k = i; k <= j; ) {
+                p = q = &co->members[k];
+                k = next_coalesce_index(g, k + 1, j + 1);
+                while ((k <= j) && (co->members[k].num == q->num + 1)) {
+                    q = &co->members[k];
+                    k = next_coalesce_index(g, k + 1, j + 1);
+                }
+                s += sprintf(s, "%s%s", (p == m ? "" : ","),
+                    p->console->name + p->prefixLen);
+                if (q != p) {
+                    s += sprintf(s, "-%s", q->console->name + q->prefixLen);
+                }
+            }
+            *s++ = ']';
+        }
+        i = next_coalesce_index(g, j + 1, co->numMembers);
+    }
+    *s = '\0';
+    assert(s < co->set + co->setLen);
+    return(co->set);
+}
+
+
+static int is_coalesce_range(coalesce_member_t *m1, coalesce_member_t *m2)
+{
+/*  Checks whether the names of members (m1) and (m2) can be listed in the
+ *    same range, having identical prefixes followed by trailing integers
+ *    of the same width if either is zero-padded (eg, "n9" & "n10",
+ *    or "n09" & "n10", but not "n09" & "n100").
+ *  Returns non-zero if so; o/w returns zero.
+ */
+    int isPadded1, isPadded2;
+
+    if ((m1->width == 0) || (m2->width == 0)) {
+        return(0);
+    }
+    if ((m1->prefixLen != m2->prefixLen)
+            || strncmp(m1->console->name, m2->console->name, m1->prefixLen)) {
+        return(0);
+    }
+    isPadded1 = (m1->width > 1) && (m1->console->name[m1->prefixLen] == '0');
+    isPadded2 = (m2->width > 1) && (m2->console->name[m2->prefixLen] == '0');
+    if ((isPadded1 || isPadded2) && (m1->width != m2->width)) {
+        return(0);
+    }
+    return(1);
+}
+
+
+static int next_coalesce_index(coalesce_group_t *g, int i, int n)
+{
+/*  Returns the index of the first member at or after index (i) that is
+ *    in the set of group (g), or (n) if there is none before index (n).
+ */
+    while ((i < n) && !(g->members[i / 8] & (1 << (i % 8)))) {
+        i++;
+    }
+    return(i);
+}
+
+
+static void destroy_coalesce_group(coalesce_group_t *g)
+{
+/*  Destroys the group (g).
+ */
+    assert(g != NULL);
+
+    free(g->members);
+    free(g->line);
+    free(g);
+    return;
+}
+
+
+static int find_coalesce_member(coalesce_member_t *m, coalesce_member_t *key)
+{
+/*  Used by list_delete_all() to locate the member specified by (key).
+ *  Returns non-zero if (m == key); o/w returns zero.
+ */
+    return(m == key);
+}
@@ -64,6 +64,7 @@ enum server_conf_toks {
     SERVER_CONF_IPMIOPTS,
 #endif /* WITH_FREEIPMI */
     SERVER_CONF_KEEPALIVE,
+    SERVER_CONF_LATENCY,
     SERVER_CONF_LOG,
     SERVER_CONF_LOGDIR,
     SERVER_CONF_LOGFILE,
@@ -74,14 +75,26 @@ enum server_conf_toks {
     SERVER_CONF_OFF,
     SERVER_CONF_ON,
     SERVER_CONF_PIDFILE,
+    SERVER_CONF_PIPELINE,
     SERVER_CONF_PORT,
+    SERVER_CONF_RESETBATCH,
     SERVER_CONF_RESETCMD,
+    SERVER_CONF_RESETMAX,
+    SERVER_CONF_SCREEN,
     SERVER_CONF_SEROPTS,
     SERVER_CONF_SERVER,
+    SERVER_CONF_SINK,
+    SERVER_CONF_STALLTIME,
     SERVER_CONF_SYSLOG,
     SERVER_CONF_TCPWRAPPERS,
+    SERVER_CONF_TELNETOPTS,
     SERVER_CONF_TESTOPTS,
-    SERVER_CONF_TIMESTAMP
+    SERVER_CONF_TIMERSLACK,
+    SERVER_CONF_TIMESTAMP,
+    SERVER_CONF_TLSCERT,
+    SERVER_CONF_TLSKEY,
+    SERVER_CONF_TLSREQUIRE,
+    SERVER_CONF_WORKERS
 };
 
 static char *server_conf_strs[] = {
@@ -99,6 +112,7 @@ static char *server_conf_strs[] = {
     "IPMIOPTS",
 #endif /* WITH_FREEIPMI */
     "KEEPALIVE",
+    "LATENCY",
     "LOG",
     "LOGDIR",
     "LOGFILE",
@@ -109,14 +123,26 @@ static char *server_conf_strs[] = {
     "OFF",
     "ON",
     "PIDFILE",
+    "PIPELINE",
     "PORT",
+    "RESETBATCH",
     "RESETCMD",
+    "RESETMAX",
+    "SCREEN",
     "SEROPTS",
     "SERVER",
+    "SINK",
+    "STALLTIME",
     "SYSLOG",
     "TCPWRAPPERS",
+    "TELNETOPTS",
     "TESTOPTS",
+    "TIMERSLACK",
     "TIMESTAMP",
+    "TLSCERT",
+    "TLSKEY",
+    "TLSREQUIRE",
+    "WORKERS",
     NULL
 };
 
@@ -179,7 +205,9 @@ typedef struct console_strs {
 #if WITH_FREEIPMI
     char *iopts;
 #endif /* WITH_FREEIPMI */
+    char *nopts;
     char *topts;
+    int   screen;                       /* SCREEN on (1), off (0), or unset */
 } console_strs_t;
 
 
@@ -214,12 +242,26 @@ server_conf_t * create_server_conf(void)
     conf->logFilePtr = NULL;
     conf->logFileLevel = LOG_INFO;
     conf->numOpenFiles = 0;
+    conf->numPipeThreads = 0;
     conf->pidFileName = NULL;
+    conf->sinkName = NULL;
     conf->resetCmd = NULL;
+    conf->resetBatch = DEFAULT_RESET_BATCH;
+    conf->resetMax = DEFAULT_RESET_MAX;
+    conf->stallMsecs = 0;
     conf->syslogFacility = -1;
     conf->throwSignal = -1;
+    conf->timerSlackMsecs = 0;
     conf->tStampMinutes = 0;
     conf->tStampNext = 0;
+    conf->tlsCertFile = NULL;
+    conf->tlsKeyFile = NULL;
+#if WITH_OPENSSL
+    conf->tlsCtx = NULL;
+#endif /* WITH_OPENSSL */
+    conf->numWorkers = 0;
+    conf->workerIndex = -1;
+    conf->workerFd = -1;
     /*
      *  The conf file's fd must be saved and kept open in order to hold an
      *    fcntl-style lock.  This lock is used to ensure only one instance
@@ -250,13 +292,19 @@ server_conf_t * create_server_conf(void)
     conf->numIpmiObjs = 0;
 #endif /* WITH_FREEIPMI */
 
+    if (init_telnet_opts(&conf->globalTelnetOpts) < 0) {
+        log_err(0, "Unable to initialize default telnet options");
+    }
     if (init_test_opts(&conf->globalTestOpts) < 0) {
         log_err(0, "Unable to initialize default test options");
     }
     conf->enableCoreDump = 0;
     conf->enableKeepAlive = 1;
+    conf->enableLatency = 0;
     conf->enableLoopBack = 1;
+    conf->enableScreen = 0;
     conf->enableTCPWrap = 0;
+    conf->enableTLSRequire = 0;
     conf->enableVerbose = 0;
     conf->enableZeroLogs = 0;
     conf->enableForeground = 0;
@@ -299,6 +347,13 @@ void destroy_server_conf(server_conf_t *conf)
         }
         conf->ld = -1;
     }
+    if (conf->workerFd >= 0) {
+        if (close(conf->workerFd) < 0) {
+            log_msg(LOG_ERR, "Unable to close worker socket: %s",
+                strerror(errno));
+        }
+        conf->workerFd = -1;
+    }
     if (conf->objs) {
         list_destroy(conf->objs);
     }
@@ -315,6 +370,12 @@ void destroy_server_conf(server_conf_t *conf)
     destroy_string(conf->logFmtName);
     destroy_string(conf->pidFileName);
     destroy_string(conf->resetCmd);
+    destroy_string(conf->sinkName);
+    destroy_string(conf->tlsCertFile);
+    destroy_string(conf->tlsKeyFile);
+#if WITH_OPENSSL
+    destroy_tls_context(conf);
+#endif /* WITH_OPENSSL */
     free(conf);
     return;
 }
@@ -405,14 +466,17 @@ void process_config(server_conf_t *conf)
     }
     /*  Must use a read lock here since the file is only open for reading.
      *    Exclusive access is ensured by testing for a write lock afterwards.
+     *  A worker proc relies on the lock held by its supervisor.
      */
-    if (get_read_lock(conf->fd) < 0) {
-        log_err(0, "Unable to lock configuration \"%s\"",
-            conf->confFileName);
-    }
-    if ((pid = is_write_lock_blocked(conf->fd)) > 0) {
-        log_err(0, "Configuration \"%s\" in use by pid %d",
-            conf->confFileName, pid);
+    if (conf->workerIndex < 0) {
+        if (get_read_lock(conf->fd) < 0) {
+            log_err(0, "Unable to lock configuration \"%s\"",
+                conf->confFileName);
+        }
+        if ((pid = is_write_lock_blocked(conf->fd)) > 0) {
+            log_err(0, "Configuration \"%s\" in use by pid %d",
+                conf->confFileName, pid);
+        }
     }
     /*  Read config into memory for parsing.
      */
@@ -470,7 +534,13 @@ void process_config(server_conf_t *conf)
             conf->logFmtName = create_string(conf->logFileName);
         }
     }
-    if (conf->pidFileName) {
+    /*  The pidfile belongs to the supervisor; a worker must not remove it.
+     */
+    if (conf->pidFileName && (conf->workerIndex >= 0)) {
+        destroy_string(conf->pidFileName);
+        conf->pidFileName = NULL;
+    }
+    else if (conf->pidFileName) {
         if (write_pidfile(conf->pidFileName) < 0) {
             free(conf->pidFileName);
             conf->pidFileName = NULL;   /* prevent unlink() at exit */
@@ -581,7 +651,8 @@ static void signal_daemon(server_conf_t *conf)
 static void parse_console_directive(server_conf_t *conf, Lex l)
 {
 /*  CONSOLE NAME="<str>" DEV="<file>" [LOG="<file>"]
- *    [LOGOPTS="<str>"] [SEROPTS="<str>"] [IPMIOPTS="<str>"] [TESTOPTS="<str>"]
+ *    [LOGOPTS="<str>"] [SEROPTS="<str>"] [IPMIOPTS="<str>"]
+ *    [TELNETOPTS="<str>"] [TESTOPTS="<str>"] [SCREEN=(ON|OFF)]
  *  Note: IPMIOPTS is only available if WITH_FREEIPMI is defined.
  */
     const char *directive;              /* name of directive being parsed */
@@ -592,6 +663,7 @@ static void parse_console_directive(server_conf_t *conf, Lex l)
     console_strs_t con;
 
     memset(&con, 0, sizeof(con));
+    con.screen = -1;
 
     directive = lex_tok_to_str(l, lex_prev(l));
     if (!directive) {
@@ -676,6 +748,23 @@ static void parse_console_directive(server_conf_t *conf, Lex l)
             }
             break;
 
+        case SERVER_CONF_SCREEN:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) == SERVER_CONF_ON) {
+                con.screen = 1;
+            }
+            else if (lex_prev(l) == SERVER_CONF_OFF) {
+                con.screen = 0;
+            }
+            else {
+                snprintf(err, sizeof(err),
+                    "expected ON or OFF for %s value", tokstr);
+            }
+            break;
+
         case SERVER_CONF_SEROPTS:
             if (lex_next(l) != '=') {
                 snprintf(err, sizeof(err),
@@ -707,6 +796,21 @@ static void parse_console_directive(server_conf_t *conf, Lex l)
             break;
 #endif /* WITH_FREEIPMI */
 
+        case SERVER_CONF_TELNETOPTS:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if ((lex_next(l) != LEX_STR)
+                    || is_empty_string(lex_text(l))) {
+                snprintf(err, sizeof(err),
+                    "expected STRING for %s value", tokstr);
+            }
+            else {
+                replace_string(&con.nopts, lex_text(l));
+            }
+            break;
+
         case SERVER_CONF_TESTOPTS:
             if (lex_next(l) != '=') {
                 snprintf(err, sizeof(err),
@@ -758,6 +862,7 @@ static void parse_console_directive(server_conf_t *conf, Lex l)
 #if WITH_FREEIPMI
     destroy_string(con.iopts);
 #endif /* WITH_FREEIPMI */
+    destroy_string(con.nopts);
     destroy_string(con.topts);
     return;
 }
@@ -778,6 +883,7 @@ static int process_console(server_conf_t *conf, console_strs_t *con_p,
     char        *path = NULL;
     obj_t       *console;
     seropt_t     seropts;
+    telnetopt_t  telnetopts;
 #if WITH_FREEIPMI
     ipmiopt_t    ipmiopts;
 #endif /* WITH_FREEIPMI */
@@ -819,6 +925,18 @@ static int process_console(server_conf_t *conf, console_strs_t *con_p,
             "console [%s] dev string is empty", con_p->name);
         goto err;
     }
+    /*  A supervisor only registers the console for routing requests to the
+     *    worker owning it.  A worker only creates the consoles it owns.
+     */
+    if ((conf->numWorkers > 0) && (conf->workerIndex < 0)) {
+        add_worker_console(con_p->name);
+        list_destroy(args);
+        return(0);
+    }
+    if ((conf->workerIndex >= 0) && !is_worker_console(conf, con_p->name)) {
+        list_destroy(args);
+        return(0);
+    }
     if (is_unixsock_dev(arg0, conf->cwd, &path)) {
         if (list_count(args) != 1) {
             snprintf(errbuf, errbuflen,
@@ -838,8 +956,13 @@ static int process_console(server_conf_t *conf, console_strs_t *con_p,
                 "console [%s] dev string has too many args", con_p->name);
             goto err;
         }
-        if (!(console = create_telnet_obj(
-                conf, con_p->name, host, port, errbuf, errbuflen))) {
+        telnetopts = conf->globalTelnetOpts;
+        if (con_p->nopts && parse_telnet_opts(
+                &telnetopts, con_p->nopts, errbuf, errbuflen) < 0) {
+            goto err;
+        }
+        if (!(console = create_telnet_obj(conf, con_p->name,
+                host, port, &telnetopts, errbuf, errbuflen))) {
             goto err;
         }
         free(host);
@@ -869,6 +992,15 @@ static int process_console(server_conf_t *conf, console_strs_t *con_p,
         free(path);
         path = NULL;
     }
+    else if (is_mux_dev(arg0, conf->cwd, conf->execPath, &path)) {
+        free(list_pop(args));
+        if (!(console = create_mux_obj(
+                conf, con_p->name, path, args, errbuf, errbuflen))) {
+            goto err;
+        }
+        free(path);
+        path = NULL;
+    }
     else if (is_process_dev(arg0, conf->cwd, conf->execPath, &path)) {
         free(list_pop(args));
         arg0 = list_push(args, path);
@@ -920,6 +1052,9 @@ static int process_console(server_conf_t *conf, console_strs_t *con_p,
             con_p->name, arg0);
         goto err;
     }
+    if ((con_p->screen > 0) || ((con_p->screen < 0) && conf->enableScreen)) {
+        console->history->enableScreen = 1;
+    }
     if ((con_p->log && con_p->log[ 0 ] != '\0')
             || (!con_p->log && conf->globalLogName)) {
         if (con_p->log) {
@@ -1024,6 +1159,23 @@ static void parse_global_directive(server_conf_t *conf, Lex l)
             }
             break;
 
+        case SERVER_CONF_SCREEN:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) == SERVER_CONF_ON) {
+                conf->enableScreen = 1;
+            }
+            else if (lex_prev(l) == SERVER_CONF_OFF) {
+                conf->enableScreen = 0;
+            }
+            else {
+                snprintf(err, sizeof(err),
+                    "expected ON or OFF for %s value", tokstr);
+            }
+            break;
+
         case SERVER_CONF_SEROPTS:
             if (lex_next(l) != '=') {
                 snprintf(err, sizeof(err),
@@ -1058,6 +1210,22 @@ static void parse_global_directive(server_conf_t *conf, Lex l)
             break;
 #endif /* WITH_FREEIPMI */
 
+        case SERVER_CONF_TELNETOPTS:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if ((lex_next(l) != LEX_STR)
+                    || is_empty_string(lex_text(l))) {
+                snprintf(err, sizeof(err),
+                    "expected STRING for %s value", tokstr);
+            }
+            else {
+                parse_telnet_opts(&conf->globalTelnetOpts, lex_text(l),
+                    err, sizeof(err));
+            }
+            break;
+
         case SERVER_CONF_TESTOPTS:
             if (lex_next(l) != '=') {
                 snprintf(err, sizeof(err),
@@ -1219,6 +1387,23 @@ static void parse_server_directive(server_conf_t *conf, Lex l)
             }
             break;
 
+        case SERVER_CONF_LATENCY:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) == SERVER_CONF_ON) {
+                conf->enableLatency = 1;
+            }
+            else if (lex_prev(l) == SERVER_CONF_OFF) {
+                conf->enableLatency = 0;
+            }
+            else {
+                snprintf(err, sizeof(err),
+                    "expected ON or OFF for %s value", tokstr);
+            }
+            break;
+
         case SERVER_CONF_LOGDIR:
             if (lex_next(l) != '=') {
                 snprintf(err, sizeof(err),
@@ -1327,6 +1512,24 @@ static void parse_server_directive(server_conf_t *conf, Lex l)
             }
             break;
 
+        case SERVER_CONF_PIPELINE:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if (((n = atoi(lex_text(l))) < 0) || (n > PIPE_MAX_THREADS)) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                conf->numPipeThreads = n;
+            }
+            break;
+
         case SERVER_CONF_PORT:
             if (lex_next(l) != '=') {
                 snprintf(err, sizeof(err),
@@ -1345,6 +1548,24 @@ static void parse_server_directive(server_conf_t *conf, Lex l)
             }
             break;
 
+        case SERVER_CONF_RESETBATCH:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if ((n = atoi(lex_text(l))) <= 0) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                conf->resetBatch = n;
+            }
+            break;
+
         case SERVER_CONF_RESETCMD:
             if (lex_next(l) != '=') {
                 snprintf(err, sizeof(err),
@@ -1368,6 +1589,64 @@ static void parse_server_directive(server_conf_t *conf, Lex l)
             }
             break;
 
+        case SERVER_CONF_RESETMAX:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if ((n = atoi(lex_text(l))) < 0) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                conf->resetMax = n;
+            }
+            break;
+
+        case SERVER_CONF_SINK:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if ((lex_next(l) != LEX_STR)
+                    || is_empty_string(lex_text(l))) {
+                snprintf(err, sizeof(err),
+                    "expected STRING for %s value", tokstr);
+            }
+            else {
+                destroy_string(conf->sinkName);
+                if (lex_text(l)[0] != '/') {
+                    conf->sinkName = create_format_string("%s/%s",
+                        conf->cwd, lex_text(l));
+                }
+                else {
+                    conf->sinkName = create_string(lex_text(l));
+                }
+            }
+            break;
+
+        case SERVER_CONF_STALLTIME:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if ((n = atoi(lex_text(l))) < 0) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                conf->stallMsecs = n;
+            }
+            break;
+
         case SERVER_CONF_SYSLOG:
             if (lex_next(l) != '=') {
                 snprintf(err, sizeof(err),
@@ -1409,6 +1688,24 @@ static void parse_server_directive(server_conf_t *conf, Lex l)
 #endif /* WITH_TCP_WRAPPERS */
             break;
 
+        case SERVER_CONF_TIMERSLACK:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if ((n = atoi(lex_text(l))) < 0) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                conf->timerSlackMsecs = n;
+            }
+            break;
+
         case SERVER_CONF_TIMESTAMP:
             if (lex_next(l) != '=') {
                 snprintf(err, sizeof(err),
@@ -1456,6 +1753,88 @@ static void parse_server_directive(server_conf_t *conf, Lex l)
             }
             break;
 
+        case SERVER_CONF_TLSCERT:
+        case SERVER_CONF_TLSKEY:
+#if ! WITH_OPENSSL
+            snprintf(err, sizeof(err),
+                "%s keyword requires compile-time support", tokstr);
+#else /* WITH_OPENSSL */
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if ((lex_next(l) != LEX_STR)
+                    || is_empty_string(lex_text(l))) {
+                snprintf(err, sizeof(err),
+                    "expected STRING for %s value", tokstr);
+            }
+            else {
+                char **pp = (tok == SERVER_CONF_TLSCERT)
+                    ? &conf->tlsCertFile : &conf->tlsKeyFile;
+
+                destroy_string(*pp);
+                if (lex_text(l)[0] != '/') {
+                    *pp = create_format_string("%s/%s",
+                        conf->cwd, lex_text(l));
+                }
+                else {
+                    *pp = create_string(lex_text(l));
+                }
+            }
+#endif /* WITH_OPENSSL */
+            break;
+
+        case SERVER_CONF_TLSREQUIRE:
+#if ! WITH_OPENSSL
+            snprintf(err, sizeof(err),
+                "%s keyword requires compile-time support", tokstr);
+#else /* WITH_OPENSSL */
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) == SERVER_CONF_ON) {
+                conf->enableTLSRequire = 1;
+            }
+            else if (lex_prev(l) == SERVER_CONF_OFF) {
+                conf->enableTLSRequire = 0;
+            }
+            else {
+                snprintf(err, sizeof(err),
+                    "expected ON or OFF for %s value", tokstr);
+            }
+#endif /* WITH_OPENSSL */
+            break;
+
+        case SERVER_CONF_WORKERS:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if (((n = atoi(lex_text(l))) < 0) || (n > WORKER_MAX_PROCS)) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else if (!list_is_empty(conf->objs)
+                    || (get_num_worker_consoles() > 0)) {
+                snprintf(err, sizeof(err),
+                    "%s keyword must precede all CONSOLE directives", tokstr);
+            }
+            else if (conf->workerIndex >= 0) {
+                if (n != conf->numWorkers) {
+                    snprintf(err, sizeof(err),
+                        "%s value changed since supervisor started", tokstr);
+                }
+            }
+            else {
+                conf->numWorkers = n;
+            }
+            break;
+
         case LEX_EOF:
         case LEX_EOL:
             done = 1;
@@ -29,8 +29,6 @@
 #include <arpa/telnet.h>
 #include <assert.h>
 #include <errno.h>
-#include <fcntl.h>
-#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -46,13 +44,15 @@
 extern tpoll_t tp_global;               /* defined in server.c */
 
 
+static int perform_client_control(obj_t *client, unsigned char c);
 static void perform_serial_break(obj_t *client);
 static void perform_del_char_seq(obj_t *client);
 static void perform_console_writer_linkage(obj_t *client);
 static void perform_log_replay(obj_t *client);
+static void perform_lines_replay(obj_t *client);
 static void perform_quiet_toggle(obj_t *client);
 static void perform_reset(obj_t *client);
-static void kill_reset_cmd(obj_t *console);
+static void perform_screen_redraw(obj_t *client);
 static void perform_suspend(obj_t *client);
 
 
@@ -74,53 +74,15 @@ int process_client_escapes(obj_t *client, void *src, int len)
         return(0);
 
     for (p=q=src; p<last; p++) {
-        if (client->aux.client.gotEscape) {
-            client->aux.client.gotEscape = 0;
-            switch (*p) {
-            case ESC_CHAR:
+        if (client->aux->client.gotEscape) {
+            client->aux->client.gotEscape = 0;
+            if (*p == ESC_CHAR)
                 *q++ = *p;
-                break;
-            case ESC_CHAR_BREAK:
-                perform_serial_break(client);
-                break;
-            case ESC_CHAR_DEL:          /* XXX: gnats:100 del char kludge */
-                perform_del_char_seq(client);
-                break;
-            case ESC_CHAR_FORCE:
-                client->aux.client.req->enableForce = 1;
-                client->aux.client.req->enableJoin = 0;
-                perform_console_writer_linkage(client);
-                break;
-            case ESC_CHAR_JOIN:
-                client->aux.client.req->enableForce = 0;
-                client->aux.client.req->enableJoin = 1;
-                perform_console_writer_linkage(client);
-                break;
-            case ESC_CHAR_REPLAY:
-                perform_log_replay(client);
-                break;
-            case ESC_CHAR_MONITOR:
-                client->aux.client.req->enableForce = 0;
-                client->aux.client.req->enableJoin = 0;
-                perform_console_writer_linkage(client);
-                break;
-            case ESC_CHAR_QUIET:
-                perform_quiet_toggle(client);
-                break;
-            case ESC_CHAR_RESET:
-                perform_reset(client);
-                break;
-            case ESC_CHAR_SUSPEND:
-                perform_suspend(client);
-                break;
-            default:
-                log_msg(LOG_WARNING, "Received invalid escape '%c' from %s",
-                    *p, client->name);
-                break;
-            }
+            else
+                (void) perform_client_control(client, *p);
         }
         else if (*p == ESC_CHAR) {
-            client->aux.client.gotEscape = 1;
+            client->aux->client.gotEscape = 1;
         }
         else {
             *q++ = *p;
@@ -133,6 +95,130 @@ int process_client_escapes(obj_t *client, void *src, int len)
 }
 
 
+int process_client_frames(obj_t *client, void *src, int len)
+{
+/*  Processes the buffer (src) of length (len) received from a client
+ *    whose input is framed.
+ *  Frame headers and CTRL frames are removed from the buffer, and each
+ *    ctrl code is immediately processed.  The payloads of DATA frames are
+ *    moved down in bulk without being scanned.  Frames may be split across
+ *    calls, so the partial state is kept in the client obj.
+ *  Since a frame header cannot be resynchronized once the stream is corrupt,
+ *    a header with an unknown type or empty payload, or a CTRL frame with
+ *    an unknown ctrl code, is rejected.
+ *  Returns the new length of the modified buffer,
+ *    or -1 if the client is to be shut down.
+ */
+    client_obj_t *auxp;
+    const unsigned char *last = (unsigned char *) src + len;
+    unsigned char *p, *q;
+    int n, i;
+
+    assert(is_client_obj(client));
+    assert(client->fd >= 0);
+
+    if (!src || len <= 0)
+        return(0);
+
+    auxp = &(client->aux->client);
+
+    for (p=q=src; p<last; p+=n) {
+        if (auxp->frameLeft == 0) {
+            n = MIN(CONMAN_FRAME_HDR_LEN - auxp->frameHdrLen, last - p);
+            memcpy(auxp->frameHdr + auxp->frameHdrLen, p, n);
+            auxp->frameHdrLen += n;
+            if (auxp->frameHdrLen == CONMAN_FRAME_HDR_LEN) {
+                auxp->frameHdrLen = 0;
+                auxp->frameLeft =
+                    (auxp->frameHdr[1] << 8) | auxp->frameHdr[2];
+                if (((auxp->frameHdr[0] != CONMAN_FRAME_DATA)
+                        && (auxp->frameHdr[0] != CONMAN_FRAME_CTRL))
+                        || (auxp->frameLeft == 0)) {
+                    log_msg(LOG_WARNING,
+                        "Received invalid frame type=%d len=%d from %s",
+                        auxp->frameHdr[0], auxp->frameLeft, client->name);
+                    return(-1);
+                }
+            }
+            continue;
+        }
+        n = MIN(auxp->frameLeft, last - p);
+        auxp->frameLeft -= n;
+
+        if (auxp->frameHdr[0] == CONMAN_FRAME_DATA) {
+            if (q != p)
+                memmove(q, p, n);
+            q += n;
+        }
+        else {
+            assert(auxp->frameHdr[0] == CONMAN_FRAME_CTRL);
+            for (i = 0; i < n; i++)
+                if (perform_client_control(client, p[i]) < 0)
+                    return(-1);
+        }
+    }
+    assert((q >= (unsigned char *) src) && (q <= p));
+    len = q - (unsigned char *) src;
+    assert(len >= 0);
+    return(len);
+}
+
+
+static int perform_client_control(obj_t *client, unsigned char c)
+{
+/*  Performs the action requested by the ctrl code (c) received from the
+ *    client, whether via an escape sequence or a CTRL frame.
+ *  Returns 0 on success, or -1 if the ctrl code is invalid.
+ */
+    switch (c) {
+    case ESC_CHAR_BREAK:
+        perform_serial_break(client);
+        break;
+    case ESC_CHAR_DEL:                  /* XXX: gnats:100 del char kludge */
+        perform_del_char_seq(client);
+        break;
+    case ESC_CHAR_FORCE:
+        client->aux->client.req->enableForce = 1;
+        client->aux->client.req->enableJoin = 0;
+        perform_console_writer_linkage(client);
+        break;
+    case ESC_CHAR_JOIN:
+        client->aux->client.req->enableForce = 0;
+        client->aux->client.req->enableJoin = 1;
+        perform_console_writer_linkage(client);
+        break;
+    case ESC_CHAR_REPLAY:
+        perform_log_replay(client);
+        break;
+    case ESC_CHAR_LINES:
+        perform_lines_replay(client);
+        break;
+    case ESC_CHAR_MONITOR:
+        client->aux->client.req->enableForce = 0;
+        client->aux->client.req->enableJoin = 0;
+        perform_console_writer_linkage(client);
+        break;
+    case ESC_CHAR_QUIET:
+        perform_quiet_toggle(client);
+        break;
+    case ESC_CHAR_RESET:
+        perform_reset(client);
+        break;
+    case ESC_CHAR_SCREEN:
+        perform_screen_redraw(client);
+        break;
+    case ESC_CHAR_SUSPEND:
+        perform_suspend(client);
+        break;
+    default:
+        log_msg(LOG_WARNING, "Received invalid escape '%c' from %s",
+            c, client->name);
+        return(-1);
+    }
+    return(0);
+}
+
+
 static void perform_serial_break(obj_t *client)
 {
 /*  Transmits a serial-break to each of the consoles written to by the client.
@@ -164,6 +250,13 @@ static void perform_serial_break(obj_t *client)
             brk[1] = ESC_CHAR_BREAK;
             write_obj_data(console, &brk, 2, 0);
         }
+        else if (is_mux_obj(console)) {
+            if (send_mux_break(console) < 0) {
+                log_msg(LOG_WARNING,
+                    "Unable to send serial-break to console [%s]",
+                    console->name);
+            }
+        }
         else if (is_serial_obj(console)) {
             if (tcsendbreak(console->fd, 0) < 0)
                 log_msg(LOG_WARNING,
@@ -230,9 +323,10 @@ static void perform_console_writer_linkage(obj_t *client)
 
     assert(is_client_obj(client));
 
-    /*  Broadcast sessions are treated as a no-op.
+    /*  Broadcast and coalesced monitor sessions are treated as a no-op.
      */
-    if (client->aux.client.req->enableBroadcast)
+    if (client->aux->client.req->enableBroadcast
+      || client->aux->client.req->enableCoalesce)
         return;
     assert(list_count(client->readers) <= 1);
 
@@ -248,11 +342,11 @@ static void perform_console_writer_linkage(obj_t *client)
     gotWrite = list_count(client->readers);
 
     if (gotWrite) {
-        client->aux.client.req->command = CONMAN_CMD_MONITOR;
+        client->aux->client.req->command = CONMAN_CMD_MONITOR;
         unlink_objs(client, console);
     }
     else {
-        client->aux.client.req->command = CONMAN_CMD_CONNECT;
+        client->aux->client.req->command = CONMAN_CMD_CONNECT;
         link_objs(client, console);
     }
     return;
@@ -391,6 +485,62 @@ static void perform_log_replay(obj_t *client)
 }
 
 
+static void perform_lines_replay(obj_t *client)
+{
+/*  Replays the last lines of console output retained in the history of the
+ *    console associated with this client (in either a R/O or R/W session,
+ *    but not a B/C session).  The number of lines is that requested by the
+ *    client when connecting, or LINE_REPLAY_NUM by default.
+ *  Unlike a log replay, the replay begins on a line boundary and does not
+ *    require the console to be logged.
+ */
+    obj_t *console;
+    char buf[MAX_LINE];
+    unsigned long long offset;
+    int num;
+    int n;
+
+    assert(is_client_obj(client));
+
+    /*  Broadcast sessions are "write-only", so the replay is a no-op.
+     */
+    if (list_is_empty(client->writers))
+        return;
+
+    /*  The client will have exactly one writer in either a R/O or R/W session.
+     */
+    assert(list_count(client->writers) == 1);
+    console = list_peek(client->writers);
+    assert(is_console_obj(console));
+    assert(console->history != NULL);
+
+    num = client->aux->client.req->numLines;
+    if (num <= 0) {
+        num = LINE_REPLAY_NUM;
+    }
+    x_pthread_mutex_lock(&console->history->lock);
+
+    offset = find_history_lines(console->history, num);
+    n = snprintf(buf, sizeof(buf), "%sBegin replay of last %d line%s"
+        " of console [%s]%s", CONMAN_MSG_PREFIX, num, (num == 1 ? "" : "s"),
+        console->name, CONMAN_MSG_SUFFIX);
+    assert((n >= 0) && ((size_t) n < sizeof(buf)));
+    write_obj_data(client, buf, n, 0);
+
+    (void) write_history_to_obj(console->history, &offset, client);
+
+    n = snprintf(buf, sizeof(buf), "%sEnd replay of console [%s]%s",
+        CONMAN_MSG_PREFIX, console->name, CONMAN_MSG_SUFFIX);
+    assert((n >= 0) && ((size_t) n < sizeof(buf)));
+    write_obj_data(client, buf, n, 0);
+
+    x_pthread_mutex_unlock(&console->history->lock);
+
+    DPRINTF((5, "Performing lines replay on console [%s].\n", console->name));
+    return;
+}
+
+
 static void perform_quiet_toggle(obj_t *client)
 {
 /*  Toggles whether informational messages are suppressed by the client.
@@ -400,9 +550,9 @@ static void perform_quiet_toggle(obj_t *client)
 
     assert(is_client_obj(client));
 
-    client->aux.client.req->enableQuiet ^= 1;
+    client->aux->client.req->enableQuiet ^= 1;
 
-    if (client->aux.client.req->enableQuiet)
+    if (client->aux->client.req->enableQuiet)
         op = "enabled", action = "suppressed";
     else
         op = "disabled", action = "displayed";
@@ -424,21 +574,13 @@ static void perform_quiet_toggle(obj_t *client)
 static void perform_reset(obj_t *client)
 {
 /*  Resets all consoles for which this client has write-access.
+ *  The resets are queued and run subject to the ResetCmd concurrency limit.
  */
-    int dev_null;
     ListIterator i;
     obj_t *console;
-    char cmd[MAX_LINE];
 
     assert(is_client_obj(client));
 
-    dev_null = open("/dev/null", O_RDWR);
-    if (dev_null < 0) {
-        log_msg(LOG_WARNING,
-            "Unable to open \"/dev/null\" for console reset: %s",
-            strerror(errno));
-    }
-
     i = list_iterator_create(client->readers);
     while ((console = list_next(i))) {
 
@@ -447,104 +589,56 @@ static void perform_reset(obj_t *client)
         if (console->resetCmdRef == NULL) {
             continue;
         }
-        if (console->resetCmdPid > 0) {
-            write_notify_msg(console, LOG_INFO,
-                "Ignoring reset of console [%s]: pid %d still active",
-                console->name, (int) console->resetCmdPid);
-            continue;
-        }
-        if (format_obj_string(
-                cmd, sizeof(cmd), console, console->resetCmdRef) < 0) {
-            write_notify_msg(console, LOG_WARNING,
-                "Unable to reset console [%s]: command too long",
-                console->name);
-            continue;
-        }
-        console->resetCmdPid = fork();
-        if (console->resetCmdPid < 0) {
-            write_notify_msg(console, LOG_WARNING,
-                "Unable to reset console [%s]: fork failed: %s",
-                console->name, strerror(errno));
-            continue;
-        }
-        else if (console->resetCmdPid == 0) {
-            setpgid(console->resetCmdPid, 0);
-            if (dev_null < 0) {
-                (void) close(STDIN_FILENO);
-                (void) close(STDOUT_FILENO);
-                (void) close(STDERR_FILENO);
-            }
-            else {
-                (void) dup2(dev_null, STDIN_FILENO);
-                (void) dup2(dev_null, STDOUT_FILENO);
-                (void) dup2(dev_null, STDERR_FILENO);
-                if (dev_null > STDERR_FILENO) {
-                    (void) close(dev_null);
-                }
-            }
-            execl("/bin/sh", "sh", "-c", cmd, (char *) NULL);
-            _exit(127);                 /* execl() error */
-        }
-        /*  Both parent and child call setpgid() to make the child a process
-         *    group leader.  One of these calls is redundant, but by doing
-         *    both we avoid a race condition.  (cf. APUE 9.4 p244)
-         */
-        setpgid(console->resetCmdPid, 0);
-
-        write_notify_msg(console, LOG_NOTICE,
-            "Console [%s] reset by <%s@%s> (pid %d)",
-            console->name, client->aux.client.req->user,
-            client->aux.client.req->host, (int) console->resetCmdPid);
-
-        /*  Set a timer to ensure the reset cmd does not exceed its time limit.
-         */
-        console->resetCmdTimer = tpoll_timeout_relative(tp_global,
-            (callback_f) kill_reset_cmd, console, RESET_CMD_TIMEOUT * 1000);
-        if (console->resetCmdTimer < 0) {
-            write_notify_msg(console, LOG_WARNING,
-                "Unable to create timer for reset of console [%s]: %s",
-                console->name, strerror(errno));
-        }
+        queue_reset_cmd(console, client);
     }
     list_iterator_destroy(i);
 
-    if ((dev_null >= 0) && (close(dev_null) < 0)) {
-        log_msg(LOG_WARNING,
-            "Unable to close \"/dev/null\" for console reset: %s",
-            strerror(errno));
-    }
+    run_reset_cmds();
     return;
 }
 
 
-static void kill_reset_cmd(obj_t *console)
+static void perform_screen_redraw(obj_t *client)
 {
-/*  Terminates the "ResetCmd" process associated with 'console' if it has
- *    exceeded its time limit.
+/*  Redraws the screen of the console associated with this client
+ *    (in either a R/O or R/W session, but not a B/C session).
+ *  The redraw is written directly to the client, bypassing any filters.
  */
-    pid_t pid;
-
-    assert(console != NULL);
+    obj_t *console;
+    char buf[MAX_LINE];
+    int n;
 
-    pid = console->resetCmdPid;
-    console->resetCmdPid = 0;
-    console->resetCmdTimer = 0;
+    assert(is_client_obj(client));
 
-    if (pid <= 0) {
-        return;
-    }
-    if (kill(pid, 0) < 0) {             /* process is no longer running */
+    /*  Broadcast sessions are "write-only", so the redraw is a no-op.
+     */
+    if (list_is_empty(client->writers))
         return;
+
+    /*  The client will have exactly one writer in either a R/O or R/W session.
+     */
+    assert(list_count(client->writers) == 1);
+    console = list_peek(client->writers);
+    assert(is_console_obj(console));
+    assert(console->history != NULL);
+
+    x_pthread_mutex_lock(&console->history->lock);
+    if (!console->history->enableScreen) {
+        n = 0;
+        snprintf(buf, sizeof(buf),
+            "%sConsole [%s] screen is not being modeled -- cannot redraw%s",
+            CONMAN_MSG_PREFIX, console->name, CONMAN_MSG_SUFFIX);
     }
-    if (kill(-pid, SIGKILL) == 0) {     /* kill entire process group */
-        log_msg(LOG_NOTICE,
-            "Console [%s] reset terminated after %ds (pid %d)",
-            console->name, RESET_CMD_TIMEOUT, (int) pid);
+    else if ((n = write_screen_to_obj(console->history, client)) <= 0) {
+        snprintf(buf, sizeof(buf),
+            "%sConsole [%s] has no screen output to redraw%s",
+            CONMAN_MSG_PREFIX, console->name, CONMAN_MSG_SUFFIX);
     }
-    else {
-        log_msg(LOG_WARNING,
-            "Unable to terminate console [%s] reset after %ds (pid %d): %s",
-            console->name, RESET_CMD_TIMEOUT, (int) pid, strerror(errno));
+    x_pthread_mutex_unlock(&console->history->lock);
+
+    if (n <= 0) {
+        buf[sizeof(buf) - 1] = '\0';
+        write_obj_data(client, buf, strlen(buf), 1);
     }
     return;
 }
@@ -559,9 +653,9 @@ static void perform_suspend(obj_t *client)
  */
     assert(is_client_obj(client));
 
-    client->aux.client.gotSuspend ^= 1;
+    client->aux->client.gotSuspend ^= 1;
 
-    if (client->aux.client.gotSuspend) {
+    if (client->aux->client.gotSuspend) {
         tpoll_clear(tp_global, client->fd, POLLOUT);
     }
     else {
@@ -572,6 +666,6 @@ static void perform_suspend(obj_t *client)
      *    Should it check the state of all readers & writers?
      */
     log_msg(LOG_INFO, "Client <%s> %s", client->name,
-        (client->aux.client.gotSuspend ? "suspended" : "resumed"));
+        (client->aux->client.gotSuspend ? "suspended" : "resumed"));
     return;
 }
@@ -0,0 +1,647 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <ctype.h>
+#include <regex.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "list.h"
+#include "log.h"
+#include "server.h"
+#include "tpoll.h"
+#include "util-str.h"
+#include "util.h"
+#include "wrapper.h"
+
+
+/*  An EXECUTE request runs a send/expect script on each of its consoles
+ *    concurrently from the mux thread.  Each console's run is linked into
+ *    the console's history and fed the console's output as it is fanned out
+ *    by write_readers_data(); output is matched against the current expect
+ *    regex within a sliding window of the most recent EXEC_WINDOW_SIZE bytes.
+ *  Results are prefixed with the console name and streamed back over the
+ *    client's connection.  Since a burst of results from many consoles can
+ *    exceed the client's circular-buffer, they are queued and only moved into
+ *    the buffer as there is room, thereby ensuring none are overwritten.
+ *    If the client falls too far behind, captured output lines are dropped
+ *    and the client is informed of the number lost; the final status of each
+ *    run is always reported.
+ *    The client is closed once all runs have finished and been reported.
+ *
+ *  A console's list of runs is protected by its history lock.  The remaining
+ *    job & run state is only accessed by the mux thread once the job has been
+ *    started.
+ */
+
+static int parse_exec_string(char *str);
+static void start_exec_runs(exec_job_t *job);
+static int step_exec_run(exec_run_t *run);
+static void append_exec_window(exec_run_t *run, const void *src, int len);
+static int match_exec_run(exec_run_t *run, exec_step_t *step);
+static void expire_exec_run(exec_run_t *run);
+static void finish_exec_run(exec_run_t *run, const char *errmsg);
+static void append_exec_capture(exec_run_t *run, const char *src, int len);
+static int find_exec_run(exec_run_t *run, exec_run_t *key);
+
+extern tpoll_t tp_global;               /* defined in server.c */
+
+
+exec_job_t * create_exec_job(req_t *req, char *errbuf, int errlen)
+{
+/*  Creates a job for running the request's (req) script.
+ *  Returns the new job, or NULL on error (writing a message into errbuf).
+ */
+    exec_job_t *job;
+    ListIterator i;
+    step_t *step;
+    exec_step_t *s;
+    int rc;
+    int gotError = 0;
+    char buf[MAX_LINE];
+
+    assert(req != NULL);
+    assert(req->command == CONMAN_CMD_EXECUTE);
+
+    if (list_is_empty(req->script)) {
+        snprintf(errbuf, errlen, "Found no script steps");
+        return(NULL);
+    }
+    if (!(job = malloc(sizeof(exec_job_t)))) {
+        out_of_memory();
+    }
+    if (!(job->steps = calloc(list_count(req->script), sizeof(exec_step_t)))) {
+        out_of_memory();
+    }
+    job->client = NULL;
+    job->numSteps = 0;
+    job->runs = list_create((ListDelF) free);
+    job->results = list_create((ListDelF) destroy_string);
+    job->timer = -1;
+    job->numDone = 0;
+    job->numFailed = 0;
+    job->numDropped = 0;
+    job->isStarted = 0;
+    job->isFinished = 0;
+
+    i = list_iterator_create(req->script);
+    while (!gotError && (step = list_next(i))) {
+        s = &job->steps[job->numSteps];
+        s->type = step->type;
+        s->str = step->str ? create_string(step->str) : NULL;
+        s->len = 0;
+        s->val = step->val;
+        job->numSteps++;
+
+        if (s->type == CONMAN_STEP_SEND) {
+            s->len = parse_exec_string(s->str);
+        }
+        else if (s->type == CONMAN_STEP_EXPECT) {
+            rc = regcomp(&s->regex, s->str, REG_EXTENDED | REG_NEWLINE);
+            if (rc != 0) {
+                regerror(rc, &s->regex, buf, sizeof(buf));
+                snprintf(errbuf, errlen, "Bad expect regex \"%s\": %s",
+                    s->str, buf);
+                /*
+                 *  The failed regex must not be freed by destroy_exec_job().
+                 */
+                s->type = CONMAN_STEP_SEND;
+                gotError = 1;
+            }
+        }
+        else if ((s->type == CONMAN_STEP_TIMEOUT) && (s->val < 0)) {
+            snprintf(errbuf, errlen, "Bad timeout of %d secs", s->val);
+            gotError = 1;
+        }
+    }
+    list_iterator_destroy(i);
+
+    if (gotError) {
+        destroy_exec_job(job);
+        return(NULL);
+    }
+    return(job);
+}
+
+
+void destroy_exec_job(exec_job_t *job)
+{
+/*  Destroys the script (job).
+ *  This does not touch the job's consoles since they may have already been
+ *    destroyed at exit; cancel_exec_job() unlinks a job from its consoles.
+ */
+    int i;
+
+    if (!job) {
+        return;
+    }
+    for (i = 0; i < job->numSteps; i++) {
+        if (job->steps[i].type == CONMAN_STEP_EXPECT) {
+            regfree(&job->steps[i].regex);
+        }
+        if (job->steps[i].str) {
+            free(job->steps[i].str);
+        }
+    }
+    free(job->steps);
+    list_destroy(job->runs);
+    list_destroy(job->results);
+    free(job);
+    return;
+}
+
+
+void start_exec_job(exec_job_t *job, obj_t *client)
+{
+/*  Starts running the script (job) on the consoles of the (client) request.
+ *  This is invoked by create_client_obj() before the client is published.
+ *  The runs are started by the mux thread, which performs all subsequent
+ *    processing of the job.
+ */
+    assert(job != NULL);
+    assert(is_client_obj(client));
+    assert(job->client == NULL);
+
+    job->client = client;
+    client->aux->client.exec = job;
+    job->timer = tpoll_timeout_relative(tp_global,
+        (callback_f) start_exec_runs, job, 0);
+    if (job->timer < 0) {
+        log_err(0, "Unable to create timer to start script on [%s]",
+            client->name);
+    }
+    return;
+}
+
+
+void cancel_exec_job(exec_job_t *job)
+{
+/*  Cancels the script (job), unlinking its unfinished runs from their
+ *    consoles and discarding any unwritten results.
+ *  This is invoked by the mux thread when the job's client is shut down.
+ */
+    ListIterator i;
+    exec_run_t *run;
+
+    assert(job != NULL);
+
+    if (job->timer > 0) {
+        (void) tpoll_timeout_cancel(tp_global, job->timer);
+        job->timer = -1;
+    }
+    i = list_iterator_create(job->runs);
+    while ((run = list_next(i))) {
+        if (run->isDone) {
+            continue;
+        }
+        x_pthread_mutex_lock(&run->console->history->lock);
+        list_delete_all(run->console->history->execs,
+            (ListFindF) find_exec_run, run);
+        x_pthread_mutex_unlock(&run->console->history->lock);
+        if (run->timer > 0) {
+            (void) tpoll_timeout_cancel(tp_global, run->timer);
+            run->timer = -1;
+        }
+        run->isDone = 1;
+    }
+    list_iterator_destroy(i);
+
+    if (job->numDone < list_count(job->runs)) {
+        log_msg(LOG_INFO, "Client <%s> canceled script on %d console%s",
+            job->client->name, list_count(job->runs) - job->numDone,
+            ((list_count(job->runs) - job->numDone) == 1 ? "" : "s"));
+    }
+    list_destroy(job->results);
+    job->results = list_create((ListDelF) destroy_string);
+    job->numDropped = 0;
+    job->isFinished = 1;
+    return;
+}
+
+
+void write_exec_data(obj_t *console, const void *src, int len)
+{
+/*  Writes the buffer (src) of length (len) read from the (console)
+ *    to each script run on that console, advancing runs through their
+ *    scripts as their expects are matched.
+ *  The console's history lock must be held by the caller.
+ */
+    ListIterator i;
+    exec_run_t *run;
+
+    assert(is_console_obj(console));
+    assert(console->history != NULL);
+
+    i = list_iterator_create(console->history->execs);
+    while ((run = list_next(i))) {
+        append_exec_window(run, src, len);
+        if (step_exec_run(run)) {
+            list_remove(i);
+        }
+        flush_exec_results(run->job);
+    }
+    list_iterator_destroy(i);
+    return;
+}
+
+
+void flush_exec_results(exec_job_t *job)
+{
+/*  Moves as many of the script (job) results into its client's buffer
+ *    as will fit without overwriting unwritten data.  Once all runs have
+ *    finished and been reported, the client is marked for shutdown.
+ */
+    obj_t *client;
+    char *str;
+    int avail;
+    int n;
+
+    assert(job != NULL);
+
+    client = job->client;
+    if (!client || job->isFinished) {
+        return;
+    }
+    avail = get_obj_buf_avail(client);
+
+    if (job->numDropped > 0) {
+        str = create_format_string(
+            "<ConMan> Dropped %d line%s of captured output.\n",
+            job->numDropped, (job->numDropped == 1 ? "" : "s"));
+        n = strlen(str);
+        if (n <= avail) {
+            avail -= write_obj_data(client, str, n, 0);
+            job->numDropped = 0;
+        }
+        free(str);
+        if (job->numDropped > 0) {
+            return;
+        }
+    }
+    while ((str = list_peek(job->results))) {
+        n = strlen(str);
+        if ((n > avail) && (avail < OBJ_BUF_SIZE - 1)) {
+            return;
+        }
+        avail -= write_obj_data(client, str, n, 0);
+        destroy_string(list_pop(job->results));
+    }
+    if (job->isStarted && (job->numDone == list_count(job->runs))) {
+        job->isFinished = 1;
+        x_pthread_mutex_lock(&client->bufLock);
+        client->gotEOF = 1;
+        x_pthread_mutex_unlock(&client->bufLock);
+        tpoll_set(tp_global, client->fd, POLLOUT);
+    }
+    return;
+}
+
+
+static int parse_exec_string(char *str)
+{
+/*  Expands C-style escape sequences in the NUL-terminated (str) in-place.
+ *    The expanded string may contain NULs.
+ *  Returns the length of the expanded string.
+ */
+    char *p, *q;
+    int i, n;
+
+    assert(str != NULL);
+
+    for (p = q = str; *p; p++) {
+        if ((*p != '\\') || (*(p + 1) == '\0')) {
+            *q++ = *p;
+            continue;
+        }
+        switch (*++p) {
+        case 'a':
+            *q++ = '\a';
+            break;
+        case 'b':
+            *q++ = '\b';
+            break;
+        case 'e':
+            *q++ = 0x1B;
+            break;
+        case 'f':
+            *q++ = '\f';
+            break;
+        case 'n':
+            *q++ = '\n';
+            break;
+        case 'r':
+            *q++ = '\r';
+            break;
+        case 't':
+            *q++ = '\t';
+            break;
+        case 'v':
+            *q++ = '\v';
+            break;
+        case 'x':
+            for (i = 0, n = 0; (i < 2) && isxdigit((int) *(p + 1)); i++) {
+                n = (n * 16) + toint(*++p);
+            }
+            *q++ = (i > 0) ? n : 'x';
+            break;
+        case '0': case '1': case '2': case '3':
+        case '4': case '5': case '6': case '7':
+            n = *p - '0';
+            for (i = 1; (i < 3) && (*(p + 1) >= '0') && (*(p + 1) <= '7');
+                    i++) {
+                n = (n * 8) + (*++p - '0');
+            }
+            *q++ = n;
+            break;
+        default:
+            *q++ = *p;
+            break;
+        }
+    }
+    *q = '\0';
+    return(q - str);
+}
+
+
+static void start_exec_runs(exec_job_t *job)
+{
+/*  Starts running the script (job) on each of its consoles.
+ *  This timer callback is invoked by the mux thread.
+ */
+    obj_t *client;
+    ListIterator i;
+    obj_t *console;
+    exec_run_t *run;
+
+    assert(job != NULL);
+    assert(job->client != NULL);
+
+    job->timer = -1;
+    client = job->client;
+
+    i = list_iterator_create(client->aux->client.req->consoles);
+    while ((console = list_next(i))) {
+        assert(is_console_obj(console));
+        assert(console->history != NULL);
+
+        if (!(run = malloc(sizeof(exec_run_t)))) {
+            out_of_memory();
+        }
+        run->job = job;
+        run->console = console;
+        run->step = 0;
+        run->timeout = DEFAULT_EXEC_TIMEOUT;
+        run->timer = -1;
+        run->len = 0;
+        run->buf[0] = '\0';
+        run->isCapturing = 0;
+        run->isDone = 0;
+        list_append(job->runs, run);
+
+        x_pthread_mutex_lock(&console->history->lock);
+        if (!step_exec_run(run)) {
+            list_append(console->history->execs, run);
+        }
+        x_pthread_mutex_unlock(&console->history->lock);
+    }
+    list_iterator_destroy(i);
+
+    job->isStarted = 1;
+    flush_exec_results(job);
+    return;
+}
+
+
+static int step_exec_run(exec_run_t *run)
+{
+/*  Advances the script (run) through its steps until it must wait for
+ *    console output to match an expect, or it has finished.
+ *  The console's history lock must be held by the caller.
+ *  Returns 1 if the run has finished (and must be removed from the console's
+ *    list of runs), or 0 if it is waiting on an expect.
+ */
+    exec_job_t *job;
+    exec_step_t *step;
+
+    assert(run != NULL);
+    assert(!run->isDone);
+
+    job = run->job;
+    while (run->step < job->numSteps) {
+        step = &job->steps[run->step];
+        switch (step->type) {
+        case CONMAN_STEP_CAPTURE:
+            run->isCapturing = (step->val != 0);
+            break;
+        case CONMAN_STEP_EXPECT:
+            if (!match_exec_run(run, step)) {
+                if ((run->timer < 0) && (run->timeout > 0)) {
+                    run->timer = tpoll_timeout_relative(tp_global,
+                        (callback_f) expire_exec_run, run,
+                        run->timeout * 1000);
+                }
+                return(0);
+            }
+            if (run->timer > 0) {
+                (void) tpoll_timeout_cancel(tp_global, run->timer);
+                run->timer = -1;
+            }
+            break;
+        case CONMAN_STEP_SEND:
+            (void) write_obj_data(run->console, step->str, step->len, 0);
+            break;
+        case CONMAN_STEP_TIMEOUT:
+            run->timeout = step->val;
+            break;
+        }
+        run->step++;
+    }
+    finish_exec_run(run, NULL);
+    return(1);
+}
+
+
+static void append_exec_window(exec_run_t *run, const void *src, int len)
+{
+/*  Appends the buffer (src) of length (len) to the output window of the
+ *    script (run).  When the window fills, the oldest half is discarded
+ *    (being captured first if capture is enabled).  The discard ends at the
+ *    last newline within that half so a partial line is carried forward to
+ *    be captured whole; only a line longer than half the window is split.
+ *    NULs are dropped so the window can be matched as a string.
+ */
+    const char *p = src;
+    const char *q = p + len;
+    int n;
+
+    while (p < q) {
+        if (run->len == EXEC_WINDOW_SIZE) {
+            for (n = EXEC_WINDOW_SIZE / 2;
+                    (n > 0) && (run->buf[n - 1] != '\n'); n--) {;}
+            if (n == 0) {
+                n = EXEC_WINDOW_SIZE / 2;
+            }
+            if (run->isCapturing) {
+                append_exec_capture(run, run->buf, n);
+            }
+            memmove(run->buf, run->buf + n, run->len - n);
+            run->len -= n;
+        }
+        if (*p != '\0') {
+            run->buf[run->len++] = *p;
+        }
+        p++;
+    }
+    run->buf[run->len] = '\0';
+    return;
+}
+
+
+static int match_exec_run(exec_run_t *run, exec_step_t *step)
+{
+/*  Matches the output window of the script (run) against the regex of the
+ *    expect (step).  On a match, output through the end of the match is
+ *    consumed from the window (being captured first if capture is enabled).
+ *  Returns 1 if the expect was matched, or 0 if not.
+ */
+    regmatch_t match;
+
+    assert(step->type == CONMAN_STEP_EXPECT);
+
+    if (regexec(&step->regex, run->buf, 1, &match, 0) != 0) {
+        return(0);
+    }
+    if (run->isCapturing) {
+        append_exec_capture(run, run->buf, match.rm_eo);
+    }
+    memmove(run->buf, run->buf + match.rm_eo, run->len - match.rm_eo + 1);
+    run->len -= match.rm_eo;
+    return(1);
+}
+
+
+static void expire_exec_run(exec_run_t *run)
+{
+/*  Fails the script (run) after having timed-out waiting on an expect.
+ *  This timer callback is invoked by the mux thread.
+ */
+    obj_t *console;
+    char buf[MAX_LINE];
+
+    assert(run != NULL);
+    assert(!run->isDone);
+
+    run->timer = -1;
+    console = run->console;
+
+    x_pthread_mutex_lock(&console->history->lock);
+    list_delete_all(console->history->execs,
+        (ListFindF) find_exec_run, run);
+    snprintf(buf, sizeof(buf), "timed out after %d sec%s waiting for \"%s\"",
+        run->timeout, (run->timeout == 1 ? "" : "s"),
+        run->job->steps[run->step].str);
+    finish_exec_run(run, buf);
+    x_pthread_mutex_unlock(&console->history->lock);
+
+    flush_exec_results(run->job);
+    return;
+}
+
+
+static void finish_exec_run(exec_run_t *run, const char *errmsg)
+{
+/*  Marks the script (run) as finished, queueing its result.
+ *    If (errmsg) is non-NULL, the run has failed.
+ */
+    exec_job_t *job;
+
+    assert(run != NULL);
+    assert(!run->isDone);
+
+    job = run->job;
+    run->isDone = 1;
+    job->numDone++;
+    if (errmsg) {
+        job->numFailed++;
+    }
+    list_append(job->results, create_format_string("%s: %s\n",
+        run->console->name, (errmsg ? errmsg : "completed")));
+
+    if ((job->numDone == list_count(job->client->aux->client.req->consoles))
+            && !job->client->aux->client.req->enableQuiet) {
+        list_append(job->results, create_format_string(
+            "<ConMan> Script completed on %d of %d console%s.\n",
+            job->numDone - job->numFailed, job->numDone,
+            (job->numDone == 1 ? "" : "s")));
+    }
+    return;
+}
+
+
+static void append_exec_capture(exec_run_t *run, const char *src, int len)
+{
+/*  Queues the captured output (src) of length (len) from the script (run)
+ *    as a result line for each line of output, dropping carriage-returns.
+ *  Lines are dropped (and counted) once EXEC_MAX_RESULTS results are queued.
+ */
+    exec_job_t *job;
+    const char *p, *q, *r;
+    int n;
+
+    job = run->job;
+    p = src;
+    q = src + len;
+    while (p < q) {
+        if (!(r = memchr(p, '\n', q - p))) {
+            r = q;
+        }
+        for (n = r - p; (n > 0) && (p[n - 1] == '\r'); n--) {;}
+        while ((n > 0) && (*p == '\r')) {
+            p++, n--;
+        }
+        if (list_count(job->results) < EXEC_MAX_RESULTS) {
+            list_append(job->results, create_format_string("%s: %.*s\n",
+                run->console->name, n, p));
+        }
+        else {
+            job->numDropped++;
+        }
+        p = r + 1;
+    }
+    return;
+}
+
+
+static int find_exec_run(exec_run_t *run, exec_run_t *key)
+{
+/*  Used by list_delete_all() to locate the run specified by (key).
+ *  Returns non-zero if (run == key); o/w returns zero.
+ */
+    return(run == key);
+}
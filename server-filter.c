@@ -0,0 +1,481 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <stdlib.h>
+#include "common.h"
+#include "list.h"
+#include "log.h"
+#include "server.h"
+#include "util-str.h"
+#include "util.h"
+
+
+/*  Output filters rewrite console output as it is fanned out to logfiles
+ *    and clients.  A logfile owns its filter state.  A client requesting
+ *    output filtering shares the filter state kept in the console's history
+ *    with every other client on that console requesting the same filter,
+ *    so each distinct filter is applied only once per write.  The console's
+ *    filters are protected by its history lock.
+ */
+
+/*  The filter engine must be inlined into each of its specialized variants
+ *    for the option tests to be resolved at compile-time.  Variants exist for
+ *    the option combinations used by logfiles (sanitize and/or timestamp) and
+ *    for CR/LF normalization alone; combinations including ANSI stripping
+ *    are only requested by clients and use the generic routine.
+ *  The variants can be compared against the generic routine with
+ *    "make bench" (cf., test/filter-bench.c).
+ */
+#ifdef __GNUC__
+#  define FILTER_INLINE inline __attribute__((always_inline))
+#else /* !__GNUC__ */
+#  define FILTER_INLINE inline
+#endif /* !__GNUC__ */
+
+typedef struct filter_arg {
+    obj_t           *console;
+    unsigned         opts;
+} filter_arg_t;
+
+static FILTER_INLINE int filter_data_opts(filter_t *filter,
+    const unsigned char *src, int len, filter_flush_f flush, void *arg,
+    const unsigned opts);
+static int filter_data_crlf(filter_t *filter,
+    const unsigned char *src, int len, filter_flush_f flush, void *arg);
+static int filter_data_sanitize(filter_t *filter,
+    const unsigned char *src, int len, filter_flush_f flush, void *arg);
+static int filter_data_timestamp(filter_t *filter,
+    const unsigned char *src, int len, filter_flush_f flush, void *arg);
+static int filter_data_sanitize_timestamp(filter_t *filter,
+    const unsigned char *src, int len, filter_flush_f flush, void *arg);
+static int filter_data_generic(filter_t *filter,
+    const unsigned char *src, int len, filter_flush_f flush, void *arg);
+static int filter_ansi_char(filter_t *filter, int c);
+static int write_filter_obj(void *arg, const void *buf, int len);
+static int write_filter_clients(void *arg, const void *buf, int len);
+
+void init_filter(filter_t *filter, unsigned opts)
+{
+/*  Initializes the (filter) state for the CONMAN_FILTER_* options (opts).
+ */
+    assert(filter != NULL);
+    assert((opts & ~CONMAN_FILTER_MASK) == 0);
+
+    /*  Since CR/LF line terminations are normalized whenever any filtering
+     *    is enabled, CONMAN_FILTER_NEWLINE does not affect the choice of
+     *    variant.
+     */
+    switch (opts & ~CONMAN_FILTER_NEWLINE) {
+    case 0:
+        filter->process = (opts) ? filter_data_crlf : NULL;
+        break;
+    case CONMAN_FILTER_SANITIZE:
+        filter->process = filter_data_sanitize;
+        break;
+    case CONMAN_FILTER_TIMESTAMP:
+        filter->process = filter_data_timestamp;
+        break;
+    case CONMAN_FILTER_SANITIZE | CONMAN_FILTER_TIMESTAMP:
+        filter->process = filter_data_sanitize_timestamp;
+        break;
+    default:
+        filter->process = filter_data_generic;
+        break;
+    }
+    filter->opts = opts;
+    filter->lineState = CONMAN_LOG_LINE_INIT;
+    filter->ansiState = CONMAN_ANSI_NONE;
+    return;
+}
+
+
+int filter_data(filter_t *filter, const void *src, int len,
+    filter_flush_f flush, void *arg)
+{
+/*  Applies the (filter) to the buffer (src) of length (len), passing the
+ *    result to the (flush) function along with (arg) in one or more chunks;
+ *    the original (src) buffer is not modified.
+ *  If any filtering is enabled, CR/LF line terminations are normalized.
+ *  If ANSI stripping is enabled, escape sequences are removed.
+ *  If sanitizing is enabled, data is stripped to 7-bit ASCII and
+ *    control/binary characters are displayed as two-character printable
+ *    sequences.
+ *  If newline timestamping is enabled, the current timestamp is appended
+ *    after each newline.
+ *  The processing is performed by the routine selected for the filter's
+ *    options when the filter was initialized.
+ *  Returns the sum of the values returned by (flush).
+ */
+    assert(filter != NULL);
+    assert(flush != NULL);
+
+    if (!filter->process) {
+        return(flush(arg, src, len));
+    }
+    return(filter->process(filter, src, len, flush, arg));
+}
+
+
+int write_filtered_obj_data(obj_t *obj, filter_t *filter,
+    const void *src, int len)
+{
+/*  Writes the buffer (src) of length (len) into the circular-buffer
+ *    of (obj) after applying the (filter).
+ *  Returns the number of bytes written into the obj's buffer.
+ */
+    assert(obj != NULL);
+    assert(filter != NULL);
+
+    return(filter_data(filter, src, len, write_filter_obj, obj));
+}
+
+
+void write_filtered_readers_data(obj_t *console, const void *src, int len)
+{
+/*  Writes the buffer (src) of length (len) read from the (console) into the
+ *    circular-buffer of each client reader that requested output filtering.
+ *  Filter state for each distinct set of filter options in use is kept in
+ *    the console's history; state for filters no longer in use is discarded.
+ *  The history lock must be held by the caller.
+ */
+    ListIterator i;
+    obj_t *reader;
+    filter_t *filter;
+    unsigned used = 0;
+    unsigned missing;
+    unsigned opts;
+    filter_arg_t arg;
+
+    assert(is_console_obj(console));
+    assert(console->history != NULL);
+
+    i = list_iterator_create(console->readers);
+    while ((reader = list_next(i))) {
+        if (is_client_obj(reader) && reader->aux->client.req->filter) {
+            used |= 1 << reader->aux->client.req->filter;
+        }
+    }
+    list_iterator_destroy(i);
+
+    missing = used;
+    i = list_iterator_create(console->history->filters);
+    while ((filter = list_next(i))) {
+        if (used & (1 << filter->opts)) {
+            missing &= ~(1 << filter->opts);
+        }
+        else {
+            list_delete(i);
+        }
+    }
+    list_iterator_destroy(i);
+
+    for (opts = 1; missing != 0; opts++) {
+        if (missing & (1 << opts)) {
+            if (!(filter = malloc(sizeof(filter_t)))) {
+                out_of_memory();
+            }
+            init_filter(filter, opts);
+            list_append(console->history->filters, filter);
+            missing &= ~(1 << opts);
+        }
+    }
+
+    arg.console = console;
+    i = list_iterator_create(console->history->filters);
+    while ((filter = list_next(i))) {
+        arg.opts = filter->opts;
+        filter_data(filter, src, len, write_filter_clients, &arg);
+    }
+    list_iterator_destroy(i);
+    return;
+}
+
+
+static FILTER_INLINE int filter_data_opts(filter_t *filter,
+    const unsigned char *src, int len, filter_flush_f flush, void *arg,
+    const unsigned opts)
+{
+/*  Implements filter_data() for the CONMAN_FILTER_* options (opts).
+ *  Where (opts) is constant at the call site, the compiler generates a
+ *    variant of this routine without any per-byte option tests.
+ */
+    const int minbuf = 25;              /* cr/lf + timestamp + meta/char */
+    unsigned char buf[OBJ_BUF_SIZE - 1];
+    const unsigned char *p;
+    unsigned char *q;
+    const unsigned char * const qLast = buf + sizeof(buf);
+    int n = 0;
+
+    assert(sizeof(buf) >= (size_t) minbuf);
+
+    for (p=src, q=buf; len>0; p++, len--) {
+
+        if ((opts & CONMAN_FILTER_NOANSI)
+                && !filter_ansi_char(filter, *p)) {
+            continue;
+        }
+        /*  A newline state machine is used to properly sanitize CR/LF line
+         *    terminations.  This is responsible for coalescing multiple CRs,
+         *    swapping LF/CR to CR/LF, transcribing CR/NUL to CR/LF,
+         *    prepending a CR to a lonely LF, and appending a LF to a
+         *    lonely CR to prevent characters from being overwritten.
+         */
+        if (*p == '\r') {
+            if (filter->lineState == CONMAN_LOG_LINE_DATA) {
+                filter->lineState = CONMAN_LOG_LINE_CR;
+            }
+            else if (filter->lineState == CONMAN_LOG_LINE_INIT) {
+                if (opts & CONMAN_FILTER_TIMESTAMP)
+                    q += write_time_string(0, (char *) q, qLast - q);
+                filter->lineState = CONMAN_LOG_LINE_CR;
+            }
+            else {
+                ; /* ignore */
+            }
+        }
+        else if (*p == '\n') {
+            if (  (filter->lineState == CONMAN_LOG_LINE_INIT)
+               || (filter->lineState == CONMAN_LOG_LINE_LF) ) {
+                if (opts & CONMAN_FILTER_TIMESTAMP)
+                    q += write_time_string(0, (char *) q, qLast - q);
+            }
+            *q++ = '\r';
+            *q++ = '\n';
+            filter->lineState = CONMAN_LOG_LINE_LF;
+        }
+        else if (  (*p == '\0')
+                && (  (filter->lineState == CONMAN_LOG_LINE_CR)
+                   || (filter->lineState == CONMAN_LOG_LINE_LF) ) ) {
+            ; /* ignore */
+        }
+        else {
+            if (filter->lineState == CONMAN_LOG_LINE_CR) {
+                *q++ = '\r';
+                *q++ = '\n';
+            }
+            if (filter->lineState != CONMAN_LOG_LINE_DATA) {
+                if (opts & CONMAN_FILTER_TIMESTAMP)
+                    q += write_time_string(0, (char *) q, qLast - q);
+            }
+            filter->lineState = CONMAN_LOG_LINE_DATA;
+
+            if (opts & CONMAN_FILTER_SANITIZE) {
+
+                int c = *p & 0x7F;      /* strip data to 7-bit ASCII */
+
+                if (c < 0x20) {         /* ASCII ctrl-chars */
+                    *q++ = (*p & 0x80) ? '~' : '^';
+                    *q++ = c + '@';
+                }
+                else if (c == 0x7F) {   /* ASCII DEL char */
+                    *q++ = (*p & 0x80) ? '~' : '^';
+                    *q++ = '?';
+                }
+                else {
+                    if (*p & 0x80)
+                        *q++ = '`';
+                    *q++ = c;
+                }
+            }
+            else {
+                *q++ = *p;
+            }
+        }
+        /*  Flush internal buffer before it overruns.
+         */
+        if ((qLast - q) < minbuf) {
+            assert((q >= buf) && (q <= qLast));
+            n += flush(arg, buf, q - buf);
+            q = buf;
+        }
+    }
+    assert((q >= buf) && (q <= qLast));
+    if (q > buf) {
+        n += flush(arg, buf, q - buf);
+    }
+    return(n);
+}
+
+
+static int filter_data_crlf(filter_t *filter,
+    const unsigned char *src, int len, filter_flush_f flush, void *arg)
+{
+    return(filter_data_opts(filter, src, len, flush, arg,
+        0));
+}
+
+
+static int filter_data_sanitize(filter_t *filter,
+    const unsigned char *src, int len, filter_flush_f flush, void *arg)
+{
+    return(filter_data_opts(filter, src, len, flush, arg,
+        CONMAN_FILTER_SANITIZE));
+}
+
+
+static int filter_data_timestamp(filter_t *filter,
+    const unsigned char *src, int len, filter_flush_f flush, void *arg)
+{
+    return(filter_data_opts(filter, src, len, flush, arg,
+        CONMAN_FILTER_TIMESTAMP));
+}
+
+
+static int filter_data_sanitize_timestamp(filter_t *filter,
+    const unsigned char *src, int len, filter_flush_f flush, void *arg)
+{
+    return(filter_data_opts(filter, src, len, flush, arg,
+        CONMAN_FILTER_SANITIZE | CONMAN_FILTER_TIMESTAMP));
+}
+
+
+static int filter_data_generic(filter_t *filter,
+    const unsigned char *src, int len, filter_flush_f flush, void *arg)
+{
+    return(filter_data_opts(filter, src, len, flush, arg,
+        filter->opts));
+}
+
+
+static int filter_ansi_char(filter_t *filter, int c)
+{
+/*  Advances the (filter) ANSI escape sequence state for the character (c).
+ *  Control characters embedded within a sequence are still passed through
+ *    since terminals act on them as well.
+ *  Returns 1 if (c) is to be output, or 0 if it is to be stripped.
+ */
+    switch (filter->ansiState) {
+    case CONMAN_ANSI_NONE:
+        if (c == 0x1B) {
+            filter->ansiState = CONMAN_ANSI_ESC;
+            return(0);
+        }
+        return(1);
+    case CONMAN_ANSI_STR:
+        if (c == 0x07) {                /* BEL terminates string seq */
+            filter->ansiState = CONMAN_ANSI_NONE;
+        }
+        else if (c == 0x1B) {
+            filter->ansiState = CONMAN_ANSI_STR_ESC;
+        }
+        return(0);
+    case CONMAN_ANSI_STR_ESC:
+        if (c == '\\') {                /* ESC \ terminates string seq */
+            filter->ansiState = CONMAN_ANSI_NONE;
+            return(0);
+        }
+        filter->ansiState = CONMAN_ANSI_ESC;
+        /* fall through */
+    case CONMAN_ANSI_ESC:
+        if (c == '[') {
+            filter->ansiState = CONMAN_ANSI_CSI;
+            return(0);
+        }
+        if ((c == ']') || (c == 'P') || (c == 'X') || (c == '^')
+                || (c == '_')) {
+            filter->ansiState = CONMAN_ANSI_STR;
+            return(0);
+        }
+        if ((c >= 0x20) && (c <= 0x2F)) {
+            filter->ansiState = CONMAN_ANSI_INTER;
+            return(0);
+        }
+        if ((c >= 0x30) && (c <= 0x7E)) {
+            filter->ansiState = CONMAN_ANSI_NONE;
+            return(0);
+        }
+        break;
+    case CONMAN_ANSI_INTER:
+        if ((c >= 0x20) && (c <= 0x2F)) {
+            return(0);
+        }
+        if ((c >= 0x30) && (c <= 0x7E)) {
+            filter->ansiState = CONMAN_ANSI_NONE;
+            return(0);
+        }
+        break;
+    case CONMAN_ANSI_CSI:
+        if ((c >= 0x20) && (c <= 0x3F)) {
+            return(0);
+        }
+        if ((c >= 0x40) && (c <= 0x7E)) {
+            filter->ansiState = CONMAN_ANSI_NONE;
+            return(0);
+        }
+        break;
+    default:
+        log_err(0, "INTERNAL: Invalid ANSI filter state=%d",
+            filter->ansiState);
+        break;
+    }
+    /*  An unexpected character was encountered within a sequence.
+     */
+    if (c == 0x1B) {                    /* ESC restarts the seq */
+        filter->ansiState = CONMAN_ANSI_ESC;
+        return(0);
+    }
+    if ((c == 0x18) || (c == 0x1A)) {   /* CAN/SUB cancels the seq */
+        filter->ansiState = CONMAN_ANSI_NONE;
+        return(0);
+    }
+    if (c < 0x20) {
+        return(1);
+    }
+    filter->ansiState = CONMAN_ANSI_NONE;
+    return(1);
+}
+
+
+static int write_filter_obj(void *arg, const void *buf, int len)
+{
+/*  Flushes filtered data (buf) of length (len) to the obj (arg).
+ */
+    return(write_obj_data((obj_t *) arg, buf, len, 0));
+}
+
+
+static int write_filter_clients(void *arg, const void *buf, int len)
+{
+/*  Flushes filtered data (buf) of length (len) to each client reader of the
+ *    console whose requested filter options match those in (arg).
+ */
+    filter_arg_t *fa = arg;
+    ListIterator i;
+    obj_t *reader;
+
+    i = list_iterator_create(fa->console->readers);
+    while ((reader = list_next(i))) {
+        if (is_client_obj(reader)
+                && (reader->aux->client.req->filter == fa->opts)) {
+            write_obj_data(reader, buf, len, 0);
+        }
+    }
+    list_iterator_destroy(i);
+    return(len);
+}
@@ -0,0 +1,272 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "server.h"
+#include "util.h"
+#include "wrapper.h"
+
+
+/*  A console's history retains the most recent CONSOLE_HISTORY_SIZE bytes
+ *    of output read from it, along with the monotonically increasing offset
+ *    of that output within the console's stream.  The byte at stream offset
+ *    'n' is stored at buf[n % CONSOLE_HISTORY_SIZE] for as long as it
+ *    remains within the window [offset - CONSOLE_HISTORY_SIZE, offset).
+ *
+ *  The stream offsets at which lines start are indexed in a ring alongside
+ *    the buf so replays can begin on a clean line boundary.  Only the low
+ *    32 bits of each offset are stored; since an offset is only used while
+ *    within the window, the full offset is recovered relative to the end.
+ *
+ *  The buf & line index are not allocated until the first output is read,
+ *    since many consoles are idle or never connected; until then, the
+ *    history is an empty stream at offset 0.
+ *
+ *  The history lock must be held when accessing the history; it is also
+ *    held by write_readers_data() across the fan-out of data to the console's
+ *    readers so a client can be linked to the console at a precise offset.
+ */
+
+
+history_t * create_history(void)
+{
+/*  Creates and returns a new (empty) console history.
+ */
+    history_t *hist;
+
+    if (!(hist = malloc(sizeof(history_t)))) {
+        out_of_memory();
+    }
+    hist->buf = NULL;
+    hist->offset = 0;
+    hist->lines = NULL;
+    hist->numLines = 0;
+    hist->filters = list_create((ListDelF) free);
+    hist->coalesce = list_create(NULL);
+    hist->execs = list_create(NULL);
+    hist->screen = NULL;
+    hist->enableScreen = 0;
+    x_pthread_mutex_init(&hist->lock, NULL);
+    return(hist);
+}
+
+
+void destroy_history(history_t *hist)
+{
+/*  Destroys the console history (hist).
+ */
+    if (!hist) {
+        return;
+    }
+    list_destroy(hist->filters);
+    list_destroy(hist->coalesce);
+    list_destroy(hist->execs);
+    destroy_screen(hist->screen);
+    free(hist->buf);
+    free(hist->lines);
+    x_pthread_mutex_destroy(&hist->lock);
+    free(hist);
+    return;
+}
+
+
+void write_history_data(history_t *hist, const void *src, int len)
+{
+/*  Appends the buffer (src) of length (len) to the history (hist),
+ *    overwriting the oldest data as needed.  The buf & line index are
+ *    allocated upon the first output.
+ *  The history lock must be held by the caller.
+ */
+    const unsigned char *p = src;
+    const unsigned char *q;
+    int i;
+    int n;
+
+    assert(hist != NULL);
+
+    if (!src || (len <= 0)) {
+        return;
+    }
+    if (!hist->buf) {
+        if (!(hist->buf = malloc(CONSOLE_HISTORY_SIZE))) {
+            out_of_memory();
+        }
+        hist->lines = malloc(CONSOLE_HISTORY_LINES * sizeof(unsigned));
+        if (!hist->lines) {
+            out_of_memory();
+        }
+        assert(hist->offset == 0);
+        hist->lines[0] = 0;
+        hist->numLines = 1;
+    }
+    /*  Only the last CONSOLE_HISTORY_SIZE bytes of (src) can be retained.
+     */
+    if (len > CONSOLE_HISTORY_SIZE) {
+        hist->offset += len - CONSOLE_HISTORY_SIZE;
+        p += len - CONSOLE_HISTORY_SIZE;
+        len = CONSOLE_HISTORY_SIZE;
+    }
+    /*  Index the start of each line following a newline.
+     *  The scan uses memchr() since libc vectorizes it.
+     */
+    for (q = p; (q = memchr(q, '\n', p + len - q)); ) {
+        q++;
+        hist->lines[hist->numLines++ % CONSOLE_HISTORY_LINES] =
+            (unsigned) (hist->offset + (q - p));
+    }
+    i = hist->offset % CONSOLE_HISTORY_SIZE;
+    n = MIN(len, CONSOLE_HISTORY_SIZE - i);
+    memcpy(&hist->buf[i], p, n);
+    if (len > n) {
+        memcpy(hist->buf, p + n, len - n);
+    }
+    hist->offset += len;
+    return;
+}
+
+
+unsigned long long find_history_start(history_t *hist)
+{
+/*  Returns the stream offset of the oldest byte retained in (hist).
+ *  The history lock must be held by the caller.
+ */
+    assert(hist != NULL);
+
+    return((hist->offset > CONSOLE_HISTORY_SIZE)
+        ? hist->offset - CONSOLE_HISTORY_SIZE : 0);
+}
+
+
+unsigned long long find_history_offset(history_t *hist,
+    unsigned long long offset)
+{
+/*  Returns the stream offset at which output can be resumed from (hist)
+ *    given the requested (offset).  This is (offset) itself if the data
+ *    is still retained, the offset of the oldest byte retained if (offset)
+ *    precedes it, or the offset of the next byte to be read if (offset)
+ *    lies beyond the end of the stream.
+ */
+    unsigned long long oldest;
+
+    assert(hist != NULL);
+
+    x_pthread_mutex_lock(&hist->lock);
+    oldest = find_history_start(hist);
+    if (offset < oldest) {
+        offset = oldest;
+    }
+    else if (offset > hist->offset) {
+        offset = hist->offset;
+    }
+    x_pthread_mutex_unlock(&hist->lock);
+    return(offset);
+}
+
+
+unsigned long long find_history_lines(history_t *hist, int n)
+{
+/*  Returns the stream offset of the start of the last (n) lines retained
+ *    in (hist), not counting an empty line at the end of the stream.
+ *  If fewer lines are retained, the start of the oldest line retained is
+ *    returned; if no line start is retained, the end of the stream is.
+ *  The history lock must be held by the caller.
+ */
+    unsigned long long k;
+    unsigned long long i;
+    unsigned d;
+
+    assert(hist != NULL);
+
+    k = hist->numLines;
+    if ((k > 0) && (hist->lines[(k - 1) % CONSOLE_HISTORY_LINES]
+            == (unsigned) hist->offset)) {
+        k--;
+    }
+    i = (n <= 0) ? k : (k > (unsigned) n) ? k - n : 0;
+    if ((hist->numLines > CONSOLE_HISTORY_LINES)
+            && (i < hist->numLines - CONSOLE_HISTORY_LINES)) {
+        i = hist->numLines - CONSOLE_HISTORY_LINES;
+    }
+    for (; i < k; i++) {
+        d = (unsigned) hist->offset - hist->lines[i % CONSOLE_HISTORY_LINES];
+        if (d <= CONSOLE_HISTORY_SIZE) {
+            return(hist->offset - d);
+        }
+    }
+    return(hist->offset);
+}
+
+
+int write_history_to_obj(history_t *hist, unsigned long long *offset_p,
+    obj_t *dst)
+{
+/*  Writes the output retained in (hist) from the stream offset (*offset_p)
+ *    to the end of the stream into the circular-buffer of the (dst) obj.
+ *  If some of this data is no longer retained, (*offset_p) is advanced
+ *    to the oldest byte available.
+ *  The history lock must be held by the caller.
+ *  Returns the number of bytes written.
+ */
+    unsigned long long oldest;
+    filter_t filter;
+    unsigned opts;
+    int i;
+    int len;
+    int n;
+
+    assert(hist != NULL);
+    assert(offset_p != NULL);
+    assert(dst != NULL);
+
+    oldest = find_history_start(hist);
+    if (*offset_p < oldest) {
+        *offset_p = oldest;
+    }
+    if (!hist->buf || (*offset_p >= hist->offset)) {
+        return(0);
+    }
+    /*  Output replayed to a client requesting output filtering is filtered
+     *    afresh since the client does not yet share the console's filters.
+     */
+    opts = is_client_obj(dst) ? dst->aux->client.req->filter : 0;
+    init_filter(&filter, opts);
+
+    len = hist->offset - *offset_p;
+    i = *offset_p % CONSOLE_HISTORY_SIZE;
+    n = MIN(len, CONSOLE_HISTORY_SIZE - i);
+    write_filtered_obj_data(dst, &filter, &hist->buf[i], n);
+    if (len > n) {
+        write_filtered_obj_data(dst, &filter, hist->buf, len - n);
+    }
+    return(len);
+}
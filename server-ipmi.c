@@ -710,7 +710,7 @@ obj_t * create_ipmi_obj(server_conf_t *conf, char *name,
             }
             break;
         }
-        if (is_ipmi_obj(ipmi) && !strcmp(ipmi->aux.ipmi.host, host)) {
+        if (is_ipmi_obj(ipmi) && !strcmp(ipmi->aux->ipmi.host, host)) {
             if ((errbuf != NULL) && (errlen > 0)) {
                 snprintf(errbuf, errlen,
                     "console [%s] specifies duplicate hostname \"%s\"",
@@ -724,14 +724,14 @@ obj_t * create_ipmi_obj(server_conf_t *conf, char *name,
         return(NULL);
     }
     ipmi = create_obj(conf, name, -1, CONMAN_OBJ_IPMI);
-    ipmi->aux.ipmi.host = create_string(host);
-    ipmi->aux.ipmi.iconf = *iconf;
-    ipmi->aux.ipmi.ctx = NULL;
-    ipmi->aux.ipmi.logfile = NULL;
-    ipmi->aux.ipmi.state = CONMAN_IPMI_DOWN;
-    ipmi->aux.ipmi.timer = -1;
-    ipmi->aux.ipmi.delay = IPMI_MIN_TIMEOUT;
-    x_pthread_mutex_init(&ipmi->aux.ipmi.mutex, NULL);
+    ipmi->aux->ipmi.host = create_string(host);
+    ipmi->aux->ipmi.iconf = *iconf;
+    ipmi->aux->ipmi.ctx = NULL;
+    ipmi->aux->ipmi.logfile = NULL;
+    ipmi->aux->ipmi.state = CONMAN_IPMI_DOWN;
+    ipmi->aux->ipmi.timer = -1;
+    ipmi->aux->ipmi.delay = IPMI_MIN_TIMEOUT;
+    x_pthread_mutex_init(&ipmi->aux->ipmi.mutex, NULL);
     conf->numIpmiObjs++;
     /*
      *  Add obj to the master conf->objs list.
@@ -740,10 +740,11 @@ obj_t * create_ipmi_obj(server_conf_t *conf, char *name,
 
     DPRINTF((10,
         " IPMI [%s] H:%s U:%s P:%s K:%s L:%d C:%d W:0x%X\n",
-        ipmi->name, ipmi->aux.ipmi.host, ipmi->aux.ipmi.iconf.username,
-        ipmi->aux.ipmi.iconf.password, ipmi->aux.ipmi.iconf.kg,
-        ipmi->aux.ipmi.iconf.privilegeLevel, ipmi->aux.ipmi.iconf.cipherSuite,
-        ipmi->aux.ipmi.iconf.workaroundFlags));
+        ipmi->name, ipmi->aux->ipmi.host, ipmi->aux->ipmi.iconf.username,
+        ipmi->aux->ipmi.iconf.password, ipmi->aux->ipmi.iconf.kg,
+        ipmi->aux->ipmi.iconf.privilegeLevel,
+        ipmi->aux->ipmi.iconf.cipherSuite,
+        ipmi->aux->ipmi.iconf.workaroundFlags));
     return(ipmi);
 }
 
@@ -760,9 +761,9 @@ int open_ipmi_obj(obj_t *ipmi)
     assert(ipmi != NULL);
     assert(is_ipmi_obj(ipmi));
 
-    x_pthread_mutex_lock(&ipmi->aux.ipmi.mutex);
-    state = ipmi->aux.ipmi.state;
-    x_pthread_mutex_unlock(&ipmi->aux.ipmi.mutex);
+    x_pthread_mutex_lock(&ipmi->aux->ipmi.mutex);
+    state = ipmi->aux->ipmi.state;
+    x_pthread_mutex_unlock(&ipmi->aux->ipmi.mutex);
 
     if (state == CONMAN_IPMI_UP) {
         disconnect_ipmi_obj(ipmi);
@@ -772,8 +773,8 @@ int open_ipmi_obj(obj_t *ipmi)
         rc = connect_ipmi_obj(ipmi);
     }
     DPRINTF((9, "Opened [%s] via IPMI: fd=%d host=%s state=%d.\n",
-        ipmi->name, ipmi->fd, ipmi->aux.ipmi.host,
-        (int) ipmi->aux.ipmi.state));
+        ipmi->name, ipmi->fd, ipmi->aux->ipmi.host,
+        (int) ipmi->aux->ipmi.state));
     return(rc);
 }
 
@@ -783,33 +784,33 @@ static void disconnect_ipmi_obj(obj_t *ipmi)
 /*  Closes the existing connection with the specified 'ipmi' obj.
  */
     DPRINTF((10, "Disconnecting from <%s> via IPMI for [%s].\n",
-        ipmi->aux.ipmi.host, ipmi->name));
+        ipmi->aux->ipmi.host, ipmi->name));
 
-    x_pthread_mutex_lock(&ipmi->aux.ipmi.mutex);
+    x_pthread_mutex_lock(&ipmi->aux->ipmi.mutex);
 
-    if (ipmi->aux.ipmi.timer >= 0) {
-        (void) tpoll_timeout_cancel(tp_global, ipmi->aux.ipmi.timer);
-        ipmi->aux.ipmi.timer = -1;
+    if (ipmi->aux->ipmi.timer >= 0) {
+        (void) tpoll_timeout_cancel(tp_global, ipmi->aux->ipmi.timer);
+        ipmi->aux->ipmi.timer = -1;
     }
     if (ipmi->fd >= 0) {
         tpoll_clear(tp_global, ipmi->fd, POLLIN | POLLOUT);
         if (close(ipmi->fd) < 0) {
             log_msg(LOG_WARNING,
                 "Unable to close connection to <%s> for console [%s]: %s",
-                ipmi->aux.ipmi.host, ipmi->name, strerror(errno));
+                ipmi->aux->ipmi.host, ipmi->name, strerror(errno));
         }
         ipmi->fd = -1;
     }
     /*  Notify linked objs when transitioning from an UP state.
      */
-    if (ipmi->aux.ipmi.state == CONMAN_IPMI_UP) {
-        write_notify_msg(ipmi, LOG_INFO,
+    if (ipmi->aux->ipmi.state == CONMAN_IPMI_UP) {
+        write_notify_event(ipmi, CONMAN_SINK_DISCONNECT, LOG_INFO,
             "Console [%s] disconnected from <%s>",
-            ipmi->name, ipmi->aux.ipmi.host);
+            ipmi->name, ipmi->aux->ipmi.host);
     }
-    ipmi->aux.ipmi.state = CONMAN_IPMI_DOWN;
+    ipmi->aux->ipmi.state = CONMAN_IPMI_DOWN;
 
-    x_pthread_mutex_unlock(&ipmi->aux.ipmi.mutex);
+    x_pthread_mutex_unlock(&ipmi->aux->ipmi.mutex);
 
     return;
 }
@@ -825,7 +826,7 @@ static int connect_ipmi_obj(obj_t *ipmi)
  */
     int rc = 0;
 
-    x_pthread_mutex_lock(&ipmi->aux.ipmi.mutex);
+    x_pthread_mutex_lock(&ipmi->aux->ipmi.mutex);
 
     /*  The if-guard for a !UP state is to protect against a race-condition
      *    where both the main thread and the ipmiconsole engine thread call
@@ -836,27 +837,27 @@ static int connect_ipmi_obj(obj_t *ipmi)
      *  If the first thread fails to complete the connection, the subsequent
      *    thread will just retry a bit sooner than planned.
      */
-    if (ipmi->aux.ipmi.state != CONMAN_IPMI_UP) {
+    if (ipmi->aux->ipmi.state != CONMAN_IPMI_UP) {
 
-        if (ipmi->aux.ipmi.timer >= 0) {
-            (void) tpoll_timeout_cancel(tp_global, ipmi->aux.ipmi.timer);
-            ipmi->aux.ipmi.timer = -1;
+        if (ipmi->aux->ipmi.timer >= 0) {
+            (void) tpoll_timeout_cancel(tp_global, ipmi->aux->ipmi.timer);
+            ipmi->aux->ipmi.timer = -1;
         }
-        if (ipmi->aux.ipmi.state == CONMAN_IPMI_DOWN) {
+        if (ipmi->aux->ipmi.state == CONMAN_IPMI_DOWN) {
             rc = initiate_ipmi_connect(ipmi);
         }
-        else if (ipmi->aux.ipmi.state == CONMAN_IPMI_PENDING) {
+        else if (ipmi->aux->ipmi.state == CONMAN_IPMI_PENDING) {
             rc = complete_ipmi_connect(ipmi);
         }
         else {
             log_err(0, "Console [%s] in unexpected IPMI state=%d",
-                ipmi->name, (int) ipmi->aux.ipmi.state);
+                ipmi->name, (int) ipmi->aux->ipmi.state);
         }
         if (rc < 0) {
             fail_ipmi_connect(ipmi);
         }
     }
-    x_pthread_mutex_unlock(&ipmi->aux.ipmi.mutex);
+    x_pthread_mutex_unlock(&ipmi->aux->ipmi.mutex);
     return(rc);
 }
 
@@ -870,20 +871,20 @@ static int initiate_ipmi_connect(obj_t *ipmi)
  */
     int rc;
 
-    assert(ipmi->aux.ipmi.state == CONMAN_IPMI_DOWN);
+    assert(ipmi->aux->ipmi.state == CONMAN_IPMI_DOWN);
 
     if (create_ipmi_ctx(ipmi) < 0) {
         return(-1);
     }
     DPRINTF((10, "Connecting to <%s> via IPMI for [%s].\n",
-        ipmi->aux.ipmi.host, ipmi->name));
+        ipmi->aux->ipmi.host, ipmi->name));
 
-    rc = ipmiconsole_engine_submit(ipmi->aux.ipmi.ctx,
+    rc = ipmiconsole_engine_submit(ipmi->aux->ipmi.ctx,
         (Ipmiconsole_callback) connect_ipmi_obj, ipmi);
     if (rc < 0) {
         return(-1);
     }
-    ipmi->aux.ipmi.state = CONMAN_IPMI_PENDING;
+    ipmi->aux->ipmi.state = CONMAN_IPMI_PENDING;
     /*
      *  ipmiconsole_engine_submit() should always call its callback function,
      *    at which point the connection will be established or retried.
@@ -891,8 +892,8 @@ static int initiate_ipmi_connect(obj_t *ipmi)
      *  Any existing timer should have already been cancelled at the start of
      *    connect_ipmi_obj().
      */
-    assert(ipmi->aux.ipmi.timer == -1);
-    ipmi->aux.ipmi.timer = tpoll_timeout_relative(tp_global,
+    assert(ipmi->aux->ipmi.timer == -1);
+    ipmi->aux->ipmi.timer = tpoll_timeout_relative(tp_global,
         (callback_f) connect_ipmi_obj, ipmi,
         IPMI_CONNECT_TIMEOUT * 1000);
 
@@ -911,13 +912,13 @@ static int create_ipmi_ctx(obj_t *ipmi)
     struct ipmiconsole_protocol_config protocol_config;
     struct ipmiconsole_engine_config engine_config;
 
-    ipmi_config.username = ipmi->aux.ipmi.iconf.username;
-    ipmi_config.password = ipmi->aux.ipmi.iconf.password;
-    ipmi_config.k_g = ipmi->aux.ipmi.iconf.kg;
-    ipmi_config.k_g_len = ipmi->aux.ipmi.iconf.kgLen;
-    ipmi_config.privilege_level = ipmi->aux.ipmi.iconf.privilegeLevel;
-    ipmi_config.cipher_suite_id = ipmi->aux.ipmi.iconf.cipherSuite;
-    ipmi_config.workaround_flags = ipmi->aux.ipmi.iconf.workaroundFlags;
+    ipmi_config.username = ipmi->aux->ipmi.iconf.username;
+    ipmi_config.password = ipmi->aux->ipmi.iconf.password;
+    ipmi_config.k_g = ipmi->aux->ipmi.iconf.kg;
+    ipmi_config.k_g_len = ipmi->aux->ipmi.iconf.kgLen;
+    ipmi_config.privilege_level = ipmi->aux->ipmi.iconf.privilegeLevel;
+    ipmi_config.cipher_suite_id = ipmi->aux->ipmi.iconf.cipherSuite;
+    ipmi_config.workaround_flags = ipmi->aux->ipmi.iconf.workaroundFlags;
 
     protocol_config.session_timeout_len = -1;
     protocol_config.retransmission_timeout_len = -1;
@@ -934,13 +935,13 @@ static int create_ipmi_ctx(obj_t *ipmi)
     /*  A context cannot be submitted to the ipmiconsole engine more than once,
      *    so create a new context if one already exists.
      */
-    if (ipmi->aux.ipmi.ctx) {
-        ipmiconsole_ctx_destroy(ipmi->aux.ipmi.ctx);
+    if (ipmi->aux->ipmi.ctx) {
+        ipmiconsole_ctx_destroy(ipmi->aux->ipmi.ctx);
     }
-    ipmi->aux.ipmi.ctx = ipmiconsole_ctx_create(
-        ipmi->aux.ipmi.host, &ipmi_config, &protocol_config, &engine_config);
+    ipmi->aux->ipmi.ctx = ipmiconsole_ctx_create(
+        ipmi->aux->ipmi.host, &ipmi_config, &protocol_config, &engine_config);
 
-    if (!ipmi->aux.ipmi.ctx) {
+    if (!ipmi->aux->ipmi.ctx) {
         return(-1);
     }
     return(0);
@@ -956,20 +957,20 @@ static int complete_ipmi_connect(obj_t *ipmi)
  */
     ipmiconsole_ctx_status_t status;
 
-    assert(ipmi->aux.ipmi.state == CONMAN_IPMI_PENDING);
+    assert(ipmi->aux->ipmi.state == CONMAN_IPMI_PENDING);
 
-    status = ipmiconsole_ctx_status(ipmi->aux.ipmi.ctx);
+    status = ipmiconsole_ctx_status(ipmi->aux->ipmi.ctx);
     if (status != IPMICONSOLE_CTX_STATUS_SOL_ESTABLISHED) {
         return(-1);
     }
-    if ((ipmi->fd = ipmiconsole_ctx_fd(ipmi->aux.ipmi.ctx)) < 0) {
+    if ((ipmi->fd = ipmiconsole_ctx_fd(ipmi->aux->ipmi.ctx)) < 0) {
         return(-1);
     }
     set_fd_nonblocking(ipmi->fd);
     set_fd_closed_on_exec(ipmi->fd);
 
     ipmi->gotEOF = 0;
-    ipmi->aux.ipmi.state = CONMAN_IPMI_UP;
+    ipmi->aux->ipmi.state = CONMAN_IPMI_UP;
     tpoll_set(tp_global, ipmi->fd, POLLIN);
 
     /*  Require the connection to be up for a minimum length of time
@@ -977,16 +978,17 @@ static int complete_ipmi_connect(obj_t *ipmi)
      *  Any existing timer should have already been cancelled at the start of
      *    connect_ipmi_obj().
      */
-    assert(ipmi->aux.ipmi.timer == -1);
-    ipmi->aux.ipmi.timer = tpoll_timeout_relative(tp_global,
+    assert(ipmi->aux->ipmi.timer == -1);
+    ipmi->aux->ipmi.timer = tpoll_timeout_relative(tp_global,
         (callback_f) reset_ipmi_delay, ipmi, IPMI_MIN_TIMEOUT * 1000);
 
     /*  Notify linked objs when transitioning into an UP state.
      */
-    write_notify_msg(ipmi, LOG_INFO, "Console [%s] connected to <%s>",
-        ipmi->name, ipmi->aux.ipmi.host);
+    write_notify_event(ipmi, CONMAN_SINK_CONNECT, LOG_INFO,
+        "Console [%s] connected to <%s>",
+        ipmi->name, ipmi->aux->ipmi.host);
     DPRINTF((15, "Connection established to <%s> via IPMI for [%s].\n",
-        ipmi->aux.ipmi.host, ipmi->name));
+        ipmi->aux->ipmi.host, ipmi->name));
     return (0);
 }
 
@@ -998,35 +1000,36 @@ static void fail_ipmi_connect(obj_t *ipmi)
  *
  *  XXX: This routine assumes the ipmi obj mutex is already locked.
  */
-    ipmi->aux.ipmi.state = CONMAN_IPMI_DOWN;
+    ipmi->aux->ipmi.state = CONMAN_IPMI_DOWN;
 
-    if (!ipmi->aux.ipmi.ctx) {
+    if (!ipmi->aux->ipmi.ctx) {
         log_msg(LOG_INFO,
             "Unable to create IPMI context for [%s]", ipmi->name);
     }
     else {
-        int e = ipmiconsole_ctx_errnum(ipmi->aux.ipmi.ctx);
+        int e = ipmiconsole_ctx_errnum(ipmi->aux->ipmi.ctx);
         log_msg(LOG_INFO,
             "Unable to connect to <%s> via IPMI for [%s]: %s",
-            ipmi->aux.ipmi.host, ipmi->name, ipmiconsole_ctx_strerror(e));
+            ipmi->aux->ipmi.host, ipmi->name, ipmiconsole_ctx_strerror(e));
     }
     /*  Set timer for establishing new connection attempt.
      *  Any existing timer should have already been cancelled at the start of
      *    connect_ipmi_obj().
      */
-    assert(ipmi->aux.ipmi.delay >= IPMI_MIN_TIMEOUT);
-    assert(ipmi->aux.ipmi.delay <= IPMI_MAX_TIMEOUT);
+    assert(ipmi->aux->ipmi.delay >= IPMI_MIN_TIMEOUT);
+    assert(ipmi->aux->ipmi.delay <= IPMI_MAX_TIMEOUT);
     DPRINTF((15, "Reconnect attempt to <%s> via IPMI for [%s] in %ds.\n",
-        ipmi->aux.ipmi.host, ipmi->name, ipmi->aux.ipmi.delay));
-    assert(ipmi->aux.ipmi.timer == -1);
-    ipmi->aux.ipmi.timer = tpoll_timeout_relative(tp_global,
+        ipmi->aux->ipmi.host, ipmi->name, ipmi->aux->ipmi.delay));
+    assert(ipmi->aux->ipmi.timer == -1);
+    ipmi->aux->ipmi.timer = tpoll_timeout_relative(tp_global,
         (callback_f) connect_ipmi_obj, ipmi,
-        ipmi->aux.ipmi.delay * 1000);
+        ipmi->aux->ipmi.delay * 1000);
 
     /*  Update timer delay via exponential backoff.
      */
-    if (ipmi->aux.ipmi.delay < IPMI_MAX_TIMEOUT) {
-        ipmi->aux.ipmi.delay = MIN(ipmi->aux.ipmi.delay * 2, IPMI_MAX_TIMEOUT);
+    if (ipmi->aux->ipmi.delay < IPMI_MAX_TIMEOUT) {
+        ipmi->aux->ipmi.delay =
+            MIN(ipmi->aux->ipmi.delay * 2, IPMI_MAX_TIMEOUT);
     }
     return;
 }
@@ -1038,15 +1041,15 @@ static void reset_ipmi_delay(obj_t *ipmi)
  */
     assert(is_ipmi_obj(ipmi));
 
-    x_pthread_mutex_lock(&ipmi->aux.ipmi.mutex);
+    x_pthread_mutex_lock(&ipmi->aux->ipmi.mutex);
 
-    ipmi->aux.ipmi.delay = IPMI_MIN_TIMEOUT;
+    ipmi->aux->ipmi.delay = IPMI_MIN_TIMEOUT;
 
     /*  Also reset the timer ID since this routine is only invoked via a timer.
      */
-    ipmi->aux.ipmi.timer = -1;
+    ipmi->aux->ipmi.timer = -1;
 
-    x_pthread_mutex_unlock(&ipmi->aux.ipmi.mutex);
+    x_pthread_mutex_unlock(&ipmi->aux->ipmi.mutex);
     return;
 }
 
@@ -1061,16 +1064,16 @@ int send_ipmi_break(obj_t *ipmi)
     assert(ipmi != NULL);
     assert(is_ipmi_obj(ipmi));
 
-    x_pthread_mutex_lock(&ipmi->aux.ipmi.mutex);
-    if (!ipmi->aux.ipmi.ctx) {
+    x_pthread_mutex_lock(&ipmi->aux->ipmi.mutex);
+    if (!ipmi->aux->ipmi.ctx) {
         log_msg(LOG_ERR,
             "Unable to send serial-break to [%s]: NULL IPMI context",
             ipmi->name);
         rc = -1;
     }
     else {
-        rc = ipmiconsole_ctx_generate_break(ipmi->aux.ipmi.ctx);
+        rc = ipmiconsole_ctx_generate_break(ipmi->aux->ipmi.ctx);
     }
-    x_pthread_mutex_unlock(&ipmi->aux.ipmi.mutex);
+    x_pthread_mutex_unlock(&ipmi->aux->ipmi.mutex);
     return(rc);
 }
@@ -0,0 +1,496 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <sys/time.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "common.h"
+#include "list.h"
+#include "log.h"
+#include "server.h"
+#include "util.h"
+#include "wrapper.h"
+
+
+/*  If the Latency option is enabled, the time from when console output is
+ *    ingested by read_from_obj() until it is written out of the circular-buf
+ *    of each client & logfile reading it is recorded at chunk granularity.
+ *  The mux thread timestamps each chunk it reads from a console before
+ *    fanning it out to the console's readers.  When a timestamped chunk is
+ *    written into a reader's circular-buf, a mark is queued on the reader
+ *    noting the chunk's timestamp & the cumulative buf offset at which it
+ *    ends.  As the buf is drained by write_to_obj(), each mark whose offset
+ *    has been reached is dequeued and its latency recorded.  A reader queues
+ *    at most LATENCY_MAX_MARKS marks; once full, the newest mark is extended
+ *    to cover subsequent chunks, which thereby record the (earlier) ingest
+ *    time of the first.  Data that is overwritten or flushed before being
+ *    written out is not recorded.
+ *  Output from a logfile's pipeline carries the timestamp of the chunk from
+ *    which it was processed, so its latency includes time spent queued in
+ *    the pipeline.  For compressed & encrypted clients, data is considered
+ *    written out once it has been consumed from the circular-buf.  Output
+ *    from coalesced monitors & scripts is not timestamped.
+ *  Latencies are recorded in HDR-style log-linear histograms: each power-of-2
+ *    range of microseconds is divided into LATENCY_HIST_SUB_BINS bins, so
+ *    values are recorded with a relative precision of 1/LATENCY_HIST_SUB_BINS
+ *    regardless of magnitude.  A histogram is kept for each client & logfile
+ *    and for each console type.  Percentiles are logged on reconfig, and for
+ *    a client when it disconnects.
+ *  Marks & obj histograms are protected by the obj's bufLock.  The console
+ *    type histograms are only accessed by the mux thread.
+ */
+
+typedef struct latency_hist {           /* LATENCY HISTOGRAM:                */
+    unsigned long    count;             /*  num chunks recorded              */
+    unsigned long    maxUsecs;          /*  max latency recorded             */
+    unsigned         bins[LATENCY_HIST_BINS];  /* num chunks in each bin     */
+} latency_hist_t;
+
+typedef struct latency_mark {           /* INGESTED CHUNK MARK:              */
+    unsigned long    end;               /*  cumulative buf offset of its end */
+    ingest_t         ingest;            /*  ingest timestamp of chunk        */
+} latency_mark_t;
+
+struct latency {                        /* OBJ LATENCY STATE:                */
+    unsigned long    inTotal;           /*  num bytes written into buf       */
+    unsigned long    outTotal;          /*  num bytes written out of buf     */
+    int              markHead;          /*  index of oldest mark             */
+    int              numMarks;          /*  num marks queued                 */
+    latency_mark_t   marks[LATENCY_MAX_MARKS];  /* queue of pending marks    */
+    latency_hist_t   hist;              /*  latencies recorded for this obj  */
+};
+
+static void record_latency_hist(latency_hist_t *hist, unsigned long usecs);
+static int get_latency_bin(unsigned long usecs);
+static unsigned long get_latency_bin_max(int bin);
+static void log_latency_hist(const char *what, const latency_hist_t *hist);
+static char * format_latency(char *buf, int len, unsigned long usecs);
+static int get_obj_type_index(unsigned type);
+static unsigned long get_latency_usecs(void);
+
+static const char *typeNames[] = {
+    "client", "logfile", "process", "serial", "telnet", "unixsock",
+    "ipmi", "test", "helper", "mux", NULL
+};
+
+static int isLatencyEnabled = 0;
+static pthread_t ingestThread;
+static ingest_t ingestNow = { 0, -1 };
+static latency_hist_t typeHists[LATENCY_MAX_TYPES];
+
+
+void init_latency(server_conf_t *conf)
+{
+/*  Initializes latency recording if enabled by the configuration (conf),
+ *    creating the latency state of each logfile.  Clients created hereafter
+ *    are given their own via create_latency().  This must be called by the
+ *    mux thread.
+ */
+    ListIterator i;
+    obj_t *obj;
+
+    if (!conf->enableLatency) {
+        return;
+    }
+    ingestThread = pthread_self();
+    isLatencyEnabled = 1;
+
+    i = list_iterator_create(conf->objs);
+    while ((obj = list_next(i))) {
+        if (is_logfile_obj(obj) && !obj->latency) {
+            obj->latency = create_latency();
+        }
+    }
+    list_iterator_destroy(i);
+    return;
+}
+
+
+latency_t * create_latency(void)
+{
+/*  Creates the latency state for a client or logfile obj.
+ *  Returns the new state, or NULL if latency recording is not enabled.
+ */
+    latency_t *lat;
+
+    if (!isLatencyEnabled) {
+        return(NULL);
+    }
+    if (!(lat = malloc(sizeof(latency_t)))) {
+        out_of_memory();
+    }
+    memset(lat, 0, sizeof(latency_t));
+    return(lat);
+}
+
+
+void destroy_latency(latency_t *lat)
+{
+/*  Destroys the latency state (lat).
+ */
+    if (lat) {
+        free(lat);
+    }
+    return;
+}
+
+
+int get_latency_mem_size(void)
+{
+/*  Returns the number of bytes allocated for each obj's latency state.
+ */
+    return(sizeof(latency_t));
+}
+
+
+void begin_ingest(obj_t *console)
+{
+/*  Timestamps the chunk of output just read from the (console), so data
+ *    written into the circular-bufs of its readers is marked with it until
+ *    end_ingest() is called.  This is ignored unless called by the mux thread.
+ */
+    if (!isLatencyEnabled || !pthread_equal(pthread_self(), ingestThread)) {
+        return;
+    }
+    assert(is_console_obj(console));
+    ingestNow.usecs = get_latency_usecs();
+    ingestNow.type = get_obj_type_index(console->type);
+    return;
+}
+
+
+void end_ingest(void)
+{
+/*  Stops marking data written into circular-bufs with the timestamp set by
+ *    begin_ingest() or set_ingest().
+ */
+    if (!isLatencyEnabled || !pthread_equal(pthread_self(), ingestThread)) {
+        return;
+    }
+    ingestNow.type = -1;
+    return;
+}
+
+
+void get_ingest(ingest_t *ingest)
+{
+/*  Sets (ingest) to the timestamp of the chunk being fanned out by the
+ *    calling thread, or to an unset timestamp if none.
+ */
+    assert(ingest != NULL);
+
+    if (isLatencyEnabled && pthread_equal(pthread_self(), ingestThread)) {
+        *ingest = ingestNow;
+    }
+    else {
+        ingest->usecs = 0;
+        ingest->type = -1;
+    }
+    return;
+}
+
+
+void set_ingest(const ingest_t *ingest)
+{
+/*  Marks data subsequently written into circular-bufs by the mux thread with
+ *    the timestamp (ingest), which was previously obtained via get_ingest().
+ *  This must be called by the mux thread.
+ */
+    assert(ingest != NULL);
+
+    if (isLatencyEnabled) {
+        assert(pthread_equal(pthread_self(), ingestThread));
+        ingestNow = *ingest;
+    }
+    return;
+}
+
+
+void mark_latency(obj_t *obj, int len)
+{
+/*  Notes that (len) bytes have been written into the circular-buf of (obj),
+ *    marking them with the current ingest timestamp if one is set.
+ *  The obj's bufLock must be held when calling this routine.
+ */
+    latency_t *lat = obj->latency;
+    latency_mark_t *mark;
+
+    assert(lat != NULL);
+
+    lat->inTotal += len;
+    if ((ingestNow.type < 0) || !pthread_equal(pthread_self(), ingestThread)) {
+        return;
+    }
+    if (lat->numMarks == LATENCY_MAX_MARKS) {
+        mark = &lat->marks[(lat->markHead + lat->numMarks - 1)
+            % LATENCY_MAX_MARKS];
+    }
+    else {
+        mark = &lat->marks[(lat->markHead + lat->numMarks)
+            % LATENCY_MAX_MARKS];
+        mark->ingest = ingestNow;
+        lat->numMarks++;
+    }
+    mark->end = lat->inTotal;
+    return;
+}
+
+
+void record_latency(obj_t *obj, int len, int isLost)
+{
+/*  Notes that (len) bytes have been removed from the circular-buf of (obj),
+ *    recording the latency of each marked chunk that has been written out
+ *    in its entirety.  If (isLost) is true, the data was discarded instead
+ *    of being written out, so latencies of chunks ending therein are not
+ *    recorded.
+ *  The obj's bufLock must be held when calling this routine, and it must be
+ *    called by the mux thread unless (isLost) is true.
+ */
+    latency_t *lat = obj->latency;
+    latency_mark_t *mark;
+    unsigned long now = 0;
+    unsigned long usecs;
+
+    assert(lat != NULL);
+
+    lat->outTotal += len;
+    while (lat->numMarks > 0) {
+        mark = &lat->marks[lat->markHead];
+        if ((long) (lat->outTotal - mark->end) < 0) {
+            break;
+        }
+        if (!isLost) {
+            if (!now) {
+                now = get_latency_usecs();
+            }
+            usecs = now - mark->ingest.usecs;
+            record_latency_hist(&lat->hist, usecs);
+            record_latency_hist(&typeHists[mark->ingest.type], usecs);
+        }
+        lat->markHead = (lat->markHead + 1) % LATENCY_MAX_MARKS;
+        lat->numMarks--;
+    }
+    return;
+}
+
+
+void log_latency_stats(server_conf_t *conf)
+{
+/*  Logs the latency percentiles for each console type, client, & logfile
+ *    for which latencies have been recorded.  This must be called by the
+ *    mux thread.
+ */
+    ListIterator i;
+    obj_t *obj;
+    latency_hist_t hist;
+    char what[MAX_LINE];
+    int n;
+
+    if (!isLatencyEnabled) {
+        return;
+    }
+    for (n = 0; n < LATENCY_MAX_TYPES; n++) {
+        if (typeHists[n].count > 0) {
+            snprintf(what, sizeof(what), "%s consoles", typeNames[n]);
+            log_latency_hist(what, &typeHists[n]);
+        }
+    }
+    i = list_iterator_create(conf->objs);
+    while ((obj = list_next(i))) {
+        if (!obj->latency) {
+            continue;
+        }
+        x_pthread_mutex_lock(&obj->bufLock);
+        hist = obj->latency->hist;
+        x_pthread_mutex_unlock(&obj->bufLock);
+        if (hist.count > 0) {
+            snprintf(what, sizeof(what), "%s \"%s\"",
+                typeNames[get_obj_type_index(obj->type)], obj->name);
+            log_latency_hist(what, &hist);
+        }
+    }
+    list_iterator_destroy(i);
+    return;
+}
+
+
+void log_obj_latency(obj_t *obj)
+{
+/*  Logs the latency percentiles recorded for the (obj), if any.
+ */
+    char what[MAX_LINE];
+
+    if (!obj->latency || (obj->latency->hist.count == 0)) {
+        return;
+    }
+    snprintf(what, sizeof(what), "%s \"%s\"",
+        typeNames[get_obj_type_index(obj->type)], obj->name);
+    log_latency_hist(what, &obj->latency->hist);
+    return;
+}
+
+
+static void record_latency_hist(latency_hist_t *hist, unsigned long usecs)
+{
+/*  Records a latency of (usecs) microseconds in the histogram (hist).
+ */
+    hist->bins[get_latency_bin(usecs)]++;
+    hist->count++;
+    if (usecs > hist->maxUsecs) {
+        hist->maxUsecs = usecs;
+    }
+    return;
+}
+
+
+static int get_latency_bin(unsigned long usecs)
+{
+/*  Returns the index of the histogram bin for a latency of (usecs).
+ *  Values below (2 * LATENCY_HIST_SUB_BINS) each have their own bin.
+ *    Above that, each power-of-2 range is split into LATENCY_HIST_SUB_BINS
+ *    bins of equal width.  Values beyond the last bin are clamped.
+ */
+    unsigned long v;
+    int shift = 0;
+    int bin;
+
+    for (v = usecs; v >= 2 * LATENCY_HIST_SUB_BINS; v >>= 1) {
+        shift++;
+    }
+    if (v < LATENCY_HIST_SUB_BINS) {
+        return((int) v);
+    }
+    bin = (shift + 1) * LATENCY_HIST_SUB_BINS + (v - LATENCY_HIST_SUB_BINS);
+    return(MIN(bin, LATENCY_HIST_BINS - 1));
+}
+
+
+static unsigned long get_latency_bin_max(int bin)
+{
+/*  Returns the largest latency (in usecs) recorded in the histogram (bin).
+ */
+    unsigned long v;
+    int shift;
+
+    if (bin < 2 * LATENCY_HIST_SUB_BINS) {
+        return((unsigned long) bin);
+    }
+    shift = (bin / LATENCY_HIST_SUB_BINS) - 1;
+    v = LATENCY_HIST_SUB_BINS + (bin % LATENCY_HIST_SUB_BINS);
+    return(((v + 1) << shift) - 1);
+}
+
+
+static void log_latency_hist(const char *what, const latency_hist_t *hist)
+{
+/*  Logs the percentiles of the latency histogram (hist) for (what).
+ *  Each percentile is reported as the upper bound of the bin in which it
+ *    falls, limited by the max latency recorded.
+ */
+    static const int pcts[] = { 500, 900, 990, 999 };
+    const int numPcts = sizeof(pcts) / sizeof(pcts[0]);
+    char bufs[sizeof(pcts) / sizeof(pcts[0])][32];
+    char maxbuf[32];
+    unsigned long sum = 0;
+    unsigned long target;
+    int bin = 0;
+    int n;
+
+    assert(hist->count > 0);
+
+    for (n = 0; n < numPcts; n++) {
+        target = (hist->count * pcts[n] + 999) / 1000;
+        while ((sum < target) && (bin < LATENCY_HIST_BINS)) {
+            sum += hist->bins[bin++];
+        }
+        format_latency(bufs[n], sizeof(bufs[n]),
+            MIN(get_latency_bin_max(bin - 1), hist->maxUsecs));
+    }
+    log_msg(LOG_INFO,
+        "Latency for %s: %lu chunk%s p50=%s p90=%s p99=%s p99.9=%s max=%s",
+        what, hist->count, ((hist->count == 1) ? "" : "s"),
+        bufs[0], bufs[1], bufs[2], bufs[3],
+        format_latency(maxbuf, sizeof(maxbuf), hist->maxUsecs));
+    return;
+}
+
+
+static char * format_latency(char *buf, int len, unsigned long usecs)
+{
+/*  Formats the latency (usecs) into (buf) of length (len) in milliseconds.
+ *  Returns (buf).
+ */
+    snprintf(buf, len, "%lu.%03lums", usecs / 1000, usecs % 1000);
+    return(buf);
+}
+
+
+static int get_obj_type_index(unsigned type)
+{
+/*  Returns the index into typeNames[] of the obj (type).
+ */
+    int n = 0;
+
+    assert(type != 0);
+
+    while (!(type & 1)) {
+        type >>= 1;
+        n++;
+    }
+    assert(n < LATENCY_MAX_TYPES);
+    return(n);
+}
+
+
+static unsigned long get_latency_usecs(void)
+{
+/*  Returns the current time in microseconds on the monotonic clock if
+ *    available, or the time of day otherwise.  Only differences between
+ *    values are meaningful, and these are unaffected by wraparound.
+ */
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+        log_err(errno, "Unable to get monotonic time");
+    }
+    return((unsigned long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else /* !HAVE_CLOCK_GETTIME || !CLOCK_MONOTONIC */
+    struct timeval tv;
+
+    if (gettimeofday(&tv, NULL) < 0) {
+        log_err(errno, "Unable to get time of day");
+    }
+    return((unsigned long) tv.tv_sec * 1000000 + tv.tv_usec);
+#endif /* !HAVE_CLOCK_GETTIME || !CLOCK_MONOTONIC */
+}
@@ -44,6 +44,11 @@
 extern tpoll_t tp_global;               /* defined in server.c */
 
 
+static int process_log_stage(obj_t *log, const void *src, int len,
+    int isInfo, filter_flush_f flush, void *arg);
+static int deliver_log_data(obj_t *log, const void *src, int len);
+
+
 int parse_logfile_opts(logopt_t *opts, const char *str,
     char *errbuf, int errlen)
 {
@@ -151,50 +156,48 @@ obj_t * create_logfile_obj(server_conf_t *conf, char *name,
     if (logfile) {
         if ((errbuf != NULL) && (errlen > 0)) {
             snprintf(errbuf, errlen, "console [%s] already logging to \"%s\"",
-                logfile->aux.logfile.console->name, pname);
+                logfile->aux->logfile.console->name, pname);
         }
         return(NULL);
     }
     logfile = create_obj(conf, name, -1, CONMAN_OBJ_LOGFILE);
-    logfile->aux.logfile.console = console;
-    logfile->aux.logfile.lineState = CONMAN_LOG_LINE_INIT;
-    logfile->aux.logfile.opts = *opts;
-    logfile->aux.logfile.gotTruncate = !!conf->enableZeroLogs;
-
-    if (logfile->aux.logfile.opts.enableSanitize
-            || logfile->aux.logfile.opts.enableTimestamp) {
-        logfile->aux.logfile.gotProcessing = 1;
-    }
-    else {
-        logfile->aux.logfile.gotProcessing = 0;
-    }
+    logfile->aux->logfile.console = console;
+    logfile->aux->logfile.opts = *opts;
+    logfile->aux->logfile.gotTruncate = !!conf->enableZeroLogs;
+    init_filter(&logfile->aux->logfile.filter,
+        (opts->enableSanitize ? CONMAN_FILTER_SANITIZE : 0)
+        | (opts->enableTimestamp ? CONMAN_FILTER_TIMESTAMP : 0));
+    logfile->aux->logfile.lane = NULL;
 
     if (strchr(name, '%')) {
-        logfile->aux.logfile.fmtName = create_string(name);
+        logfile->aux->logfile.fmtName = create_string(name);
     }
     else {
-        logfile->aux.logfile.fmtName = NULL;
+        logfile->aux->logfile.fmtName = NULL;
     }
 
     if (is_process_obj(console)) {
-        console->aux.process.logfile = logfile;
+        console->aux->process.logfile = logfile;
+    }
+    else if (is_mux_obj(console)) {
+        console->aux->mux.logfile = logfile;
     }
     else if (is_serial_obj(console)) {
-        console->aux.serial.logfile = logfile;
+        console->aux->serial.logfile = logfile;
     }
     else if (is_telnet_obj(console)) {
-        console->aux.telnet.logfile = logfile;
+        console->aux->telnet.logfile = logfile;
     }
     else if (is_unixsock_obj(console)) {
-        console->aux.unixsock.logfile = logfile;
+        console->aux->unixsock.logfile = logfile;
     }
 #if WITH_FREEIPMI
     else if (is_ipmi_obj(console)) {
-        console->aux.ipmi.logfile = logfile;
+        console->aux->ipmi.logfile = logfile;
     }
 #endif /* WITH_FREEIPMI */
     else if (is_test_obj(console)) {
-        console->aux.test.logfile = logfile;
+        console->aux->test.logfile = logfile;
     }
     else {
         log_err(0, "INTERNAL: Unrecognized console [%s] type=%d",
@@ -235,8 +238,8 @@ int open_logfile_obj(obj_t *logfile)
     assert(is_logfile_obj(logfile));
     assert(logfile->name != NULL);
     assert(logfile->name[0] == '/');
-    assert(logfile->aux.logfile.console != NULL);
-    assert(logfile->aux.logfile.console->name != NULL);
+    assert(logfile->aux->logfile.console != NULL);
+    assert(logfile->aux->logfile.console->name != NULL);
 
     if (logfile->fd >= 0) {
         tpoll_clear(tp_global, logfile->fd, POLLOUT);
@@ -247,16 +250,16 @@ int open_logfile_obj(obj_t *logfile)
     }
     /*  Perform conversion specifier expansion.
      */
-    if (logfile->aux.logfile.fmtName) {
+    if (logfile->aux->logfile.fmtName) {
 
         char buf[MAX_LINE];
 
         if (format_obj_string(buf, sizeof(buf),
-          logfile->aux.logfile.console,
-          logfile->aux.logfile.fmtName) < 0) {
+          logfile->aux->logfile.console,
+          logfile->aux->logfile.fmtName) < 0) {
             log_msg(LOG_WARNING,
                 "Unable to open logfile for [%s]: filename exceeded buffer",
-                logfile->aux.logfile.console->name);
+                logfile->aux->logfile.console->name);
             logfile->fd = -1;
             return(-1);
         }
@@ -266,21 +269,26 @@ int open_logfile_obj(obj_t *logfile)
     /*  Create intermediate directories.
      */
     if (get_dir_name(logfile->name, dirname, sizeof(dirname))) {
+        begin_mux_phase("create_dirs", logfile);
         (void) create_dirs(dirname);
+        end_mux_phase();
     }
     /*  Only truncate on the initial open if ZeroLogs was enabled.
      */
     flags = O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK;
-    if (logfile->aux.logfile.gotTruncate) {
-        logfile->aux.logfile.gotTruncate = 0;
+    if (logfile->aux->logfile.gotTruncate) {
+        logfile->aux->logfile.gotTruncate = 0;
         flags |= O_TRUNC;
     }
-    if ((logfile->fd = open(logfile->name, flags, S_IRUSR | S_IWUSR)) < 0) {
+    begin_mux_phase("open", logfile);
+    logfile->fd = open(logfile->name, flags, S_IRUSR | S_IWUSR);
+    end_mux_phase();
+    if (logfile->fd < 0) {
         log_msg(LOG_WARNING, "Unable to open logfile \"%s\": %s",
             logfile->name, strerror(errno));
         return(-1);
     }
-    if (logfile->aux.logfile.opts.enableLock
+    if (logfile->aux->logfile.opts.enableLock
             && (get_write_lock(logfile->fd) < 0)) {
         log_msg(LOG_WARNING, "Unable to lock \"%s\"", logfile->name);
         (void) close(logfile->fd);
@@ -293,20 +301,18 @@ int open_logfile_obj(obj_t *logfile)
 
     now = create_long_time_string(0);
     msg = create_format_string("%sConsole [%s] log opened at %s%s",
-        CONMAN_MSG_PREFIX, logfile->aux.logfile.console->name, now,
+        CONMAN_MSG_PREFIX, logfile->aux->logfile.console->name, now,
         CONMAN_MSG_SUFFIX);
-    write_obj_data(logfile, msg, strlen(msg), 0);
-    free(now);
-    free(msg);
     /*
-     *  Since the above console log message is not marked "informational",
-     *    the test in write_obj_data() to re-init the line state will not
-     *    be triggered.  Thusly, we re-initialize the line state here.
+     *  The message is marked "informational" so write_obj_data() will re-init
+     *    the line state, queueing it behind any data still in the pipeline.
      */
-    logfile->aux.logfile.lineState = CONMAN_LOG_LINE_INIT;
+    write_obj_data(logfile, msg, strlen(msg), 1);
+    free(now);
+    free(msg);
 
     DPRINTF((9, "Opened [%s] logfile: fd=%d file=%s.\n",
-        logfile->aux.logfile.console->name, logfile->fd, logfile->name));
+        logfile->aux->logfile.console->name, logfile->fd, logfile->name));
     return(0);
 }
 
@@ -322,24 +328,27 @@ obj_t * get_console_logfile_obj(obj_t *console)
     assert(is_console_obj(console));
 
     if (is_process_obj(console)) {
-        logfile = console->aux.process.logfile;
+        logfile = console->aux->process.logfile;
+    }
+    else if (is_mux_obj(console)) {
+        logfile = console->aux->mux.logfile;
     }
     else if (is_serial_obj(console)) {
-        logfile = console->aux.serial.logfile;
+        logfile = console->aux->serial.logfile;
     }
     else if (is_telnet_obj(console)) {
-        logfile = console->aux.telnet.logfile;
+        logfile = console->aux->telnet.logfile;
     }
     else if (is_unixsock_obj(console)) {
-        logfile = console->aux.unixsock.logfile;
+        logfile = console->aux->unixsock.logfile;
     }
 #if WITH_FREEIPMI
     else if (is_ipmi_obj(console)) {
-        logfile = console->aux.ipmi.logfile;
+        logfile = console->aux->ipmi.logfile;
     }
 #endif /* WITH_FREEIPMI */
     else if (is_test_obj(console)) {
-        logfile = console->aux.test.logfile;
+        logfile = console->aux->test.logfile;
     }
     else {
         log_err(0, "INTERNAL: Unrecognized console [%s] type=%d",
@@ -366,103 +375,74 @@ int write_log_data(obj_t *log, const void *src, int len)
  *    after each newline.
  *  Returns the number of bytes written into the logfile obj's buffer.
  */
-    const int minbuf = 25;              /* cr/lf + timestamp + meta/char */
-    unsigned char buf[OBJ_BUF_SIZE - 1];
-    const unsigned char *p;
-    unsigned char *q;
-    const unsigned char * const qLast = buf + sizeof(buf);
-    int n = 0;
-
     assert(is_logfile_obj(log));
-    assert(sizeof(buf) >= (size_t) minbuf);
 
     /*  If no additional processing is needed, listen to Biff Tannen:
      *    "make like a tree and get outta here".
      */
-    if (!log->aux.logfile.gotProcessing) {
+    if (!log->aux->logfile.filter.opts) {
         return(write_obj_data(log, src, len, 0));
     }
+    /*  Hand the data off to the pipeline if the processing is offloaded.
+     */
+    if (log->aux->logfile.lane) {
+        return(submit_pipe_data(log->aux->logfile.lane, src, len, 0));
+    }
     DPRINTF((15, "Processing %d bytes for [%s] log \"%s\".\n",
-        len, log->aux.logfile.console->name, log->name));
-
-    for (p=src, q=buf; len>0; p++, len--) {
-        /*
-         *  A newline state machine is used to properly sanitize CR/LF line
-         *    terminations.  This is responsible for coalescing multiple CRs,
-         *    swapping LF/CR to CR/LF, transcribing CR/NUL to CR/LF,
-         *    prepending a CR to a lonely LF, and appending a LF to a
-         *    lonely CR to prevent characters from being overwritten.
-         */
-        if (*p == '\r') {
-            if (log->aux.logfile.lineState == CONMAN_LOG_LINE_DATA) {
-                log->aux.logfile.lineState = CONMAN_LOG_LINE_CR;
-            }
-            else if (log->aux.logfile.lineState == CONMAN_LOG_LINE_INIT) {
-                if (log->aux.logfile.opts.enableTimestamp)
-                    q += write_time_string(0, (char *) q, qLast - q);
-                log->aux.logfile.lineState = CONMAN_LOG_LINE_CR;
-            }
-            else {
-                ; /* ignore */
-            }
-        }
-        else if (*p == '\n') {
-            if (  (log->aux.logfile.lineState == CONMAN_LOG_LINE_INIT)
-               || (log->aux.logfile.lineState == CONMAN_LOG_LINE_LF) ) {
-                if (log->aux.logfile.opts.enableTimestamp)
-                    q += write_time_string(0, (char *) q, qLast - q);
-            }
-            *q++ = '\r';
-            *q++ = '\n';
-            log->aux.logfile.lineState = CONMAN_LOG_LINE_LF;
-        }
-        else if (  (*p == '\0')
-                && (  (log->aux.logfile.lineState == CONMAN_LOG_LINE_CR)
-                   || (log->aux.logfile.lineState == CONMAN_LOG_LINE_LF) ) ) {
-            ; /* ignore */
-        }
-        else {
-            if (log->aux.logfile.lineState == CONMAN_LOG_LINE_CR) {
-                *q++ = '\r';
-                *q++ = '\n';
-            }
-            if (log->aux.logfile.lineState != CONMAN_LOG_LINE_DATA) {
-                if (log->aux.logfile.opts.enableTimestamp)
-                    q += write_time_string(0, (char *) q, qLast - q);
-            }
-            log->aux.logfile.lineState = CONMAN_LOG_LINE_DATA;
-
-            if (log->aux.logfile.opts.enableSanitize) {
-
-                int c = *p & 0x7F;      /* strip data to 7-bit ASCII */
-
-                if (c < 0x20) {         /* ASCII ctrl-chars */
-                    *q++ = (*p & 0x80) ? '~' : '^';
-                    *q++ = c + '@';
-                }
-                else if (c == 0x7F) {   /* ASCII DEL char */
-                    *q++ = (*p & 0x80) ? '~' : '^';
-                    *q++ = '?';
-                }
-                else {
-                    if (*p & 0x80)
-                        *q++ = '`';
-                    *q++ = c;
-                }
-            }
-            else {
-                *q++ = *p;
-            }
-        }
-        /*  Flush internal buffer before it overruns.
-         */
-        if ((qLast - q) < minbuf) {
-            assert((q >= buf) && (q <= qLast));
-            n += write_obj_data(log, buf, q - buf, 0);
-            q = buf;
-        }
+        len, log->aux->logfile.console->name, log->name));
+
+    return(write_filtered_obj_data(log, &log->aux->logfile.filter, src, len));
+}
+
+
+int enable_logfile_pipeline(obj_t *logfile)
+{
+/*  Offloads the processing of console data written to the 'logfile' obj
+ *    onto a pipeline lane, if the logfile requires any processing.
+ *  Returns 0 if a lane is created; o/w, returns -1.
+ */
+    assert(is_logfile_obj(logfile));
+
+    if (!logfile->aux->logfile.filter.opts || logfile->aux->logfile.lane) {
+        return(-1);
+    }
+    logfile->aux->logfile.lane = create_pipe_lane(
+        logfile->aux->logfile.console, logfile,
+        (pipe_stage_f) process_log_stage, (filter_flush_f) deliver_log_data,
+        logfile);
+    return(0);
+}
+
+
+static int process_log_stage(obj_t *log, const void *src, int len,
+    int isInfo, filter_flush_f flush, void *arg)
+{
+/*  Processes the buffer (src) of length (len) for the logfile obj (log),
+ *    passing the result to the (flush) function along with (arg).
+ *    If (isInfo) is true, the data is an informational message which is
+ *    passed through as is, and the log's newline state is re-initialized.
+ *  This is the pipeline stage fn run by a worker thread; the log's filter
+ *    state is only accessed by the one worker processing its lane.
+ *  Returns the number of bytes of processed data.
+ */
+    assert(is_logfile_obj(log));
+
+    if (isInfo) {
+        log->aux->logfile.filter.lineState = CONMAN_LOG_LINE_INIT;
+        return(flush(arg, src, len));
     }
-    assert((q >= buf) && (q <= qLast));
-    n += write_obj_data(log, buf, q - buf, 0);
-    return(n);
+    DPRINTF((15, "Processing %d bytes for [%s] log in pipeline.\n",
+        len, log->aux->logfile.console->name));
+
+    return(filter_data(&log->aux->logfile.filter, src, len, flush, arg));
+}
+
+
+static int deliver_log_data(obj_t *log, const void *src, int len)
+{
+/*  Writes the processed data (src) of length (len) into the circular-buffer
+ *    of the logfile obj (log).  This is the pipeline deliver fn run by the
+ *    mux thread.
+ */
+    return(write_obj_data(log, src, len, 0));
 }
@@ -0,0 +1,373 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#if HAVE_MALLOC_H
+#  include <malloc.h>
+#endif /* HAVE_MALLOC_H */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "common.h"
+#include "list.h"
+#include "log.h"
+#include "server.h"
+#include "util.h"
+#include "util-str.h"
+#include "wrapper.h"
+
+
+/*  Memory accounting is computed on demand rather than tracked at each
+ *    allocation: on reconfig, the mux thread walks the master objs list and
+ *    sums the bytes owned by each subsystem from the sizes of the structures
+ *    & strings reachable from each obj.  These are the sizes requested of
+ *    the allocator, so they exclude its per-allocation overhead; the gap
+ *    between their total and the heap in use indicates that overhead along
+ *    with memory owned by libraries (eg, TLS sessions & IPMI contexts, which
+ *    are opaque and are therefore only counted).  Lists are accounted by the
+ *    list allocator, which never returns memory to the heap.
+ *  The process-wide RSS, heap in use, & number of open fds are obtained
+ *    from /proc & mallinfo2() where available, and are also reported per
+ *    console to aid in sizing hosts.
+ */
+
+typedef enum mem_type {                 /* MEMORY ACCOUNTING SUBSYSTEMS:     */
+    MEM_BUFS,                           /*  circular-bufs of objs            */
+    MEM_OBJS,                           /*  obj headers & per-obj state      */
+    MEM_HISTORY,                        /*  console history & screen models  */
+    MEM_CLIENTS,                        /*  client compression, coalescing,  */
+                                        /*   & script state                  */
+    MEM_REQS,                           /*  client requests                  */
+    MEM_STRINGS,                        /*  names, devices, & args of objs   */
+    MEM_LISTS,                          /*  lists, list nodes, & iterators   */
+    MEM_TYPES
+} mem_type_t;
+
+typedef struct mem_usage {              /* MEMORY USAGE TOTALS:              */
+    unsigned long    bytes[MEM_TYPES];  /*  num bytes owned by each subsys   */
+    int              numConsoles;       /*  num console objs                 */
+    int              numClients;        /*  num client objs                  */
+    int              numLogfiles;       /*  num logfile objs                 */
+    int              numIpmiCtxs;       /*  num ipmi contexts                */
+    int              numTlsSessions;    /*  num tls sessions                 */
+} mem_usage_t;
+
+static void account_obj_mem(mem_usage_t *usage, obj_t *obj);
+static void account_client_mem(mem_usage_t *usage, obj_t *client);
+static unsigned long get_argv_mem_size(char **argv);
+static unsigned long get_string_mem_size(const char *str);
+static long get_rss_kbytes(void);
+static long get_heap_kbytes(void);
+static int get_num_fds(void);
+
+static const char *memTypeNames[MEM_TYPES] = {
+    "bufs", "objs", "history", "clients", "reqs", "strings", "lists"
+};
+
+
+void log_mem_stats(server_conf_t *conf)
+{
+/*  Logs the memory owned by each subsystem, along with the process-wide
+ *    RSS, heap in use, & open fds.
+ *  This must be called by the mux thread.
+ */
+    mem_usage_t usage;
+    ListIterator i;
+    obj_t *obj;
+    char buf[MAX_LINE];
+    long rss, heap;
+    int numFds;
+    int n;
+
+    memset(&usage, 0, sizeof(usage));
+    i = list_iterator_create(conf->objs);
+    while ((obj = list_next(i))) {
+        account_obj_mem(&usage, obj);
+    }
+    list_iterator_destroy(i);
+    usage.bytes[MEM_LISTS] = list_mem_size();
+    usage.bytes[MEM_BUFS] += get_sink_mem_size();
+
+    buf[0] = '\0';
+    for (n = 0; n < MEM_TYPES; n++) {
+        append_format_string(buf, sizeof(buf), " %s=%luKB",
+            memTypeNames[n], (usage.bytes[n] + 1023) / 1024);
+    }
+    log_msg(LOG_INFO, "Memory owned by subsystem:%s ipmi=%d ctx%s tls=%d"
+        " session%s", buf, usage.numIpmiCtxs,
+        ((usage.numIpmiCtxs == 1) ? "" : "s"), usage.numTlsSessions,
+        ((usage.numTlsSessions == 1) ? "" : "s"));
+
+    rss = get_rss_kbytes();
+    heap = get_heap_kbytes();
+    numFds = get_num_fds();
+    n = MAX(usage.numConsoles, 1);
+
+    buf[0] = '\0';
+    if (rss >= 0) {
+        append_format_string(buf, sizeof(buf), " rss=%ldKB (%.1fKB/console)",
+            rss, (double) rss / n);
+    }
+    if (heap >= 0) {
+        append_format_string(buf, sizeof(buf), " heap=%ldKB (%.1fKB/console)",
+            heap, (double) heap / n);
+    }
+    if (numFds >= 0) {
+        append_format_string(buf, sizeof(buf), " fds=%d (%.2f/console)",
+            numFds, (double) numFds / n);
+    }
+    log_msg(LOG_INFO,
+        "Memory for %d console%s, %d logfile%s, & %d client%s:%s",
+        usage.numConsoles, ((usage.numConsoles == 1) ? "" : "s"),
+        usage.numLogfiles, ((usage.numLogfiles == 1) ? "" : "s"),
+        usage.numClients, ((usage.numClients == 1) ? "" : "s"),
+        (*buf ? buf : " unavailable"));
+    return;
+}
+
+
+static void account_obj_mem(mem_usage_t *usage, obj_t *obj)
+{
+/*  Adds the memory owned by the (obj) to the (usage) totals.
+ */
+    unsigned long *bytes = usage->bytes;
+
+    bytes[MEM_OBJS] += sizeof(obj_t) + sizeof(aux_obj_t);
+    if (obj->buf) {
+        bytes[MEM_BUFS] += OBJ_BUF_SIZE;
+    }
+    if (obj->latency) {
+        bytes[MEM_OBJS] += get_latency_mem_size();
+    }
+    if (obj->history) {
+        bytes[MEM_HISTORY] += sizeof(history_t);
+        if (obj->history->buf) {
+            bytes[MEM_HISTORY] += CONSOLE_HISTORY_SIZE
+                + (CONSOLE_HISTORY_LINES * sizeof(unsigned));
+        }
+        if (obj->history->screen) {
+            bytes[MEM_HISTORY] += sizeof(screen_t);
+        }
+    }
+    bytes[MEM_STRINGS] += get_string_mem_size(obj->name);
+
+    if (is_console_obj(obj)) {
+        usage->numConsoles++;
+    }
+    switch (obj->type) {
+    case CONMAN_OBJ_CLIENT:
+        usage->numClients++;
+        account_client_mem(usage, obj);
+        break;
+    case CONMAN_OBJ_LOGFILE:
+        usage->numLogfiles++;
+        bytes[MEM_STRINGS] += get_string_mem_size(obj->aux->logfile.fmtName);
+        break;
+    case CONMAN_OBJ_HELPER:
+        bytes[MEM_STRINGS] += get_argv_mem_size(obj->aux->helper.argv);
+        bytes[MEM_OBJS] += ((obj->aux->helper.numSessions + 63) / 64) * 64
+            * sizeof(obj_t *);
+        bytes[MEM_OBJS] += obj->aux->helper.msg ? MAX_LINE : 0;
+        break;
+    case CONMAN_OBJ_MUX:
+        bytes[MEM_STRINGS] += get_argv_mem_size(obj->aux->mux.argv);
+        break;
+    case CONMAN_OBJ_PROCESS:
+        bytes[MEM_STRINGS] += get_argv_mem_size(obj->aux->process.argv);
+        break;
+    case CONMAN_OBJ_SERIAL:
+        bytes[MEM_STRINGS] += get_string_mem_size(obj->aux->serial.dev);
+        break;
+    case CONMAN_OBJ_TELNET:
+        bytes[MEM_STRINGS] += get_string_mem_size(obj->aux->telnet.host);
+        break;
+    case CONMAN_OBJ_UNIXSOCK:
+        bytes[MEM_STRINGS] += get_string_mem_size(obj->aux->unixsock.dev);
+        break;
+#if WITH_FREEIPMI
+    case CONMAN_OBJ_IPMI:
+        bytes[MEM_STRINGS] += get_string_mem_size(obj->aux->ipmi.host);
+        x_pthread_mutex_lock(&obj->aux->ipmi.mutex);
+        if (obj->aux->ipmi.ctx) {
+            usage->numIpmiCtxs++;
+        }
+        x_pthread_mutex_unlock(&obj->aux->ipmi.mutex);
+        break;
+#endif /* WITH_FREEIPMI */
+    default:
+        break;
+    }
+    return;
+}
+
+
+static void account_client_mem(mem_usage_t *usage, obj_t *client)
+{
+/*  Adds the memory owned by the (client) obj's request & stream state
+ *    to the (usage) totals.
+ */
+    unsigned long *bytes = usage->bytes;
+    req_t *req = client->aux->client.req;
+    coalesce_t *co = client->aux->client.coalesce;
+    exec_job_t *job = client->aux->client.exec;
+    coalesce_group_t *g;
+    ListIterator i;
+    int n;
+
+    if (req) {
+        bytes[MEM_REQS] += sizeof(req_t);
+        bytes[MEM_REQS] += get_string_mem_size(req->user);
+        bytes[MEM_REQS] += get_string_mem_size(req->tty);
+        bytes[MEM_REQS] += get_string_mem_size(req->fqdn);
+        bytes[MEM_REQS] += get_string_mem_size(req->host);
+        bytes[MEM_REQS] += get_string_mem_size(req->ip);
+#if WITH_OPENSSL
+        if (req->ssl) {
+            usage->numTlsSessions++;
+        }
+#endif /* WITH_OPENSSL */
+    }
+#if WITH_ZLIB
+    /*  The deflate state's size is given in <zconf.h> for the default
+     *    windowBits (15) & memLevel (8) used by deflateInit().
+     */
+    if (client->aux->client.zlib) {
+        bytes[MEM_CLIENTS] += sizeof(zlib_obj_t)
+            + (1 << (MAX_WBITS + 2)) + (1 << (8 + 9));
+    }
+#endif /* WITH_ZLIB */
+#if WITH_OPENSSL
+    if (client->aux->client.tls) {
+        bytes[MEM_CLIENTS] += sizeof(tls_obj_t);
+    }
+#endif /* WITH_OPENSSL */
+    if (co) {
+        bytes[MEM_CLIENTS] += sizeof(coalesce_t) + co->setLen
+            + co->numMembers * sizeof(coalesce_member_t);
+        i = list_iterator_create(co->groups);
+        while ((g = list_next(i))) {
+            bytes[MEM_CLIENTS] += sizeof(coalesce_group_t) + g->len + 1
+                + (co->numMembers + 7) / 8;
+        }
+        list_iterator_destroy(i);
+    }
+    if (job) {
+        bytes[MEM_CLIENTS] += sizeof(exec_job_t)
+            + job->numSteps * sizeof(exec_step_t)
+            + list_count(job->runs) * sizeof(exec_run_t);
+        for (n = 0; n < job->numSteps; n++) {
+            bytes[MEM_CLIENTS] += get_string_mem_size(job->steps[n].str);
+        }
+    }
+    return;
+}
+
+
+static unsigned long get_argv_mem_size(char **argv)
+{
+/*  Returns the number of bytes allocated for the NULL-terminated (argv).
+ */
+    unsigned long n = 0;
+    char **p;
+
+    if (!argv) {
+        return(0);
+    }
+    for (p = argv; *p; p++) {
+        n += sizeof(char *) + strlen(*p) + 1;
+    }
+    return(n + sizeof(char *));
+}
+
+
+static unsigned long get_string_mem_size(const char *str)
+{
+/*  Returns the number of bytes allocated for the string (str), if any.
+ */
+    return(str ? strlen(str) + 1 : 0);
+}
+
+
+static long get_rss_kbytes(void)
+{
+/*  Returns the resident set size of the daemon in kilobytes,
+ *    or -1 if unavailable.
+ */
+    FILE *fp;
+    unsigned long size, resident;
+    int n;
+
+    if (!(fp = fopen("/proc/self/statm", "r"))) {
+        return(-1);
+    }
+    n = fscanf(fp, "%lu %lu", &size, &resident);
+    (void) fclose(fp);
+    if (n != 2) {
+        return(-1);
+    }
+    return((long) (resident * (sysconf(_SC_PAGESIZE) / 1024)));
+}
+
+
+static long get_heap_kbytes(void)
+{
+/*  Returns the number of kilobytes of heap in use by the daemon (including
+ *    mmap'd allocations), or -1 if unavailable.
+ */
+#if HAVE_MALLINFO2
+    struct mallinfo2 mi;
+
+    mi = mallinfo2();
+    return((long) ((mi.uordblks + mi.hblkhd) / 1024));
+#else /* !HAVE_MALLINFO2 */
+    return(-1);
+#endif /* !HAVE_MALLINFO2 */
+}
+
+
+static int get_num_fds(void)
+{
+/*  Returns the number of file descriptors open by the daemon,
+ *    or -1 if unavailable.
+ */
+    DIR *dp;
+    struct dirent *dep;
+    int n = 0;
+
+    if (!(dp = opendir("/proc/self/fd"))) {
+        return(-1);
+    }
+    while ((dep = readdir(dp))) {
+        if (dep->d_name[0] != '.') {
+            n++;
+        }
+    }
+    (void) closedir(dp);
+    return(n - 1);                      /* exclude the fd for dp */
+}
@@ -0,0 +1,838 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+/*  A mux console is a session served by a long-lived helper process shared
+ *    by every mux console specifying the same helper executable.  Instead of
+ *    forking a process (and holding a socketpair) for each console, the
+ *    daemon multiplexes all of the helper's sessions over a single
+ *    socketpair using the framed protocol described in "mux.h".
+ *
+ *  Frames are written into the helper obj's circular-buffer only if they fit
+ *    in their entirety, since a partially-overwritten frame would corrupt the
+ *    stream.  Frames read from the helper are demultiplexed as they arrive;
+ *    the payload of a DATA frame is passed along to the session's readers
+ *    without waiting for the rest of the frame.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "list.h"
+#include "log.h"
+#include "mux.h"
+#include "server.h"
+#include "tpoll.h"
+#include "util.h"
+#include "util-file.h"
+#include "util-str.h"
+
+
+static obj_t * find_helper_obj(server_conf_t *conf, const char *path);
+static int  disconnect_helper_obj(obj_t *helper);
+static int  connect_helper_obj(obj_t *helper);
+static int  check_helper_prog(obj_t *helper);
+static int  connect_mux_obj(obj_t *mux);
+static void close_mux_obj(obj_t *mux, const char *reason);
+static void expire_mux_obj(obj_t *mux);
+static void schedule_mux_obj(obj_t *mux);
+static void dispatch_helper_frame(obj_t *helper);
+static int  write_mux_frame(obj_t *mux, int type, const void *src, int len);
+
+extern tpoll_t tp_global;               /* defined in server.c */
+
+
+int is_mux_dev(const char *dev, const char *cwd,
+    const char *exec_path, char **path_ref)
+{
+/*  Returns 1 if 'dev' specifies a mux console device of the form
+ *    "mux:PROG" (where PROG is the helper executable, resolved in the same
+ *    manner as a process console); o/w, returns 0.
+ *  If 'path_ref' is not NULL, it is set to the helper's pathname.
+ */
+    assert(dev != NULL);
+
+    if (strncasecmp(dev, "mux:", 4) != 0) {
+        return(0);
+    }
+    return(is_process_dev(dev + 4, cwd, exec_path, path_ref));
+}
+
+
+obj_t * create_mux_obj(server_conf_t *conf, char *name, char *path,
+    List args, char *errbuf, int errlen)
+{
+/*  Creates a new mux device object served by the helper at 'path' with the
+ *    session 'args', and adds it to the master objs list.  The helper obj is
+ *    created (and added to the master objs list) along with its first mux
+ *    obj.
+ *  Note: the helper will later be fork/exec'd
+ *    by main:open_objs:reopen_obj:open_helper_obj().
+ *  Returns the new object, or NULL on error.
+ */
+    ListIterator   i;
+    obj_t         *mux;
+    obj_t         *helper;
+    helper_obj_t  *hauxp;
+    mux_obj_t     *auxp;
+    int            num_args;
+    int            n;
+    char          *arg;
+
+    assert(conf != NULL);
+    assert((name != NULL) && (name[0] != '\0'));
+    assert((path != NULL) && (path[0] != '\0'));
+    assert(args != NULL);
+
+    /*  Check for duplicate console names.
+     */
+    i = list_iterator_create(conf->objs);
+    while ((mux = list_next(i))) {
+        if (is_console_obj(mux) && !strcmp(mux->name, name)) {
+            if ((errbuf != NULL) && (errlen > 0)) {
+                snprintf(errbuf, errlen,
+                    "console [%s] specifies duplicate console name", name);
+            }
+            break;
+        }
+    }
+    list_iterator_destroy(i);
+    if (mux != NULL) {
+        return(NULL);
+    }
+    if (!(helper = find_helper_obj(conf, path))) {
+        helper = create_obj(conf, path, -1, CONMAN_OBJ_HELPER);
+        hauxp = &(helper->aux->helper);
+        hauxp->argv = calloc(2, sizeof(char *));
+        if (!hauxp->argv) {
+            out_of_memory();
+        }
+        hauxp->argv[0] = create_string(path);
+        hauxp->argv[1] = (char *) NULL;
+        if ((arg = strrchr(hauxp->argv[0], '/'))) {
+            hauxp->prog = arg + 1;
+        }
+        else {
+            hauxp->prog = hauxp->argv[0];
+        }
+        hauxp->sessions = NULL;
+        hauxp->numSessions = 0;
+        hauxp->timer = -1;
+        hauxp->delay = HELPER_MIN_TIMEOUT;
+        hauxp->pid = -1;
+        hauxp->tStart = 0;
+        if (!(hauxp->msg = malloc(MAX_LINE))) {
+            out_of_memory();
+        }
+        hauxp->msgLen = 0;
+        hauxp->hdrLen = 0;
+        hauxp->numLeft = 0;
+        hauxp->state = CONMAN_HELPER_DOWN;
+        list_append(conf->objs, helper);
+    }
+    hauxp = &(helper->aux->helper);
+
+    mux = create_obj(conf, name, -1, CONMAN_OBJ_MUX);
+    auxp = &(mux->aux->mux);
+
+    auxp->helper = helper;
+    auxp->logfile = NULL;
+    auxp->timer = -1;
+    auxp->delay = MUX_MIN_TIMEOUT;
+    auxp->tStart = 0;
+    auxp->state = CONMAN_MUX_DOWN;
+    num_args = list_count(args);
+    auxp->argv = calloc(num_args + 1, sizeof(char *));
+    if (!auxp->argv) {
+        out_of_memory();
+    }
+    for (n = 0; (n < num_args) && (arg = list_pop(args)); n++) {
+        auxp->argv[n] = arg;
+    }
+    auxp->argv[n] = (char *) NULL;
+
+    /*  The session id is the mux obj's index into the helper's sessions ary.
+     */
+    if ((hauxp->numSessions % 64) == 0) {
+        hauxp->sessions = realloc(hauxp->sessions,
+            (hauxp->numSessions + 64) * sizeof(obj_t *));
+        if (!hauxp->sessions) {
+            out_of_memory();
+        }
+    }
+    auxp->id = hauxp->numSessions;
+    hauxp->sessions[hauxp->numSessions++] = mux;
+
+    /*  Add obj to the master conf->objs list.
+     */
+    list_append(conf->objs, mux);
+
+    return(mux);
+}
+
+
+static obj_t * find_helper_obj(server_conf_t *conf, const char *path)
+{
+/*  Returns the helper obj for the executable at 'path', or NULL if none
+ *    has been created yet.
+ */
+    ListIterator  i;
+    obj_t        *helper;
+
+    i = list_iterator_create(conf->objs);
+    while ((helper = list_next(i))) {
+        if (is_helper_obj(helper)
+                && !strcmp(helper->aux->helper.argv[0], path)) {
+            break;
+        }
+    }
+    list_iterator_destroy(i);
+    return(helper);
+}
+
+
+int open_helper_obj(obj_t *helper)
+{
+/*  (Re)opens the specified 'helper' obj, (re)opening each of its sessions.
+ *  Returns 0 if the helper process is successfully started;
+ *    o/w, sets a reconnect timer and returns -1.
+ */
+    helper_obj_t *auxp;
+    int           rc = 0;
+
+    assert(helper != NULL);
+    assert(is_helper_obj(helper));
+
+    auxp = &(helper->aux->helper);
+
+    if (auxp->timer >= 0) {
+        (void) tpoll_timeout_cancel(tp_global, auxp->timer);
+        auxp->timer = -1;
+    }
+
+    if (auxp->state == CONMAN_HELPER_UP) {
+        rc = disconnect_helper_obj(helper);
+    }
+    else if (auxp->state == CONMAN_HELPER_DOWN) {
+        rc = connect_helper_obj(helper);
+    }
+
+    if (rc < 0) {
+        DPRINTF((15, "Retrying helper \"%s\" in %ds\n",
+            auxp->argv[0], auxp->delay));
+
+        auxp->timer = tpoll_timeout_relative(tp_global,
+            (callback_f) open_helper_obj, helper, auxp->delay * 1000);
+
+        auxp->delay = (auxp->delay == 0)
+            ? HELPER_MIN_TIMEOUT
+            : MIN(auxp->delay * 2, HELPER_MAX_TIMEOUT);
+    }
+    return(rc);
+}
+
+
+static int disconnect_helper_obj(obj_t *helper)
+{
+/*  Closes the existing connection with the specified 'helper' obj,
+ *    thereby closing each of its sessions.
+ *  Always returns -1 to signal a reconnect.
+ */
+    helper_obj_t *auxp;
+    obj_t        *mux;
+    time_t        tNow;
+    char         *delta_str;
+    int           n;
+
+    assert(helper != NULL);
+    assert(helper->aux->helper.pid > 0);
+    assert(helper->aux->helper.state == CONMAN_HELPER_UP);
+
+    auxp = &(helper->aux->helper);
+
+    if (helper->fd >= 0) {
+        tpoll_clear(tp_global, helper->fd, POLLIN | POLLOUT);
+        (void) close(helper->fd);
+        helper->fd = -1;
+    }
+    if (time(&tNow) == (time_t) -1) {
+        log_err(errno, "time() failed");
+    }
+    delta_str = create_time_delta_string(auxp->tStart, tNow);
+    log_msg(LOG_NOTICE, "Helper \"%s\" (pid %d) terminated after %s",
+        auxp->prog, auxp->pid, delta_str);
+    free(delta_str);
+
+    for (n = 0; n < auxp->numSessions; n++) {
+        mux = auxp->sessions[n];
+        if (mux->aux->mux.timer >= 0) {
+            (void) tpoll_timeout_cancel(tp_global, mux->aux->mux.timer);
+            mux->aux->mux.timer = -1;
+        }
+        close_mux_obj(mux, "helper terminated");
+    }
+    /*  Require the helper to have been up for a minimum length of time before
+     *    resetting the reconnect-delay back to zero.  This protects against
+     *    spinning on restarts where the helper immediately terminates.
+     */
+    if (tNow - auxp->tStart >= MIN_CONNECT_SECS) {
+        auxp->delay = 0;
+    }
+    (void) kill(auxp->pid, SIGKILL);
+    auxp->pid = -1;
+    auxp->tStart = 0;
+    auxp->state = CONMAN_HELPER_DOWN;
+    return(-1);
+}
+
+
+static int connect_helper_obj(obj_t *helper)
+{
+/*  Starts the specified 'helper' process, and opens each of its sessions.
+ *  The helper's stderr is inherited from the daemon so its diagnostics are
+ *    not mistaken for frames.
+ *  Returns 0 if the helper is successfully started; o/w, returns -1.
+ */
+    helper_obj_t *auxp;
+    int           fd_pair[2] = {-1,-1};
+    pid_t         pid;
+    int           n;
+
+    assert(helper != NULL);
+    assert(helper->fd == -1);
+    assert(helper->aux->helper.pid == -1);
+    assert(helper->aux->helper.state != CONMAN_HELPER_UP);
+
+    auxp = &(helper->aux->helper);
+
+    if (check_helper_prog(helper) < 0) {
+        goto err;
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd_pair) < 0) {
+        log_msg(LOG_WARNING, "Unable to start helper \"%s\": socketpair: %s",
+            auxp->prog, strerror(errno));
+        goto err;
+    }
+    set_fd_nonblocking(fd_pair[0]);
+    set_fd_nonblocking(fd_pair[1]);
+    set_fd_closed_on_exec(fd_pair[0]);
+    set_fd_closed_on_exec(fd_pair[1]);
+
+    begin_mux_phase("fork", helper);
+    pid = fork();
+    if (pid != 0) {
+        end_mux_phase();
+    }
+    if (pid < 0) {
+        log_msg(LOG_WARNING, "Unable to start helper \"%s\": fork: %s",
+            auxp->prog, strerror(errno));
+        goto err;
+    }
+    else if (pid == 0) {
+        if (close(fd_pair[0]) < 0) {
+            log_err(errno, "close() of child fd_pair failed");
+        }
+        if (dup2(fd_pair[1], STDIN_FILENO) < 0) {
+            log_err(errno, "dup2() of child stdin failed");
+        }
+        if (dup2(fd_pair[1], STDOUT_FILENO) < 0) {
+            log_err(errno, "dup2() of child stdout failed");
+        }
+        execv(auxp->argv[0], auxp->argv);
+        _exit(127);
+    }
+    if (close(fd_pair[1]) < 0) {
+        log_err(errno, "close() of parent fd_pair failed");
+    }
+    if (time(&(auxp->tStart)) == (time_t) -1) {
+        log_err(errno, "time() failed");
+    }
+    helper->fd = fd_pair[0];
+    auxp->pid = pid;
+    auxp->hdrLen = 0;
+    auxp->numLeft = 0;
+    helper->gotEOF = 0;
+    auxp->state = CONMAN_HELPER_UP;
+    tpoll_set(tp_global, helper->fd, POLLIN);
+
+    log_msg(LOG_INFO, "Helper \"%s\" (pid %d) started for %d console%s",
+        auxp->prog, auxp->pid, auxp->numSessions,
+        ((auxp->numSessions == 1) ? "" : "s"));
+    DPRINTF((9, "Opened helper \"%s\": fd=%d/%d pid=%d.\n",
+        auxp->argv[0], fd_pair[0], fd_pair[1], auxp->pid));
+
+    for (n = 0; n < auxp->numSessions; n++) {
+        (void) open_mux_obj(auxp->sessions[n]);
+    }
+    return(0);
+
+err:
+    if (fd_pair[0] >= 0) {
+        (void) close(fd_pair[0]);
+    }
+    if (fd_pair[1] >= 0) {
+        (void) close(fd_pair[1]);
+    }
+    return(-1);
+}
+
+
+static int check_helper_prog(obj_t *helper)
+{
+/*  Checks whether the 'helper' executable will likely exec.
+ *  Returns 0 if all checks pass; o/w, returns -1.
+ */
+    helper_obj_t *auxp;
+    struct stat   st;
+
+    assert(helper != NULL);
+
+    auxp = &(helper->aux->helper);
+
+    if (stat(auxp->argv[0], &st) < 0) {
+        log_msg(LOG_WARNING, "Unable to start helper \"%s\": %s",
+            auxp->prog, strerror(errno));
+        return(-1);
+    }
+    if (!S_ISREG(st.st_mode)) {
+        log_msg(LOG_WARNING,
+            "Unable to start helper \"%s\": not a regular file", auxp->prog);
+        return(-1);
+    }
+    if (access(auxp->argv[0], X_OK) < 0) {
+        log_msg(LOG_WARNING,
+            "Unable to start helper \"%s\": not executable", auxp->prog);
+        return(-1);
+    }
+    return(0);
+}
+
+
+int open_mux_obj(obj_t *mux)
+{
+/*  Opens the specified 'mux' obj's session if it is not already open.
+ *  If the helper is not running, the session will be opened once the
+ *    helper has started.
+ *  Returns 0 if the session is opened or deferred;
+ *    o/w, sets a reopen timer and returns -1.
+ */
+    mux_obj_t *auxp;
+    int        rc = 0;
+
+    assert(mux != NULL);
+    assert(is_mux_obj(mux));
+
+    auxp = &(mux->aux->mux);
+
+    if (auxp->state != CONMAN_MUX_DOWN) {
+        return(0);
+    }
+    if (auxp->timer >= 0) {
+        (void) tpoll_timeout_cancel(tp_global, auxp->timer);
+        auxp->timer = -1;
+    }
+    if (auxp->helper->aux->helper.state != CONMAN_HELPER_UP) {
+        return(0);
+    }
+    if ((rc = connect_mux_obj(mux)) < 0) {
+        schedule_mux_obj(mux);
+    }
+    return(rc);
+}
+
+
+static int connect_mux_obj(obj_t *mux)
+{
+/*  Sends an OPEN frame (followed by a RESIZE frame) for the specified
+ *    'mux' obj to its helper.  The session is pending until the helper
+ *    acknowledges it with an OPEN frame of its own.
+ *  Returns 0 if the frames are sent; o/w, returns -1.
+ */
+    mux_obj_t     *auxp;
+    unsigned char  buf[MUX_MAX_FRAME_LEN];
+    int            len;
+    int            n;
+    char         **pp;
+
+    assert(mux != NULL);
+    assert(mux->aux->mux.state == CONMAN_MUX_DOWN);
+
+    auxp = &(mux->aux->mux);
+
+    len = 0;
+    n = strlen(mux->name) + 1;
+    if (n <= (int) sizeof(buf)) {
+        memcpy(buf, mux->name, n);
+    }
+    len += n;
+    for (pp = auxp->argv; *pp != NULL; pp++) {
+        n = strlen(*pp) + 1;
+        if (len + n <= (int) sizeof(buf)) {
+            memcpy(buf + len, *pp, n);
+        }
+        len += n;
+    }
+    if (len > (int) sizeof(buf)) {
+        write_notify_msg(mux, LOG_WARNING,
+            "Console [%s] connection failed: args exceed %d bytes",
+            mux->name, (int) sizeof(buf));
+        return(-1);
+    }
+    if (write_mux_frame(mux, MUX_FRAME_OPEN, buf, len) < 0) {
+        write_notify_msg(mux, LOG_WARNING,
+            "Console [%s] connection failed: helper \"%s\" not ready",
+            mux->name, auxp->helper->aux->helper.prog);
+        return(-1);
+    }
+    buf[0] = (SCREEN_ROWS >> 8) & 0xFF;
+    buf[1] = SCREEN_ROWS & 0xFF;
+    buf[2] = (SCREEN_COLS >> 8) & 0xFF;
+    buf[3] = SCREEN_COLS & 0xFF;
+    (void) write_mux_frame(mux, MUX_FRAME_RESIZE, buf, 4);
+
+    auxp->state = CONMAN_MUX_PENDING;
+    auxp->timer = tpoll_timeout_relative(tp_global,
+        (callback_f) expire_mux_obj, mux, MUX_CONNECT_TIMEOUT * 1000);
+
+    DPRINTF((9, "Opening [%s] session %d via helper \"%s\".\n",
+        mux->name, auxp->id, auxp->helper->aux->helper.prog));
+    return(0);
+}
+
+
+static void close_mux_obj(obj_t *mux, const char *reason)
+{
+/*  Marks the specified 'mux' obj's session as closed for the given 'reason',
+ *    notifying linked objs if the session was open.
+ *  The caller is responsible for scheduling the session to be reopened.
+ */
+    mux_obj_t *auxp;
+    obj_t     *helper;
+    time_t     tNow;
+    char      *delta_str;
+
+    assert(mux != NULL);
+    assert(is_mux_obj(mux));
+
+    auxp = &(mux->aux->mux);
+    helper = auxp->helper;
+
+    if (auxp->state == CONMAN_MUX_UP) {
+        if (time(&tNow) == (time_t) -1) {
+            log_err(errno, "time() failed");
+        }
+        delta_str = create_time_delta_string(auxp->tStart, tNow);
+        write_notify_event(mux, CONMAN_SINK_DISCONNECT, LOG_INFO,
+            "Console [%s] disconnected from \"%s\" (pid %d) after %s: %s",
+            mux->name, helper->aux->helper.prog, helper->aux->helper.pid,
+            delta_str, reason);
+        free(delta_str);
+        /*
+         *  Require the session to have been up for a minimum length of time
+         *    before resetting the reopen-delay back to zero.
+         */
+        if (tNow - auxp->tStart >= MIN_CONNECT_SECS) {
+            auxp->delay = 0;
+        }
+    }
+    else if (auxp->state == CONMAN_MUX_PENDING) {
+        write_notify_msg(mux, LOG_WARNING,
+            "Console [%s] connection failed: %s", mux->name, reason);
+    }
+    auxp->tStart = 0;
+    auxp->state = CONMAN_MUX_DOWN;
+    return;
+}
+
+
+static void expire_mux_obj(obj_t *mux)
+{
+/*  Closes the specified 'mux' obj's session if the helper has not
+ *    acknowledged it within the connect timeout.
+ */
+    mux_obj_t *auxp;
+
+    assert(mux != NULL);
+    assert(is_mux_obj(mux));
+
+    auxp = &(mux->aux->mux);
+
+    /*  Reset the timer ID since this routine is only invoked by a timer.
+     */
+    auxp->timer = -1;
+
+    if (auxp->state != CONMAN_MUX_PENDING) {
+        return;
+    }
+    (void) write_mux_frame(mux, MUX_FRAME_CLOSE, NULL, 0);
+    close_mux_obj(mux, "timed out");
+    schedule_mux_obj(mux);
+    return;
+}
+
+
+static void schedule_mux_obj(obj_t *mux)
+{
+/*  Schedules the specified 'mux' obj's session to be reopened after its
+ *    reopen-delay, backing off the delay for the next attempt.
+ */
+    mux_obj_t *auxp;
+
+    assert(mux != NULL);
+    assert(is_mux_obj(mux));
+
+    auxp = &(mux->aux->mux);
+
+    DPRINTF((15, "Reopening [%s] session in %ds\n", mux->name, auxp->delay));
+
+    auxp->timer = tpoll_timeout_relative(tp_global,
+        (callback_f) open_mux_obj, mux, auxp->delay * 1000);
+
+    auxp->delay = (auxp->delay == 0)
+        ? MUX_MIN_TIMEOUT
+        : MIN(auxp->delay * 2, MUX_MAX_TIMEOUT);
+    return;
+}
+
+
+int process_helper_frames(obj_t *helper, const void *src, int len)
+{
+/*  Demultiplexes the buffer 'src' of length 'len' read from the 'helper'
+ *    obj into frames for its sessions.  A frame may be split across reads;
+ *    the parser state is kept in the helper obj.
+ *  Returns 0 since no data remains to be written to the helper's readers.
+ */
+    helper_obj_t        *auxp;
+    const unsigned char *p = src;
+    obj_t               *mux;
+    unsigned long        id;
+    int                  n;
+    int                  m;
+
+    assert(helper != NULL);
+    assert(is_helper_obj(helper));
+
+    auxp = &(helper->aux->helper);
+
+    while (len > 0) {
+
+        if (auxp->hdrLen < MUX_HDR_LEN) {
+            n = MIN(len, MUX_HDR_LEN - auxp->hdrLen);
+            memcpy(auxp->hdr + auxp->hdrLen, p, n);
+            auxp->hdrLen += n;
+            p += n;
+            len -= n;
+            if (auxp->hdrLen < MUX_HDR_LEN) {
+                break;
+            }
+            auxp->numLeft = MUX_HDR_PAYLOAD_LEN(auxp->hdr);
+            auxp->msgLen = 0;
+        }
+        if (auxp->numLeft > 0) {
+            n = MIN(len, auxp->numLeft);
+            id = MUX_HDR_ID(auxp->hdr);
+            mux = (id < (unsigned long) auxp->numSessions)
+                ? auxp->sessions[id] : NULL;
+
+            if (MUX_HDR_TYPE(auxp->hdr) == MUX_FRAME_DATA) {
+                if (mux && (mux->aux->mux.state == CONMAN_MUX_UP)) {
+                    write_readers_data(mux, p, n);
+                }
+            }
+            else if (MUX_HDR_TYPE(auxp->hdr) == MUX_FRAME_CLOSE) {
+                m = MIN(n, MAX_LINE - 1 - auxp->msgLen);
+                memcpy(auxp->msg + auxp->msgLen, p, m);
+                auxp->msgLen += m;
+            }
+            auxp->numLeft -= n;
+            p += n;
+            len -= n;
+        }
+        if (auxp->numLeft == 0) {
+            dispatch_helper_frame(helper);
+            auxp->hdrLen = 0;
+        }
+    }
+    return(0);
+}
+
+
+static void dispatch_helper_frame(obj_t *helper)
+{
+/*  Acts upon the (fully-read) control frame received from the 'helper' obj.
+ */
+    helper_obj_t  *auxp;
+    mux_obj_t     *mauxp;
+    obj_t         *mux;
+    unsigned long  id;
+
+    assert(helper != NULL);
+    assert(is_helper_obj(helper));
+
+    auxp = &(helper->aux->helper);
+
+    id = MUX_HDR_ID(auxp->hdr);
+    if (id >= (unsigned long) auxp->numSessions) {
+        DPRINTF((15, "Ignoring helper \"%s\" frame type=%d for session %lu.\n",
+            auxp->prog, MUX_HDR_TYPE(auxp->hdr), id));
+        return;
+    }
+    mux = auxp->sessions[id];
+    mauxp = &(mux->aux->mux);
+
+    switch (MUX_HDR_TYPE(auxp->hdr)) {
+    case MUX_FRAME_OPEN:
+        if (mauxp->state != CONMAN_MUX_PENDING) {
+            break;
+        }
+        if (mauxp->timer >= 0) {
+            (void) tpoll_timeout_cancel(tp_global, mauxp->timer);
+            mauxp->timer = -1;
+        }
+        if (time(&(mauxp->tStart)) == (time_t) -1) {
+            log_err(errno, "time() failed");
+        }
+        mauxp->state = CONMAN_MUX_UP;
+        write_notify_event(mux, CONMAN_SINK_CONNECT, LOG_INFO,
+            "Console [%s] connected to \"%s\" (pid %d)",
+            mux->name, auxp->prog, auxp->pid);
+        break;
+    case MUX_FRAME_CLOSE:
+        if (mauxp->state == CONMAN_MUX_DOWN) {
+            break;
+        }
+        if (mauxp->timer >= 0) {
+            (void) tpoll_timeout_cancel(tp_global, mauxp->timer);
+            mauxp->timer = -1;
+        }
+        auxp->msg[auxp->msgLen] = '\0';
+        close_mux_obj(mux, (auxp->msgLen > 0) ? auxp->msg : "closed");
+        schedule_mux_obj(mux);
+        break;
+    default:
+        break;
+    }
+    return;
+}
+
+
+int write_mux_data(obj_t *mux, const void *src, int len)
+{
+/*  Writes the buffer 'src' of length 'len' to the 'mux' obj's session as
+ *    DATA frames.  Data written while the session is not open is discarded.
+ *  Returns the number of bytes written.
+ */
+    const unsigned char *p = src;
+    int                  n;
+    int                  m;
+
+    assert(mux != NULL);
+    assert(is_mux_obj(mux));
+
+    if (mux->aux->mux.state != CONMAN_MUX_UP) {
+        DPRINTF((15, "Discarded %d bytes for [%s] session not open.\n",
+            len, mux->name));
+        return(0);
+    }
+    for (n = 0; n < len; n += m) {
+        m = MIN(len - n, MUX_MAX_FRAME_LEN);
+        if (write_mux_frame(mux, MUX_FRAME_DATA, p + n, m) < 0) {
+            log_msg(LOG_NOTICE, "Discarded %d bytes for [%s]: helper \"%s\" "
+                "not ready", len - n, mux->name,
+                mux->aux->mux.helper->aux->helper.prog);
+            break;
+        }
+    }
+    return(n);
+}
+
+
+int send_mux_break(obj_t *mux)
+{
+/*  Sends a BREAK frame to the 'mux' obj's session.
+ *  Returns 0 on success, or -1 on error.
+ */
+    assert(mux != NULL);
+    assert(is_mux_obj(mux));
+
+    if (mux->aux->mux.state != CONMAN_MUX_UP) {
+        return(-1);
+    }
+    return(write_mux_frame(mux, MUX_FRAME_BREAK, NULL, 0));
+}
+
+
+static int write_mux_frame(obj_t *mux, int type, const void *src, int len)
+{
+/*  Writes a frame of the given 'type' with the payload 'src' of length 'len'
+ *    for the 'mux' obj's session into its helper's circular-buffer.
+ *  The frame is only written if it fits in its entirety; this check-then-write
+ *    relies on frames only being written by the mux thread.
+ *  Returns 0 on success, or -1 if the helper is not running or its buffer
+ *    lacks room for the frame.
+ */
+    obj_t         *helper;
+    unsigned char  buf[MUX_HDR_LEN + MUX_MAX_FRAME_LEN];
+    unsigned long  id;
+
+    assert(mux != NULL);
+    assert(is_mux_obj(mux));
+    assert((len >= 0) && (len <= MUX_MAX_FRAME_LEN));
+    assert((src != NULL) || (len == 0));
+
+    helper = mux->aux->mux.helper;
+    id = mux->aux->mux.id;
+
+    if ((helper->fd < 0) || helper->gotEOF
+            || (helper->aux->helper.state != CONMAN_HELPER_UP)) {
+        return(-1);
+    }
+    if (get_obj_buf_avail(helper) < MUX_HDR_LEN + len) {
+        return(-1);
+    }
+    buf[0] = type;
+    buf[1] = 0;
+    buf[2] = (len >> 8) & 0xFF;
+    buf[3] = len & 0xFF;
+    buf[4] = (id >> 24) & 0xFF;
+    buf[5] = (id >> 16) & 0xFF;
+    buf[6] = (id >> 8) & 0xFF;
+    buf[7] = id & 0xFF;
+    if (len > 0) {
+        memcpy(buf + MUX_HDR_LEN, src, len);
+    }
+    (void) write_obj_data(helper, buf, MUX_HDR_LEN + len, 0);
+    return(0);
+}
@@ -53,13 +53,43 @@
 
 extern tpoll_t tp_global;               /* defined in server.c */
 
+/*  Objs written to by the mux thread while dispatching I/O in mux_io() whose
+ *    POLLOUT interest has yet to be set.  These are applied in a single
+ *    batch by apply_obj_events() before the next poll, thereby avoiding a
+ *    tpoll_set() (and its mutex) for every write during fan-out.
+ *  Writes from other threads set POLLOUT directly since tpoll_set() is what
+ *    wakes the mux thread, as do writes from timer callbacks since these are
+ *    dispatched within tpoll() itself.  This queue is only accessed by the
+ *    mux thread.
+ */
+static obj_t **eventObjs = NULL;
+static int numEventObjs = 0;
+static int maxEventObjs = 0;
+static pthread_t muxThread;
+static int gotMuxThread = 0;
+static int isDeferringEvents = 0;
+
 
+static void queue_obj_pollout(obj_t *obj);
+static void dequeue_obj_pollout(obj_t *obj);
 static char * sanitize_file_string(char *str);
-static char * find_trailing_int_str(char *str);
+static const char * find_trailing_int_str(const char *str);
+static int vwrite_notify_msg(obj_t *console, enum sink_event event,
+    int priority, char *fmt, va_list vargs);
+static void set_client_eof(obj_t *client);
 #ifndef NDEBUG
 static int validate_obj_links(obj_t *obj);
 #endif /* !NDEBUG */
 static int num_bytes_buffered(obj_t *obj);
+static int write_buf_to_obj(obj_t *obj);
+#if WITH_ZLIB
+static zlib_obj_t * create_zlib_obj(obj_t *client);
+static void destroy_zlib_obj(zlib_obj_t *zlib);
+static int write_zlib_to_obj(obj_t *client);
+#endif /* WITH_ZLIB */
+#if WITH_OPENSSL
+static int write_tls_to_obj(obj_t *client);
+#endif /* WITH_OPENSSL */
 
 
 obj_t * create_obj(
@@ -74,6 +104,10 @@ obj_t * create_obj(
 
     if (!(obj = malloc(sizeof(obj_t))))
         out_of_memory();
+    if (!(obj->aux = malloc(sizeof(aux_obj_t))))
+        out_of_memory();
+    if (!(obj->buf = malloc(OBJ_BUF_SIZE)))
+        out_of_memory();
     obj->name = create_string(name);
     obj->fd = fd;
     obj->bufInPtr = obj->bufOutPtr = obj->buf;
@@ -84,24 +118,30 @@ obj_t * create_obj(
         log_err(0, "INTERNAL: Unrecognized object [%s] type=%d", name, type);
     }
     obj->type = type;
+    obj->history = is_console_obj(obj) ? create_history() : NULL;
+    obj->latency = NULL;
     obj->gotBufWrap = 0;
     obj->gotEOF = 0;
+    obj->gotPollOut = 0;
     /*
-     *  resetCmdRef, resetCmdPid, and resetCmdTimer only apply to console objs.
-     *  But the code is simplified if they are placed in the base obj.
+     *  resetCmdRef, resetCmdPid, and gotResetQueued only apply to console
+     *    objs.  But the code is simplified if they are placed in the base obj.
      */
     obj->resetCmdRef = NULL;
     obj->resetCmdPid = 0;
-    obj->resetCmdTimer = 0;
+    obj->gotResetQueued = 0;
 
     DPRINTF((10, "Created object [%s].\n", obj->name));
     return(obj);
 }
 
 
-obj_t * create_client_obj(server_conf_t *conf, req_t *req)
+obj_t * create_client_obj(server_conf_t *conf, req_t *req,
+    exec_job_t *job, coalesce_t *co)
 {
 /*  Creates a new client object and adds it to the master objs list.
+ *    If a script (job) or coalesced monitor (co) is specified, it is started
+ *    for the client before the client is published to the mux thread.
  *    Note: the socket is open and set for non-blocking I/O.
  *  Returns the new object.
  */
@@ -116,20 +156,40 @@ obj_t * create_client_obj(server_conf_t *conf, req_t *req)
 
     set_fd_nonblocking(req->sd);
     set_fd_closed_on_exec(req->sd);
-    tpoll_set(tp_global, req->sd, POLLIN);
 
     snprintf(name, sizeof(name), "%s@%s:%d", req->user, req->host, req->port);
     name[sizeof(name) - 1] = '\0';
     client = create_obj(conf, name, req->sd, CONMAN_OBJ_CLIENT);
-    client->aux.client.req = req;
-    time(&client->aux.client.timeLastRead);
-    if (client->aux.client.timeLastRead == (time_t) -1)
+    client->aux->client.req = req;
+#if WITH_ZLIB
+    client->aux->client.zlib = (req->enableCompress)
+        ? create_zlib_obj(client) : NULL;
+#endif /* WITH_ZLIB */
+#if WITH_OPENSSL
+    client->aux->client.tls = (req->ssl) ? create_tls_obj(client) : NULL;
+#endif /* WITH_OPENSSL */
+    client->aux->client.coalesce = NULL;
+    client->aux->client.exec = NULL;
+    client->latency = create_latency();
+    time(&client->aux->client.timeLastRead);
+    if (client->aux->client.timeLastRead == (time_t) -1)
         log_err(errno, "time() failed");
-    client->aux.client.gotEscape = 0;
-    client->aux.client.gotSuspend = 0;
-
-    /*  Add obj to the master conf->objs list.
+    client->aux->client.frameLeft = 0;
+    client->aux->client.frameHdrLen = 0;
+    client->aux->client.gotEscape = 0;
+    client->aux->client.gotSuspend = 0;
+
+    /*  Attach the job or monitor while the client is still private to this
+     *    thread, since the mux thread may shut it down at any point after it
+     *    is added to the master conf->objs list.
      */
+    if (job != NULL) {
+        start_exec_job(job, client);
+    }
+    if (co != NULL) {
+        start_coalesce(co, client);
+    }
+    tpoll_set(tp_global, req->sd, POLLIN);
     list_append(conf->objs, client);
 
     DPRINTF((9, "Opened client: fd=%d user=%s tty=%s host=%s port=%d.\n",
@@ -159,25 +219,72 @@ void destroy_obj(obj_t *obj)
 
     switch(obj->type) {
     case CONMAN_OBJ_CLIENT:
-        if (obj->aux.client.req) {
-            req_t *req = obj->aux.client.req;
+        if (obj->aux->client.req) {
+            req_t *req = obj->aux->client.req;
             log_msg(LOG_INFO, "Client <%s@%s:%d> disconnected",
                 req->user, req->fqdn, req->port);
+            log_obj_latency(obj);
+#if WITH_OPENSSL
+            if (req->ssl && (obj->fd >= 0)) {
+                (void) SSL_shutdown(req->ssl);  /* send close_notify alert */
+            }
+#endif /* WITH_OPENSSL */
             req->sd = -1;       /* prevent destroy_req from also closing sd */
             destroy_req(req);
-            obj->aux.client.req = NULL;
+            obj->aux->client.req = NULL;
         }
+#if WITH_ZLIB
+        if (obj->aux->client.zlib) {
+            destroy_zlib_obj(obj->aux->client.zlib);
+            obj->aux->client.zlib = NULL;
+        }
+#endif /* WITH_ZLIB */
+#if WITH_OPENSSL
+        if (obj->aux->client.tls) {
+            destroy_tls_obj(obj->aux->client.tls);
+            obj->aux->client.tls = NULL;
+        }
+#endif /* WITH_OPENSSL */
+        if (obj->aux->client.coalesce) {
+            destroy_coalesce(obj->aux->client.coalesce);
+            obj->aux->client.coalesce = NULL;
+        }
+        if (obj->aux->client.exec) {
+            destroy_exec_job(obj->aux->client.exec);
+            obj->aux->client.exec = NULL;
+        }
+        break;
+    case CONMAN_OBJ_HELPER:
+        for (pp = obj->aux->helper.argv; *pp != NULL; pp++) {
+            free(*pp);
+        }
+        free(obj->aux->helper.argv);
+        free(obj->aux->helper.sessions);
+        free(obj->aux->helper.msg);
         break;
     case CONMAN_OBJ_LOGFILE:
-        if (obj->aux.logfile.fmtName) {
-            free(obj->aux.logfile.fmtName);
+        if (obj->aux->logfile.lane) {
+            destroy_pipe_lane(obj->aux->logfile.lane);
+            obj->aux->logfile.lane = NULL;
+        }
+        if (obj->aux->logfile.fmtName) {
+            free(obj->aux->logfile.fmtName);
+        }
+        break;
+    case CONMAN_OBJ_MUX:
+        for (pp = obj->aux->mux.argv; *pp != NULL; pp++) {
+            free(*pp);
         }
+        free(obj->aux->mux.argv);
+        /*  Do not destroy obj->aux->mux.helper or obj->aux->mux.logfile
+         *    since they are only refs.
+         */
         break;
     case CONMAN_OBJ_PROCESS:
-        for (pp = obj->aux.process.argv; *pp != NULL; pp++) {
+        for (pp = obj->aux->process.argv; *pp != NULL; pp++) {
             free(*pp);
         }
-        /*  Do not destroy obj->aux.process.logfile since it is only a ref.
+        /*  Do not destroy obj->aux->process.logfile since it is only a ref.
          */
         break;
     case CONMAN_OBJ_SERIAL:
@@ -192,41 +299,41 @@ void destroy_obj(obj_t *obj)
          *    Play it safe and discard any pending output.
          */
         if (obj->fd >= 0) {
-            set_tty_mode(&obj->aux.serial.tty, obj->fd);
+            set_tty_mode(&obj->aux->serial.tty, obj->fd);
             if (tcflush(obj->fd, TCIOFLUSH) < 0)
                 log_msg(LOG_INFO,
                     "Unable to flush tty device for console [%s]", obj->name);
         }
-        if (obj->aux.serial.dev) {
-            free(obj->aux.serial.dev);
+        if (obj->aux->serial.dev) {
+            free(obj->aux->serial.dev);
         }
-        /*  Do not destroy obj->aux.serial.logfile since it is only a ref.
+        /*  Do not destroy obj->aux->serial.logfile since it is only a ref.
          */
         break;
     case CONMAN_OBJ_TELNET:
-        if (obj->aux.telnet.host) {
-            free(obj->aux.telnet.host);
+        if (obj->aux->telnet.host) {
+            free(obj->aux->telnet.host);
         }
-        /*  Do not destroy obj->aux.telnet.logfile since it is only a ref.
+        /*  Do not destroy obj->aux->telnet.logfile since it is only a ref.
          */
         break;
     case CONMAN_OBJ_UNIXSOCK:
-        if (obj->aux.unixsock.dev) {
-            (void) inevent_remove(obj->aux.unixsock.dev);
-            free(obj->aux.unixsock.dev);
+        if (obj->aux->unixsock.dev) {
+            (void) inevent_remove(obj->aux->unixsock.dev);
+            free(obj->aux->unixsock.dev);
         }
-        /*  Do not destroy obj->aux.unixsock.logfile since it is only a ref.
+        /*  Do not destroy obj->aux->unixsock.logfile since it is only a ref.
          */
         break;
 #if WITH_FREEIPMI
     case CONMAN_OBJ_IPMI:
-        if (obj->aux.ipmi.host) {
-            free(obj->aux.ipmi.host);
+        if (obj->aux->ipmi.host) {
+            free(obj->aux->ipmi.host);
         }
-        if (obj->aux.ipmi.ctx) {
-            ipmiconsole_ctx_destroy(obj->aux.ipmi.ctx);
+        if (obj->aux->ipmi.ctx) {
+            ipmiconsole_ctx_destroy(obj->aux->ipmi.ctx);
         }
-        x_pthread_mutex_destroy(&obj->aux.ipmi.mutex);
+        x_pthread_mutex_destroy(&obj->aux->ipmi.mutex);
         break;
 #endif /* WITH_FREEIPMI */
     case CONMAN_OBJ_TEST:
@@ -237,7 +344,16 @@ void destroy_obj(obj_t *obj)
         break;
     }
 
+    if (obj->gotPollOut) {
+        dequeue_obj_pollout(obj);
+    }
     x_pthread_mutex_destroy(&obj->bufLock);
+    if (obj->history) {
+        destroy_history(obj->history);
+    }
+    if (obj->latency) {
+        destroy_latency(obj->latency);
+    }
     if (obj->readers) {
         list_destroy(obj->readers);
     }
@@ -255,6 +371,8 @@ void destroy_obj(obj_t *obj)
     if (obj->name) {
         free(obj->name);
     }
+    free(obj->buf);
+    free(obj->aux);
     free(obj);
     return;
 }
@@ -270,6 +388,12 @@ void reopen_obj(obj_t *obj)
     else if (is_process_obj(obj)) {
         open_process_obj(obj);
     }
+    else if (is_helper_obj(obj)) {
+        open_helper_obj(obj);
+    }
+    else if (is_mux_obj(obj)) {
+        open_mux_obj(obj);
+    }
     else if (is_serial_obj(obj)) {
         open_serial_obj(obj);
     }
@@ -353,7 +477,7 @@ int format_obj_string(char *buf, int buflen, obj_t *obj, const char *fmt)
                 if (!obj)
                     goto ignore_specifier;
                 if (is_serial_obj(obj) || is_unixsock_obj(obj)) {
-                    q = obj->aux.serial.dev;
+                    q = obj->aux->serial.dev;
                     p = (p = strrchr(q, '/')) ? p + 1 : q;
                     m = strlen(p);
                     if ((n -= m) > 0) {
@@ -365,7 +489,7 @@ int format_obj_string(char *buf, int buflen, obj_t *obj, const char *fmt)
                 else if (is_telnet_obj(obj)) {
                     assert(n > 0);
                     m = snprintf (pdst, n, "%s:%d",
-                        obj->aux.telnet.host, obj->aux.telnet.port);
+                        obj->aux->telnet.host, obj->aux->telnet.port);
                     if ((m < 0) || (m >= n))
                         n = 0;
                     else {
@@ -448,24 +572,34 @@ static char * sanitize_file_string(char *str)
 
 int compare_objs(obj_t *obj1, obj_t *obj2)
 {
-/*  Used by list_sort() to compare the name of (obj1) to that of (obj2).
- *  Objects are sorted by their name in ascending ASCII order, with the
- *    exception that if both objects match up to the point of a trailing
- *    integer string then they will be sorted numerically according to
- *    this integer (eg, foo1 < foo2 < foo10).
- *  Returns less-than-zero if (obj1 < obj2), zero if (obj1 == obj2),
- *    and greater-than-zero if (obj1 > obj2).
+/*  Used by list_sort() to compare the name of (obj1) to that of (obj2)
+ *    as per compare_obj_names().
  */
-    char *str1, *str2;
-    char *int1, *int2;
-
     assert(obj1 != NULL);
     assert(obj2 != NULL);
-    assert(obj1->name != NULL);
-    assert(obj2->name != NULL);
 
-    str1 = obj1->name;
-    str2 = obj2->name;
+    return(compare_obj_names(obj1->name, obj2->name));
+}
+
+
+int compare_obj_names(const char *name1, const char *name2)
+{
+/*  Used by list_sort() to compare obj (name1) to obj (name2).
+ *  Names are sorted in ascending ASCII order, with the exception that
+ *    if both names match up to the point of a trailing integer string
+ *    then they will be sorted numerically according to this integer
+ *    (eg, foo1 < foo2 < foo10).
+ *  Returns less-than-zero if (name1 < name2), zero if (name1 == name2),
+ *    and greater-than-zero if (name1 > name2).
+ */
+    const char *str1, *str2;
+    const char *int1, *int2;
+
+    assert(name1 != NULL);
+    assert(name2 != NULL);
+
+    str1 = name1;
+    str2 = name2;
     int1 = find_trailing_int_str(str1);
     int2 = find_trailing_int_str(str2);
 
@@ -481,12 +615,12 @@ int compare_objs(obj_t *obj1, obj_t *obj2)
 }
 
 
-static char * find_trailing_int_str(char *str)
+static const char * find_trailing_int_str(const char *str)
 {
 /*  Searches string 'str' for a trailing integer.
  *  Returns a ptr to the start of the integer; o/w, returns NULL.
  */
-    char *p, *q;
+    const char *p, *q;
 
     for (p=str, q=NULL; p && *p; p++) {
         if (!isdigit((int) *p))
@@ -515,12 +649,46 @@ int write_notify_msg(obj_t *console, int priority, char *fmt, ...)
 {
 /*  Writes a notification message to the daemon logfile and all attached
  *    readers & writers of (console).
+ */
+    va_list  vargs;
+    int      rc;
+
+    va_start(vargs, fmt);
+    rc = vwrite_notify_msg(console, CONMAN_SINK_NONE, priority, fmt, vargs);
+    va_end(vargs);
+    return(rc);
+}
+
+
+int write_notify_event(obj_t *console, enum sink_event event,
+    int priority, char *fmt, ...)
+{
+/*  Writes a notification message for the (event) on (console) as with
+ *    write_notify_msg(), and writes a record of the event to the sink.
+ *  Since the console has connected or disconnected, the console registry
+ *    is invalidated to publish its new state.
+ */
+    va_list  vargs;
+    int      rc;
+
+    invalidate_console_registry();
+    va_start(vargs, fmt);
+    rc = vwrite_notify_msg(console, event, priority, fmt, vargs);
+    va_end(vargs);
+    return(rc);
+}
+
+
+static int vwrite_notify_msg(obj_t *console, enum sink_event event,
+    int priority, char *fmt, va_list vargs)
+{
+/*  Writes the notification message for write_notify_msg() and
+ *    write_notify_event().
  */
     char     buf[MAX_LINE];
     char    *p;
     int      len;
     int      n;
-    va_list  vargs;
 
     assert(console != NULL);
     assert(is_console_obj(console));
@@ -543,10 +711,11 @@ int write_notify_msg(obj_t *console, int priority, char *fmt, ...)
     }
 
     if (len > 0) {
-        va_start(vargs, fmt);
         n = vsnprintf(p, len, fmt, vargs);
-        va_end(vargs);
         log_msg(priority, "%s", p);
+        if (event != CONMAN_SINK_NONE) {
+            write_sink_event(console, event, p);
+        }
         if ((n < 0) || (n >= len)) {
             len = 0;
         }
@@ -615,20 +784,20 @@ void link_objs(obj_t *src, obj_t *dst)
 
     if (is_client_obj(src) && is_console_obj(dst)) {
 
-        gotBcast = src->aux.client.req->enableBroadcast;
-        gotStolen = src->aux.client.req->enableForce
+        gotBcast = src->aux->client.req->enableBroadcast;
+        gotStolen = src->aux->client.req->enableForce
             && !list_is_empty(dst->writers);
         now = create_short_time_string(0);
 
         /*  Notify existing console readers and writers
          *    regarding the "writable" client's arrival.
          */
-        tty = src->aux.client.req->tty;
+        tty = src->aux->client.req->tty;
         snprintf(buf, sizeof(buf),
             "%sConsole [%s] %s%s by <%s@%s>%s%s at %s%s",
             CONMAN_MSG_PREFIX, dst->name,
             (gotStolen ? "stolen" : "joined"), (gotBcast ? " for B/C" : ""),
-            src->aux.client.req->user, src->aux.client.req->host,
+            src->aux->client.req->user, src->aux->client.req->host,
             (tty ? " on " : ""), (tty ? tty : ""), now, CONMAN_MSG_SUFFIX);
         strcpy(&buf[sizeof(buf) - 3], "\r\n");
         notify_console_objs(dst, buf);
@@ -638,12 +807,12 @@ void link_objs(obj_t *src, obj_t *dst)
         i = list_iterator_create(dst->writers);
         while ((writer = list_next(i))) {
             assert(is_client_obj(writer));
-            tty = writer->aux.client.req->tty;
+            tty = writer->aux->client.req->tty;
             snprintf(buf, sizeof(buf),
                 "%sConsole [%s] %s <%s@%s>%s%s at %s%s",
                 CONMAN_MSG_PREFIX, dst->name,
                 (gotStolen ? "stolen from" : "joined with"),
-                writer->aux.client.req->user, writer->aux.client.req->host,
+                writer->aux->client.req->user, writer->aux->client.req->host,
                 (tty ? " on " : ""), (tty ? tty : ""), now, CONMAN_MSG_SUFFIX);
             strcpy(&buf[sizeof(buf) - 3], "\r\n");
             write_obj_data(src, buf, strlen(buf), 1);
@@ -705,11 +874,11 @@ void unlink_objs(obj_t *src, obj_t *dst)
          *    regarding the "writable" client's departure.
          */
         now = create_short_time_string(0);
-        tty = src->aux.client.req->tty;
+        tty = src->aux->client.req->tty;
         snprintf(buf, sizeof(buf),
             "%sConsole [%s] departed by <%s@%s>%s%s at %s%s",
             CONMAN_MSG_PREFIX, dst->name,
-            src->aux.client.req->user, src->aux.client.req->host,
+            src->aux->client.req->user, src->aux->client.req->host,
             (tty ? " on " : ""), (tty ? tty : ""), now, CONMAN_MSG_SUFFIX);
         free(now);
         strcpy(&buf[sizeof(buf) - 3], "\r\n");
@@ -722,13 +891,13 @@ void unlink_objs(obj_t *src, obj_t *dst)
      */
     if (is_client_obj(src)
             && list_is_empty(src->readers) && list_is_empty(src->writers)) {
-        assert(is_console_obj(dst));
-        src->gotEOF = 1;
+        assert(is_console_obj(dst) || src->aux->client.req->enableRelay);
+        set_client_eof(src);
     }
-    else if (is_client_obj(dst)
+    if (is_client_obj(dst)
             && list_is_empty(dst->readers) && list_is_empty(dst->writers)) {
-        assert(is_console_obj(src));
-        dst->gotEOF = 1;
+        assert(is_console_obj(src) || dst->aux->client.req->enableRelay);
+        set_client_eof(dst);
     }
 
     DPRINTF((10, "Unlinked [%s] reads from [%s] writes.\n",
@@ -739,6 +908,22 @@ void unlink_objs(obj_t *src, obj_t *dst)
 }
 
 
+static void set_client_eof(obj_t *client)
+{
+/*  Sets the EOF flag of a (client) obj that has become completely unlinked.
+ *  Nothing more is written to an unlinked relay client, so POLLOUT is set
+ *    to ensure it is closed once its buffer has drained.
+ */
+    assert(is_client_obj(client));
+
+    client->gotEOF = 1;
+    if (client->aux->client.req->enableRelay && (client->fd >= 0)) {
+        tpoll_set(tp_global, client->fd, POLLOUT);
+    }
+    return;
+}
+
+
 void unlink_obj(obj_t *obj)
 {
 /*  Destroys all links between (obj) and its readers & writers.
@@ -835,6 +1020,9 @@ int shutdown_obj(obj_t *obj)
     n = num_bytes_buffered(obj);
     obj->bufInPtr = obj->bufOutPtr = obj->buf;
     obj->gotEOF = 0;
+    if (obj->latency) {
+        record_latency(obj, n, 1);
+    }
     x_pthread_mutex_unlock(&obj->bufLock);
     if (n > 0) {
         log_msg(LOG_WARNING,
@@ -846,6 +1034,12 @@ int shutdown_obj(obj_t *obj)
      *    and the objs list destructor will destroy the obj.
      */
     if (is_client_obj(obj)) {
+        if (obj->aux->client.coalesce) {
+            cancel_coalesce(obj->aux->client.coalesce);
+        }
+        if (obj->aux->client.exec) {
+            cancel_exec_job(obj->aux->client.exec);
+        }
         unlink_obj(obj);
         return(-1);
     }
@@ -855,10 +1049,10 @@ int shutdown_obj(obj_t *obj)
     if (is_logfile_obj(obj)) {
         return(0);
     }
-    /*  If a console obj is shut down, close the existing connection
+    /*  If a console or helper obj is shut down, close the existing connection
      *    and re-open a new one.
      */
-    if (is_console_obj(obj)) {
+    if (is_console_obj(obj) || is_helper_obj(obj)) {
         reopen_obj(obj);
         return(0);
     }
@@ -884,8 +1078,7 @@ int read_from_obj(obj_t *obj)
     unsigned char buf[(OBJ_BUF_SIZE / 2) - 1];
     int n;
     int isEmpty;
-    ListIterator i;
-    obj_t *reader;
+    obj_t *logfile;
 
     DPRINTF((20, "Entered read_from_obj: [%s]\n", obj->name));
 
@@ -897,11 +1090,44 @@ int read_from_obj(obj_t *obj)
      *    when connection establishment fails, it becomes readable & writable.
      *  The completion of a PENDING connection is handled in write_to_obj().
      */
-    if (is_telnet_obj(obj) && (obj->aux.telnet.state != CONMAN_TELNET_UP)) {
+    if (is_telnet_obj(obj) && (obj->aux->telnet.state != CONMAN_TELNET_UP)) {
+        return(0);
+    }
+    /*  Stop reading from a console whose logfile pipeline lane is backed up;
+     *    POLLIN is set again once the backlog has been delivered.
+     */
+    if (is_console_obj(obj)
+            && (logfile = get_console_logfile_obj(obj))
+            && logfile->aux->logfile.lane
+            && throttle_pipe_lane(logfile->aux->logfile.lane)) {
+        tpoll_clear(tp_global, obj->fd, POLLIN);
+        return(0);
+    }
+    /*  A relay client has nowhere to write its data until it has been linked
+     *    by the thread that created it, so leave the data in the socket.
+     *  Once it has been unlinked, it is only awaiting its close.
+     */
+    if (is_client_obj(obj) && obj->aux->client.req->enableRelay
+            && list_is_empty(obj->readers)) {
+        if (obj->gotEOF) {
+            tpoll_clear(tp_global, obj->fd, POLLIN);
+        }
         return(0);
     }
 again:
-    if ((n = read(obj->fd, buf, sizeof(buf))) < 0) {
+#if WITH_OPENSSL
+    /*  An encrypted client is read through its TLS session unless the kernel
+     *    is decrypting the stream.
+     */
+    if (is_client_obj(obj) && (obj->aux->client.tls != NULL)
+            && !obj->aux->client.tls->isKtlsRecv) {
+        n = read_req_data(obj->aux->client.req, buf, sizeof(buf));
+    }
+    else
+#endif /* WITH_OPENSSL */
+    n = read(obj->fd, buf, sizeof(buf));
+
+    if (n < 0) {
         if (errno == EINTR) {
             goto again;
         }
@@ -926,37 +1152,121 @@ again:
         DPRINTF((15, "Read %d bytes from [%s].\n", n, obj->name));
         if (is_client_obj(obj)) {
             x_pthread_mutex_lock(&obj->bufLock);
-            time(&obj->aux.client.timeLastRead);
-            if (obj->aux.client.timeLastRead == (time_t) -1) {
+            time(&obj->aux->client.timeLastRead);
+            if (obj->aux->client.timeLastRead == (time_t) -1) {
                 log_err(errno, "time() failed");
             }
             x_pthread_mutex_unlock(&obj->bufLock);
-            n = process_client_escapes(obj, buf, n);
+            /*
+             *  Data relayed to/from a worker proc is processed by the worker.
+             */
+            if (obj->aux->client.req->enableRelay) {
+                ;
+            }
+            else if (obj->aux->client.req->enableFramed) {
+                n = process_client_frames(obj, buf, n);
+                if (n < 0) {
+                    return(shutdown_obj(obj));
+                }
+            }
+            else {
+                n = process_client_escapes(obj, buf, n);
+            }
         }
         else if (is_telnet_obj(obj)) {
+            if (obj->aux->telnet.opts.probeSecs > 0) {
+                time(&obj->aux->telnet.timeLastRead);
+            }
             n = process_telnet_escapes(obj, buf, n);
         }
+        else if (is_helper_obj(obj)) {
+            n = process_helper_frames(obj, buf, n);
+        }
         /*  Ensure the buffer still contains data
          *    after the escape characters have been processed.
          */
         if (n > 0) {
-            i = list_iterator_create(obj->readers);
-            while ((reader = list_next(i))) {
-
-                if (is_logfile_obj(reader)) {
-                    write_log_data(reader, buf, n);
-                }
-                else {
-                    write_obj_data(reader, buf, n, 0);
-                }
-            }
-            list_iterator_destroy(i);
+            write_readers_data(obj, buf, n);
         }
+#if WITH_OPENSSL
+        /*  A TLS record may hold more data than was read into buf; since
+         *    this remainder has already been read from the socket, poll()
+         *    will not report it.
+         */
+        if (is_client_obj(obj) && is_req_data_pending(obj->aux->client.req)) {
+            goto again;
+        }
+#endif /* WITH_OPENSSL */
     }
     return(n);
 }
 
 
+void write_readers_data(obj_t *obj, const void *src, int len)
+{
+/*  Writes the buffer (src) of length (len) read from (obj) into the
+ *    circular-buffer of each obj in its "readers" list.
+ *  Output read from a console is first appended to the console's history,
+ *    whose buf is allocated upon the console's first output.
+ *    The history lock is held across the fan-out so a client being linked
+ *    to the console sees each byte exactly once: either replayed from the
+ *    history or written here.
+ *  Clients that requested output filtering are written afterwards, since
+ *    each distinct filter is applied only once for all clients sharing it.
+ */
+    ListIterator i;
+    obj_t *reader;
+    int gotFilter = 0;
+
+    assert(obj != NULL);
+
+    if (!src || (len <= 0)) {
+        return;
+    }
+    if (is_console_obj(obj)) {
+        begin_ingest(obj);
+        write_sink_data(obj, src, len);
+    }
+    if (obj->history) {
+        x_pthread_mutex_lock(&obj->history->lock);
+        write_history_data(obj->history, src, len);
+        if (obj->history->enableScreen) {
+            write_screen_data(obj->history, src, len);
+        }
+    }
+    i = list_iterator_create(obj->readers);
+    while ((reader = list_next(i))) {
+
+        if (is_logfile_obj(reader)) {
+            write_log_data(reader, src, len);
+        }
+        else if (is_client_obj(reader) && reader->aux->client.req->filter) {
+            gotFilter = 1;
+        }
+        else {
+            write_obj_data(reader, src, len, 0);
+        }
+    }
+    list_iterator_destroy(i);
+
+    if (gotFilter && obj->history) {
+        write_filtered_readers_data(obj, src, len);
+    }
+    if (obj->history && !list_is_empty(obj->history->coalesce)) {
+        write_coalesce_data(obj, src, len);
+    }
+    if (obj->history && !list_is_empty(obj->history->execs)) {
+        write_exec_data(obj, src, len);
+    }
+
+    if (obj->history) {
+        x_pthread_mutex_unlock(&obj->history->lock);
+    }
+    end_ingest();
+    return;
+}
+
+
 int write_obj_data(obj_t *obj, const void *src, int len, int isInfo)
 {
 /*  Writes the buffer (src) of length (len) into the object's (obj)
@@ -975,6 +1285,18 @@ int write_obj_data(obj_t *obj, const void *src, int len, int isInfo)
     if (!src || len <= 0) {
         return(0);
     }
+    /*  A mux obj has no fd of its own; its data is written into the
+     *    circular-buffer of its helper obj as frames.
+     */
+    if (is_mux_obj(obj)) {
+        return(write_mux_data(obj, src, len));
+    }
+    /*  An informational message for a logfile whose data is being processed
+     *    by the pipeline is queued behind that data to preserve its order.
+     */
+    if (isInfo && is_logfile_obj(obj) && obj->aux->logfile.lane) {
+        return(submit_pipe_data(obj->aux->logfile.lane, src, len, 1));
+    }
     /*  If the obj's gotEOF flag is set,
      *    no more data can be written into its buffer.
      */
@@ -994,7 +1316,7 @@ int write_obj_data(obj_t *obj, const void *src, int len, int isInfo)
     /*  Do nothing if this is an informational message
      *    and the client has requested not to be bothered.
      */
-    if (isInfo && is_client_obj(obj) && obj->aux.client.req->enableQuiet) {
+    if (isInfo && is_client_obj(obj) && obj->aux->client.req->enableQuiet) {
         x_pthread_mutex_unlock(&obj->bufLock);
         return(0);
     }
@@ -1037,13 +1359,19 @@ int write_obj_data(obj_t *obj, const void *src, int len, int isInfo)
         memcpy(obj->bufInPtr, src, n);
         obj->bufInPtr += n;             /* Hokey-Pokey not needed here */
     }
+    if (obj->latency) {
+        mark_latency(obj, len);
+    }
     /*  Check to see if any data in circular-buffer was overwritten.
      */
     if (len > avail) {
-        if (!is_client_obj(obj) || !obj->aux.client.gotSuspend) {
+        if (!is_client_obj(obj) || !obj->aux->client.gotSuspend) {
             log_msg(LOG_NOTICE, "Overwrote %d bytes for \"%s\"",
                 len - avail, obj->name);
         }
+        if (obj->latency) {
+            record_latency(obj, len - avail, 1);
+        }
         obj->bufOutPtr = obj->bufInPtr + 1;
         if (obj->bufOutPtr == &obj->buf[OBJ_BUF_SIZE]) {
             obj->bufOutPtr = obj->buf;
@@ -1052,8 +1380,14 @@ int write_obj_data(obj_t *obj, const void *src, int len, int isInfo)
     /*  Notify tpoll that data is available for writing
      *    unless it is a client obj that is currently suspended.
      */
-    if (!is_client_obj(obj) || !obj->aux.client.gotSuspend) {
-        tpoll_set(tp_global, obj->fd, POLLOUT);
+    if (!is_client_obj(obj) || !obj->aux->client.gotSuspend) {
+        if (gotMuxThread && pthread_equal(pthread_self(), muxThread)
+                && isDeferringEvents) {
+            queue_obj_pollout(obj);
+        }
+        else {
+            tpoll_set(tp_global, obj->fd, POLLOUT);
+        }
     }
     /*  Assert the buffer's input and output ptrs are valid upon exit.
      */
@@ -1068,21 +1402,117 @@ int write_obj_data(obj_t *obj, const void *src, int len, int isInfo)
      *    re-initialize the console log's newline state.
      */
     if (isInfo && is_logfile_obj(obj)) {
-        obj->aux.logfile.lineState = CONMAN_LOG_LINE_INIT;
+        obj->aux->logfile.filter.lineState = CONMAN_LOG_LINE_INIT;
     }
     return(len);
 }
 
 
+int get_obj_buf_avail(obj_t *obj)
+{
+/*  Returns the number of bytes that can be written into the object's (obj)
+ *    circular-buffer without overwriting data not yet written out to its fd.
+ */
+    int avail;
+
+    assert(obj != NULL);
+
+    x_pthread_mutex_lock(&obj->bufLock);
+    avail = OBJ_BUF_SIZE - 1 - num_bytes_buffered(obj);
+    x_pthread_mutex_unlock(&obj->bufLock);
+    return(avail);
+}
+
+
+void defer_obj_events(void)
+{
+/*  Defers setting POLLOUT for objs written to by the calling (mux) thread
+ *    until apply_obj_events() is called.
+ */
+    if (!gotMuxThread) {
+        muxThread = pthread_self();
+        gotMuxThread = 1;
+    }
+    isDeferringEvents = 1;
+    return;
+}
+
+
+void apply_obj_events(void)
+{
+/*  Sets POLLOUT for each obj written to since defer_obj_events() was called,
+ *    and stops deferring.  This must be called by the mux thread before
+ *    each poll.
+ */
+    obj_t *obj;
+    int i;
+
+    if (!isDeferringEvents) {
+        return;
+    }
+    assert(pthread_equal(pthread_self(), muxThread));
+    isDeferringEvents = 0;
+
+    for (i = 0; i < numEventObjs; i++) {
+        obj = eventObjs[i];
+        x_pthread_mutex_lock(&obj->bufLock);
+        obj->gotPollOut = 0;
+        if ((obj->fd >= 0)
+                && (!is_client_obj(obj) || !obj->aux->client.gotSuspend)) {
+            tpoll_set(tp_global, obj->fd, POLLOUT);
+        }
+        x_pthread_mutex_unlock(&obj->bufLock);
+    }
+    numEventObjs = 0;
+    return;
+}
+
+
+static void queue_obj_pollout(obj_t *obj)
+{
+/*  Queues the (obj) to have its POLLOUT interest set before the next poll.
+ *  The obj's bufLock must be held by the caller.
+ */
+    if (obj->gotPollOut) {
+        return;
+    }
+    if (numEventObjs == maxEventObjs) {
+        maxEventObjs = (maxEventObjs > 0) ? maxEventObjs * 2 : 64;
+        eventObjs = realloc(eventObjs, maxEventObjs * sizeof(obj_t *));
+        if (!eventObjs) {
+            out_of_memory();
+        }
+    }
+    eventObjs[numEventObjs++] = obj;
+    obj->gotPollOut = 1;
+    return;
+}
+
+
+static void dequeue_obj_pollout(obj_t *obj)
+{
+/*  Removes the (obj) from the queue of pending POLLOUT updates
+ *    since it is being destroyed.
+ */
+    int i;
+
+    for (i = 0; i < numEventObjs; i++) {
+        if (eventObjs[i] == obj) {
+            eventObjs[i] = eventObjs[--numEventObjs];
+            break;
+        }
+    }
+    obj->gotPollOut = 0;
+    return;
+}
+
+
 int write_to_obj(obj_t *obj)
 {
 /*  Writes data from the obj's circular-buffer out to its file descriptor.
  *  Returns 0 on success, or -1 if the obj is ready to be destroyed.
  */
-    struct iovec iov[2];
-    int iovcnt = 0;
-    int isDead = 0;
-    int n;
+    int isDead;
 
     DPRINTF((20, "Entered write_to_obj: [%s]\n", obj->name));
 
@@ -1092,11 +1522,60 @@ int write_to_obj(obj_t *obj)
     /*  The completion of a nonblocking connect() makes the socket writable,
      *    so complete the telnet obj non-blocking connect here if needed.
      */
-    if (is_telnet_obj(obj) && (obj->aux.telnet.state == CONMAN_TELNET_PENDING))
-    {
+    if (is_telnet_obj(obj)
+            && (obj->aux->telnet.state == CONMAN_TELNET_PENDING)) {
         open_telnet_obj(obj);
         return(0);
     }
+#if WITH_ZLIB
+    /*  A compressed client stream is deflated on its way out of the buffer.
+     */
+    if (is_client_obj(obj) && (obj->aux->client.zlib != NULL)) {
+        isDead = write_zlib_to_obj(obj);
+    }
+    else
+#endif /* WITH_ZLIB */
+#if WITH_OPENSSL
+    /*  An encrypted client stream is written through its TLS session unless
+     *    the kernel is encrypting it, in which case the circular-buffer is
+     *    written out directly.
+     */
+    if (is_client_obj(obj) && (obj->aux->client.tls != NULL)
+            && !obj->aux->client.tls->isKtlsSend) {
+        isDead = write_tls_to_obj(obj);
+    }
+    else
+#endif /* WITH_OPENSSL */
+    isDead = write_buf_to_obj(obj);
+
+    /*  Results of a client's script or coalesced monitor (or a logfile's
+     *    pipeline) are held back until there is room for them in the buffer,
+     *    so move more in now that some has drained.
+     */
+    if (!isDead && is_client_obj(obj) && obj->aux->client.coalesce) {
+        flush_coalesce_results(obj->aux->client.coalesce);
+    }
+    if (!isDead && is_client_obj(obj) && obj->aux->client.exec) {
+        flush_exec_results(obj->aux->client.exec);
+    }
+    if (!isDead && is_logfile_obj(obj) && obj->aux->logfile.lane) {
+        flush_pipe_lane(obj->aux->logfile.lane);
+    }
+    return(isDead ? shutdown_obj(obj) : 0);
+}
+
+
+static int write_buf_to_obj(obj_t *obj)
+{
+/*  Writes data from the obj's circular-buffer out to its file descriptor
+ *    as is.
+ *  Returns non-zero if the obj is ready to be destroyed.
+ */
+    struct iovec iov[2];
+    int iovcnt = 0;
+    int isDead = 0;
+    int n;
+
     x_pthread_mutex_lock(&obj->bufLock);
 
     /*  Assert the buffer's input and output ptrs are valid upon entry.
@@ -1152,6 +1631,9 @@ again:
             if (obj->bufOutPtr >= &obj->buf[OBJ_BUF_SIZE]) {
                 obj->bufOutPtr -= OBJ_BUF_SIZE;
             }
+            if (obj->latency) {
+                record_latency(obj, n, 0);
+            }
         }
     }
     /*  If all buffered data has been written out to the fd...
@@ -1177,7 +1659,7 @@ again:
 
     x_pthread_mutex_unlock(&obj->bufLock);
 
-    return(isDead ? shutdown_obj(obj) : 0);
+    return(isDead);
 }
 
 
@@ -1199,3 +1681,251 @@ static int num_bytes_buffered(obj_t *obj)
     }
     return(n);
 }
+
+
+#if WITH_ZLIB
+static zlib_obj_t * create_zlib_obj(obj_t *client)
+{
+/*  Creates the deflate state for compressing the data stream written
+ *    out to the (client) obj.
+ *  Returns the new zlib obj.
+ */
+    zlib_obj_t *zlib;
+    int rc;
+
+    assert(client != NULL);
+
+    if (!(zlib = malloc(sizeof(zlib_obj_t)))) {
+        out_of_memory();
+    }
+    memset(&zlib->strm, 0, sizeof(zlib->strm));
+    rc = deflateInit(&zlib->strm, ZLIB_COMPRESS_LEVEL);
+    if (rc == Z_MEM_ERROR) {
+        out_of_memory();
+    }
+    else if (rc != Z_OK) {
+        log_err(0, "Unable to initialize compression for [%s]: %s",
+            client->name, (zlib->strm.msg ? zlib->strm.msg : "zlib error"));
+    }
+    zlib->bufInPtr = zlib->bufOutPtr = zlib->buf;
+    zlib->gotFlush = 0;
+    return(zlib);
+}
+
+
+static void destroy_zlib_obj(zlib_obj_t *zlib)
+{
+/*  Destroys the deflate state of a compressed client stream.
+ */
+    assert(zlib != NULL);
+
+    (void) deflateEnd(&zlib->strm);
+    free(zlib);
+    return;
+}
+
+
+static int write_zlib_to_obj(obj_t *client)
+{
+/*  Deflates data from the (client) obj's circular-buffer and writes the
+ *    compressed result out to its file descriptor.
+ *  Data is only deflated once the previously compressed data has been
+ *    written out, so a slow client leaves uncompressed data in the
+ *    circular-buffer where it is subject to the normal overwrite policy.
+ *  Each pass ends with a sync flush so everything buffered thus far reaches
+ *    the client without waiting for more output; this bounds the latency
+ *    of interactive echo at the cost of a few bytes per flush.
+ *  Returns non-zero if the obj is ready to be destroyed.
+ */
+    zlib_obj_t *zlib;
+    int isDead = 0;
+    int len;
+    int n;
+
+    assert(is_client_obj(client));
+    assert(client->aux->client.zlib != NULL);
+
+    zlib = client->aux->client.zlib;
+
+    x_pthread_mutex_lock(&client->bufLock);
+
+    if ((zlib->bufOutPtr == zlib->bufInPtr)
+            && ((client->bufInPtr != client->bufOutPtr) || zlib->gotFlush)) {
+
+        zlib->bufInPtr = zlib->bufOutPtr = zlib->buf;
+        zlib->strm.next_out = zlib->buf;
+        zlib->strm.avail_out = sizeof(zlib->buf);
+        /*
+         *  Complete a sync flush left unfinished by the previous pass
+         *    before any more input is consumed.
+         */
+        if (zlib->gotFlush) {
+            zlib->strm.avail_in = 0;
+            (void) deflate(&zlib->strm, Z_SYNC_FLUSH);
+            zlib->gotFlush = (zlib->strm.avail_out == 0);
+        }
+        while (!zlib->gotFlush && (zlib->strm.avail_out > 0)
+                && (client->bufInPtr != client->bufOutPtr)) {
+            if (client->bufOutPtr > client->bufInPtr) {
+                len = &client->buf[OBJ_BUF_SIZE] - client->bufOutPtr;
+            }
+            else {
+                len = client->bufInPtr - client->bufOutPtr;
+            }
+            zlib->strm.next_in = client->bufOutPtr;
+            zlib->strm.avail_in = len;
+            if (deflate(&zlib->strm, Z_NO_FLUSH) == Z_STREAM_ERROR) {
+                log_err(0, "Unable to compress data for [%s]", client->name);
+            }
+            client->bufOutPtr += len - zlib->strm.avail_in;
+            if (client->bufOutPtr >= &client->buf[OBJ_BUF_SIZE]) {
+                client->bufOutPtr -= OBJ_BUF_SIZE;
+            }
+            if (client->latency) {
+                record_latency(client, len - zlib->strm.avail_in, 0);
+            }
+        }
+        if (!zlib->gotFlush) {
+            if (zlib->strm.avail_out > 0) {
+                zlib->strm.avail_in = 0;
+                (void) deflate(&zlib->strm, Z_SYNC_FLUSH);
+            }
+            zlib->gotFlush = (zlib->strm.avail_out == 0);
+        }
+        zlib->bufInPtr = zlib->strm.next_out;
+    }
+
+    if (zlib->bufInPtr > zlib->bufOutPtr) {
+again:
+#if WITH_OPENSSL
+        if ((client->aux->client.tls != NULL)
+                && !client->aux->client.tls->isKtlsSend) {
+            n = write_req_data(client->aux->client.req, zlib->bufOutPtr,
+                zlib->bufInPtr - zlib->bufOutPtr);
+        }
+        else
+#endif /* WITH_OPENSSL */
+        n = write(client->fd, zlib->bufOutPtr,
+            zlib->bufInPtr - zlib->bufOutPtr);
+        if (n < 0) {
+            if (errno == EINTR) {
+                goto again;
+            }
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                log_msg(LOG_INFO, "Unable to write to [%s]: %s",
+                    client->name, strerror(errno));
+                isDead = 1;
+            }
+        }
+        else if (n > 0) {
+            DPRINTF((15, "Wrote %d compressed bytes to [%s].\n",
+                n, client->name));
+            zlib->bufOutPtr += n;
+        }
+    }
+    /*  If all buffered data has been deflated and written out to the fd...
+     */
+    if ((client->bufInPtr == client->bufOutPtr)
+            && (zlib->bufInPtr == zlib->bufOutPtr) && !zlib->gotFlush) {
+        if (client->gotEOF) {
+            isDead = 1;
+        }
+        tpoll_clear(tp_global, client->fd, POLLOUT);
+    }
+    x_pthread_mutex_unlock(&client->bufLock);
+
+    return(isDead);
+}
+#endif /* WITH_ZLIB */
+
+
+#if WITH_OPENSSL
+static int write_tls_to_obj(obj_t *client)
+{
+/*  Copies data from the (client) obj's circular-buffer into its staging
+ *    buffer and writes it out through the client's TLS session.
+ *  A TLS write that would block must be retried with the same data, so data
+ *    is only staged once the previously staged data has been written out;
+ *    a slow client's backlog thereby remains in the circular-buffer where
+ *    it is subject to the normal overwrite policy.
+ *  When the kernel is encrypting the stream (kTLS), write_to_obj() writes the
+ *    circular-buffer out directly and this copy is avoided.
+ *  Returns non-zero if the obj is ready to be destroyed.
+ */
+    tls_obj_t *tls;
+    int isDead = 0;
+    int len;
+    int n;
+
+    assert(is_client_obj(client));
+    assert(client->aux->client.tls != NULL);
+
+    tls = client->aux->client.tls;
+
+    x_pthread_mutex_lock(&client->bufLock);
+
+    if ((tls->bufOutPtr == tls->bufInPtr)
+            && (client->bufInPtr != client->bufOutPtr)) {
+
+        tls->bufInPtr = tls->bufOutPtr = tls->buf;
+
+        while ((tls->bufInPtr < &tls->buf[TLS_BUF_SIZE])
+                && (client->bufInPtr != client->bufOutPtr)) {
+            if (client->bufOutPtr > client->bufInPtr) {
+                len = &client->buf[OBJ_BUF_SIZE] - client->bufOutPtr;
+            }
+            else {
+                len = client->bufInPtr - client->bufOutPtr;
+            }
+            len = MIN(len, &tls->buf[TLS_BUF_SIZE] - tls->bufInPtr);
+            memcpy(tls->bufInPtr, client->bufOutPtr, len);
+            tls->bufInPtr += len;
+            client->bufOutPtr += len;
+            if (client->bufOutPtr >= &client->buf[OBJ_BUF_SIZE]) {
+                client->bufOutPtr -= OBJ_BUF_SIZE;
+            }
+            if (client->latency) {
+                record_latency(client, len, 0);
+            }
+        }
+    }
+
+    if (tls->bufInPtr > tls->bufOutPtr) {
+again:
+        n = write_req_data(client->aux->client.req, tls->bufOutPtr,
+            tls->bufInPtr - tls->bufOutPtr);
+        if (n < 0) {
+            if (errno == EINTR) {
+                goto again;
+            }
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                log_msg(LOG_INFO, "Unable to write to [%s]: %s",
+                    client->name, strerror(errno));
+                isDead = 1;
+            }
+        }
+        else if (n == 0) {
+            log_msg(LOG_INFO, "Unable to write to [%s]: %s",
+                client->name, "TLS session closed");
+            isDead = 1;
+        }
+        else {
+            DPRINTF((15, "Wrote %d encrypted bytes to [%s].\n",
+                n, client->name));
+            tls->bufOutPtr += n;
+        }
+    }
+    /*  If all buffered data has been encrypted and written out to the fd...
+     */
+    if ((client->bufInPtr == client->bufOutPtr)
+            && (tls->bufInPtr == tls->bufOutPtr)) {
+        if (client->gotEOF) {
+            isDead = 1;
+        }
+        tpoll_clear(tp_global, client->fd, POLLOUT);
+    }
+    x_pthread_mutex_unlock(&client->bufLock);
+
+    return(isDead);
+}
+#endif /* WITH_OPENSSL */
@@ -0,0 +1,576 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "common.h"
+#include "list.h"
+#include "log.h"
+#include "server.h"
+#include "tpoll.h"
+#include "util.h"
+#include "util-file.h"
+#include "wrapper.h"
+
+extern tpoll_t tp_global;               /* defined in server.c */
+
+
+/*  If the Pipeline option is enabled, CPU-heavy post-processing of console
+ *    output (eg, sanitizing & timestamping logfile data) is handed off from
+ *    the mux thread to a pool of worker threads instead of running inline.
+ *  Each console's data is queued as a sequence of chunks on its own lane.
+ *    A lane is processed by at most one worker at a time, so its chunks are
+ *    processed (and their results delivered) in order; different lanes are
+ *    processed in parallel.  Since lanes are scheduled round-robin one chunk
+ *    at a time, a busy console cannot starve the others.
+ *  Processed chunks are appended to a single done queue, and a byte is
+ *    written to a pipe to wake the mux thread if the queue was empty.  The
+ *    mux thread then moves each chunk onto its lane's ready list, and
+ *    delivers the results into the circular-buf of the lane's destination
+ *    obj (eg, the logfile) as room becomes available; like the results of
+ *    coalesced monitors, these are held back rather than overwriting data
+ *    not yet written out.
+ *  Each lane is bounded: once it holds PIPE_LANE_THROTTLE_BYTES of data not
+ *    yet delivered, the mux thread stops reading from its console until the
+ *    backlog drains to half that amount.  The console is thereby throttled
+ *    to the rate at which its output can be processed and written out.
+ *    Data from consoles not read via read_from_obj() cannot be throttled,
+ *    and is dropped if the lane exceeds PIPE_LANE_MAX_BYTES.  Informational
+ *    messages are never dropped.
+ *  The lanes, run queue, and done queue are protected by a single mutex.
+ */
+
+typedef struct pipe_chunk {             /* PIPELINE DATA CHUNK:              */
+    struct pipe_chunk *next;            /*  next chunk in lane or done queue */
+    struct pipe_lane *lane;             /*  lane to which chunk belongs      */
+    unsigned char   *in;                /*  data to be processed             */
+    unsigned char   *out;               /*  processed data, or NULL          */
+    int              len;               /*  num bytes of data to process     */
+    int              outLen;            /*  num bytes of processed data      */
+    int              outOff;            /*  num bytes of it delivered so far */
+    int              outMax;            /*  num bytes allocated for out      */
+    ingest_t         ingest;            /*  when data was read from console  */
+    unsigned         isInfo:1;          /*  true if informational message    */
+} pipe_chunk_t;
+
+struct pipe_lane {                      /* PIPELINE LANE (ONE PER CONSOLE):  */
+    struct pipe_lane *nextRun;          /*  next lane in run queue           */
+    pipe_chunk_t    *head;              /*  first chunk awaiting processing  */
+    pipe_chunk_t    *tail;              /*  last chunk awaiting processing   */
+    pipe_chunk_t    *readyHead;         /*  first chunk awaiting delivery    */
+    pipe_chunk_t    *readyTail;         /*  last chunk awaiting delivery     */
+    pipe_stage_f     stage;             /*  fn to process chunk (worker)     */
+    filter_flush_f   deliver;           /*  fn to deliver result (mux)       */
+    void            *arg;               /*  arg passed to stage & deliver    */
+    obj_t           *console;           /*  console throttled when backed up */
+    obj_t           *dst;               /*  obj into which results delivered */
+    int              numBytes;          /*  num data bytes not yet delivered */
+    int              numChunks;         /*  num chunks not yet delivered     */
+    unsigned         isRunnable:1;      /*  true if on run queue or busy     */
+    unsigned         isBusy:1;          /*  true if chunk being processed    */
+    unsigned         isThrottled:1;     /*  true if console reads suspended  */
+    unsigned         isDead:1;          /*  true if lane has been destroyed  */
+};
+
+static void * process_pipe_lanes(void *arg);
+static int write_pipe_chunk(void *arg, const void *src, int len);
+static void destroy_pipe_chunk(pipe_chunk_t *chunk);
+
+static pthread_mutex_t pipeLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pipeRunCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pipeIdleCond = PTHREAD_COND_INITIALIZER;
+static pipe_lane_t *runHead = NULL;
+static pipe_lane_t *runTail = NULL;
+static pipe_chunk_t *doneHead = NULL;
+static pipe_chunk_t *doneTail = NULL;
+static int pipeFds[2] = { -1, -1 };
+
+
+void init_pipeline(server_conf_t *conf)
+{
+/*  Initializes the post-processing pipeline if enabled by the configuration
+ *    (conf), starting its worker threads and creating a lane for each
+ *    logfile that requires processing.  This must be called before the objs
+ *    are opened.
+ */
+    ListIterator i;
+    obj_t *obj;
+    pthread_t tid;
+    int numLanes = 0;
+    int n;
+    int rc;
+
+    if (conf->numPipeThreads <= 0) {
+        return;
+    }
+    if (pipe(pipeFds) < 0) {
+        log_err(errno, "Unable to create pipeline notification pipe");
+    }
+    set_fd_nonblocking(pipeFds[0]);
+    set_fd_nonblocking(pipeFds[1]);
+    set_fd_closed_on_exec(pipeFds[0]);
+    set_fd_closed_on_exec(pipeFds[1]);
+
+    for (n = 0; n < conf->numPipeThreads; n++) {
+        if ((rc = pthread_create(&tid, NULL, process_pipe_lanes, NULL)) != 0) {
+            log_err(rc, "Unable to create pipeline thread");
+        }
+        x_pthread_detach(tid);
+    }
+    i = list_iterator_create(conf->objs);
+    while ((obj = list_next(i))) {
+        if (is_logfile_obj(obj) && (enable_logfile_pipeline(obj) == 0)) {
+            numLanes++;
+        }
+    }
+    list_iterator_destroy(i);
+
+    log_msg(LOG_INFO, "Pipeline started with %d thread%s for %d logfile%s",
+        conf->numPipeThreads, ((conf->numPipeThreads == 1) ? "" : "s"),
+        numLanes, ((numLanes == 1) ? "" : "s"));
+    return;
+}
+
+
+int get_pipeline_fd(void)
+{
+/*  Returns the fd that becomes readable when processed data is ready to be
+ *    delivered by process_pipeline_results(), or -1 if not enabled.
+ */
+    return(pipeFds[0]);
+}
+
+
+pipe_lane_t * create_pipe_lane(obj_t *console, obj_t *dst,
+    pipe_stage_f stage, filter_flush_f deliver, void *arg)
+{
+/*  Creates a lane for post-processing output from (console).
+ *  Each chunk of data submitted to the lane is passed by a worker thread
+ *    to the (stage) fn along with (arg), which passes its result to the
+ *    flush fn it is given; this result is later passed by the mux thread
+ *    to the (deliver) fn along with (arg) as room becomes available in the
+ *    circular-buf of the (dst) obj.
+ *  Returns the new lane.
+ */
+    pipe_lane_t *lane;
+
+    assert(console != NULL);
+    assert(dst != NULL);
+    assert(stage != NULL);
+    assert(deliver != NULL);
+    assert(pipeFds[0] >= 0);
+
+    if (!(lane = malloc(sizeof(pipe_lane_t)))) {
+        out_of_memory();
+    }
+    memset(lane, 0, sizeof(pipe_lane_t));
+    lane->stage = stage;
+    lane->deliver = deliver;
+    lane->arg = arg;
+    lane->console = console;
+    lane->dst = dst;
+    return(lane);
+}
+
+
+void destroy_pipe_lane(pipe_lane_t *lane)
+{
+/*  Destroys the (lane), discarding data not yet processed or delivered, and
+ *    waiting for the chunk being processed (if any) to finish.  Chunks still
+ *    on the done queue are discarded when the mux thread next processes
+ *    results; the lane is freed after the last of these.
+ *  This must be called by the mux thread.
+ */
+    pipe_chunk_t *chunk;
+    int n = 0;
+    int isFreeable;
+    int rc;
+
+    if (!lane) {
+        return;
+    }
+    x_pthread_mutex_lock(&pipeLock);
+    lane->isDead = 1;
+    while ((chunk = lane->head) || (chunk = lane->readyHead)) {
+        if (chunk == lane->head) {
+            lane->head = chunk->next;
+        }
+        else {
+            lane->readyHead = chunk->next;
+        }
+        lane->numBytes -= chunk->len;
+        lane->numChunks--;
+        n += chunk->len;
+        destroy_pipe_chunk(chunk);
+    }
+    lane->tail = NULL;
+    lane->readyTail = NULL;
+
+    if (lane->isRunnable && !lane->isBusy) {
+        pipe_lane_t **pLane;
+        pipe_lane_t *prev = NULL;
+
+        for (pLane = &runHead; *pLane != lane; pLane = &(*pLane)->nextRun) {
+            prev = *pLane;
+        }
+        *pLane = lane->nextRun;
+        if (runTail == lane) {
+            runTail = prev;
+        }
+        lane->isRunnable = 0;
+    }
+    while (lane->isBusy) {
+        if ((rc = pthread_cond_wait(&pipeIdleCond, &pipeLock)) != 0) {
+            log_err(rc, "pthread_cond_wait() failed");
+        }
+    }
+    isFreeable = (lane->numChunks == 0) && !lane->isRunnable;
+    x_pthread_mutex_unlock(&pipeLock);
+
+    if (n > 0) {
+        log_msg(LOG_WARNING,
+            "Destroying pipeline for [%s] with %d byte%s of undelivered data",
+            lane->console->name, n, (n == 1 ? "" : "s"));
+    }
+    if (isFreeable) {
+        free(lane);
+    }
+    return;
+}
+
+
+int submit_pipe_data(pipe_lane_t *lane, const void *src, int len, int isInfo)
+{
+/*  Queues the buffer (src) of length (len) to be processed on the (lane).
+ *    If (isInfo) is true, the data is an informational message.
+ *  This can be called by any thread.
+ *  Returns the number of bytes queued.
+ */
+    pipe_chunk_t *chunk;
+
+    assert(lane != NULL);
+
+    if (!src || (len <= 0)) {
+        return(0);
+    }
+    if (!(chunk = malloc(sizeof(pipe_chunk_t) + len))) {
+        out_of_memory();
+    }
+    chunk->next = NULL;
+    chunk->lane = lane;
+    chunk->in = (unsigned char *) (chunk + 1);
+    chunk->out = NULL;
+    chunk->len = len;
+    chunk->outLen = 0;
+    chunk->outOff = 0;
+    chunk->outMax = 0;
+    chunk->isInfo = !!isInfo;
+    get_ingest(&chunk->ingest);
+    memcpy(chunk->in, src, len);
+
+    x_pthread_mutex_lock(&pipeLock);
+    if (lane->isDead
+            || (!isInfo && (lane->numBytes + len > PIPE_LANE_MAX_BYTES))) {
+        x_pthread_mutex_unlock(&pipeLock);
+        if (!lane->isDead) {
+            log_msg(LOG_NOTICE, "Dropped %d bytes in pipeline for [%s]",
+                len, lane->console->name);
+        }
+        destroy_pipe_chunk(chunk);
+        return(0);
+    }
+    if (lane->tail) {
+        lane->tail->next = chunk;
+    }
+    else {
+        lane->head = chunk;
+    }
+    lane->tail = chunk;
+    lane->numBytes += len;
+    lane->numChunks++;
+
+    if (!lane->isRunnable) {
+        lane->isRunnable = 1;
+        lane->nextRun = NULL;
+        if (runTail) {
+            runTail->nextRun = lane;
+        }
+        else {
+            runHead = lane;
+        }
+        runTail = lane;
+        pthread_cond_signal(&pipeRunCond);
+    }
+    x_pthread_mutex_unlock(&pipeLock);
+    return(len);
+}
+
+
+int throttle_pipe_lane(pipe_lane_t *lane)
+{
+/*  Checks whether the (lane) is backed up, in which case the caller should
+ *    stop reading from its console; reading is resumed by the mux thread
+ *    setting POLLIN on the console's fd once the backlog has drained.
+ *  Returns true if the lane is throttled.
+ */
+    int isThrottled;
+
+    assert(lane != NULL);
+
+    x_pthread_mutex_lock(&pipeLock);
+    if (lane->numBytes >= PIPE_LANE_THROTTLE_BYTES) {
+        if (!lane->isThrottled) {
+            DPRINTF((10, "Throttling reads from [%s] with %d bytes queued.\n",
+                lane->console->name, lane->numBytes));
+        }
+        lane->isThrottled = 1;
+    }
+    isThrottled = lane->isThrottled;
+    x_pthread_mutex_unlock(&pipeLock);
+    return(isThrottled);
+}
+
+
+void process_pipeline_results(void)
+{
+/*  Moves each processed chunk from the done queue onto its lane's ready
+ *    list, and delivers as much of the results as there is room for.
+ *  This must be called by the mux thread.
+ */
+    unsigned char buf[256];
+    pipe_chunk_t *chunk;
+    pipe_lane_t *lane;
+
+    while (read(pipeFds[0], buf, sizeof(buf)) > 0) {
+        ;                               /* drain notifications */
+    }
+    x_pthread_mutex_lock(&pipeLock);
+    chunk = doneHead;
+    doneHead = doneTail = NULL;
+    x_pthread_mutex_unlock(&pipeLock);
+
+    while (chunk) {
+        pipe_chunk_t *next = chunk->next;
+
+        chunk->next = NULL;
+        lane = chunk->lane;
+        if (lane->readyTail) {
+            lane->readyTail->next = chunk;
+        }
+        else {
+            lane->readyHead = chunk;
+        }
+        lane->readyTail = chunk;
+        flush_pipe_lane(lane);
+        chunk = next;
+    }
+    return;
+}
+
+
+void flush_pipe_lane(pipe_lane_t *lane)
+{
+/*  Delivers the results on the (lane)'s ready list in order, stopping once
+ *    the circular-buf of the lane's destination obj has no more room; this
+ *    is called again once that obj's data has been written out.  If the
+ *    destination obj is not open, results are delivered regardless since
+ *    its buf will not be drained.  Reads are resumed from the lane's console
+ *    once the backlog has drained.
+ *  Results are delivered with the ingest timestamp of the data from which
+ *    they were processed, so their latency includes time in the pipeline.
+ *  This must be called by the mux thread.
+ */
+    pipe_chunk_t *chunk;
+    ingest_t ingest;
+    int n;
+    int isResumed;
+    int isFreeable;
+
+    if (!lane) {
+        return;
+    }
+    get_ingest(&ingest);
+    while ((chunk = lane->readyHead)) {
+
+        /*  Deliver the result in pieces no larger than a read would produce
+         *    since an obj's circular-buf cannot hold more than OBJ_BUF_SIZE.
+         */
+        while (!lane->isDead && (chunk->outOff < chunk->outLen)) {
+            n = MIN(MAX_BUF_SIZE, chunk->outLen - chunk->outOff);
+            if ((lane->dst->fd >= 0) && (get_obj_buf_avail(lane->dst) < n)) {
+                return;
+            }
+            set_ingest(&chunk->ingest);
+            lane->deliver(lane->arg, chunk->out + chunk->outOff, n);
+            set_ingest(&ingest);
+            chunk->outOff += n;
+        }
+        lane->readyHead = chunk->next;
+        if (!lane->readyHead) {
+            lane->readyTail = NULL;
+        }
+        x_pthread_mutex_lock(&pipeLock);
+        lane->numBytes -= chunk->len;
+        lane->numChunks--;
+        isResumed = lane->isThrottled && !lane->isDead
+            && (lane->numBytes <= PIPE_LANE_THROTTLE_BYTES / 2);
+        if (isResumed) {
+            lane->isThrottled = 0;
+        }
+        isFreeable = lane->isDead
+            && (lane->numChunks == 0) && !lane->isRunnable;
+        x_pthread_mutex_unlock(&pipeLock);
+        destroy_pipe_chunk(chunk);
+
+        if (isResumed && (lane->console->fd >= 0)) {
+            DPRINTF((10, "Resuming reads from [%s].\n", lane->console->name));
+            tpoll_set(tp_global, lane->console->fd, POLLIN);
+        }
+        if (isFreeable) {
+            free(lane);
+            return;
+        }
+    }
+    return;
+}
+
+
+static void * process_pipe_lanes(void *arg)
+{
+/*  Worker thread that repeatedly takes the next lane from the run queue
+ *    and processes the first chunk on it.  A lane with chunks remaining is
+ *    placed back at the end of the run queue.
+ */
+    pipe_lane_t *lane;
+    pipe_chunk_t *chunk;
+    int isEmpty;
+    int rc;
+
+    x_pthread_mutex_lock(&pipeLock);
+    for (;;) {
+        while (!runHead) {
+            if ((rc = pthread_cond_wait(&pipeRunCond, &pipeLock)) != 0) {
+                log_err(rc, "pthread_cond_wait() failed");
+            }
+        }
+        lane = runHead;
+        runHead = lane->nextRun;
+        if (!runHead) {
+            runTail = NULL;
+        }
+        chunk = lane->head;
+        assert(chunk != NULL);
+        lane->head = chunk->next;
+        if (!lane->head) {
+            lane->tail = NULL;
+        }
+        chunk->next = NULL;
+        lane->isBusy = 1;
+        x_pthread_mutex_unlock(&pipeLock);
+
+        lane->stage(lane->arg, chunk->in, chunk->len, chunk->isInfo,
+            write_pipe_chunk, chunk);
+
+        x_pthread_mutex_lock(&pipeLock);
+        lane->isBusy = 0;
+        if (lane->isDead) {
+            pthread_cond_broadcast(&pipeIdleCond);
+        }
+        if (lane->head && !lane->isDead) {
+            lane->nextRun = NULL;
+            if (runTail) {
+                runTail->nextRun = lane;
+            }
+            else {
+                runHead = lane;
+            }
+            runTail = lane;
+        }
+        else {
+            lane->isRunnable = 0;
+        }
+        isEmpty = (doneHead == NULL);
+        if (doneTail) {
+            doneTail->next = chunk;
+        }
+        else {
+            doneHead = chunk;
+        }
+        doneTail = chunk;
+
+        if (isEmpty) {
+            while ((write(pipeFds[1], "", 1) < 0) && (errno == EINTR)) {
+                ;
+            }
+        }
+    }
+    /* not reached */
+    x_pthread_mutex_unlock(&pipeLock);
+    return(arg);
+}
+
+
+static int write_pipe_chunk(void *arg, const void *src, int len)
+{
+/*  Appends the processed data (src) of length (len) to the output of the
+ *    chunk (arg).  This is the flush fn passed to a lane's stage fn.
+ *  Returns the number of bytes appended.
+ */
+    pipe_chunk_t *chunk = arg;
+    int n;
+
+    if (!src || (len <= 0)) {
+        return(0);
+    }
+    if (chunk->outLen + len > chunk->outMax) {
+        n = (chunk->outMax > 0) ? (chunk->outMax * 2) : (chunk->len + 64);
+        chunk->outMax = MAX(n, chunk->outLen + len);
+        if (!(chunk->out = realloc(chunk->out, chunk->outMax))) {
+            out_of_memory();
+        }
+    }
+    memcpy(chunk->out + chunk->outLen, src, len);
+    chunk->outLen += len;
+    return(len);
+}
+
+
+static void destroy_pipe_chunk(pipe_chunk_t *chunk)
+{
+    assert(chunk != NULL);
+
+    if (chunk->out) {
+        free(chunk->out);
+    }
+    free(chunk);
+    return;
+}
@@ -181,7 +181,7 @@ obj_t * create_process_obj(server_conf_t *conf, char *name, List args,
         return(NULL);
     }
     process = create_obj(conf, name, -1, CONMAN_OBJ_PROCESS);
-    auxp = &(process->aux.process);
+    auxp = &(process->aux->process);
 
     auxp->timer = -1;
     auxp->delay = PROCESS_MIN_TIMEOUT;
@@ -224,7 +224,7 @@ int open_process_obj(obj_t *process)
     assert(process != NULL);
     assert(is_process_obj(process));
 
-    auxp = &(process->aux.process);
+    auxp = &(process->aux->process);
 
     if (auxp->timer >= 0) {
         (void) tpoll_timeout_cancel(tp_global, auxp->timer);
@@ -263,11 +263,11 @@ static int disconnect_process_obj(obj_t *process)
     char          *delta_str;
 
     assert(process != NULL);
-    assert(process->aux.process.pid > 0);
-    assert(process->aux.process.tStart > 0);
-    assert(process->aux.process.state != CONMAN_PROCESS_DOWN);
+    assert(process->aux->process.pid > 0);
+    assert(process->aux->process.tStart > 0);
+    assert(process->aux->process.state != CONMAN_PROCESS_DOWN);
 
-    auxp = &(process->aux.process);
+    auxp = &(process->aux->process);
 
     if (process->fd >= 0) {
         tpoll_clear(tp_global, process->fd, POLLIN | POLLOUT);
@@ -282,7 +282,7 @@ static int disconnect_process_obj(obj_t *process)
     /*  Notify linked objs when transitioning from an UP state.
      */
     assert(auxp->state == CONMAN_PROCESS_UP);
-    write_notify_msg(process, LOG_INFO,
+    write_notify_event(process, CONMAN_SINK_DISCONNECT, LOG_INFO,
         "Console [%s] disconnected from \"%s\" (pid %d) after %s",
         process->name, auxp->prog, auxp->pid, delta_str);
     free(delta_str);
@@ -306,10 +306,10 @@ static int connect_process_obj(obj_t *process)
 
     assert(process != NULL);
     assert(process->fd == -1);
-    assert(process->aux.process.pid == -1);
-    assert(process->aux.process.state != CONMAN_PROCESS_UP);
+    assert(process->aux->process.pid == -1);
+    assert(process->aux->process.state != CONMAN_PROCESS_UP);
 
-    auxp = &(process->aux.process);
+    auxp = &(process->aux->process);
 
     if (check_process_prog(process) < 0) {
         goto err;
@@ -325,7 +325,12 @@ static int connect_process_obj(obj_t *process)
     set_fd_closed_on_exec(fd_pair[0]);
     set_fd_closed_on_exec(fd_pair[1]);
 
-    if ((pid = fork()) < 0) {
+    begin_mux_phase("fork", process);
+    pid = fork();
+    if (pid != 0) {
+        end_mux_phase();
+    }
+    if (pid < 0) {
         write_notify_msg(process, LOG_WARNING,
             "Console [%s] connection failed: fork error: %s",
             process->name, strerror(errno));
@@ -367,7 +372,7 @@ static int connect_process_obj(obj_t *process)
 
     /*  Notify linked objs when transitioning into an UP state.
      */
-    write_notify_msg(process, LOG_INFO,
+    write_notify_event(process, CONMAN_SINK_CONNECT, LOG_INFO,
         "Console [%s] connected to \"%s\" (pid %d)",
         process->name, auxp->prog, auxp->pid);
     DPRINTF((9, "Opened [%s] process: fd=%d/%d prog=\"%s\" pid=%d.\n",
@@ -396,7 +401,7 @@ static int check_process_prog(obj_t *process)
 
     assert(process != NULL);
 
-    auxp = &(process->aux.process);
+    auxp = &(process->aux->process);
 
     if (stat(auxp->argv[0], &st) < 0) {
         write_notify_msg(process, LOG_WARNING,
@@ -431,7 +436,7 @@ static void reset_process_delay(obj_t *process)
     assert(process != NULL);
     assert(is_process_obj(process));
 
-    auxp = &(process->aux.process);
+    auxp = &(process->aux->process);
 
     /*  Reset the timer ID since this routine is only invoked by a timer.
      */
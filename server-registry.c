@@ -0,0 +1,266 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include "list.h"
+#include "log.h"
+#include "server.h"
+#include "util.h"
+#include "wrapper.h"
+
+
+/*  The console registry is an immutable snapshot of the console objs
+ *    (their names, types, and states, sorted by name) published by the mux
+ *    thread for the client threads resolving console names in requests.
+ *    A client thread takes a ref to the current snapshot and traverses it
+ *    without holding any lock, so it neither contends with nor observes the
+ *    objs being appended to and deleted from conf->objs by other threads.
+ *  A supervisor creates no console objs; its registry holds the names of the
+ *    consoles owned by its worker procs, whose types and states are unknown.
+ *  Whenever the console set or a console's state changes, the registry is
+ *    invalidated; the mux thread then publishes a new snapshot in place of
+ *    the current one before it next polls.  A snapshot is destroyed once it
+ *    has been replaced and its last ref has been put; client threads holding
+ *    a ref to a replaced snapshot finish with the console set it described.
+ *  The registryLock protects only the registry ptr, the refcounts, and the
+ *    stale flag; it is held just long enough to take or put a ref.  The
+ *    console objs and names referenced by a snapshot are retained until the
+ *    daemon exits.
+ */
+
+static int compare_registry_entries(
+    const registry_entry_t *e1, const registry_entry_t *e2);
+static unsigned get_console_state(obj_t *console);
+static void destroy_console_registry(registry_t *reg);
+
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+static registry_t *registry = NULL;
+static unsigned numRegistries = 0;
+static int isRegistryStale = 0;
+
+
+void publish_console_registry(server_conf_t *conf)
+{
+/*  Publishes a new snapshot of the console objs in the configuration (conf),
+ *    replacing the current one.  This must be called by the mux thread
+ *    whenever the set of consoles changes.
+ */
+    registry_t *reg;
+    registry_t *old;
+    registry_entry_t *entry;
+    ListIterator i;
+    obj_t *obj;
+    int numWorkerConsoles;
+    int n;
+    int k;
+
+    /*  The stale flag is cleared before the console states are read so a
+     *    state change racing with this snapshot invalidates it again.
+     */
+    x_pthread_mutex_lock(&registryLock);
+    isRegistryStale = 0;
+    x_pthread_mutex_unlock(&registryLock);
+
+    if (!(reg = malloc(sizeof(registry_t)))) {
+        out_of_memory();
+    }
+    reg->refCount = 1;                  /* held by the registry ptr */
+    reg->numConsoles = 0;
+
+    numWorkerConsoles = get_num_worker_consoles();
+    n = list_count(conf->objs) + numWorkerConsoles;
+    if (!(reg->consoles = malloc(MAX(n, 1) * sizeof(registry_entry_t)))) {
+        out_of_memory();
+    }
+    i = list_iterator_create(conf->objs);
+    while ((obj = list_next(i)) && (reg->numConsoles < n)) {
+        if (!is_console_obj(obj)) {
+            continue;
+        }
+        entry = &reg->consoles[reg->numConsoles++];
+        entry->name = obj->name;
+        entry->type = obj->type;
+        entry->state = get_console_state(obj);
+        entry->console = obj;
+    }
+    list_iterator_destroy(i);
+
+    for (k = 0; k < numWorkerConsoles; k++) {
+        entry = &reg->consoles[reg->numConsoles++];
+        entry->name = (char *) get_worker_console(k);
+        entry->type = 0;
+        entry->state = CONMAN_CONSOLE_UNKNOWN;
+        entry->console = NULL;
+    }
+
+    qsort(reg->consoles, reg->numConsoles, sizeof(registry_entry_t),
+        (int (*)(const void *, const void *)) compare_registry_entries);
+
+    x_pthread_mutex_lock(&registryLock);
+    reg->generation = numRegistries++;
+    old = registry;
+    registry = reg;
+    if (old && (--old->refCount > 0)) {
+        old = NULL;
+    }
+    x_pthread_mutex_unlock(&registryLock);
+
+    if (old) {
+        destroy_console_registry(old);
+    }
+    DPRINTF((5, "Published console registry #%u with %d console%s.\n",
+        reg->generation, reg->numConsoles,
+        ((reg->numConsoles == 1) ? "" : "s")));
+    return;
+}
+
+
+void invalidate_console_registry(void)
+{
+/*  Marks the current console registry snapshot as stale, such as when a
+ *    console connects or disconnects.  This may be called by any thread.
+ */
+    x_pthread_mutex_lock(&registryLock);
+    isRegistryStale = 1;
+    x_pthread_mutex_unlock(&registryLock);
+    return;
+}
+
+
+void refresh_console_registry(server_conf_t *conf)
+{
+/*  Publishes a new console registry snapshot for the configuration (conf)
+ *    if the current one has been invalidated.  This must be called by the
+ *    mux thread.  Invalidations are thereby coalesced into a single snapshot
+ *    per pass through the mux loop.
+ */
+    int isStale;
+
+    x_pthread_mutex_lock(&registryLock);
+    isStale = isRegistryStale;
+    x_pthread_mutex_unlock(&registryLock);
+
+    if (isStale) {
+        publish_console_registry(conf);
+    }
+    return;
+}
+
+
+registry_t * get_console_registry(void)
+{
+/*  Returns a ref to the current console registry snapshot, or NULL if none
+ *    has been published.  The snapshot must not be modified, and the ref
+ *    must be released via put_console_registry().
+ */
+    registry_t *reg;
+
+    x_pthread_mutex_lock(&registryLock);
+    if ((reg = registry)) {
+        reg->refCount++;
+    }
+    x_pthread_mutex_unlock(&registryLock);
+    return(reg);
+}
+
+
+void put_console_registry(registry_t *reg)
+{
+/*  Releases a ref to the console registry snapshot (reg) obtained via
+ *    get_console_registry().
+ */
+    int n;
+
+    if (!reg) {
+        return;
+    }
+    x_pthread_mutex_lock(&registryLock);
+    assert(reg->refCount > 0);
+    n = --reg->refCount;
+    x_pthread_mutex_unlock(&registryLock);
+
+    if (n == 0) {
+        destroy_console_registry(reg);
+    }
+    return;
+}
+
+
+static int compare_registry_entries(
+    const registry_entry_t *e1, const registry_entry_t *e2)
+{
+/*  Used by qsort() to sort the registry entries by console name
+ *    in the same order as compare_objs().
+ */
+    return(compare_obj_names(e1->name, e2->name));
+}
+
+
+static unsigned get_console_state(obj_t *console)
+{
+/*  Returns the enum console_state of the (console) obj in the same manner as
+ *    check_console_state() determines whether it is disconnected.
+ */
+    assert(is_console_obj(console));
+
+    if (is_process_obj(console) || is_serial_obj(console)
+            || is_unixsock_obj(console)) {
+        return((console->fd >= 0) ? CONMAN_CONSOLE_UP : CONMAN_CONSOLE_DOWN);
+    }
+    if (is_mux_obj(console)) {
+        return((console->aux->mux.state == CONMAN_MUX_UP)
+            ? CONMAN_CONSOLE_UP : CONMAN_CONSOLE_DOWN);
+    }
+    if (is_telnet_obj(console)) {
+        return((console->aux->telnet.state == CONMAN_TELNET_UP)
+            ? CONMAN_CONSOLE_UP : CONMAN_CONSOLE_DOWN);
+    }
+#if WITH_FREEIPMI
+    if (is_ipmi_obj(console)) {
+        return((console->aux->ipmi.state == CONMAN_IPMI_UP)
+            ? CONMAN_CONSOLE_UP : CONMAN_CONSOLE_DOWN);
+    }
+#endif /* WITH_FREEIPMI */
+    return(CONMAN_CONSOLE_UNKNOWN);
+}
+
+
+static void destroy_console_registry(registry_t *reg)
+{
+/*  Destroys the console registry snapshot (reg) once its last ref is put.
+ *    The console names are not copied, so they are not destroyed here.
+ */
+    assert(reg != NULL);
+    assert(reg->refCount == 0);
+
+    free(reg->consoles);
+    free(reg);
+    return;
+}
@@ -0,0 +1,423 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "common.h"
+#include "list.h"
+#include "log.h"
+#include "server.h"
+#include "tpoll.h"
+#include "util-str.h"
+#include "util.h"
+
+
+/*  Console resets requested via the client's reset escape are queued and
+ *    executed in FIFO order, with at most 'resetMax' ResetCmd processes
+ *    running at a time.  If 'resetBatch' is greater than one, the ResetCmd
+ *    is a batch command: a single invocation resets up to 'resetBatch'
+ *    consoles, with "%N" expanding to their space-separated names.
+ *  Since the SIGCHLD handler reaps all children, completed commands are
+ *    detected by polling their pids while any are running.
+ *  Reset state is only accessed by the mux thread.
+ */
+
+typedef struct reset_req {              /* QUEUED CONSOLE RESET:             */
+    obj_t           *console;           /*  console obj to be reset          */
+    char            *who;               /*  user@host requesting the reset   */
+} reset_req_t;
+
+typedef struct reset_cmd {              /* RUNNING RESET CMD:                */
+    pid_t            pid;               /*  pid of ResetCmd process group    */
+    List             consoles;          /*  console objs being reset (refs)  */
+    int              timer;             /*  timer id for cmd time limit      */
+} reset_cmd_t;
+
+static int start_reset_cmd(int dev_null);
+static int format_reset_cmd(char *buf, int buflen, reset_cmd_t *cmd,
+    List reqs);
+static void check_reset_cmds(void *arg);
+static void kill_reset_cmd(reset_cmd_t *cmd);
+static void destroy_reset_req(reset_req_t *req);
+static void destroy_reset_cmd(reset_cmd_t *cmd);
+
+extern tpoll_t tp_global;               /* defined in server.c */
+
+static List resetQueue = NULL;          /* list of reset_req_t's to start    */
+static List resetCmds = NULL;           /* list of running reset_cmd_t's    */
+static int  resetMax = DEFAULT_RESET_MAX;
+static int  resetBatch = DEFAULT_RESET_BATCH;
+static int  resetTimer = -1;            /* timer id for polling reset cmds   */
+
+
+void init_reset_cmds(server_conf_t *conf)
+{
+/*  Initializes the reset executor according to the server's (conf).
+ */
+    assert(conf != NULL);
+
+    resetMax = conf->resetMax;
+    resetBatch = (conf->resetBatch > 1) ? conf->resetBatch : 1;
+    if (!resetQueue) {
+        resetQueue = list_create((ListDelF) destroy_reset_req);
+    }
+    if (!resetCmds) {
+        resetCmds = list_create((ListDelF) destroy_reset_cmd);
+    }
+    return;
+}
+
+
+void queue_reset_cmd(obj_t *console, obj_t *client)
+{
+/*  Queues a reset of the (console) requested by the (client).
+ *  The reset is started by a subsequent call to run_reset_cmds().
+ */
+    reset_req_t *req;
+
+    assert(is_console_obj(console));
+    assert(is_client_obj(client));
+    assert(console->resetCmdRef != NULL);
+    assert(resetQueue != NULL);
+
+    if (console->resetCmdPid > 0) {
+        write_notify_msg(console, LOG_INFO,
+            "Ignoring reset of console [%s]: pid %d still active",
+            console->name, (int) console->resetCmdPid);
+        return;
+    }
+    if (console->gotResetQueued) {
+        write_notify_msg(console, LOG_INFO,
+            "Ignoring reset of console [%s]: reset already queued",
+            console->name);
+        return;
+    }
+    if (!(req = malloc(sizeof(reset_req_t)))) {
+        out_of_memory();
+    }
+    req->console = console;
+    req->who = create_format_string("%s@%s",
+        client->aux->client.req->user, client->aux->client.req->host);
+    list_append(resetQueue, req);
+    console->gotResetQueued = 1;
+    return;
+}
+
+
+void run_reset_cmds(void)
+{
+/*  Starts queued console resets while below the concurrency limit.
+ */
+    int dev_null;
+
+    assert(resetQueue != NULL);
+
+    if (list_is_empty(resetQueue)) {
+        return;
+    }
+    dev_null = open("/dev/null", O_RDWR);
+    if (dev_null < 0) {
+        log_msg(LOG_WARNING,
+            "Unable to open \"/dev/null\" for console reset: %s",
+            strerror(errno));
+    }
+    while (!list_is_empty(resetQueue)
+            && ((resetMax <= 0) || (list_count(resetCmds) < resetMax))) {
+        (void) start_reset_cmd(dev_null);
+    }
+    if ((dev_null >= 0) && (close(dev_null) < 0)) {
+        log_msg(LOG_WARNING,
+            "Unable to close \"/dev/null\" for console reset: %s",
+            strerror(errno));
+    }
+    if (!list_is_empty(resetQueue)) {
+        DPRINTF((10, "Queued %d console reset%s behind %d running.\n",
+            list_count(resetQueue), (list_count(resetQueue) == 1 ? "" : "s"),
+            list_count(resetCmds)));
+    }
+    if (!list_is_empty(resetCmds) && (resetTimer < 0)) {
+        resetTimer = tpoll_timeout_relative(tp_global,
+            (callback_f) check_reset_cmds, NULL, RESET_CMD_POLL_MSECS);
+    }
+    return;
+}
+
+
+static int start_reset_cmd(int dev_null)
+{
+/*  Starts a ResetCmd process for the next console (or batch of consoles)
+ *    in the queue.
+ *  Returns 0 if the cmd was started, or -1 on error.
+ */
+    List reqs;
+    reset_req_t *req;
+    reset_cmd_t *cmd;
+    ListIterator i;
+    int len = 0;
+    char buf[MAX_BUF_SIZE];
+
+    /*  A batch is limited both by its size and by the length of the list
+     *    of console names that must fit within the cmd string.
+     */
+    reqs = list_create((ListDelF) destroy_reset_req);
+    while ((list_count(reqs) < resetBatch)
+            && (req = list_peek(resetQueue))) {
+        len += strlen(req->console->name) + 1;
+        if ((len > RESET_CMD_BATCH_LEN) && !list_is_empty(reqs)) {
+            break;
+        }
+        req = list_pop(resetQueue);
+        req->console->gotResetQueued = 0;
+        list_append(reqs, req);
+    }
+    if (!(cmd = malloc(sizeof(reset_cmd_t)))) {
+        out_of_memory();
+    }
+    cmd->pid = 0;
+    cmd->consoles = list_create(NULL);
+    cmd->timer = -1;
+
+    if (format_reset_cmd(buf, sizeof(buf), cmd, reqs) < 0) {
+        i = list_iterator_create(reqs);
+        while ((req = list_next(i))) {
+            write_notify_msg(req->console, LOG_WARNING,
+                "Unable to reset console [%s]: command too long",
+                req->console->name);
+        }
+        list_iterator_destroy(i);
+        goto err;
+    }
+    begin_mux_phase("fork", NULL);
+    cmd->pid = fork();
+    if (cmd->pid != 0) {
+        end_mux_phase();
+    }
+    if (cmd->pid < 0) {
+        i = list_iterator_create(reqs);
+        while ((req = list_next(i))) {
+            write_notify_msg(req->console, LOG_WARNING,
+                "Unable to reset console [%s]: fork failed: %s",
+                req->console->name, strerror(errno));
+        }
+        list_iterator_destroy(i);
+        goto err;
+    }
+    else if (cmd->pid == 0) {
+        setpgid(cmd->pid, 0);
+        if (dev_null < 0) {
+            (void) close(STDIN_FILENO);
+            (void) close(STDOUT_FILENO);
+            (void) close(STDERR_FILENO);
+        }
+        else {
+            (void) dup2(dev_null, STDIN_FILENO);
+            (void) dup2(dev_null, STDOUT_FILENO);
+            (void) dup2(dev_null, STDERR_FILENO);
+            if (dev_null > STDERR_FILENO) {
+                (void) close(dev_null);
+            }
+        }
+        execl("/bin/sh", "sh", "-c", buf, (char *) NULL);
+        _exit(127);                     /* execl() error */
+    }
+    /*  Both parent and child call setpgid() to make the child a process
+     *    group leader.  One of these calls is redundant, but by doing
+     *    both we avoid a race condition.  (cf. APUE 9.4 p244)
+     */
+    setpgid(cmd->pid, 0);
+
+    i = list_iterator_create(reqs);
+    while ((req = list_next(i))) {
+        req->console->resetCmdPid = cmd->pid;
+        write_notify_msg(req->console, LOG_NOTICE,
+            "Console [%s] reset by <%s> (pid %d)",
+            req->console->name, req->who, (int) cmd->pid);
+    }
+    list_iterator_destroy(i);
+    list_destroy(reqs);
+
+    /*  Set a timer to ensure the reset cmd does not exceed its time limit.
+     */
+    cmd->timer = tpoll_timeout_relative(tp_global,
+        (callback_f) kill_reset_cmd, cmd, RESET_CMD_TIMEOUT * 1000);
+    if (cmd->timer < 0) {
+        log_msg(LOG_WARNING, "Unable to create timer for reset (pid %d): %s",
+            (int) cmd->pid, strerror(errno));
+    }
+    list_append(resetCmds, cmd);
+    return(0);
+
+err:
+    list_destroy(reqs);
+    destroy_reset_cmd(cmd);
+    return(-1);
+}
+
+
+static int format_reset_cmd(char *buf, int buflen, reset_cmd_t *cmd,
+    List reqs)
+{
+/*  Formats the ResetCmd string into the buffer (buf) of length (buflen)
+ *    for the list of reset requests (reqs), adding their consoles to (cmd).
+ *  A batch command is formatted once for the whole batch, substituting
+ *    the space-separated list of console names for "%N".
+ *  Returns the length of the cmd string, or -1 if it was too long.
+ */
+    reset_req_t *req;
+    ListIterator i;
+    char fmt[MAX_BUF_SIZE];
+    char names[MAX_BUF_SIZE] = "";      /* init buf for appending with NUL */
+    int n = 0;
+
+    assert(!list_is_empty(reqs));
+
+    i = list_iterator_create(reqs);
+    while ((req = list_next(i))) {
+        list_append(cmd->consoles, req->console);
+        if (resetBatch > 1) {
+            n = append_format_string(names, sizeof(names), "%s%s",
+                (names[0] ? " " : ""), req->console->name);
+        }
+    }
+    list_iterator_destroy(i);
+
+    req = list_peek(reqs);
+    if (resetBatch <= 1) {
+        return(format_obj_string(buf, buflen, req->console,
+            req->console->resetCmdRef));
+    }
+    /*  Expand all other specifiers first since the names may contain '%'.
+     */
+    if ((n < 0) || (format_obj_string(fmt, sizeof(fmt), NULL,
+            req->console->resetCmdRef) < 0)) {
+        return(-1);
+    }
+    return(substitute_string(buf, buflen, fmt, 'N', names));
+}
+
+
+static void check_reset_cmds(void *arg)
+{
+/*  Checks for completed ResetCmd processes, and starts queued resets in
+ *    their place.  This timer callback is invoked while any are running.
+ */
+    ListIterator i;
+    reset_cmd_t *cmd;
+
+    resetTimer = -1;
+
+    i = list_iterator_create(resetCmds);
+    while ((cmd = list_next(i))) {
+        if ((kill(cmd->pid, 0) < 0) && (errno == ESRCH)) {
+            list_delete(i);
+        }
+    }
+    list_iterator_destroy(i);
+
+    run_reset_cmds();
+
+    if (!list_is_empty(resetCmds) && (resetTimer < 0)) {
+        resetTimer = tpoll_timeout_relative(tp_global,
+            (callback_f) check_reset_cmds, NULL, RESET_CMD_POLL_MSECS);
+    }
+    return;
+}
+
+
+static void kill_reset_cmd(reset_cmd_t *cmd)
+{
+/*  Terminates the ResetCmd process group of (cmd) if it has exceeded its
+ *    time limit.  The cmd is removed once its termination is detected.
+ */
+    obj_t *console;
+
+    assert(cmd != NULL);
+    assert(cmd->pid > 0);
+
+    cmd->timer = -1;
+    console = list_peek(cmd->consoles);
+
+    if (kill(cmd->pid, 0) < 0) {        /* process is no longer running */
+        return;
+    }
+    if (kill(-cmd->pid, SIGKILL) == 0) {    /* kill entire process group */
+        log_msg(LOG_NOTICE,
+            "Console [%s]%s reset terminated after %ds (pid %d)",
+            console->name, (list_count(cmd->consoles) > 1 ? " batch" : ""),
+            RESET_CMD_TIMEOUT, (int) cmd->pid);
+    }
+    else {
+        log_msg(LOG_WARNING,
+            "Unable to terminate console [%s]%s reset after %ds (pid %d): %s",
+            console->name, (list_count(cmd->consoles) > 1 ? " batch" : ""),
+            RESET_CMD_TIMEOUT, (int) cmd->pid, strerror(errno));
+    }
+    return;
+}
+
+
+static void destroy_reset_req(reset_req_t *req)
+{
+    assert(req != NULL);
+
+    if (req->who) {
+        free(req->who);
+    }
+    free(req);
+    return;
+}
+
+
+static void destroy_reset_cmd(reset_cmd_t *cmd)
+{
+/*  Destroys the (cmd), marking its consoles as no longer being reset.
+ */
+    ListIterator i;
+    obj_t *console;
+
+    assert(cmd != NULL);
+
+    if (cmd->timer > 0) {
+        (void) tpoll_timeout_cancel(tp_global, cmd->timer);
+    }
+    i = list_iterator_create(cmd->consoles);
+    while ((console = list_next(i))) {
+        if (console->resetCmdPid == cmd->pid) {
+            console->resetCmdPid = 0;
+        }
+    }
+    list_iterator_destroy(i);
+    list_destroy(cmd->consoles);
+    free(cmd);
+    return;
+}
@@ -0,0 +1,766 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "server.h"
+#include "util.h"
+
+
+/*  A console's screen model tracks what a VT100/ANSI terminal attached to the
+ *    console would be displaying: a SCREEN_ROWS x SCREEN_COLS grid of chars
+ *    and SGR attributes along with the cursor position.  It is updated from
+ *    the console's output as it is fanned out by write_readers_data(), so a
+ *    newly-attached client can be sent a compact redraw of the current screen
+ *    (such as a BIOS setup menu) instead of a blank terminal.
+ *  The model is only allocated once a console with the screen option enabled
+ *    produces output; idle consoles thereby cost nothing beyond the flag.
+ *    Bytes outside of escape sequences are treated as 8-bit chars (as with
+ *    the code pages used by BIOS console redirection).  Sequences that are
+ *    not modeled are parsed and discarded.
+ *
+ *  The screen is protected by the console's history lock.
+ */
+
+
+#define SCREEN_ATTR_FG_MASK     0x000F
+#define SCREEN_ATTR_BG_MASK     0x00F0
+#define SCREEN_ATTR_BG_SHIFT    4
+#define SCREEN_ATTR_BOLD        0x0100
+#define SCREEN_ATTR_UNDERLINE   0x0200
+#define SCREEN_ATTR_BLINK       0x0400
+#define SCREEN_ATTR_REVERSE     0x0800
+#define SCREEN_COLOR_DEFAULT    9
+#define SCREEN_ATTR_DEFAULT     \
+    (SCREEN_COLOR_DEFAULT | (SCREEN_COLOR_DEFAULT << SCREEN_ATTR_BG_SHIFT))
+#define SCREEN_MAX_PARAM        9999
+#define SCREEN_TAB_WIDTH        8
+
+
+static void reset_screen(screen_t *s);
+static void put_screen_char(screen_t *s, unsigned char c);
+static void process_screen_esc(screen_t *s, unsigned char c);
+static void process_screen_csi(screen_t *s, unsigned char c);
+static void perform_screen_csi(screen_t *s, unsigned char c);
+static void perform_screen_sgr(screen_t *s);
+static void perform_screen_linefeed(screen_t *s);
+static void perform_screen_reverse_index(screen_t *s);
+static void scroll_screen_up(screen_t *s, int top, int bottom, int n);
+static void scroll_screen_down(screen_t *s, int top, int bottom, int n);
+static void clear_screen_cells(screen_t *s, int row, int col, int n);
+static void move_screen_cursor(screen_t *s, int row, int col);
+static int render_screen(screen_t *s, char *dst, int len, int doAttrs);
+static int render_screen_sgr(unsigned short attr, char *dst, int len);
+
+
+void destroy_screen(screen_t *screen)
+{
+/*  Destroys the console screen model (screen).
+ */
+    if (!screen) {
+        return;
+    }
+    free(screen);
+    return;
+}
+
+
+void write_screen_data(history_t *hist, const void *src, int len)
+{
+/*  Updates the screen model of the history (hist) with the buffer (src)
+ *    of length (len) read from the console, allocating it if needed.
+ *  The history lock must be held by the caller.
+ */
+    const unsigned char *p = src;
+    const unsigned char *last = p + len;
+    screen_t *s;
+
+    assert(hist != NULL);
+    assert(hist->enableScreen);
+
+    if (!src || (len <= 0)) {
+        return;
+    }
+    if (!(s = hist->screen)) {
+        if (!(s = malloc(sizeof(screen_t)))) {
+            out_of_memory();
+        }
+        reset_screen(s);
+        hist->screen = s;
+    }
+    for (; p < last; p++) {
+        switch (s->state) {
+        case CONMAN_SCREEN_NORMAL:
+            if (*p >= 0x20) {
+                if (*p != 0x7F) {
+                    put_screen_char(s, *p);
+                }
+            }
+            else if (*p == 0x1B) {
+                s->state = CONMAN_SCREEN_ESC;
+            }
+            else if (*p == '\r') {
+                s->col = 0;
+                s->isWrapPending = 0;
+            }
+            else if ((*p == '\n') || (*p == '\v') || (*p == '\f')) {
+                perform_screen_linefeed(s);
+            }
+            else if (*p == '\b') {
+                move_screen_cursor(s, s->row, s->col - 1);
+            }
+            else if (*p == '\t') {
+                move_screen_cursor(s, s->row,
+                    (s->col / SCREEN_TAB_WIDTH + 1) * SCREEN_TAB_WIDTH);
+            }
+            break;
+        case CONMAN_SCREEN_ESC:
+            process_screen_esc(s, *p);
+            break;
+        case CONMAN_SCREEN_CSI:
+            process_screen_csi(s, *p);
+            break;
+        case CONMAN_SCREEN_OSC:
+            if (*p == 0x07) {
+                s->state = CONMAN_SCREEN_NORMAL;
+            }
+            else if (*p == 0x1B) {
+                s->state = CONMAN_SCREEN_OSC_ESC;
+            }
+            break;
+        case CONMAN_SCREEN_OSC_ESC:
+        case CONMAN_SCREEN_SKIP:
+            s->state = CONMAN_SCREEN_NORMAL;
+            break;
+        }
+    }
+    return;
+}
+
+
+int write_screen_to_obj(history_t *hist, obj_t *dst)
+{
+/*  Writes a redraw of the screen modeled by the history (hist) into the
+ *    circular-buffer of (dst): the screen is cleared, each non-blank row is
+ *    drawn with its attributes, and the cursor is restored.
+ *  If the redraw with attributes would exceed half of the obj's buffer
+ *    (as with log replays), the screen is redrawn as plain text instead.
+ *  The history lock must be held by the caller.
+ *  Returns the number of bytes written, or 0 if the screen has no model.
+ */
+    char buf[OBJ_BUF_SIZE / 2];
+    int n;
+
+    assert(hist != NULL);
+    assert(dst != NULL);
+
+    if (!hist->screen) {
+        return(0);
+    }
+    if ((n = render_screen(hist->screen, buf, sizeof(buf), 1)) < 0) {
+        n = render_screen(hist->screen, buf, sizeof(buf), 0);
+    }
+    if (n <= 0) {
+        return(0);
+    }
+    return(write_obj_data(dst, buf, n, 0));
+}
+
+
+static void reset_screen(screen_t *s)
+{
+/*  Resets the screen (s) to its power-on state (ie, RIS).
+ */
+    int i;
+
+    assert(s != NULL);
+
+    memset(s->chars, ' ', sizeof(s->chars));
+    for (i = 0; i < SCREEN_COLS; i++) {
+        s->attrs[0][i] = SCREEN_ATTR_DEFAULT;
+    }
+    for (i = 1; i < SCREEN_ROWS; i++) {
+        memcpy(s->attrs[i], s->attrs[0], sizeof(s->attrs[0]));
+    }
+    s->row = s->col = 0;
+    s->top = 0;
+    s->bottom = SCREEN_ROWS - 1;
+    s->savedRow = s->savedCol = 0;
+    s->attr = s->savedAttr = SCREEN_ATTR_DEFAULT;
+    s->state = CONMAN_SCREEN_NORMAL;
+    s->numParams = 0;
+    s->isPrivate = 0;
+    s->isWrapPending = 0;
+    return;
+}
+
+
+static void put_screen_char(screen_t *s, unsigned char c)
+{
+/*  Writes the char (c) at the cursor of the screen (s) and advances it.
+ *  As with a VT100, writing the last column defers the wrap until the
+ *    next char so a full-width row does not scroll the screen.
+ */
+    if (s->isWrapPending) {
+        s->col = 0;
+        s->isWrapPending = 0;
+        perform_screen_linefeed(s);
+    }
+    s->chars[s->row][s->col] = c;
+    s->attrs[s->row][s->col] = s->attr;
+    if (s->col == SCREEN_COLS - 1) {
+        s->isWrapPending = 1;
+    }
+    else {
+        s->col++;
+    }
+    return;
+}
+
+
+static void process_screen_esc(screen_t *s, unsigned char c)
+{
+/*  Processes the char (c) following an ESC on the screen (s).
+ */
+    s->state = CONMAN_SCREEN_NORMAL;
+
+    switch (c) {
+    case '[':
+        memset(s->params, 0, sizeof(s->params));
+        s->numParams = 0;
+        s->isPrivate = 0;
+        s->state = CONMAN_SCREEN_CSI;
+        break;
+    case ']':
+    case 'P':
+    case '_':
+    case '^':
+        s->state = CONMAN_SCREEN_OSC;
+        break;
+    case '#':
+    case '(':
+    case ')':
+    case '*':
+    case '+':
+        s->state = CONMAN_SCREEN_SKIP;
+        break;
+    case '7':
+        s->savedRow = s->row;
+        s->savedCol = s->col;
+        s->savedAttr = s->attr;
+        break;
+    case '8':
+        s->attr = s->savedAttr;
+        move_screen_cursor(s, s->savedRow, s->savedCol);
+        break;
+    case 'D':
+        perform_screen_linefeed(s);
+        break;
+    case 'E':
+        s->col = 0;
+        perform_screen_linefeed(s);
+        break;
+    case 'M':
+        perform_screen_reverse_index(s);
+        break;
+    case 'c':
+        reset_screen(s);
+        break;
+    case 0x1B:
+        s->state = CONMAN_SCREEN_ESC;
+        break;
+    default:
+        break;
+    }
+    return;
+}
+
+
+static void process_screen_csi(screen_t *s, unsigned char c)
+{
+/*  Processes the char (c) of a CSI sequence on the screen (s).
+ */
+    int *param;
+
+    if ((c >= '0') && (c <= '9')) {
+        if (s->numParams == 0) {
+            s->numParams = 1;
+        }
+        param = &s->params[s->numParams - 1];
+        if (*param <= SCREEN_MAX_PARAM) {
+            *param = (*param * 10) + (c - '0');
+        }
+    }
+    else if (c == ';') {
+        if (s->numParams == 0) {
+            s->numParams = 1;
+        }
+        if (s->numParams < SCREEN_MAX_PARAMS) {
+            s->numParams++;
+        }
+    }
+    else if ((c >= 0x3C) && (c <= 0x3F)) {
+        s->isPrivate = 1;
+    }
+    else if ((c >= 0x40) && (c <= 0x7E)) {
+        s->state = CONMAN_SCREEN_NORMAL;
+        if (!s->isPrivate) {
+            perform_screen_csi(s, c);
+        }
+    }
+    else if (c == 0x1B) {
+        s->state = CONMAN_SCREEN_ESC;
+    }
+    else if ((c == 0x18) || (c == 0x1A)) {
+        s->state = CONMAN_SCREEN_NORMAL;
+    }
+    return;
+}
+
+
+static void perform_screen_csi(screen_t *s, unsigned char c)
+{
+/*  Performs the CSI sequence with final char (c) on the screen (s).
+ */
+    int n = (s->params[0] > 0) ? s->params[0] : 1;
+
+    switch (c) {
+    case 'A':
+        move_screen_cursor(s, s->row - n, s->col);
+        break;
+    case 'B':
+    case 'e':
+        move_screen_cursor(s, s->row + n, s->col);
+        break;
+    case 'C':
+    case 'a':
+        move_screen_cursor(s, s->row, s->col + n);
+        break;
+    case 'D':
+        move_screen_cursor(s, s->row, s->col - n);
+        break;
+    case 'E':
+        move_screen_cursor(s, s->row + n, 0);
+        break;
+    case 'F':
+        move_screen_cursor(s, s->row - n, 0);
+        break;
+    case 'G':
+    case '`':
+        move_screen_cursor(s, s->row, n - 1);
+        break;
+    case 'H':
+    case 'f':
+        move_screen_cursor(s, n - 1,
+            (s->params[1] > 0) ? s->params[1] - 1 : 0);
+        break;
+    case 'd':
+        move_screen_cursor(s, n - 1, s->col);
+        break;
+    case 'J':
+        if (s->params[0] == 0) {
+            clear_screen_cells(s, s->row, s->col, SCREEN_COLS - s->col);
+            for (n = s->row + 1; n < SCREEN_ROWS; n++) {
+                clear_screen_cells(s, n, 0, SCREEN_COLS);
+            }
+        }
+        else if (s->params[0] == 1) {
+            for (n = 0; n < s->row; n++) {
+                clear_screen_cells(s, n, 0, SCREEN_COLS);
+            }
+            clear_screen_cells(s, s->row, 0, s->col + 1);
+        }
+        else {
+            for (n = 0; n < SCREEN_ROWS; n++) {
+                clear_screen_cells(s, n, 0, SCREEN_COLS);
+            }
+        }
+        break;
+    case 'K':
+        if (s->params[0] == 0) {
+            clear_screen_cells(s, s->row, s->col, SCREEN_COLS - s->col);
+        }
+        else if (s->params[0] == 1) {
+            clear_screen_cells(s, s->row, 0, s->col + 1);
+        }
+        else {
+            clear_screen_cells(s, s->row, 0, SCREEN_COLS);
+        }
+        break;
+    case 'L':
+        if ((s->row >= s->top) && (s->row <= s->bottom)) {
+            scroll_screen_down(s, s->row, s->bottom, n);
+            s->col = 0;
+        }
+        break;
+    case 'M':
+        if ((s->row >= s->top) && (s->row <= s->bottom)) {
+            scroll_screen_up(s, s->row, s->bottom, n);
+            s->col = 0;
+        }
+        break;
+    case '@':
+        n = MIN(n, SCREEN_COLS - s->col);
+        memmove(&s->chars[s->row][s->col + n], &s->chars[s->row][s->col],
+            (SCREEN_COLS - s->col - n) * sizeof(s->chars[0][0]));
+        memmove(&s->attrs[s->row][s->col + n], &s->attrs[s->row][s->col],
+            (SCREEN_COLS - s->col - n) * sizeof(s->attrs[0][0]));
+        clear_screen_cells(s, s->row, s->col, n);
+        break;
+    case 'P':
+        n = MIN(n, SCREEN_COLS - s->col);
+        memmove(&s->chars[s->row][s->col], &s->chars[s->row][s->col + n],
+            (SCREEN_COLS - s->col - n) * sizeof(s->chars[0][0]));
+        memmove(&s->attrs[s->row][s->col], &s->attrs[s->row][s->col + n],
+            (SCREEN_COLS - s->col - n) * sizeof(s->attrs[0][0]));
+        clear_screen_cells(s, s->row, SCREEN_COLS - n, n);
+        break;
+    case 'X':
+        clear_screen_cells(s, s->row, s->col, MIN(n, SCREEN_COLS - s->col));
+        break;
+    case 'm':
+        perform_screen_sgr(s);
+        break;
+    case 'r':
+        n = (s->numParams > 1 && s->params[1] > 0)
+            ? MIN(s->params[1], SCREEN_ROWS) : SCREEN_ROWS;
+        if ((s->params[0] > 0 ? s->params[0] : 1) < n) {
+            s->top = (s->params[0] > 0) ? s->params[0] - 1 : 0;
+            s->bottom = n - 1;
+            move_screen_cursor(s, 0, 0);
+        }
+        break;
+    case 's':
+        s->savedRow = s->row;
+        s->savedCol = s->col;
+        break;
+    case 'u':
+        move_screen_cursor(s, s->savedRow, s->savedCol);
+        break;
+    default:
+        break;
+    }
+    return;
+}
+
+
+static void perform_screen_sgr(screen_t *s)
+{
+/*  Performs the SGR (Select Graphic Rendition) sequence on the screen (s).
+ *  Bright colors are modeled as bold; 256-color and RGB colors are ignored.
+ */
+    int i;
+    int n;
+    int p;
+
+    n = (s->numParams > 0) ? s->numParams : 1;
+    for (i = 0; i < n; i++) {
+        p = s->params[i];
+        if (p == 0) {
+            s->attr = SCREEN_ATTR_DEFAULT;
+        }
+        else if (p == 1) {
+            s->attr |= SCREEN_ATTR_BOLD;
+        }
+        else if (p == 4) {
+            s->attr |= SCREEN_ATTR_UNDERLINE;
+        }
+        else if (p == 5) {
+            s->attr |= SCREEN_ATTR_BLINK;
+        }
+        else if (p == 7) {
+            s->attr |= SCREEN_ATTR_REVERSE;
+        }
+        else if (p == 22) {
+            s->attr &= ~SCREEN_ATTR_BOLD;
+        }
+        else if (p == 24) {
+            s->attr &= ~SCREEN_ATTR_UNDERLINE;
+        }
+        else if (p == 25) {
+            s->attr &= ~SCREEN_ATTR_BLINK;
+        }
+        else if (p == 27) {
+            s->attr &= ~SCREEN_ATTR_REVERSE;
+        }
+        else if (((p >= 30) && (p <= 37)) || (p == 39)) {
+            s->attr = (s->attr & ~SCREEN_ATTR_FG_MASK) | (p - 30);
+        }
+        else if (((p >= 40) && (p <= 47)) || (p == 49)) {
+            s->attr = (s->attr & ~SCREEN_ATTR_BG_MASK)
+                | ((p - 40) << SCREEN_ATTR_BG_SHIFT);
+        }
+        else if ((p >= 90) && (p <= 97)) {
+            s->attr = (s->attr & ~SCREEN_ATTR_FG_MASK)
+                | SCREEN_ATTR_BOLD | (p - 90);
+        }
+        else if ((p >= 100) && (p <= 107)) {
+            s->attr = (s->attr & ~SCREEN_ATTR_BG_MASK)
+                | ((p - 100) << SCREEN_ATTR_BG_SHIFT);
+        }
+        else if ((p == 38) || (p == 48)) {
+            if ((i + 1 < n) && (s->params[i + 1] == 5)) {
+                i += 2;
+            }
+            else if ((i + 1 < n) && (s->params[i + 1] == 2)) {
+                i += 4;
+            }
+        }
+    }
+    return;
+}
+
+
+static void perform_screen_linefeed(screen_t *s)
+{
+/*  Moves the cursor of the screen (s) down a row,
+ *    scrolling the scrolling region if the cursor is at its bottom.
+ */
+    s->isWrapPending = 0;
+    if (s->row == s->bottom) {
+        scroll_screen_up(s, s->top, s->bottom, 1);
+    }
+    else if (s->row < SCREEN_ROWS - 1) {
+        s->row++;
+    }
+    return;
+}
+
+
+static void perform_screen_reverse_index(screen_t *s)
+{
+/*  Moves the cursor of the screen (s) up a row,
+ *    scrolling the scrolling region if the cursor is at its top.
+ */
+    s->isWrapPending = 0;
+    if (s->row == s->top) {
+        scroll_screen_down(s, s->top, s->bottom, 1);
+    }
+    else if (s->row > 0) {
+        s->row--;
+    }
+    return;
+}
+
+
+static void scroll_screen_up(screen_t *s, int top, int bottom, int n)
+{
+/*  Scrolls rows [top, bottom] of the screen (s) up by (n) rows,
+ *    clearing the rows exposed at the bottom.
+ */
+    int i;
+
+    n = MIN(n, bottom - top + 1);
+    if (n < bottom - top + 1) {
+        memmove(s->chars[top], s->chars[top + n],
+            (bottom - top + 1 - n) * sizeof(s->chars[0]));
+        memmove(s->attrs[top], s->attrs[top + n],
+            (bottom - top + 1 - n) * sizeof(s->attrs[0]));
+    }
+    for (i = bottom - n + 1; i <= bottom; i++) {
+        clear_screen_cells(s, i, 0, SCREEN_COLS);
+    }
+    return;
+}
+
+
+static void scroll_screen_down(screen_t *s, int top, int bottom, int n)
+{
+/*  Scrolls rows [top, bottom] of the screen (s) down by (n) rows,
+ *    clearing the rows exposed at the top.
+ */
+    int i;
+
+    n = MIN(n, bottom - top + 1);
+    if (n < bottom - top + 1) {
+        memmove(s->chars[top + n], s->chars[top],
+            (bottom - top + 1 - n) * sizeof(s->chars[0]));
+        memmove(s->attrs[top + n], s->attrs[top],
+            (bottom - top + 1 - n) * sizeof(s->attrs[0]));
+    }
+    for (i = top; i < top + n; i++) {
+        clear_screen_cells(s, i, 0, SCREEN_COLS);
+    }
+    return;
+}
+
+
+static void clear_screen_cells(screen_t *s, int row, int col, int n)
+{
+/*  Clears (n) cells of the screen (s) starting at (row, col).
+ *  Cleared cells retain the current background color.
+ */
+    unsigned short attr;
+    int i;
+
+    assert((row >= 0) && (row < SCREEN_ROWS));
+    assert((col >= 0) && (col + n <= SCREEN_COLS));
+
+    attr = (s->attr & SCREEN_ATTR_BG_MASK) | SCREEN_COLOR_DEFAULT;
+    memset(&s->chars[row][col], ' ', n);
+    for (i = col; i < col + n; i++) {
+        s->attrs[row][i] = attr;
+    }
+    return;
+}
+
+
+static void move_screen_cursor(screen_t *s, int row, int col)
+{
+/*  Moves the cursor of the screen (s) to (row, col),
+ *    clamping it to the bounds of the screen.
+ */
+    s->row = MAX(0, MIN(row, SCREEN_ROWS - 1));
+    s->col = MAX(0, MIN(col, SCREEN_COLS - 1));
+    s->isWrapPending = 0;
+    return;
+}
+
+
+static int render_screen(screen_t *s, char *dst, int len, int doAttrs)
+{
+/*  Renders a redraw of the screen (s) into the buffer (dst) of length (len).
+ *  If (doAttrs) is true, SGR sequences are rendered as attributes change;
+ *    otherwise, the screen is rendered as plain text.
+ *  Trailing blanks of each row are not rendered; if they have a background
+ *    color, the row is instead erased to its end in that color (ie, EL).
+ *  Returns the number of bytes rendered (not NUL-terminated),
+ *    or -1 if the buffer is too small.
+ */
+    unsigned short attr = SCREEN_ATTR_DEFAULT;
+    unsigned short fill;
+    int isFill;
+    int row;
+    int col;
+    int last;
+    int n;
+    int m;
+
+    n = snprintf(dst, len, "\033[0m\033[H\033[2J");
+    if ((n < 0) || (n >= len)) {
+        return(-1);
+    }
+    for (row = 0; row < SCREEN_ROWS; row++) {
+
+        /*  EL erases with the background color, but not other attributes.
+         */
+        fill = s->attrs[row][SCREEN_COLS - 1];
+        last = SCREEN_COLS - 1;
+        if (!doAttrs
+                || !(fill & (SCREEN_ATTR_UNDERLINE | SCREEN_ATTR_REVERSE))) {
+            while ((last >= 0) && (s->chars[row][last] == ' ')
+                    && (!doAttrs || (s->attrs[row][last] == fill))) {
+                last--;
+            }
+        }
+        isFill = doAttrs && (fill != SCREEN_ATTR_DEFAULT)
+            && (last < SCREEN_COLS - 1);
+        if ((last < 0) && !isFill) {
+            continue;
+        }
+        m = snprintf(dst + n, len - n, "\033[%d;1H", row + 1);
+        if ((m < 0) || (m >= len - n)) {
+            return(-1);
+        }
+        n += m;
+        for (col = 0; col <= last; col++) {
+            if (doAttrs && (s->attrs[row][col] != attr)) {
+                attr = s->attrs[row][col];
+                if ((m = render_screen_sgr(attr, dst + n, len - n)) < 0) {
+                    return(-1);
+                }
+                n += m;
+            }
+            if (n >= len) {
+                return(-1);
+            }
+            dst[n++] = s->chars[row][col];
+        }
+        if (isFill) {
+            if (fill != attr) {
+                attr = fill;
+                if ((m = render_screen_sgr(attr, dst + n, len - n)) < 0) {
+                    return(-1);
+                }
+                n += m;
+            }
+            m = snprintf(dst + n, len - n, "\033[K");
+            if ((m < 0) || (m >= len - n)) {
+                return(-1);
+            }
+            n += m;
+        }
+    }
+    if (doAttrs && (s->attr != attr)) {
+        if ((m = render_screen_sgr(s->attr, dst + n, len - n)) < 0) {
+            return(-1);
+        }
+        n += m;
+    }
+    m = snprintf(dst + n, len - n, "\033[%d;%dH", s->row + 1, s->col + 1);
+    if ((m < 0) || (m >= len - n)) {
+        return(-1);
+    }
+    n += m;
+    return(n);
+}
+
+
+static int render_screen_sgr(unsigned short attr, char *dst, int len)
+{
+/*  Renders an SGR sequence selecting the attributes (attr) into the
+ *    buffer (dst) of length (len).
+ *  Returns the number of bytes rendered, or -1 if the buffer is too small.
+ */
+    int fg = attr & SCREEN_ATTR_FG_MASK;
+    int bg = (attr & SCREEN_ATTR_BG_MASK) >> SCREEN_ATTR_BG_SHIFT;
+    int n;
+
+    n = snprintf(dst, len, "\033[0%s%s%s%s",
+        (attr & SCREEN_ATTR_BOLD) ? ";1" : "",
+        (attr & SCREEN_ATTR_UNDERLINE) ? ";4" : "",
+        (attr & SCREEN_ATTR_BLINK) ? ";5" : "",
+        (attr & SCREEN_ATTR_REVERSE) ? ";7" : "");
+    if ((n < 0) || (n >= len)) {
+        return(-1);
+    }
+    if (fg != SCREEN_COLOR_DEFAULT) {
+        n += snprintf(dst + n, len - n, ";3%d", fg);
+    }
+    if ((n < len) && (bg != SCREEN_COLOR_DEFAULT)) {
+        n += snprintf(dst + n, len - n, ";4%d", bg);
+    }
+    if (n >= len - 1) {
+        return(-1);
+    }
+    dst[n++] = 'm';
+    return(n);
+}
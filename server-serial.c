@@ -270,7 +270,7 @@ void set_serial_opts(struct termios *tty, obj_t *serial, seropt_t *opts)
     assert((opts->stopbits >= 1) && (opts->stopbits <= 2));
 
     DPRINTF((10, "Setting [%s] dev=%s to %d,%d%s%d.\n",
-        serial->name, serial->aux.serial.dev, bps_to_int(opts->bps),
+        serial->name, serial->aux->serial.dev, bps_to_int(opts->bps),
         opts->databits, parity_to_str(opts->parity), opts->stopbits));
 
     if (cfsetispeed(tty, opts->bps) < 0)
@@ -346,7 +346,7 @@ obj_t * create_serial_obj(server_conf_t *conf, char *name,
             }
             break;
         }
-        if (is_serial_obj(serial) && !strcmp(serial->aux.serial.dev, dev)) {
+        if (is_serial_obj(serial) && !strcmp(serial->aux->serial.dev, dev)) {
             if ((errbuf != NULL) && (errlen > 0)) {
                 snprintf(errbuf, errlen,
                     "console [%s] specifies duplicate device \"%s\"",
@@ -360,9 +360,9 @@ obj_t * create_serial_obj(server_conf_t *conf, char *name,
         return(NULL);
     }
     serial = create_obj(conf, name, -1, CONMAN_OBJ_SERIAL);
-    serial->aux.serial.dev = create_string(dev);
-    serial->aux.serial.opts = *opts;
-    serial->aux.serial.logfile = NULL;
+    serial->aux->serial.dev = create_string(dev);
+    serial->aux->serial.opts = *opts;
+    serial->aux->serial.logfile = NULL;
     /*
      *  Add obj to the master conf->objs list.
      */
@@ -387,30 +387,30 @@ int open_serial_obj(obj_t *serial)
     assert(is_serial_obj(serial));
 
     if (serial->fd >= 0) {
-        write_notify_msg(serial, LOG_INFO,
+        write_notify_event(serial, CONMAN_SINK_DISCONNECT, LOG_INFO,
             "Console [%s] disconnected from \"%s\"",
-            serial->name, serial->aux.serial.dev);
+            serial->name, serial->aux->serial.dev);
         tpoll_clear(tp_global, serial->fd, POLLIN | POLLOUT);
-        set_tty_mode(&serial->aux.serial.tty, serial->fd);
+        set_tty_mode(&serial->aux->serial.tty, serial->fd);
         if (close(serial->fd) < 0)      /* log err and continue */
             log_msg(LOG_WARNING, "Unable to close [%s] device \"%s\": %s",
-                serial->name, serial->aux.serial.dev, strerror(errno));
+                serial->name, serial->aux->serial.dev, strerror(errno));
         serial->fd = -1;
     }
     flags = O_RDWR | O_NONBLOCK | O_NOCTTY;
-    if ((fd = open(serial->aux.serial.dev, flags)) < 0) {
+    if ((fd = open(serial->aux->serial.dev, flags)) < 0) {
         log_msg(LOG_WARNING, "Unable to open [%s] device \"%s\": %s",
-            serial->name, serial->aux.serial.dev, strerror(errno));
+            serial->name, serial->aux->serial.dev, strerror(errno));
         goto err;
     }
     if (get_write_lock(fd) < 0) {
         log_msg(LOG_WARNING, "Unable to lock [%s] device \"%s\"",
-            serial->name, serial->aux.serial.dev);
+            serial->name, serial->aux->serial.dev);
         goto err;
     }
     if (!isatty(fd)) {
         log_msg(LOG_WARNING, "[%s] device \"%s\" not a terminal",
-            serial->name, serial->aux.serial.dev);
+            serial->name, serial->aux->serial.dev);
         goto err;
     }
     /*  According to the UNIX Programming FAQ v1.37
@@ -431,9 +431,9 @@ int open_serial_obj(obj_t *serial)
      *  FIXME: Re-evaluate this thinking since a SIGHUP should attempt
      *         to resurrect "downed" serial objs.
      */
-    get_tty_mode(&serial->aux.serial.tty, fd);
+    get_tty_mode(&serial->aux->serial.tty, fd);
     get_tty_raw(&tty, fd);
-    set_serial_opts(&tty, serial, &serial->aux.serial.opts);
+    set_serial_opts(&tty, serial, &serial->aux->serial.opts);
     set_tty_mode(&tty, fd);
     serial->fd = fd;
     serial->gotEOF = 0;
@@ -441,11 +441,12 @@ int open_serial_obj(obj_t *serial)
     /*
      *  Success!
      */
-    write_notify_msg(serial, LOG_INFO, "Console [%s] connected to \"%s\"",
-        serial->name, serial->aux.serial.dev);
+    write_notify_event(serial, CONMAN_SINK_CONNECT, LOG_INFO,
+        "Console [%s] connected to \"%s\"",
+        serial->name, serial->aux->serial.dev);
     DPRINTF((9, "Opened [%s] serial: fd=%d dev=%s bps=%d.\n",
-        serial->name, serial->fd, serial->aux.serial.dev,
-        bps_to_int(serial->aux.serial.opts.bps)));
+        serial->name, serial->fd, serial->aux->serial.dev,
+        bps_to_int(serial->aux->serial.opts.bps)));
     return(0);
 
 err:
@@ -0,0 +1,595 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "log.h"
+#include "server.h"
+#include "tpoll.h"
+#include "util.h"
+#include "util-file.h"
+#include "util-str.h"
+#include "wrapper.h"
+
+
+/*  If the Sink option is enabled, the data read from every console and the
+ *    console connect/disconnect events are streamed as JSON records (one per
+ *    line) to a single consumer via a FIFO or a unix domain socket owned by
+ *    the consumer.  Each record specifies the console, the time, the stream
+ *    offset of the console's data, and either the data or the event:
+ *
+ *    {"console":"x","time":1.000001,"offset":0,"event":"data","data":"..."}
+ *    {"console":"x","time":1.000001,"offset":0,"event":"connect","msg":"..."}
+ *
+ *  Console data is split into records of at most SINK_CHUNK_SIZE bytes.
+ *    Each byte is encoded as the JSON character of the same code point
+ *    (U+0000 to U+00FF), so the original bytes are recovered by encoding
+ *    the decoded string as ISO-8859-1.
+ *  Records are appended to a ring of SINK_BUF_SIZE bytes and written out by
+ *    the mux thread in batches as the consumer accepts them, so a slow or
+ *    absent consumer never blocks the daemon.  A record that does not fit
+ *    is dropped, and a warning is logged at most once per SINK_LOG_INTERVAL
+ *    seconds.  Once space is available, a "drop" record reports the number
+ *    of records and console data bytes dropped since the last one:
+ *
+ *    {"time":1.000001,"event":"drop","records":1,"bytes":10}
+ *
+ *  While the consumer is not connected, records accumulate in the ring;
+ *    connection attempts are retried with exponential backoff.  A record
+ *    partially written to a consumer that disconnects is discarded.
+ *  The ring and connection state are protected by the sinkLock.  It is held
+ *    while calling tpoll, which does not hold its own mutex while invoking
+ *    timer callbacks.
+ */
+
+static void write_sink_record(const char *rec, int len, int numBytes);
+static int format_sink_head(char *buf, int buflen, obj_t *console,
+    const char *event);
+static int format_sink_string(char *buf, int buflen,
+    const unsigned char *src, int len);
+static void connect_sink(void);
+static void disconnect_sink(const char *reason);
+static void flush_sink(void);
+static void retry_sink(void *arg);
+static void reset_sink_delay(void *arg);
+
+extern tpoll_t tp_global;               /* defined in server.c */
+
+static pthread_mutex_t sinkLock = PTHREAD_MUTEX_INITIALIZER;
+static char *sinkName = NULL;
+static int sinkFd = -1;
+static int isSinkUp = 0;
+static int sinkTimer = -1;
+static int sinkDelay = 0;
+static int isSinkPollOut = 0;
+static int isSinkMidRecord = 0;
+static unsigned char *sinkBuf = NULL;
+static int sinkIn = 0;
+static int sinkOut = 0;
+static int sinkCount = 0;
+static time_t sinkLogTime = 0;
+static char *sinkRecord = NULL;
+static unsigned long long numSinkRecords = 0;
+static unsigned long long numSinkDropRecords = 0;
+static unsigned long long numSinkDropBytes = 0;
+static unsigned long long numPendDropRecords = 0;
+static unsigned long long numPendDropBytes = 0;
+
+
+void init_sink(server_conf_t *conf)
+{
+/*  Initializes the sink if enabled by the configuration (conf),
+ *    and initiates the connection to the consumer.
+ *  A supervisor of worker procs has no consoles, so it has no sink.
+ *    A FIFO cannot be shared by the worker procs since their batched
+ *    writes would interleave.
+ *  This must be called by the mux thread.
+ */
+    struct stat st;
+
+    if (!conf->sinkName) {
+        return;
+    }
+    if ((conf->numWorkers > 0) && (conf->workerIndex < 0)) {
+        return;
+    }
+    if ((conf->workerIndex >= 0)
+            && (stat(conf->sinkName, &st) == 0) && S_ISFIFO(st.st_mode)) {
+        log_msg(LOG_ERR, "Unable to share sink FIFO \"%s\" among workers",
+            conf->sinkName);
+        return;
+    }
+    if (!(sinkBuf = malloc(SINK_BUF_SIZE))
+            || !(sinkRecord = malloc(SINK_RECORD_SIZE))) {
+        out_of_memory();
+    }
+    x_pthread_mutex_lock(&sinkLock);
+    sinkName = create_string(conf->sinkName);
+    connect_sink();
+    x_pthread_mutex_unlock(&sinkLock);
+    return;
+}
+
+
+void write_sink_data(obj_t *console, const void *src, int len)
+{
+/*  Writes the buffer (src) of length (len) read from (console) to the sink
+ *    as one or more data records.  This must be called before the data is
+ *    appended to the console's history so the stream offset is that of the
+ *    first byte.
+ */
+    const unsigned char *p = src;
+    unsigned long long offset;
+    int n, m;
+
+    if (!sinkName || !src || (len <= 0)) {
+        return;
+    }
+    assert(is_console_obj(console));
+
+    offset = (console->history ? console->history->offset : 0);
+
+    x_pthread_mutex_lock(&sinkLock);
+    while (len > 0) {
+        m = MIN(len, SINK_CHUNK_SIZE);
+        n = format_sink_head(sinkRecord, SINK_RECORD_SIZE, console, "data");
+        n += snprintf(sinkRecord + n, SINK_RECORD_SIZE - n,
+            ",\"offset\":%llu,\"data\":\"", offset);
+        n += format_sink_string(sinkRecord + n, SINK_RECORD_SIZE - n - 3,
+            p, m);
+        n += snprintf(sinkRecord + n, SINK_RECORD_SIZE - n, "\"}\n");
+        write_sink_record(sinkRecord, n, m);
+        offset += m;
+        p += m;
+        len -= m;
+    }
+    x_pthread_mutex_unlock(&sinkLock);
+    return;
+}
+
+
+void write_sink_event(obj_t *console, enum sink_event event, const char *msg)
+{
+/*  Writes a record of the (event) on (console) to the sink, along with
+ *    the notification (msg) if not NULL.
+ */
+    const char *name;
+    int n;
+
+    if (!sinkName) {
+        return;
+    }
+    assert(is_console_obj(console));
+
+    switch (event) {
+    case CONMAN_SINK_CONNECT:
+        name = "connect";
+        break;
+    case CONMAN_SINK_DISCONNECT:
+        name = "disconnect";
+        break;
+    default:
+        return;
+    }
+    x_pthread_mutex_lock(&sinkLock);
+    n = format_sink_head(sinkRecord, SINK_RECORD_SIZE, console, name);
+    n += snprintf(sinkRecord + n, SINK_RECORD_SIZE - n, ",\"offset\":%llu",
+        (console->history ? console->history->offset : 0));
+    if (msg) {
+        n += snprintf(sinkRecord + n, SINK_RECORD_SIZE - n, ",\"msg\":\"");
+        n += format_sink_string(sinkRecord + n, SINK_RECORD_SIZE - n - 3,
+            (const unsigned char *) msg, strlen(msg));
+        n += snprintf(sinkRecord + n, SINK_RECORD_SIZE - n, "\"");
+    }
+    n += snprintf(sinkRecord + n, SINK_RECORD_SIZE - n, "}\n");
+    write_sink_record(sinkRecord, n, 0);
+    x_pthread_mutex_unlock(&sinkLock);
+    return;
+}
+
+
+int dispatch_sink_io(server_conf_t *conf)
+{
+/*  Writes records buffered for the sink if its consumer is ready for them.
+ *  Returns the number of fds handled (0 or 1).
+ *  This must be called by the mux thread.
+ */
+    int n = 0;
+
+    if (!sinkName) {
+        return(0);
+    }
+    x_pthread_mutex_lock(&sinkLock);
+    if ((sinkFd >= 0)
+            && (tpoll_is_set(conf->tp, sinkFd, POLLOUT | POLLHUP | POLLERR)
+                > 0)) {
+        flush_sink();
+        n = 1;
+    }
+    x_pthread_mutex_unlock(&sinkLock);
+    return(n);
+}
+
+
+void log_sink_stats(void)
+{
+/*  Logs the sink's record and drop counts.
+ */
+    unsigned long long numRecs, numDrops, numBytes;
+    int numBuffered;
+    int isConnected;
+
+    if (!sinkName) {
+        return;
+    }
+    x_pthread_mutex_lock(&sinkLock);
+    numRecs = numSinkRecords;
+    numDrops = numSinkDropRecords;
+    numBytes = numSinkDropBytes;
+    numBuffered = sinkCount;
+    isConnected = isSinkUp;
+    x_pthread_mutex_unlock(&sinkLock);
+
+    log_msg(LOG_NOTICE, "Sink \"%s\" %s: %llu record%s written, "
+        "%llu record%s dropped (%llu console bytes), %dKB buffered",
+        sinkName, (isConnected ? "connected" : "disconnected"),
+        numRecs, ((numRecs == 1) ? "" : "s"),
+        numDrops, ((numDrops == 1) ? "" : "s"), numBytes,
+        (numBuffered + 1023) / 1024);
+    return;
+}
+
+
+int get_sink_mem_size(void)
+{
+/*  Returns the number of bytes allocated for the sink's buffers.
+ */
+    return(sinkBuf ? SINK_BUF_SIZE + SINK_RECORD_SIZE : 0);
+}
+
+
+static void write_sink_record(const char *rec, int len, int numBytes)
+{
+/*  Appends the record (rec) of length (len) to the sink's ring, or drops it
+ *    if the ring is full; (numBytes) is the number of console data bytes
+ *    contained in the record.  Pending drops are reported first.
+ *  The sinkLock must be held when calling this routine.
+ */
+    char buf[MAX_LINE];
+    struct timeval tv;
+    int n, m;
+
+    assert(len > 0);
+    assert(rec[len - 1] == '\n');
+
+    if (numPendDropRecords > 0) {
+        if (gettimeofday(&tv, NULL) < 0) {
+            log_err(errno, "Unable to get time of day");
+        }
+        n = snprintf(buf, sizeof(buf), "{\"time\":%ld.%06ld,"
+            "\"event\":\"drop\",\"records\":%llu,\"bytes\":%llu}\n",
+            (long) tv.tv_sec, (long) tv.tv_usec,
+            numPendDropRecords, numPendDropBytes);
+        if (n + len <= SINK_BUF_SIZE - sinkCount) {
+            numPendDropRecords = 0;
+            numPendDropBytes = 0;
+            write_sink_record(buf, n, 0);
+        }
+    }
+    if ((numPendDropRecords > 0) || (len > SINK_BUF_SIZE - sinkCount)) {
+        if ((numPendDropRecords == 0)
+                && (time(NULL) - sinkLogTime >= SINK_LOG_INTERVAL)) {
+            log_msg(LOG_WARNING, "Sink \"%s\" buffer full: dropping records",
+                sinkName);
+            sinkLogTime = time(NULL);
+        }
+        numPendDropRecords++;
+        numPendDropBytes += numBytes;
+        numSinkDropRecords++;
+        numSinkDropBytes += numBytes;
+        return;
+    }
+    m = MIN(len, SINK_BUF_SIZE - sinkIn);
+    memcpy(sinkBuf + sinkIn, rec, m);
+    memcpy(sinkBuf, rec + m, len - m);
+    sinkIn = (sinkIn + len) % SINK_BUF_SIZE;
+    sinkCount += len;
+    numSinkRecords++;
+
+    if ((sinkFd >= 0) && !isSinkPollOut) {
+        tpoll_set(tp_global, sinkFd, POLLOUT);
+        isSinkPollOut = 1;
+    }
+    return;
+}
+
+
+static int format_sink_head(char *buf, int buflen, obj_t *console,
+    const char *event)
+{
+/*  Formats the start of a record for the (event) on (console) into (buf)
+ *    of length (buflen).
+ *  Returns the number of bytes written, not including the terminating NUL.
+ */
+    struct timeval tv;
+    int n;
+
+    if (gettimeofday(&tv, NULL) < 0) {
+        log_err(errno, "Unable to get time of day");
+    }
+    n = snprintf(buf, buflen, "{\"console\":\"");
+    n += format_sink_string(buf + n, MIN(buflen - n, MAX_LINE),
+        (const unsigned char *) console->name, strlen(console->name));
+    n += snprintf(buf + n, buflen - n,
+        "\",\"time\":%ld.%06ld,\"event\":\"%s\"",
+        (long) tv.tv_sec, (long) tv.tv_usec, event);
+    return(n);
+}
+
+
+static int format_sink_string(char *buf, int buflen,
+    const unsigned char *src, int len)
+{
+/*  Formats the (src) string of length (len) as the contents of a JSON string
+ *    into (buf) of length (buflen), mapping each byte to the character of
+ *    the same code point.  The string is truncated if (buf) is too small.
+ *  Returns the number of bytes written, not including the terminating NUL.
+ */
+    static const char hex[] = "0123456789abcdef";
+    char *p = buf;
+    char *q = buf + buflen - 7;         /* reserve longest escape plus NUL */
+    unsigned char c;
+    int i;
+
+    for (i = 0; (i < len) && (p < q); i++) {
+        c = src[i];
+        if ((c >= 0x20) && (c < 0x7F) && (c != '"') && (c != '\\')) {
+            *p++ = c;
+            continue;
+        }
+        *p++ = '\\';
+        if (c == '"') {
+            *p++ = '"';
+        }
+        else if (c == '\\') {
+            *p++ = '\\';
+        }
+        else if (c == '\n') {
+            *p++ = 'n';
+        }
+        else if (c == '\r') {
+            *p++ = 'r';
+        }
+        else if (c == '\t') {
+            *p++ = 't';
+        }
+        else {
+            *p++ = 'u';
+            *p++ = '0';
+            *p++ = '0';
+            *p++ = hex[c >> 4];
+            *p++ = hex[c & 0x0F];
+        }
+    }
+    if (buflen > 0) {
+        *p = '\0';
+    }
+    return(p - buf);
+}
+
+
+static void connect_sink(void)
+{
+/*  Opens the connection to the sink's consumer, retrying with exponential
+ *    backoff while the FIFO has no reader or the socket is not listening.
+ *  The sinkLock must be held when calling this routine.
+ */
+    struct stat st;
+    struct sockaddr_un saddr;
+
+    assert(sinkFd < 0);
+
+    if (stat(sinkName, &st) < 0) {
+        disconnect_sink(strerror(errno));
+        return;
+    }
+    if (S_ISFIFO(st.st_mode)) {
+        /*  Opening a FIFO for writing without a reader fails with ENXIO.
+         */
+        if ((sinkFd = open(sinkName, O_WRONLY | O_NONBLOCK)) < 0) {
+            disconnect_sink(strerror(errno));
+            return;
+        }
+    }
+    else {
+        memset(&saddr, 0, sizeof(saddr));
+        saddr.sun_family = AF_UNIX;
+        if (strlcpy(saddr.sun_path, sinkName, sizeof(saddr.sun_path))
+                >= sizeof(saddr.sun_path)) {
+            disconnect_sink("pathname too long");
+            return;
+        }
+        if ((sinkFd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+            disconnect_sink(strerror(errno));
+            return;
+        }
+        set_fd_nonblocking(sinkFd);
+        if (connect(sinkFd, (struct sockaddr *) &saddr, sizeof(saddr)) < 0) {
+            disconnect_sink(strerror(errno));
+            return;
+        }
+        (void) shutdown(sinkFd, SHUT_RD);
+    }
+    set_fd_closed_on_exec(sinkFd);
+    isSinkUp = 1;
+    log_msg(LOG_INFO, "Sink connected to \"%s\"", sinkName);
+
+    /*  Require the connection to be up for a minimum length of time before
+     *    resetting the reconnect-delay back to the minimum.
+     */
+    sinkTimer = tpoll_timeout_relative(tp_global,
+        (callback_f) reset_sink_delay, NULL, MIN_CONNECT_SECS * 1000);
+
+    if (sinkCount > 0) {
+        tpoll_set(tp_global, sinkFd, POLLOUT);
+        isSinkPollOut = 1;
+    }
+    return;
+}
+
+
+static void disconnect_sink(const char *reason)
+{
+/*  Closes the connection to the sink's consumer (if open) due to (reason),
+ *    and schedules the next connection attempt.
+ *  The sinkLock must be held when calling this routine.
+ */
+    if (sinkTimer >= 0) {
+        (void) tpoll_timeout_cancel(tp_global, sinkTimer);
+        sinkTimer = -1;
+    }
+    if (sinkFd >= 0) {
+        if (isSinkPollOut) {
+            tpoll_clear(tp_global, sinkFd, POLLOUT);
+            isSinkPollOut = 0;
+        }
+        if (close(sinkFd) < 0) {
+            log_msg(LOG_WARNING, "Unable to close sink \"%s\": %s",
+                sinkName, strerror(errno));
+        }
+        sinkFd = -1;
+    }
+    if (isSinkUp) {
+        log_msg(LOG_INFO, "Sink disconnected from \"%s\": %s",
+            sinkName, reason);
+        isSinkUp = 0;
+    }
+    else {
+        log_msg(LOG_DEBUG, "Unable to connect sink to \"%s\": %s",
+            sinkName, reason);
+    }
+    /*  Discard the remainder of a partially-written record.
+     */
+    if (isSinkMidRecord) {
+        while ((sinkCount > 0) && (sinkBuf[sinkOut] != '\n')) {
+            sinkOut = (sinkOut + 1) % SINK_BUF_SIZE;
+            sinkCount--;
+        }
+        if (sinkCount > 0) {
+            sinkOut = (sinkOut + 1) % SINK_BUF_SIZE;
+            sinkCount--;
+        }
+        numSinkDropRecords++;
+        isSinkMidRecord = 0;
+    }
+    sinkDelay = (sinkDelay == 0)
+        ? SINK_MIN_TIMEOUT : MIN(sinkDelay * 2, SINK_MAX_TIMEOUT);
+    sinkTimer = tpoll_timeout_relative(tp_global,
+        (callback_f) retry_sink, NULL, sinkDelay * 1000);
+    return;
+}
+
+
+static void flush_sink(void)
+{
+/*  Writes as much of the sink's ring as the consumer will accept.
+ *  The sinkLock must be held when calling this routine.
+ */
+    struct iovec iov[2];
+    int iovcnt;
+    ssize_t n;
+
+    assert(sinkFd >= 0);
+
+    while (sinkCount > 0) {
+        iov[0].iov_base = sinkBuf + sinkOut;
+        iov[0].iov_len = MIN(sinkCount, SINK_BUF_SIZE - sinkOut);
+        iov[1].iov_base = sinkBuf;
+        iov[1].iov_len = sinkCount - iov[0].iov_len;
+        iovcnt = (iov[1].iov_len > 0) ? 2 : 1;
+
+        if ((n = writev(sinkFd, iov, iovcnt)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                return;
+            }
+            disconnect_sink(strerror(errno));
+            return;
+        }
+        sinkOut = (sinkOut + n) % SINK_BUF_SIZE;
+        sinkCount -= n;
+        isSinkMidRecord =
+            (sinkBuf[(sinkOut + SINK_BUF_SIZE - 1) % SINK_BUF_SIZE] != '\n');
+    }
+    if (isSinkPollOut) {
+        tpoll_clear(tp_global, sinkFd, POLLOUT);
+        isSinkPollOut = 0;
+    }
+    return;
+}
+
+
+static void retry_sink(void *arg)
+{
+/*  Timer callback to retry the connection to the sink's consumer.
+ */
+    x_pthread_mutex_lock(&sinkLock);
+    sinkTimer = -1;
+    connect_sink();
+    x_pthread_mutex_unlock(&sinkLock);
+    return;
+}
+
+
+static void reset_sink_delay(void *arg)
+{
+/*  Resets the sink's reconnect-delay after the connection has been up for
+ *    the minimum length of time.
+ */
+    x_pthread_mutex_lock(&sinkLock);
+    sinkTimer = -1;
+    sinkDelay = 0;
+    x_pthread_mutex_unlock(&sinkLock);
+    return;
+}
@@ -47,6 +47,7 @@
 #include "util-file.h"
 #include "util-net.h"
 #include "util-str.h"
+#include "util.h"
 #include "wrapper.h"
 
 
@@ -67,22 +68,30 @@ int deny_severity = LOG_WARNING;        /* logging level for rejected reqs */
 
 
 static int resolve_addr(server_conf_t *conf, req_t *req, int sd);
-static int recv_greeting(req_t *req);
+static int recv_greeting(server_conf_t *conf, req_t *req);
 static void parse_greeting(Lex l, req_t *req);
-static int recv_req(req_t *req);
+static int recv_req(req_t *req, char *buf, int buflen);
+static void parse_req(req_t *req, const char *buf);
 static void parse_cmd_opts(Lex l, req_t *req);
 static int query_consoles(server_conf_t *conf, req_t *req);
 static int query_consoles_via_globbing(
-    server_conf_t *conf, req_t *req, List matches);
+    registry_t *reg, req_t *req, List matches);
 static int query_consoles_via_regex(
-    server_conf_t *conf, req_t *req, List matches);
+    registry_t *reg, req_t *req, List matches);
 static int validate_req(req_t *req);
 static int check_too_many_consoles(req_t *req);
 static int check_busy_consoles(req_t *req);
 static int send_rsp(req_t *req, int errnum, char *errmsg);
+static int route_worker_req(server_conf_t *conf, req_t *req, char *request);
+static int relay_worker_req(server_conf_t *conf, req_t *req, char *request,
+    List names, int *indices, int numIndices);
+static int send_worker_rsp(req_t *req, List names);
 static int perform_query_cmd(req_t *req);
 static int perform_monitor_cmd(req_t *req, server_conf_t *conf);
 static int perform_connect_cmd(req_t *req, server_conf_t *conf);
+static int perform_execute_cmd(req_t *req, server_conf_t *conf);
+static void find_console_offset(obj_t *console, req_t *req);
+static void link_console_at_offset(obj_t *console, obj_t *client);
 static void check_console_state(obj_t *console, obj_t *client);
 
 
@@ -91,12 +100,16 @@ void process_client(client_arg_t *args)
 /*  The thread responsible for accepting a client connection
  *    and processing the request.
  *  The QUERY cmd is processed entirely by this thread.
- *  The MONITOR and CONNECT cmds are setup and then placed
+ *  The MONITOR, CONNECT, and EXECUTE cmds are setup and then placed
  *    in the conf->objs list to be handled by mux_io().
+ *  A supervisor routes the request to its worker procs instead.  A client
+ *    handed off to a worker arrives with its greeting already processed.
  */
     int sd;
     server_conf_t *conf;
     req_t *req;
+    char *request;
+    char buf[MAX_SOCK_LINE];
 
     /*  Free the tmp struct that was created by accept_client()
      *    in order to pass multiple args to this thread.
@@ -104,20 +117,40 @@ void process_client(client_arg_t *args)
     assert(args != NULL);
     sd = args->sd;
     conf = args->conf;
+    req = args->req;
+    request = args->request;
     free(args);
 
     DPRINTF((5, "Processing new client.\n"));
 
     x_pthread_detach(pthread_self());
 
-    req = create_req();
+    if (req) {
+        assert(req->sd == sd);
+        assert(request != NULL);
+        DPRINTF((5, "Received request from supervisor: %s", request));
+        parse_req(req, request);
+        free(request);
+    }
+    else {
+        req = create_req();
 
-    if (resolve_addr(conf, req, sd) < 0)
-        goto err;
-    if (recv_greeting(req) < 0)
-        goto err;
-    if (recv_req(req) < 0)
-        goto err;
+        if (resolve_addr(conf, req, sd) < 0)
+            goto err;
+#if WITH_OPENSSL
+        if (accept_tls_client(conf, req) < 0)
+            goto err;
+#endif /* WITH_OPENSSL */
+        if (recv_greeting(conf, req) < 0)
+            goto err;
+        if (recv_req(req, buf, sizeof(buf)) < 0)
+            goto err;
+        if ((conf->numWorkers > 0) && (conf->workerIndex < 0)) {
+            if (route_worker_req(conf, req, buf) < 0)
+                goto err;
+            return;
+        }
+    }
     if (query_consoles(conf, req) < 0)
         goto err;
     if (validate_req(req) < 0)
@@ -135,6 +168,10 @@ void process_client(client_arg_t *args)
         if (perform_connect_cmd(req, conf) < 0)
             goto err;
         break;
+    case CONMAN_CMD_EXECUTE:
+        if (perform_execute_cmd(req, conf) < 0)
+            goto err;
+        break;
     case CONMAN_CMD_MONITOR:
         if (perform_monitor_cmd(req, conf) < 0)
             goto err;
@@ -217,10 +254,11 @@ static int resolve_addr(server_conf_t *conf, req_t *req, int sd)
 }
 
 
-static int recv_greeting(req_t *req)
+static int recv_greeting(server_conf_t *conf, req_t *req)
 {
 /*  Performs the initial handshake with the client
- *    (SOMEDAY including authentication & encryption, if needed).
+ *    (SOMEDAY including authentication, if needed).
+ *  Encryption has already been negotiated by accept_tls_client().
  *  Returns 0 if the greeting is valid, or -1 on error.
  */
     int n;
@@ -231,7 +269,7 @@ static int recv_greeting(req_t *req)
 
     assert(req->sd >= 0);
 
-    if ((n = read_line(req->sd, buf, sizeof(buf))) < 0) {
+    if ((n = read_req_line(req, buf, sizeof(buf))) < 0) {
         log_msg(LOG_NOTICE, "Unable to read greeting from <%s:%d>: %s",
             req->fqdn, req->port, strerror(errno));
         return(-1);
@@ -269,6 +307,11 @@ static int recv_greeting(req_t *req)
             "Invalid greeting: no user specified");
         return(-1);
     }
+    if (conf->enableTLSRequire && !req->enableTLS) {
+        send_rsp(req, CONMAN_ERR_AUTHENTICATE,
+            "Encryption required: reconnect using TLS");
+        return(-1);
+    }
 
     /*  Send response to greeting.
      */
@@ -279,7 +322,7 @@ static int recv_greeting(req_t *req)
 static void parse_greeting(Lex l, req_t *req)
 {
 /*  Parses the "HELLO" command from the client:
- *    HELLO USER='<str>' TTY='<str>'
+ *    HELLO USER='<str>' TTY='<str>' OPTION=COMPRESS OPTION=FRAMED
  */
     int done = 0;
     int tok;
@@ -303,6 +346,17 @@ static void parse_greeting(Lex l, req_t *req)
                 req->tty = lex_decode(create_string(lex_text(l)));
             }
             break;
+        case CONMAN_TOK_OPTION:
+            if (lex_next(l) == '=') {
+                tok = lex_next(l);
+#if WITH_ZLIB
+                if (tok == CONMAN_TOK_COMPRESS)
+                    req->enableCompress = 1;
+#endif /* WITH_ZLIB */
+                if (tok == CONMAN_TOK_FRAMED)
+                    req->enableFramed = 1;
+            }
+            break;
         case LEX_EOF:
         case LEX_EOL:
             done = 1;
@@ -315,20 +369,17 @@ static void parse_greeting(Lex l, req_t *req)
 }
 
 
-static int recv_req(req_t *req)
+static int recv_req(req_t *req, char *buf, int buflen)
 {
-/*  Receives the request from the client after the greeting has completed.
+/*  Receives the request from the client after the greeting has completed,
+ *    retaining the request line in (buf) of length (buflen).
  *  Returns 0 if the request is read OK, or -1 on error.
  */
     int n;
-    char buf[MAX_SOCK_LINE];
-    Lex l;
-    int done = 0;
-    int tok;
 
     assert(req->sd >= 0);
 
-    if ((n = read_line(req->sd, buf, sizeof(buf))) < 0) {
+    if ((n = read_req_line(req, buf, buflen)) < 0) {
         log_msg(LOG_NOTICE, "Unable to read request from <%s:%d>: %s",
             req->fqdn, req->port, strerror(errno));
         return(-1);
@@ -341,7 +392,20 @@ static int recv_req(req_t *req)
 
     DPRINTF((5, "Received request: %s", buf));
 
-    l = lex_create(buf, proto_strs);
+    parse_req(req, buf);
+    return(0);
+}
+
+
+static void parse_req(req_t *req, const char *buf)
+{
+/*  Parses the request line (buf) into the request (req).
+ */
+    Lex l;
+    int done = 0;
+    int tok;
+
+    l = lex_create((void *) buf, proto_strs);
     while (!done) {
         tok = lex_next(l);
         switch(tok) {
@@ -349,6 +413,10 @@ static int recv_req(req_t *req)
             req->command = CONMAN_CMD_CONNECT;
             parse_cmd_opts(l, req);
             break;
+        case CONMAN_TOK_EXECUTE:
+            req->command = CONMAN_CMD_EXECUTE;
+            parse_cmd_opts(l, req);
+            break;
         case CONMAN_TOK_MONITOR:
             req->command = CONMAN_CMD_MONITOR;
             parse_cmd_opts(l, req);
@@ -366,8 +434,7 @@ static int recv_req(req_t *req)
         }
     }
     lex_destroy(l);
-
-    return(0);
+    return;
 }
 
 
@@ -393,14 +460,62 @@ static void parse_cmd_opts(Lex l, req_t *req)
             if (lex_next(l) == '=') {
                 if (lex_next(l) == CONMAN_TOK_BROADCAST)
                     req->enableBroadcast = 1;
+                else if (lex_prev(l) == CONMAN_TOK_COALESCE)
+                    req->enableCoalesce = 1;
                 else if (lex_prev(l) == CONMAN_TOK_FORCE)
                     req->enableForce = 1;
                 else if (lex_prev(l) == CONMAN_TOK_JOIN)
                     req->enableJoin = 1;
+                else if (lex_prev(l) == CONMAN_TOK_NEWLINE)
+                    req->filter |= CONMAN_FILTER_NEWLINE;
+                else if (lex_prev(l) == CONMAN_TOK_NOANSI)
+                    req->filter |= CONMAN_FILTER_NOANSI;
                 else if (lex_prev(l) == CONMAN_TOK_QUIET)
                     req->enableQuiet = 1;
                 else if (lex_prev(l) == CONMAN_TOK_REGEX)
                     req->enableRegex = 1;
+                else if (lex_prev(l) == CONMAN_TOK_SANITIZE)
+                    req->filter |= CONMAN_FILTER_SANITIZE;
+                else if (lex_prev(l) == CONMAN_TOK_TIMESTAMP)
+                    req->filter |= CONMAN_FILTER_TIMESTAMP;
+            }
+            break;
+        case CONMAN_TOK_RESUME:
+            if ((lex_next(l) == '=') && (lex_next(l) == LEX_INT)) {
+                req->offset = strtoull(lex_text(l), NULL, 10);
+                req->enableResume = 1;
+            }
+            break;
+        case CONMAN_TOK_LINES:
+            if ((lex_next(l) == '=') && (lex_next(l) == LEX_INT)) {
+                req->numLines = atoi(lex_text(l));
+            }
+            break;
+        case CONMAN_TOK_CAPTURE:
+            if ((lex_next(l) == '=') && (lex_next(l) == LEX_INT)) {
+                list_append(req->script, create_step(CONMAN_STEP_CAPTURE,
+                    NULL, atoi(lex_text(l))));
+            }
+            break;
+        case CONMAN_TOK_EXPECT:
+            if ((lex_next(l) == '=') && (lex_next(l) == LEX_STR)
+              && (*lex_text(l) != '\0')) {
+                str = lex_decode(create_string(lex_text(l)));
+                list_append(req->script,
+                    create_step(CONMAN_STEP_EXPECT, str, 0));
+            }
+            break;
+        case CONMAN_TOK_SEND:
+            if ((lex_next(l) == '=') && (lex_next(l) == LEX_STR)) {
+                str = lex_decode(create_string(lex_text(l)));
+                list_append(req->script,
+                    create_step(CONMAN_STEP_SEND, str, 0));
+            }
+            break;
+        case CONMAN_TOK_TIMEOUT:
+            if ((lex_next(l) == '=') && (lex_next(l) == LEX_INT)) {
+                list_append(req->script, create_step(CONMAN_STEP_TIMEOUT,
+                    NULL, atoi(lex_text(l))));
             }
             break;
         case LEX_EOF:
@@ -417,40 +532,69 @@ static void parse_cmd_opts(Lex l, req_t *req)
 
 static int query_consoles(server_conf_t *conf, req_t *req)
 {
-/*  Queries the server's conf to resolve the console names specified
- *    in the client's request.
+/*  Queries the server's console registry to resolve the console names
+ *    specified in the client's request.
  *  Returns 0 on success, or -1 on error.
  *    Upon a successful return, the req->consoles list of strings
- *    is replaced with a list of console obj_t's.
+ *    is replaced with a list of console obj_t's sorted by name.
+ *    A supervisor has no console objs, so its list is instead replaced
+ *    with a list of the console names owned by its worker procs.
  */
+    List entries;
     List matches;
+    ListIterator i;
+    registry_t *reg;
+    registry_entry_t *entry;
+    int isSupervisor;
     int rc;
 
     if (list_is_empty(req->consoles) && (req->command != CONMAN_CMD_QUERY))
         return(0);
 
+    isSupervisor = (conf->numWorkers > 0) && (conf->workerIndex < 0);
+
     /*  The NULL destructor is used for 'matches' because the matches list
-     *    will only contain refs to objs contained in the conf->objs list.
-     *    These objs will be destroyed when the conf->objs list is destroyed.
+     *    will only contain refs to objs contained in the conf->objs list
+     *    (or to names in the supervisor's list of worker consoles).
+     *    These will be destroyed when the daemon exits.
      */
+    entries = list_create(NULL);
     matches = list_create(NULL);
 
-    if (req->enableRegex)
-        rc = query_consoles_via_regex(conf, req, matches);
+    /*  The registry is traversed in sorted order, so the matches are sorted.
+     *    The matching entries are only valid while the ref is held.
+     */
+    reg = get_console_registry();
+    if (!reg)
+        rc = 0;
+    else if (req->enableRegex)
+        rc = query_consoles_via_regex(reg, req, entries);
     else
-        rc = query_consoles_via_globbing(conf, req, matches);
+        rc = query_consoles_via_globbing(reg, req, entries);
+
+    i = list_iterator_create(entries);
+    while ((entry = list_next(i))) {
+        if (isSupervisor)
+            list_append(matches, entry->name);
+        else
+            list_append(matches, entry->console);
+    }
+    list_iterator_destroy(i);
+    list_destroy(entries);
+    put_console_registry(reg);
 
     /*  Replace original list of strings with list of obj_t's.
      */
     list_destroy(req->consoles);
     req->consoles = matches;
-    list_sort(req->consoles, (ListCmpF) compare_objs);
 
     /*  If only one console was selected for a broadcast, then
      *    the session is placed into R/W mode instead of W/O mode.
      *    So update the req accordingly.
+     *  This does not apply if the broadcast spans worker procs, since the
+     *    other workers' consoles are part of the session as well.
      */
-    if (list_count(req->consoles) == 1)
+    if ((list_count(req->consoles) == 1) && !req->enableSpan)
         req->enableBroadcast = 0;
 
     return(rc);
@@ -458,17 +602,18 @@ static int query_consoles(server_conf_t *conf, req_t *req)
 
 
 static int query_consoles_via_globbing(
-    server_conf_t *conf, req_t *req, List matches)
+    registry_t *reg, req_t *req, List matches)
 {
-/*  Match request patterns against console names using shell-style globbing.
+/*  Match request patterns against console names using shell-style globbing,
+ *    appending the matching registry entries to the (matches) list.
  *  This is less efficient than matching via regular expressions
- *    since the console list must be traversed for each pattern, and the
- *    matches list must be traversed for each match to prevent duplicates.
+ *    since each console name must be matched against each pattern.
  */
     char *p;
-    ListIterator i, j;
+    ListIterator i;
     char *pat;
-    obj_t *obj;
+    registry_entry_t *entry;
+    int n;
 
     /*  An empty list for the QUERY command matches all consoles.
      */
@@ -477,30 +622,30 @@ static int query_consoles_via_globbing(
         list_append(req->consoles, p);
     }
 
-    /*  Search objs for console names matching console patterns in the request.
+    /*  Search the registry for console names matching console patterns
+     *    in the request.  Each console is appended at most once.
      */
     i = list_iterator_create(req->consoles);
-    j = list_iterator_create(conf->objs);
-    while ((pat = list_next(i))) {
-        list_iterator_reset(j);
-        while ((obj = list_next(j))) {
-            if (!is_console_obj(obj))
-                continue;
-            if (!fnmatch(pat, obj->name, 0)
-              && !list_find_first(matches, (ListFindF) find_obj, obj))
-                list_append(matches, obj);
+    for (n = 0; n < reg->numConsoles; n++) {
+        entry = &reg->consoles[n];
+        list_iterator_reset(i);
+        while ((pat = list_next(i))) {
+            if (!fnmatch(pat, entry->name, 0)) {
+                list_append(matches, entry);
+                break;
+            }
         }
     }
     list_iterator_destroy(i);
-    list_iterator_destroy(j);
     return(0);
 }
 
 
 static int query_consoles_via_regex(
-    server_conf_t *conf, req_t *req, List matches)
+    registry_t *reg, req_t *req, List matches)
 {
-/*  Match request patterns against console names using regular expressions.
+/*  Match request patterns against console names using regular expressions,
+ *    appending the matching registry entries to the (matches) list.
  */
     char *p;
     ListIterator i;
@@ -508,7 +653,8 @@ static int query_consoles_via_regex(
     int rc;
     regex_t rex;
     regmatch_t match;
-    obj_t *obj;
+    registry_entry_t *entry;
+    int n;
 
     /*  An empty list for the QUERY command matches all consoles.
      */
@@ -542,18 +688,16 @@ static int query_consoles_via_regex(
         return(-1);
     }
 
-    /*  Search objs for console names matching console patterns in the request.
+    /*  Search the registry for console names matching console patterns
+     *    in the request.
      */
-    i = list_iterator_create(conf->objs);
-    while ((obj = list_next(i))) {
-        if (!is_console_obj(obj))
-            continue;
-        if (!regexec(&rex, obj->name, 1, &match, 0)
+    for (n = 0; n < reg->numConsoles; n++) {
+        entry = &reg->consoles[n];
+        if (!regexec(&rex, entry->name, 1, &match, 0)
           && (match.rm_so == 0)
-          && (match.rm_eo == (int) strlen(obj->name)))
-            list_append(matches, obj);
+          && (match.rm_eo == (int) strlen(entry->name)))
+            list_append(matches, entry);
     }
-    list_iterator_destroy(i);
     regfree(&rex);
     return(0);
 }
@@ -581,8 +725,10 @@ static int check_too_many_consoles(req_t *req)
 {
 /*  Checks to see if the request matches too many consoles
  *    for the given command.
- *  A MONITOR command can only affect a single console, as can a
- *    CONNECT command unless the broadcast option is enabled.
+ *  A MONITOR command can only affect a single console unless the coalesce
+ *    option is enabled, and a CONNECT command can only affect a single console
+ *    unless the broadcast option is enabled.
+ *    An EXECUTE command can affect any number of consoles.
  *  Returns 0 if the request is valid, or -1 on error.
  */
     ListIterator i;
@@ -597,6 +743,10 @@ static int check_too_many_consoles(req_t *req)
         return(0);
     if ((req->command == CONMAN_CMD_CONNECT) && (req->enableBroadcast))
         return(0);
+    if ((req->command == CONMAN_CMD_MONITOR) && (req->enableCoalesce))
+        return(0);
+    if (req->command == CONMAN_CMD_EXECUTE)
+        return(0);
 
     snprintf(buf, sizeof(buf), "Found %d matching consoles",
         list_count(req->consoles));
@@ -608,7 +758,7 @@ static int check_too_many_consoles(req_t *req)
     while ((obj = list_next(i))) {
         strlcpy(buf, obj->name, sizeof(buf));
         strlcat(buf, "\n", sizeof(buf));
-        if (write_n(req->sd, buf, strlen(buf)) < 0) {
+        if (write_req_n(req, buf, strlen(buf)) < 0) {
             log_msg(LOG_NOTICE, "Unable to write to <%s:%d>: %s",
                 req->fqdn, req->port, strerror(errno));
             break;
@@ -676,23 +826,23 @@ static int check_busy_consoles(req_t *req)
 
             assert(is_client_obj(writer));
             x_pthread_mutex_lock(&writer->bufLock);
-            t = writer->aux.client.timeLastRead;
+            t = writer->aux->client.timeLastRead;
             gotBcast = list_is_empty(writer->writers);
-            tty = writer->aux.client.req->tty;
+            tty = writer->aux->client.req->tty;
             x_pthread_mutex_unlock(&writer->bufLock);
             delta = create_time_delta_string(t, -1);
 
             snprintf(buf, sizeof(buf),
                 "Console [%s] open %s by <%s@%s>%s%s (idle %s).\n",
                 console->name, (gotBcast ? "B/C" : "R/W"),
-                writer->aux.client.req->user, writer->aux.client.req->host,
+                writer->aux->client.req->user, writer->aux->client.req->host,
                 (tty ? " on " : ""), (tty ? tty : ""),
                 (delta ? delta : "???"));
             buf[sizeof(buf) - 2] = '\n';
             buf[sizeof(buf) - 1] = '\0';
             if (delta)
                 free(delta);
-            if (write_n(req->sd, buf, strlen(buf)) < 0) {
+            if (write_req_n(req, buf, strlen(buf)) < 0) {
                 log_msg(LOG_NOTICE, "Unable to write to <%s:%d>: %s",
                     req->fqdn, req->port, strerror(errno));
                 break;
@@ -743,6 +893,20 @@ static int send_rsp(req_t *req, int errnum, char *errmsg)
                     goto overrun;
                 }
             }
+            /*  A single-console session reports the output stream offset
+             *    of the first byte of console data that follows.
+             *    Coalesced output does not correspond to any console's stream.
+             */
+            if (((req->command == CONMAN_CMD_CONNECT)
+                    || (req->command == CONMAN_CMD_MONITOR))
+                    && (list_count(req->consoles) == 1)
+                    && !req->enableCoalesce) {
+                n = append_format_string(buf, sizeof(buf), " %s=%llu",
+                    LEX_TOK2STR(proto_strs, CONMAN_TOK_OFFSET), req->offset);
+                if (n == -1) {
+                    goto overrun;
+                }
+            }
             i = list_iterator_create(req->consoles);
             while ((console = list_next(i))) {
                 n = strlcpy(tmp, console->name, sizeof(tmp));
@@ -758,6 +922,27 @@ static int send_rsp(req_t *req, int errnum, char *errmsg)
             }
             list_iterator_destroy(i);
         }
+        /*  Otherwise, acknowledge the greeting's options so the client
+         *    knows to expect a deflated data stream and to frame its input.
+         */
+        else {
+            if (req->enableCompress) {
+                n = append_format_string(buf, sizeof(buf), " %s=%s",
+                    LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+                    LEX_TOK2STR(proto_strs, CONMAN_TOK_COMPRESS));
+                if (n == -1) {
+                    goto overrun;
+                }
+            }
+            if (req->enableFramed) {
+                n = append_format_string(buf, sizeof(buf), " %s=%s",
+                    LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+                    LEX_TOK2STR(proto_strs, CONMAN_TOK_FRAMED));
+                if (n == -1) {
+                    goto overrun;
+                }
+            }
+        }
 
         n = append_format_string(buf, sizeof(buf), "\n");
         if (n == -1) {
@@ -782,7 +967,7 @@ static int send_rsp(req_t *req, int errnum, char *errmsg)
 
     /*  Write response to client.
      */
-    if (write_n(req->sd, buf, strlen(buf)) < 0) {
+    if (write_req_n(req, buf, strlen(buf)) < 0) {
         log_msg(LOG_NOTICE, "Unable to write to <%s:%d>: %s",
             req->fqdn, req->port, strerror(errno));
         return(-1);
@@ -799,6 +984,275 @@ overrun:
 }
 
 
+static int route_worker_req(server_conf_t *conf, req_t *req, char *request)
+{
+/*  Routes the request (req) received by a supervisor to the worker procs
+ *    owning its consoles, forwarding the original (request) line so each
+ *    worker can process it as if the client had connected directly.
+ *  The QUERY cmd is answered by the supervisor from its console registry.
+ *  If the consoles are owned by a single worker, the client is handed off
+ *    to that worker; o/w, the session is relayed by the supervisor.
+ *  Returns 0 if the request is routed (consuming the req), or -1 on error.
+ */
+    List names;
+    ListIterator i;
+    char *name;
+    char buf[MAX_SOCK_LINE];
+    unsigned char *isUsed;
+    int *indices;
+    int numIndices = 0;
+    int index;
+    int rc = -1;
+
+    if (conf->resetCmd)
+        req->enableReset = 1;
+
+    if (query_consoles(conf, req) < 0)
+        return(-1);
+    names = req->consoles;
+
+    if (list_is_empty(names)) {
+        send_rsp(req, CONMAN_ERR_NO_CONSOLES, "Found no matching consoles");
+        return(-1);
+    }
+    if (req->command == CONMAN_CMD_QUERY) {
+        log_msg(LOG_INFO, "Client <%s@%s:%d> issued query",
+            req->user, req->fqdn, req->port);
+        rc = send_worker_rsp(req, names);
+        if (rc == 0)
+            destroy_req(req);
+        return(rc);
+    }
+    /*  Check for too many consoles here since the consoles matched by each
+     *    worker would otherwise be checked separately.
+     */
+    if ((list_count(names) > 1)
+            && (((req->command == CONMAN_CMD_CONNECT) && !req->enableBroadcast)
+            || ((req->command == CONMAN_CMD_MONITOR) && !req->enableCoalesce))) {
+        snprintf(buf, sizeof(buf), "Found %d matching consoles",
+            list_count(names));
+        send_rsp(req, CONMAN_ERR_TOO_MANY_CONSOLES, buf);
+        i = list_iterator_create(names);
+        while ((name = list_next(i))) {
+            strlcpy(buf, name, sizeof(buf));
+            strlcat(buf, "\n", sizeof(buf));
+            if (write_req_n(req, buf, strlen(buf)) < 0) {
+                log_msg(LOG_NOTICE, "Unable to write to <%s:%d>: %s",
+                    req->fqdn, req->port, strerror(errno));
+                break;
+            }
+        }
+        list_iterator_destroy(i);
+        return(-1);
+    }
+    /*  Determine the workers involved, in the order of their first console.
+     */
+    if (!(isUsed = calloc(conf->numWorkers, sizeof(unsigned char)))
+            || !(indices = malloc(conf->numWorkers * sizeof(int)))) {
+        out_of_memory();
+    }
+    i = list_iterator_create(names);
+    while ((name = list_next(i))) {
+        index = get_worker_index(conf, name);
+        if (!isUsed[index]) {
+            isUsed[index] = 1;
+            indices[numIndices++] = index;
+        }
+    }
+    list_iterator_destroy(i);
+    free(isUsed);
+
+    /*  A TLS session cannot be handed off, so it is always relayed.
+     */
+    if ((numIndices == 1) && !req->enableTLS) {
+        if (send_worker_client(indices[0], req->sd, req, request, 0) < 0) {
+            snprintf(buf, sizeof(buf), "Unable to pass request to worker %d",
+                indices[0]);
+            log_msg(LOG_WARNING, "Client <%s@%s:%d> request failed: %s",
+                req->user, req->fqdn, req->port, strerror(errno));
+            send_rsp(req, CONMAN_ERR_LOCAL, buf);
+        }
+        else {
+            log_msg(LOG_INFO, "Client <%s@%s:%d> passed to worker %d",
+                req->user, req->fqdn, req->port, indices[0]);
+            destroy_req(req);
+            rc = 0;
+        }
+    }
+    else {
+        rc = relay_worker_req(conf, req, request, names, indices, numIndices);
+    }
+    free(indices);
+    return(rc);
+}
+
+
+static int relay_worker_req(server_conf_t *conf, req_t *req, char *request,
+    List names, int *indices, int numIndices)
+{
+/*  Relays the request (req) to the worker procs listed in the (indices) array
+ *    of length (numIndices), each over a new socketpair.
+ *  If the request spans multiple workers, their responses are combined into
+ *    a single response covering all of the matching console (names), and
+ *    their output is merged.  If any worker rejects the request, its error
+ *    response is passed along instead and the request is abandoned.
+ *  Returns 0 if the request is relayed (consuming the req), or -1 on error.
+ */
+    int *sds;
+    int sv[2];
+    int isSpan;
+    char buf[MAX_SOCK_LINE];
+    const char *ok;
+    obj_t *client;
+    obj_t *relay;
+    req_t *relayReq;
+    int k, n;
+    int rc = -1;
+
+    assert(numIndices > 0);
+
+    if (!(sds = malloc(numIndices * sizeof(int)))) {
+        out_of_memory();
+    }
+    for (k = 0; k < numIndices; k++) {
+        sds[k] = -1;
+    }
+    isSpan = (numIndices > 1);
+
+    for (k = 0; k < numIndices; k++) {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+            log_msg(LOG_WARNING, "Unable to create worker relay socket: %s",
+                strerror(errno));
+            send_rsp(req, CONMAN_ERR_LOCAL, "Unable to relay request");
+            goto end;
+        }
+        set_fd_closed_on_exec(sv[0]);
+        set_fd_closed_on_exec(sv[1]);
+        sds[k] = sv[0];
+        n = send_worker_client(indices[k], sv[1], req, request, isSpan);
+        (void) close(sv[1]);
+        if (n < 0) {
+            log_msg(LOG_WARNING, "Client <%s@%s:%d> request failed: %s",
+                req->user, req->fqdn, req->port, strerror(errno));
+            snprintf(buf, sizeof(buf), "Unable to pass request to worker %d",
+                indices[k]);
+            send_rsp(req, CONMAN_ERR_LOCAL, buf);
+            goto end;
+        }
+    }
+    /*  Collect the responses of a spanning request.  Each is read in full
+     *    before any output from the consoles is relayed.
+     */
+    if (isSpan) {
+        ok = LEX_TOK2STR(proto_strs, CONMAN_TOK_OK);
+        for (k = 0; k < numIndices; k++) {
+            if ((n = read_line(sds[k], buf, sizeof(buf))) <= 0) {
+                snprintf(buf, sizeof(buf), "Worker %d terminated",
+                    indices[k]);
+                send_rsp(req, CONMAN_ERR_LOCAL, buf);
+                goto end;
+            }
+            if (strncmp(buf, ok, strlen(ok)) != 0) {
+                do {
+                    if (write_req_n(req, buf, n) < 0)
+                        break;
+                } while ((n = read(sds[k], buf, sizeof(buf))) > 0);
+                goto end;
+            }
+        }
+        if (send_worker_rsp(req, names) < 0)
+            goto end;
+    }
+    /*  The client obj relays its input to a relay obj for each worker, and
+     *    the output of each worker back to the client.  Output filtering and
+     *    (unless spanning) compression are performed by the workers.
+     */
+    req->filter = 0;
+    req->enableRelay = 1;
+    if (!isSpan)
+        req->enableCompress = 0;
+
+    log_msg(LOG_INFO, "Client <%s@%s:%d> relayed to %d worker%s",
+        req->user, req->fqdn, req->port, numIndices,
+        (numIndices == 1 ? "" : "s"));
+
+    client = create_client_obj(conf, req, NULL, NULL);
+    for (k = 0; k < numIndices; k++) {
+        relayReq = create_req();
+        relayReq->sd = sds[k];
+        sds[k] = -1;
+        relayReq->user = create_string(req->user);
+        relayReq->host = create_format_string("worker%d", indices[k]);
+        relayReq->fqdn = create_string(relayReq->host);
+        relayReq->port = req->port;
+        relayReq->command = req->command;
+        relayReq->enableRelay = 1;
+        relay = create_client_obj(conf, relayReq, NULL, NULL);
+        link_objs(client, relay);
+        link_objs(relay, client);
+    }
+    rc = 0;
+
+end:
+    for (k = 0; k < numIndices; k++) {
+        if (sds[k] >= 0)
+            (void) close(sds[k]);
+    }
+    free(sds);
+    return(rc);
+}
+
+
+static int send_worker_rsp(req_t *req, List names)
+{
+/*  Sends an "OK" response to the request (req) received by a supervisor,
+ *    listing the matching console (names) from its registry.
+ *  Returns 0 if the response is sent OK, or -1 on error.
+ */
+    char buf[MAX_SOCK_LINE];
+    char tmp[MAX_LINE];
+    int n;
+    ListIterator i;
+    char *name;
+
+    assert(req->sd >= 0);
+
+    n = snprintf(buf, sizeof(buf), "%s",
+        LEX_TOK2STR(proto_strs, CONMAN_TOK_OK));
+    if ((n > 0) && req->enableReset) {
+        n = append_format_string(buf, sizeof(buf), " %s=%s",
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_RESET));
+    }
+    i = list_iterator_create(names);
+    while ((n > 0) && (name = list_next(i))) {
+        if (strlcpy(tmp, name, sizeof(tmp)) >= sizeof(tmp)) {
+            n = -1;
+            break;
+        }
+        n = append_format_string(buf, sizeof(buf), " %s='%s'",
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_CONSOLE), lex_encode(tmp));
+    }
+    list_iterator_destroy(i);
+    if (n > 0) {
+        n = append_format_string(buf, sizeof(buf), "\n");
+    }
+    if (n <= 0) {
+        log_msg(LOG_WARNING,
+            "Client <%s@%s:%d> request terminated due to buffer overrun",
+            req->user, req->fqdn, req->port);
+        return(-1);
+    }
+    if (write_req_n(req, buf, strlen(buf)) < 0) {
+        log_msg(LOG_NOTICE, "Unable to write to <%s:%d>: %s",
+            req->fqdn, req->port, strerror(errno));
+        return(-1);
+    }
+    DPRINTF((5, "Sent response: %s", buf));
+    return(0);
+}
+
+
 static int perform_query_cmd(req_t *req)
 {
 /*  Performs the QUERY command, returning a list of consoles that
@@ -826,22 +1280,42 @@ static int perform_monitor_cmd(req_t *req, server_conf_t *conf)
 {
 /*  Performs the MONITOR command, placing the client in a
  *    "read-only" session with a single console.
+ *    If the coalesce option is enabled, the client is instead placed in a
+ *    "read-only" session coalescing the output of any number of consoles.
  *  Returns 0 if the command succeeds, or -1 on error.
  */
     obj_t *client;
     obj_t *console;
+    coalesce_t *co;
 
     assert(req->sd >= 0);
     assert(req->command == CONMAN_CMD_MONITOR);
+
+    if (req->enableCoalesce) {
+        co = create_coalesce(req);
+        if (send_rsp(req, CONMAN_ERR_NONE, NULL) < 0) {
+            destroy_coalesce(co);
+            return(-1);
+        }
+        log_msg(LOG_INFO,
+            "Client <%s@%s:%d> connected to %d console%s (coalesced)",
+            req->user, req->fqdn, req->port, list_count(req->consoles),
+            (list_count(req->consoles) == 1 ? "" : "s"));
+
+        (void) create_client_obj(conf, req, NULL, co);
+        return(0);
+    }
     assert(list_count(req->consoles) == 1);
 
+    console = list_peek(req->consoles);
+    assert(is_console_obj(console));
+    find_console_offset(console, req);
+
     if (send_rsp(req, CONMAN_ERR_NONE, NULL) < 0) {
         return(-1);
     }
-    client = create_client_obj(conf, req);
-    console = list_peek(req->consoles);
-    assert(is_console_obj(console));
-    link_objs(console, client);
+    client = create_client_obj(conf, req, NULL, NULL);
+    link_console_at_offset(console, client);
     check_console_state(console, client);
 
     log_msg(LOG_INFO, "Client <%s@%s:%d> connected to [%s] (read-only)",
@@ -866,19 +1340,23 @@ static int perform_connect_cmd(req_t *req, server_conf_t *conf)
     assert(req->sd >= 0);
     assert(req->command == CONMAN_CMD_CONNECT);
 
+    if (!req->enableBroadcast) {
+        console = list_peek(req->consoles);
+        assert(is_console_obj(console));
+        find_console_offset(console, req);
+    }
     if (send_rsp(req, CONMAN_ERR_NONE, NULL) < 0) {
         return(-1);
     }
-    client = create_client_obj(conf, req);
+    client = create_client_obj(conf, req, NULL, NULL);
 
-    if (list_count(req->consoles) == 1) {
+    if (!req->enableBroadcast) {
         /*
          *  Unicast connection (R/W).
          */
         console = list_peek(req->consoles);
         assert(is_console_obj(console));
-        link_objs(client, console);
-        link_objs(console, client);
+        link_console_at_offset(console, client);
         check_console_state(console, client);
 
         log_msg(LOG_INFO, "Client <%s@%s:%d> connected to [%s]",
@@ -897,13 +1375,132 @@ static int perform_connect_cmd(req_t *req, server_conf_t *conf)
         list_iterator_destroy(i);
 
         log_msg(LOG_INFO,
-            "Client <%s@%s:%d> connected to %d consoles (broadcast)",
-            req->user, req->fqdn, req->port, list_count(req->consoles));
+            "Client <%s@%s:%d> connected to %d console%s (broadcast)",
+            req->user, req->fqdn, req->port, list_count(req->consoles),
+            (list_count(req->consoles) == 1 ? "" : "s"));
+    }
+    return(0);
+}
+
+
+static int perform_execute_cmd(req_t *req, server_conf_t *conf)
+{
+/*  Performs the EXECUTE command, running the request's send/expect script
+ *    on each of its consoles concurrently.  The results are written back
+ *    to the client, which is closed once the script has finished everywhere.
+ *  Returns 0 if the command succeeds, or -1 on error.
+ */
+    exec_job_t *job;
+    char buf[MAX_LINE];
+
+    assert(req->sd >= 0);
+    assert(req->command == CONMAN_CMD_EXECUTE);
+
+    if (!(job = create_exec_job(req, buf, sizeof(buf)))) {
+        send_rsp(req, CONMAN_ERR_BAD_REQUEST, buf);
+        return(-1);
     }
+    if (send_rsp(req, CONMAN_ERR_NONE, NULL) < 0) {
+        destroy_exec_job(job);
+        return(-1);
+    }
+    /*  Log before starting the job since the mux thread may finish it
+     *    and destroy the client (along with its req) at any point after.
+     */
+    log_msg(LOG_INFO,
+        "Client <%s@%s:%d> executing %d-step script on %d console%s",
+        req->user, req->fqdn, req->port, list_count(req->script),
+        list_count(req->consoles),
+        (list_count(req->consoles) == 1 ? "" : "s"));
+
+    (void) create_client_obj(conf, req, job, NULL);
     return(0);
 }
 
 
+static void find_console_offset(obj_t *console, req_t *req)
+{
+/*  Sets the request's offset to the console output stream offset at which
+ *    the session will begin.  This is the offset requested by the client
+ *    (if resuming and the data is still retained in the console's history),
+ *    the start of the last lines requested by the client,
+ *    or the current end of the stream.
+ */
+    assert(is_console_obj(console));
+    assert(console->history != NULL);
+
+    if (req->enableResume) {
+        req->resumeOffset = req->offset;
+        req->offset = find_history_offset(console->history, req->offset);
+    }
+    else if (req->numLines > 0) {
+        x_pthread_mutex_lock(&console->history->lock);
+        req->offset = find_history_lines(console->history, req->numLines);
+        x_pthread_mutex_unlock(&console->history->lock);
+    }
+    else {
+        req->offset = find_history_offset(console->history, ~0ULL);
+    }
+    return;
+}
+
+
+static void link_console_at_offset(obj_t *console, obj_t *client)
+{
+/*  Links the (client) to the (console) for a unicast session, first replaying
+ *    console output from the offset reported in the response.  This includes
+ *    any output read since the response was sent, so no data is lost between
+ *    the response and the link.  The console history lock is held throughout
+ *    so data cannot be fanned out to the client until it has been linked.
+ *  If the output requested by the client (when resuming) or reported in the
+ *    response has since been discarded from the history, the replay starts
+ *    at the oldest byte retained and is preceded by a notice of the number
+ *    of bytes lost.  Discarded output is not recovered from the logfile.
+ *  If the console's screen is being modeled, a new (unfiltered) session not
+ *    replaying output is instead sent a redraw of the current screen, which
+ *    already reflects any output read since the response.
+ */
+    req_t *req;
+    unsigned long long start;
+    unsigned long long offset;
+    char buf[MAX_LINE];
+
+    assert(is_console_obj(console));
+    assert(is_client_obj(client));
+
+    req = client->aux->client.req;
+    start = req->enableResume ? req->resumeOffset : req->offset;
+    offset = req->offset;
+
+    x_pthread_mutex_lock(&console->history->lock);
+    if (req->enableResume || req->numLines || req->filter
+            || (write_screen_to_obj(console->history, client) <= 0)) {
+        offset = MAX(offset, find_history_start(console->history));
+        if (offset > start) {
+            snprintf(buf, sizeof(buf),
+                "%sConsole [%s] lost %llu bytes before offset %llu%s",
+                CONMAN_MSG_PREFIX, console->name, offset - start, offset,
+                CONMAN_MSG_SUFFIX);
+            strcpy(&buf[sizeof(buf) - 3], "\r\n");
+            write_obj_data(client, buf, strlen(buf), 1);
+        }
+        (void) write_history_to_obj(console->history, &offset, client);
+    }
+    if (req->command == CONMAN_CMD_CONNECT) {
+        link_objs(client, console);
+    }
+    link_objs(console, client);
+    x_pthread_mutex_unlock(&console->history->lock);
+
+    if (offset > start) {
+        log_msg(LOG_NOTICE,
+            "Client <%s@%s:%d> lost %llu bytes of console [%s] output",
+            req->user, req->fqdn, req->port, offset - start, console->name);
+    }
+    return;
+}
+
+
 static void check_console_state(obj_t *console, obj_t *client)
 {
 /*  Checks the state of the console and warns the client if needed.
@@ -918,44 +1515,55 @@ static void check_console_state(obj_t *console, obj_t *client)
     if (is_process_obj(console) && (console->fd < 0)) {
         snprintf(buf, sizeof(buf),
             "%sConsole [%s] is currently disconnected from \"%s\"%s",
-            CONMAN_MSG_PREFIX, console->name, console->aux.process.prog,
+            CONMAN_MSG_PREFIX, console->name, console->aux->process.prog,
             CONMAN_MSG_SUFFIX);
         strcpy(&buf[sizeof(buf) - 3], "\r\n");
         write_obj_data(client, buf, strlen(buf), 1);
         open_process_obj(console);
     }
+    else if (is_mux_obj(console)
+            && (console->aux->mux.state != CONMAN_MUX_UP)) {
+        snprintf(buf, sizeof(buf),
+            "%sConsole [%s] is currently disconnected from \"%s\"%s",
+            CONMAN_MSG_PREFIX, console->name,
+            console->aux->mux.helper->aux->helper.prog, CONMAN_MSG_SUFFIX);
+        strcpy(&buf[sizeof(buf) - 3], "\r\n");
+        write_obj_data(client, buf, strlen(buf), 1);
+        console->aux->mux.delay = MUX_MIN_TIMEOUT;
+        open_mux_obj(console);
+    }
     else if (is_serial_obj(console) && (console->fd < 0)) {
         snprintf(buf, sizeof(buf),
             "%sConsole [%s] is currently disconnected from \"%s\"%s",
-            CONMAN_MSG_PREFIX, console->name, console->aux.serial.dev,
+            CONMAN_MSG_PREFIX, console->name, console->aux->serial.dev,
             CONMAN_MSG_SUFFIX);
         strcpy(&buf[sizeof(buf) - 3], "\r\n");
         write_obj_data(client, buf, strlen(buf), 1);
         open_serial_obj(console);
     }
     else if (is_telnet_obj(console)
-            && (console->aux.telnet.state != CONMAN_TELNET_UP)) {
+            && (console->aux->telnet.state != CONMAN_TELNET_UP)) {
         snprintf(buf, sizeof(buf),
             "%sConsole [%s] is currently disconnected from <%s:%d>%s",
-            CONMAN_MSG_PREFIX, console->name, console->aux.telnet.host,
-            console->aux.telnet.port, CONMAN_MSG_SUFFIX);
+            CONMAN_MSG_PREFIX, console->name, console->aux->telnet.host,
+            console->aux->telnet.port, CONMAN_MSG_SUFFIX);
         strcpy(&buf[sizeof(buf) - 3], "\r\n");
         write_obj_data(client, buf, strlen(buf), 1);
-        console->aux.telnet.delay = TELNET_MIN_TIMEOUT;
+        console->aux->telnet.delay = TELNET_MIN_TIMEOUT;
         /*
          *  Do not call connect_telnet_obj() while in the PENDING state since
          *    it would be misinterpreted as the completion of the non-blocking
          *    connect().
          */
-        if (console->aux.telnet.state == CONMAN_TELNET_DOWN) {
+        if (console->aux->telnet.state == CONMAN_TELNET_DOWN) {
             open_telnet_obj(console);
         }
     }
     else if (is_unixsock_obj(console) && (console->fd < 0)) {
-        assert(console->aux.unixsock.state == CONMAN_UNIXSOCK_DOWN);
+        assert(console->aux->unixsock.state == CONMAN_UNIXSOCK_DOWN);
         snprintf(buf, sizeof(buf),
             "%sConsole [%s] is currently disconnected from \"%s\"%s",
-            CONMAN_MSG_PREFIX, console->name, console->aux.unixsock.dev,
+            CONMAN_MSG_PREFIX, console->name, console->aux->unixsock.dev,
             CONMAN_MSG_SUFFIX);
         strcpy(&buf[sizeof(buf) - 3], "\r\n");
         write_obj_data(client, buf, strlen(buf), 1);
@@ -963,14 +1571,14 @@ static void check_console_state(obj_t *console, obj_t *client)
     }
 #if WITH_FREEIPMI
     else if (is_ipmi_obj(console)
-            && (console->aux.ipmi.state != CONMAN_IPMI_UP)) {
+            && (console->aux->ipmi.state != CONMAN_IPMI_UP)) {
         snprintf(buf, sizeof(buf),
             "%sConsole [%s] is currently disconnected from <%s>%s",
-            CONMAN_MSG_PREFIX, console->name, console->aux.ipmi.host,
+            CONMAN_MSG_PREFIX, console->name, console->aux->ipmi.host,
             CONMAN_MSG_SUFFIX);
         strcpy(&buf[sizeof(buf) - 3], "\r\n");
         write_obj_data(client, buf, strlen(buf), 1);
-        if (console->aux.ipmi.state == CONMAN_IPMI_DOWN) {
+        if (console->aux->ipmi.state == CONMAN_IPMI_DOWN) {
             open_ipmi_obj(console);
         }
     }
@@ -0,0 +1,347 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <sys/time.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "common.h"
+#include "log.h"
+#include "server.h"
+#include "util.h"
+#include "util-str.h"
+#include "wrapper.h"
+
+
+/*  If the StallTime option is enabled, the mux thread marks each operation
+ *    it performs (eg, reading from an obj, or forking a process console)
+ *    via begin_mux_phase() & end_mux_phase().  These markers nest, and the
+ *    mux thread is busy from the time the outermost phase begins until it
+ *    ends; it is idle while blocked waiting for I/O.  Each marker records
+ *    the operation and a copy of the obj name, so the obj may be destroyed
+ *    before the phase ends.
+ *  When the mux thread returns to idle after having been busy for at least
+ *    the threshold, the stall is recorded in a ring of the most recent
+ *    STALL_RING_SIZE stalls along with the operation that accounted for the
+ *    most time (excluding time spent in nested phases).
+ *  A watchdog thread logs the stalls recorded since it last checked, but
+ *    at most once every STALL_LOG_INTERVAL seconds; the longest of these is
+ *    logged along with a count of the others.  It also logs the operation
+ *    in progress while the mux thread remains stalled for at least that
+ *    interval, so a hang is reported before it ends.  The full ring is
+ *    logged on reconfig.
+ *  Markers set by threads other than the mux thread are ignored.  A phase
+ *    in which the mux thread forks must not be ended by the child, since
+ *    the watchdog may have held the mutex at the time of the fork.
+ *  All of the stall state is protected by a single mutex.
+ */
+
+typedef struct stall_phase {            /* MUX THREAD PHASE MARKER:          */
+    const char      *op;                /*  operation being performed        */
+    char             name[STALL_NAME_LEN];  /* obj name, or empty string     */
+} stall_phase_t;
+
+typedef struct stall {                  /* STALL RECORD:                     */
+    time_t           when;              /*  time at which mux thread stalled */
+    int              msecs;             /*  num msecs mux thread was busy    */
+    int              opMsecs;           /*  num msecs spent in op below      */
+    const char      *op;                /*  operation accounting for most    */
+    char             name[STALL_NAME_LEN];  /* obj name, or empty string     */
+} stall_t;
+
+static void * watch_mux_thread(void *arg);
+static void log_stall(int priority, const char *prefix, const stall_t *stall);
+static void account_mux_phase(unsigned long now);
+static unsigned long get_stall_msecs(void);
+
+static pthread_mutex_t stallLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t muxThread;
+static int stallMsecs = 0;
+static stall_phase_t phases[STALL_MAX_DEPTH];
+static int depth = 0;
+static unsigned long busyStart;
+static unsigned long phaseStart;
+static stall_t current;
+static stall_t stalls[STALL_RING_SIZE];
+static unsigned numStalls = 0;
+
+
+void init_stall_detector(server_conf_t *conf)
+{
+/*  Initializes the stall detector if enabled by the configuration (conf),
+ *    starting the watchdog thread.  This must be called by the mux thread.
+ */
+    pthread_t tid;
+    int rc;
+
+    if (conf->stallMsecs <= 0) {
+        return;
+    }
+    x_pthread_mutex_lock(&stallLock);
+    muxThread = pthread_self();
+    stallMsecs = conf->stallMsecs;
+    x_pthread_mutex_unlock(&stallLock);
+
+    if ((rc = pthread_create(&tid, NULL, watch_mux_thread, NULL)) != 0) {
+        log_err(rc, "Unable to create stall watchdog thread");
+    }
+    x_pthread_detach(tid);
+    return;
+}
+
+
+void begin_mux_phase(const char *op, obj_t *obj)
+{
+/*  Marks the start of operation (op) by the mux thread on the (obj),
+ *    which may be NULL.  This must be followed by end_mux_phase().
+ */
+    unsigned long now;
+    stall_phase_t *phase;
+
+    assert(op != NULL);
+
+    if (!stallMsecs || !pthread_equal(pthread_self(), muxThread)) {
+        return;
+    }
+    now = get_stall_msecs();
+    x_pthread_mutex_lock(&stallLock);
+    if (depth == 0) {
+        busyStart = now;
+        current.opMsecs = -1;
+    }
+    else {
+        account_mux_phase(now);
+    }
+    if (depth < STALL_MAX_DEPTH) {
+        phase = &phases[depth];
+        phase->op = op;
+        if (obj) {
+            strlcpy(phase->name, obj->name, sizeof(phase->name));
+        }
+        else {
+            phase->name[0] = '\0';
+        }
+    }
+    depth++;
+    phaseStart = now;
+    x_pthread_mutex_unlock(&stallLock);
+    return;
+}
+
+
+void end_mux_phase(void)
+{
+/*  Marks the end of the operation most recently begun by the mux thread.
+ *    If this returns the mux thread to idle after having been busy for at
+ *    least the StallTime threshold, the stall is recorded.
+ */
+    unsigned long now;
+    stall_t *stall;
+
+    if (!stallMsecs || !pthread_equal(pthread_self(), muxThread)) {
+        return;
+    }
+    now = get_stall_msecs();
+    x_pthread_mutex_lock(&stallLock);
+    assert(depth > 0);
+    account_mux_phase(now);
+    depth--;
+    phaseStart = now;
+    if ((depth == 0) && ((int) (now - busyStart) >= stallMsecs)) {
+        current.msecs = now - busyStart;
+        current.when = time(NULL) - (current.msecs / 1000);
+        stall = &stalls[numStalls % STALL_RING_SIZE];
+        *stall = current;
+        numStalls++;
+    }
+    x_pthread_mutex_unlock(&stallLock);
+    return;
+}
+
+
+void log_stall_records(void)
+{
+/*  Logs the most recent stalls of the mux thread, oldest first.
+ */
+    stall_t buf[STALL_RING_SIZE];
+    unsigned n, m;
+    unsigned i;
+
+    if (!stallMsecs) {
+        return;
+    }
+    x_pthread_mutex_lock(&stallLock);
+    n = numStalls;
+    m = MIN(n, STALL_RING_SIZE);
+    for (i = 0; i < m; i++) {
+        buf[i] = stalls[(n - m + i) % STALL_RING_SIZE];
+    }
+    x_pthread_mutex_unlock(&stallLock);
+
+    log_msg(LOG_NOTICE, "Mux thread stalled %u time%s for %dms or more",
+        n, ((n == 1) ? "" : "s"), stallMsecs);
+    for (i = 0; i < m; i++) {
+        log_stall(LOG_NOTICE, "Mux thread stalled", &buf[i]);
+    }
+    return;
+}
+
+
+static void * watch_mux_thread(void *arg)
+{
+/*  Watchdog thread that periodically logs stalls of the mux thread.
+ */
+    const unsigned long interval = STALL_LOG_INTERVAL * 1000;
+    struct timespec ts;
+    unsigned long now;
+    unsigned long lastLog = 0;
+    unsigned long lastHang = 0;
+    unsigned numLogged = 0;
+    stall_t worst;
+    stall_t hang;
+    int numNew;
+    int isHang;
+    unsigned i;
+
+    ts.tv_sec = STALL_CHECK_MSECS / 1000;
+    ts.tv_nsec = (STALL_CHECK_MSECS % 1000) * 1000000;
+
+    for (;;) {
+        (void) nanosleep(&ts, NULL);
+        now = get_stall_msecs();
+        numNew = 0;
+        isHang = 0;
+
+        x_pthread_mutex_lock(&stallLock);
+        if ((numStalls != numLogged) && (now - lastLog >= interval)) {
+            numNew = numStalls - numLogged;
+            worst.msecs = -1;
+            for (i = numStalls - MIN(numNew, STALL_RING_SIZE);
+                    i != numStalls; i++) {
+                if (stalls[i % STALL_RING_SIZE].msecs > worst.msecs) {
+                    worst = stalls[i % STALL_RING_SIZE];
+                }
+            }
+            numLogged = numStalls;
+            lastLog = now;
+        }
+        if ((depth > 0) && (now - busyStart >= interval)
+                && (now - lastHang >= interval)) {
+            hang.op = phases[MIN(depth, STALL_MAX_DEPTH) - 1].op;
+            strlcpy(hang.name, phases[MIN(depth, STALL_MAX_DEPTH) - 1].name,
+                sizeof(hang.name));
+            hang.msecs = now - busyStart;
+            isHang = 1;
+            lastHang = now;
+        }
+        x_pthread_mutex_unlock(&stallLock);
+
+        if (numNew > 0) {
+            log_stall(LOG_WARNING, "Mux thread stalled", &worst);
+        }
+        if (numNew > 1) {
+            log_msg(LOG_WARNING,
+                "Mux thread stalled %d other time%s since last report",
+                numNew - 1, ((numNew == 2) ? "" : "s"));
+        }
+        if (isHang) {
+            log_msg(LOG_WARNING,
+                "Mux thread stalled for %dms so far in %s%s%s%s",
+                hang.msecs, hang.op, (*hang.name ? " [" : ""), hang.name,
+                (*hang.name ? "]" : ""));
+        }
+    }
+    /* NOT_REACHED */
+    return(NULL);
+}
+
+
+static void log_stall(int priority, const char *prefix, const stall_t *stall)
+{
+/*  Logs the (stall) record at the given (priority), prefixed by (prefix).
+ */
+    char *when;
+
+    assert(stall != NULL);
+
+    when = create_long_time_string(stall->when);
+    log_msg(priority, "%s at %s for %dms (%dms in %s%s%s%s)",
+        prefix, when, stall->msecs, stall->opMsecs, stall->op,
+        (*stall->name ? " [" : ""), stall->name, (*stall->name ? "]" : ""));
+    free(when);
+    return;
+}
+
+
+static void account_mux_phase(unsigned long now)
+{
+/*  Charges the time since the innermost phase began or resumed to that
+ *    phase, noting it as the current stall's op if it is the longest yet.
+ *  The stallLock must be held when calling this routine.
+ */
+    stall_phase_t *phase;
+    int n;
+
+    assert(depth > 0);
+
+    n = now - phaseStart;
+    if (n > current.opMsecs) {
+        phase = &phases[MIN(depth, STALL_MAX_DEPTH) - 1];
+        current.opMsecs = n;
+        current.op = phase->op;
+        strlcpy(current.name, phase->name, sizeof(current.name));
+    }
+    return;
+}
+
+
+static unsigned long get_stall_msecs(void)
+{
+/*  Returns the current time in milliseconds on the monotonic clock if
+ *    available, or the time of day otherwise.  Only differences between
+ *    values are meaningful, and these are unaffected by wraparound.
+ */
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+        log_err(errno, "Unable to get monotonic time");
+    }
+    return((unsigned long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+#else /* !HAVE_CLOCK_GETTIME || !CLOCK_MONOTONIC */
+    struct timeval tv;
+
+    if (gettimeofday(&tv, NULL) < 0) {
+        log_err(errno, "Unable to get time of day");
+    }
+    return((unsigned long) tv.tv_sec * 1000 + tv.tv_usec / 1000);
+#endif /* !HAVE_CLOCK_GETTIME || !CLOCK_MONOTONIC */
+}
@@ -31,9 +31,12 @@
 
 #include <sys/types.h>                  /* include before in.h for bsd */
 #include <netinet/in.h>                 /* include before telnet.h for bsd */
+#include <netinet/tcp.h>
 #include <arpa/telnet.h>
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -51,14 +54,33 @@
 #define OPTBUFLEN 8                     /* "OPT:nnn" + \0 */
 
 
+static int process_telnet_opt(
+    telnetopt_t *opts, const char *str, char *errbuf, int errlen);
 static int connect_telnet_obj(obj_t *telnet);
+static void set_telnet_sockopts(obj_t *telnet);
 static void disconnect_telnet_obj(obj_t *telnet);
 static void reset_telnet_delay(obj_t *telnet);
+static void start_telnet_probes(obj_t *telnet);
+static void schedule_telnet_probe(obj_t *telnet, time_t t);
+static void check_telnet_probes(void *arg);
+static void check_telnet_probe(obj_t *telnet, time_t now);
 static int process_telnet_cmd(obj_t *telnet, int cmd, int opt);
 static char * opt2str(int opt, char *buf, int buflen);
 
 extern tpoll_t tp_global;               /* defined in server.c */
 
+/*  Liveness probes for all telnet consoles are driven by a single timer
+ *    ticking once a second over a hashed timing wheel.  Each slot holds
+ *    the consoles due for a check in a given second (modulo the wheel size).
+ *    A console is not moved when data is read from it; its check is simply
+ *    rescheduled based upon the time of its last read when its slot comes
+ *    around, so the per-read cost is limited to recording a timestamp.
+ */
+static List probeWheel[TELNET_PROBE_WHEEL_SIZE];
+static int probeCount = 0;              /* num consoles on the probe wheel  */
+static int probeTimer = -1;             /* timer id for the next wheel tick */
+static time_t probeTick = 0;            /* time of the last wheel tick      */
+
 
 int is_telnet_dev(const char *dev, char **host_ref, int *port_ref)
 {
@@ -91,8 +113,136 @@ int is_telnet_dev(const char *dev, char **host_ref, int *port_ref)
 }
 
 
+int init_telnet_opts(telnetopt_t *opts)
+{
+/*  Initializes 'opts' to the default values.
+ *  Returns 0 on success, -1 on error.
+ */
+    if (opts == NULL) {
+        return(-1);
+    }
+    opts->probeSecs = 0;
+    opts->replySecs = 0;
+    opts->userTimeout = 0;
+    opts->keepIdle = 0;
+    opts->keepIntvl = 0;
+    opts->keepCount = 0;
+    return(0);
+}
+
+
+int parse_telnet_opts(
+    telnetopt_t *opts, const char *str, char *errbuf, int errlen)
+{
+/*  Parses string 'str' for telnet console device options 'opts'.
+ *    The string 'str' is broken up into comma-delimited tokens; as such,
+ *    token values for a given telnet device option cannot contain commas.
+ *    The 'opts' should be initialized to a default value beforehand.
+ *  Returns 0 and updates the 'opts' struct on success; o/w, returns -1
+ *    (writing an error message into buffer 'errbuf' of length 'errlen').
+ */
+    telnetopt_t         opts_tmp;
+    char                buf[MAX_LINE];
+    char               *tok;
+    const char * const  separators = ",";
+
+    if (opts == NULL) {
+        log_err(0, "parse_telnet_opts: opts ptr is NULL");
+    }
+    opts_tmp = *opts;
+
+    if (str == NULL) {
+        if ((errbuf != NULL) && (errlen > 0)) {
+            snprintf(errbuf, errlen, "telnetopts string is NULL");
+        }
+        return(-1);
+    }
+    if (strlcpy(buf, str, sizeof(buf)) >= sizeof(buf)) {
+        if ((errbuf != NULL) && (errlen > 0)) {
+            snprintf(errbuf, errlen,
+                "telnetopts string exceeds %lu-byte maximum",
+                (unsigned long) sizeof(buf) - 1);
+        }
+        return(-1);
+    }
+    tok = strtok(buf, separators);
+    while (tok != NULL) {
+        if (process_telnet_opt(&opts_tmp, tok, errbuf, errlen) < 0) {
+            return(-1);
+        }
+        tok = strtok(NULL, separators);
+    }
+    *opts = opts_tmp;
+    return(0);
+}
+
+
+static int process_telnet_opt(
+    telnetopt_t *opts, const char *str, char *errbuf, int errlen)
+{
+/*  Parses string 'str' for a single telnet console device option.
+ *    The string 'str' is of the form "X:VALUE", where "X" is a single-char key
+ *    tag specifying the option type and "VALUE" is its corresponding value.
+ *  Returns 0 and updates the 'opts' struct on success; o/w, returns -1
+ *    (writing an error message into buffer 'errbuf' of length 'errlen').
+ */
+    char        c;
+    const char *p;
+    long        l;
+    char       *endp;
+
+    assert(opts != NULL);
+    assert(str != NULL);
+
+    if ((strspn(str, "CcIiKkPpRrUu") != 1) || (str[1] != ':')) {
+        if ((errbuf != NULL) && (errlen > 0)) {
+            snprintf(errbuf, errlen, "invalid telnetopts value \"%s\"", str);
+        }
+        return(-1);
+    }
+    c = toupper((int) str[0]);
+    p = str + 2;
+    errno = 0;
+    l = strtol(p, &endp, 0);
+    if ((*p == '\0') || (*endp != '\0') || (errno == ERANGE)
+            || (l < 0) || (l > INT_MAX / 1000)) {
+        if ((errbuf != NULL) && (errlen > 0)) {
+            snprintf(errbuf, errlen, "invalid telnetopts value \"%s\"", str);
+        }
+        return(-1);
+    }
+    switch (c) {
+        case 'C':
+            opts->keepCount = l;
+            break;
+        case 'I':
+            opts->keepIntvl = l;
+            break;
+        case 'K':
+            opts->keepIdle = l;
+            break;
+        case 'P':
+            opts->probeSecs = l;
+            break;
+        case 'R':
+            opts->replySecs = l;
+            break;
+        case 'U':
+            opts->userTimeout = l;
+            break;
+        default:
+            /*  This case should never happen since the tag has already been
+             *    validated above via strspn().
+             */
+            log_err(0, "invalid telnetopts tag '%c'", c);
+            break;
+    }
+    return(0);
+}
+
+
 obj_t * create_telnet_obj(server_conf_t *conf, char *name,
-    char *host, int port, char *errbuf, int errlen)
+    char *host, int port, telnetopt_t *opts, char *errbuf, int errlen)
 {
 /*  Creates a new terminal server object and adds it to the master objs list.
  *  Note: a non-blocking connect will later be initiated for the remote host
@@ -105,6 +255,7 @@ obj_t * create_telnet_obj(server_conf_t *conf, char *name,
     assert(conf != NULL);
     assert((name != NULL) && (name[0] != '\0'));
     assert((host != NULL) && (host[0] != '\0'));
+    assert(opts != NULL);
 
     if (port <= 0) {
         if ((errbuf != NULL) && (errlen > 0)) {
@@ -130,18 +281,23 @@ obj_t * create_telnet_obj(server_conf_t *conf, char *name,
         return(NULL);
     }
     telnet = create_obj(conf, name, -1, CONMAN_OBJ_TELNET);
-    telnet->aux.telnet.host = create_string(host);
-    telnet->aux.telnet.port = port;
-    telnet->aux.telnet.logfile = NULL;
-    telnet->aux.telnet.timer = -1;
-    telnet->aux.telnet.delay = TELNET_MIN_TIMEOUT;
-    telnet->aux.telnet.iac = -1;
-    telnet->aux.telnet.state = CONMAN_TELNET_DOWN;
+    telnet->aux->telnet.host = create_string(host);
+    telnet->aux->telnet.port = port;
+    telnet->aux->telnet.opts = *opts;
+    telnet->aux->telnet.logfile = NULL;
+    telnet->aux->telnet.timer = -1;
+    telnet->aux->telnet.delay = TELNET_MIN_TIMEOUT;
+    telnet->aux->telnet.iac = -1;
+    telnet->aux->telnet.timeLastRead = 0;
+    telnet->aux->telnet.timeProbe = 0;
+    telnet->aux->telnet.timeCheck = 0;
+    telnet->aux->telnet.state = CONMAN_TELNET_DOWN;
+    telnet->aux->telnet.gotProbeWheel = 0;
     /*
      *  Dup 'enableKeepAlive' to prevent passing 'conf'
      *    to connect_telnet_obj().
      */
-    telnet->aux.telnet.enableKeepAlive = conf->enableKeepAlive;
+    telnet->aux->telnet.enableKeepAlive = conf->enableKeepAlive;
 
     /*  Add obj to the master conf->objs list.
      */
@@ -161,15 +317,15 @@ int open_telnet_obj(obj_t *telnet)
     assert(telnet != NULL);
     assert(is_telnet_obj(telnet));
 
-    if (telnet->aux.telnet.state == CONMAN_TELNET_UP) {
+    if (telnet->aux->telnet.state == CONMAN_TELNET_UP) {
         disconnect_telnet_obj(telnet);
     }
     else {
         rc = connect_telnet_obj(telnet);
     }
     DPRINTF((9, "Opened [%s] telnet: fd=%d host=%s port=%d state=%d.\n",
-        telnet->name, telnet->fd, telnet->aux.telnet.host,
-        telnet->aux.telnet.port, (int) telnet->aux.telnet.state));
+        telnet->name, telnet->fd, telnet->aux->telnet.host,
+        telnet->aux->telnet.port, (int) telnet->aux->telnet.state));
     return(rc);
 }
 
@@ -181,24 +337,28 @@ static int connect_telnet_obj(obj_t *telnet)
  */
     struct sockaddr_in saddr;
     const int on = 1;
+    int rv;
 
-    assert(telnet->aux.telnet.state != CONMAN_TELNET_UP);
+    assert(telnet->aux->telnet.state != CONMAN_TELNET_UP);
 
-    if (telnet->aux.telnet.timer >= 0) {
-        (void) tpoll_timeout_cancel(tp_global, telnet->aux.telnet.timer);
-        telnet->aux.telnet.timer = -1;
+    if (telnet->aux->telnet.timer >= 0) {
+        (void) tpoll_timeout_cancel(tp_global, telnet->aux->telnet.timer);
+        telnet->aux->telnet.timer = -1;
     }
-    if (telnet->aux.telnet.state == CONMAN_TELNET_DOWN) {
+    if (telnet->aux->telnet.state == CONMAN_TELNET_DOWN) {
         /*
          *  Initiate a non-blocking connection attempt.
          */
         memset(&saddr, 0, sizeof(saddr));
         saddr.sin_family = AF_INET;
-        saddr.sin_port = htons(telnet->aux.telnet.port);
-        if (host_name_to_addr4(telnet->aux.telnet.host, &saddr.sin_addr) < 0) {
+        saddr.sin_port = htons(telnet->aux->telnet.port);
+        begin_mux_phase("host_name_to_addr4", telnet);
+        rv = host_name_to_addr4(telnet->aux->telnet.host, &saddr.sin_addr);
+        end_mux_phase();
+        if (rv < 0) {
             log_msg(LOG_WARNING, "Unable to resolve hostname \"%s\" for [%s]",
-                telnet->aux.telnet.host, telnet->name);
-            telnet->aux.telnet.timer = tpoll_timeout_relative(tp_global,
+                telnet->aux->telnet.host, telnet->name);
+            telnet->aux->telnet.timer = tpoll_timeout_relative(tp_global,
                 (callback_f) connect_telnet_obj, telnet,
                 RESOLVE_RETRY_TIMEOUT * 1000);
             return(-1);
@@ -210,22 +370,17 @@ static int connect_telnet_obj(obj_t *telnet)
                 (const void *) &on, sizeof(on)) < 0) {
             log_err(errno, "Unable to set OOBINLINE socket option");
         }
-        if (telnet->aux.telnet.enableKeepAlive) {
-            if (setsockopt(telnet->fd, SOL_SOCKET, SO_KEEPALIVE,
-                    (const void *) &on, sizeof(on)) < 0) {
-                log_err(errno, "Unable to set KEEPALIVE socket option");
-            }
-        }
+        set_telnet_sockopts(telnet);
         set_fd_nonblocking(telnet->fd);
         set_fd_closed_on_exec(telnet->fd);
 
         DPRINTF((10, "Connecting to <%s:%d> for [%s].\n",
-            telnet->aux.telnet.host, telnet->aux.telnet.port, telnet->name));
+            telnet->aux->telnet.host, telnet->aux->telnet.port, telnet->name));
 
         if (connect(telnet->fd,
                 (struct sockaddr *) &saddr, sizeof(saddr)) < 0) {
             if (errno == EINPROGRESS) {
-                telnet->aux.telnet.state = CONMAN_TELNET_PENDING;
+                telnet->aux->telnet.state = CONMAN_TELNET_PENDING;
                 tpoll_set(tp_global, telnet->fd, POLLIN | POLLOUT);
             }
             else {
@@ -234,7 +389,7 @@ static int connect_telnet_obj(obj_t *telnet)
             return(-1);
         }
     }
-    else if (telnet->aux.telnet.state == CONMAN_TELNET_PENDING) {
+    else if (telnet->aux->telnet.state == CONMAN_TELNET_PENDING) {
         /*
          *  Did the non-blocking connect complete successfully?
          *    (cf. Stevens UNPv1 15.3 p409)
@@ -258,20 +413,21 @@ static int connect_telnet_obj(obj_t *telnet)
         }
         tpoll_clear(tp_global, telnet->fd, POLLOUT);
         DPRINTF((10, "Completing connection to <%s:%d> for [%s].\n",
-            telnet->aux.telnet.host, telnet->aux.telnet.port, telnet->name));
+            telnet->aux->telnet.host, telnet->aux->telnet.port, telnet->name));
     }
     else {
         log_err(0, "Console [%s] is in unexpected telnet state=%d",
-            telnet->aux.telnet.state);
+            telnet->aux->telnet.state);
     }
     telnet->gotEOF = 0;
-    telnet->aux.telnet.state = CONMAN_TELNET_UP;
+    telnet->aux->telnet.state = CONMAN_TELNET_UP;
     tpoll_set(tp_global, telnet->fd, POLLIN);
 
     /*  Notify linked objs when transitioning into an UP state.
      */
-    write_notify_msg(telnet, LOG_INFO, "Console [%s] connected to <%s:%d>",
-        telnet->name, telnet->aux.telnet.host, telnet->aux.telnet.port);
+    write_notify_event(telnet, CONMAN_SINK_CONNECT, LOG_INFO,
+        "Console [%s] connected to <%s:%d>",
+        telnet->name, telnet->aux->telnet.host, telnet->aux->telnet.port);
     /*
      *  Require the connection to be up for a minimum length of time
      *    before resetting the reconnect delay back to zero.  This protects
@@ -281,7 +437,7 @@ static int connect_telnet_obj(obj_t *telnet)
      *    disconnect_telnet_obj() will cancel the timer and the
      *    exponential backoff will continue.
      */
-    telnet->aux.telnet.timer = tpoll_timeout_relative(tp_global,
+    telnet->aux->telnet.timer = tpoll_timeout_relative(tp_global,
         (callback_f) reset_telnet_delay, telnet, TELNET_MIN_TIMEOUT * 1000);
 
     send_telnet_cmd(telnet, DO, TELOPT_BINARY);
@@ -290,51 +446,118 @@ static int connect_telnet_obj(obj_t *telnet)
     send_telnet_cmd(telnet, WILL, TELOPT_BINARY);
     send_telnet_cmd(telnet, WILL, TELOPT_SGA);
 
+    if (telnet->aux->telnet.opts.probeSecs > 0) {
+        start_telnet_probes(telnet);
+    }
     return(0);
 }
 
 
+static void set_telnet_sockopts(obj_t *telnet)
+{
+/*  Sets the socket options for the (telnet) obj's newly-created socket.
+ *  TCP keep-alive is enabled if enabled globally or if any of the per-socket
+ *    keep-alive intervals are specified.  Options not supported by the
+ *    platform are silently ignored.
+ */
+    const int on = 1;
+    telnetopt_t *opts = &telnet->aux->telnet.opts;
+    int n;
+
+    assert(telnet->fd >= 0);
+
+    if (telnet->aux->telnet.enableKeepAlive
+            || opts->keepIdle || opts->keepIntvl || opts->keepCount) {
+        if (setsockopt(telnet->fd, SOL_SOCKET, SO_KEEPALIVE,
+                (const void *) &on, sizeof(on)) < 0) {
+            log_err(errno, "Unable to set KEEPALIVE socket option");
+        }
+    }
+#ifdef TCP_KEEPIDLE
+    if ((n = opts->keepIdle) > 0) {
+        if (setsockopt(telnet->fd, IPPROTO_TCP, TCP_KEEPIDLE,
+                (const void *) &n, sizeof(n)) < 0) {
+            log_msg(LOG_WARNING, "Unable to set KEEPIDLE for [%s]: %s",
+                telnet->name, strerror(errno));
+        }
+    }
+#endif /* TCP_KEEPIDLE */
+#ifdef TCP_KEEPINTVL
+    if ((n = opts->keepIntvl) > 0) {
+        if (setsockopt(telnet->fd, IPPROTO_TCP, TCP_KEEPINTVL,
+                (const void *) &n, sizeof(n)) < 0) {
+            log_msg(LOG_WARNING, "Unable to set KEEPINTVL for [%s]: %s",
+                telnet->name, strerror(errno));
+        }
+    }
+#endif /* TCP_KEEPINTVL */
+#ifdef TCP_KEEPCNT
+    if ((n = opts->keepCount) > 0) {
+        if (setsockopt(telnet->fd, IPPROTO_TCP, TCP_KEEPCNT,
+                (const void *) &n, sizeof(n)) < 0) {
+            log_msg(LOG_WARNING, "Unable to set KEEPCNT for [%s]: %s",
+                telnet->name, strerror(errno));
+        }
+    }
+#endif /* TCP_KEEPCNT */
+#ifdef TCP_USER_TIMEOUT
+    /*  Abort the connection if transmitted data (such as a liveness probe)
+     *    remains unacknowledged for longer than the user timeout.
+     */
+    if ((n = opts->userTimeout * 1000) > 0) {
+        if (setsockopt(telnet->fd, IPPROTO_TCP, TCP_USER_TIMEOUT,
+                (const void *) &n, sizeof(n)) < 0) {
+            log_msg(LOG_WARNING, "Unable to set USER_TIMEOUT for [%s]: %s",
+                telnet->name, strerror(errno));
+        }
+    }
+#endif /* TCP_USER_TIMEOUT */
+    (void) n;                           /* suppress unused-variable warning */
+    return;
+}
+
+
 static void disconnect_telnet_obj(obj_t *telnet)
 {
 /*  Closes the existing connection with the specified (telnet) obj
  *    and sets a timer for establishing a new connection.
  */
     DPRINTF((10, "Disconnecting from <%s:%d> for [%s].\n",
-        telnet->aux.telnet.host, telnet->aux.telnet.port, telnet->name));
+        telnet->aux->telnet.host, telnet->aux->telnet.port, telnet->name));
 
-    if (telnet->aux.telnet.timer >= 0) {
-        (void) tpoll_timeout_cancel(tp_global, telnet->aux.telnet.timer);
-        telnet->aux.telnet.timer = -1;
+    if (telnet->aux->telnet.timer >= 0) {
+        (void) tpoll_timeout_cancel(tp_global, telnet->aux->telnet.timer);
+        telnet->aux->telnet.timer = -1;
     }
     if (telnet->fd >= 0) {
         tpoll_clear(tp_global, telnet->fd, POLLIN | POLLOUT);
         if (close(telnet->fd) < 0)
             log_msg(LOG_WARNING,
                 "Unable to close connection to <%s:%d> for [%s]: %s",
-                telnet->aux.telnet.host, telnet->aux.telnet.port,
+                telnet->aux->telnet.host, telnet->aux->telnet.port,
                 telnet->name, strerror(errno));
         telnet->fd = -1;
     }
     /*  Notify linked objs when transitioning from an UP state.
      */
-    if (telnet->aux.telnet.state == CONMAN_TELNET_UP) {
-        write_notify_msg(telnet, LOG_INFO,
+    if (telnet->aux->telnet.state == CONMAN_TELNET_UP) {
+        write_notify_event(telnet, CONMAN_SINK_DISCONNECT, LOG_INFO,
             "Console [%s] disconnected from <%s:%d>",
-            telnet->name, telnet->aux.telnet.host, telnet->aux.telnet.port);
+            telnet->name, telnet->aux->telnet.host, telnet->aux->telnet.port);
     }
-    telnet->aux.telnet.state = CONMAN_TELNET_DOWN;
+    telnet->aux->telnet.state = CONMAN_TELNET_DOWN;
     /*
      *  Set timer for establishing new connection using exponential backoff.
      */
-    telnet->aux.telnet.timer = tpoll_timeout_relative(tp_global,
+    telnet->aux->telnet.timer = tpoll_timeout_relative(tp_global,
         (callback_f) connect_telnet_obj, telnet,
-        telnet->aux.telnet.delay * 1000);
-    if (telnet->aux.telnet.delay == 0) {
-        telnet->aux.telnet.delay = TELNET_MIN_TIMEOUT;
+        telnet->aux->telnet.delay * 1000);
+    if (telnet->aux->telnet.delay == 0) {
+        telnet->aux->telnet.delay = TELNET_MIN_TIMEOUT;
     }
-    else if (telnet->aux.telnet.delay < TELNET_MAX_TIMEOUT) {
-        telnet->aux.telnet.delay =
-            MIN(telnet->aux.telnet.delay * 2, TELNET_MAX_TIMEOUT);
+    else if (telnet->aux->telnet.delay < TELNET_MAX_TIMEOUT) {
+        telnet->aux->telnet.delay =
+            MIN(telnet->aux->telnet.delay * 2, TELNET_MAX_TIMEOUT);
     }
     return;
 }
@@ -349,12 +572,12 @@ static void reset_telnet_delay(obj_t *telnet)
  */
     assert(is_telnet_obj(telnet));
 
-    telnet->aux.telnet.delay = 0;
+    telnet->aux->telnet.delay = 0;
     /*
      *  Also reset the timer ID since this routine is only invoked
      *    by a timer when it expires.
      */
-    telnet->aux.telnet.timer = -1;
+    telnet->aux->telnet.timer = -1;
     return;
 }
 
@@ -372,16 +595,16 @@ int process_telnet_escapes(obj_t *telnet, void *src, int len)
 
     assert(is_telnet_obj(telnet));
     assert(telnet->fd >= 0);
-    assert(telnet->aux.telnet.state == CONMAN_TELNET_UP);
+    assert(telnet->aux->telnet.state == CONMAN_TELNET_UP);
 
     if (!src || len <= 0)
         return(0);
 
     for (p=q=src; p<last; p++) {
-        switch(telnet->aux.telnet.iac) {
+        switch(telnet->aux->telnet.iac) {
         case -1:
             if (*p == IAC)
-                telnet->aux.telnet.iac = *p;
+                telnet->aux->telnet.iac = *p;
             else
                 *q++ = *p;
             break;
@@ -389,7 +612,7 @@ int process_telnet_escapes(obj_t *telnet, void *src, int len)
             switch (*p) {
             case IAC:
                 *q++ = *p;
-                telnet->aux.telnet.iac = -1;
+                telnet->aux->telnet.iac = -1;
                 break;
             case DONT:
                 /* fall-thru */
@@ -400,14 +623,14 @@ int process_telnet_escapes(obj_t *telnet, void *src, int len)
             case WILL:
                 /* fall-thru */
             case SB:
-                telnet->aux.telnet.iac = *p;
+                telnet->aux->telnet.iac = *p;
                 break;
             case SE:
-                telnet->aux.telnet.iac = -1;
+                telnet->aux->telnet.iac = -1;
                 break;
             default:
                 process_telnet_cmd(telnet, *p, -1);
-                telnet->aux.telnet.iac = -1;
+                telnet->aux->telnet.iac = -1;
                 break;
             }
             break;
@@ -418,8 +641,8 @@ int process_telnet_escapes(obj_t *telnet, void *src, int len)
         case WONT:
             /* fall-thru */
         case WILL:
-            process_telnet_cmd(telnet, telnet->aux.telnet.iac, *p);
-            telnet->aux.telnet.iac = -1;
+            process_telnet_cmd(telnet, telnet->aux->telnet.iac, *p);
+            telnet->aux->telnet.iac = -1;
             break;
         case SB:
             /*
@@ -428,11 +651,11 @@ int process_telnet_escapes(obj_t *telnet, void *src, int len)
              *    the state to IAC assuming the next byte will be the SE cmd.
              */
             if (*p == IAC)
-                telnet->aux.telnet.iac = *p;
+                telnet->aux->telnet.iac = *p;
             break;
         default:
             log_err(0, "Reached invalid state %#.2x%.2x for console [%s]",
-                telnet->aux.telnet.iac, *p, telnet->name);
+                telnet->aux->telnet.iac, *p, telnet->name);
             break;
         }
     }
@@ -460,7 +683,7 @@ int send_telnet_cmd(obj_t *telnet, int cmd, int opt)
 
     /*  This is a no-op if the telnet connection is not yet established.
      */
-    if ((telnet->fd < 0) || (telnet->aux.telnet.state != CONMAN_TELNET_UP))
+    if ((telnet->fd < 0) || (telnet->aux->telnet.state != CONMAN_TELNET_UP))
         return(0);
 
     *p++ = IAC;
@@ -499,6 +722,150 @@ int send_telnet_cmd(obj_t *telnet, int cmd, int opt)
 }
 
 
+static void start_telnet_probes(obj_t *telnet)
+{
+/*  Starts liveness probing of the (telnet) obj once its connection is up.
+ *  The first check is spread pseudorandomly over the probe interval so
+ *    consoles connected at the same time are not all probed in lockstep.
+ */
+    time_t now;
+
+    assert(is_telnet_obj(telnet));
+    assert(telnet->aux->telnet.opts.probeSecs > 0);
+
+    if (time(&now) == (time_t) -1) {
+        log_err(errno, "time() failed");
+    }
+    telnet->aux->telnet.timeLastRead = now;
+    telnet->aux->telnet.timeProbe = 0;
+
+    if (!telnet->aux->telnet.gotProbeWheel) {
+        telnet->aux->telnet.gotProbeWheel = 1;
+        probeCount++;
+        schedule_telnet_probe(telnet,
+            now + 1 + (rand() % telnet->aux->telnet.opts.probeSecs));
+    }
+    return;
+}
+
+
+static void schedule_telnet_probe(obj_t *telnet, time_t t)
+{
+/*  Places the (telnet) obj on the probe wheel for a liveness check at time (t),
+ *    and starts the wheel ticking if needed.
+ */
+    int i;
+
+    if (!probeWheel[0]) {
+        for (i = 0; i < TELNET_PROBE_WHEEL_SIZE; i++) {
+            probeWheel[i] = list_create(NULL);
+        }
+    }
+    telnet->aux->telnet.timeCheck = t;
+    list_append(probeWheel[t % TELNET_PROBE_WHEEL_SIZE], telnet);
+
+    if (probeTimer < 0) {
+        probeTimer = tpoll_timeout_relative(tp_global,
+            (callback_f) check_telnet_probes, NULL, 1000);
+    }
+    return;
+}
+
+
+static void check_telnet_probes(void *arg)
+{
+/*  Advances the probe wheel, checking the liveness of each telnet obj whose
+ *    slot has come due since the last tick.
+ *  The timer is only rearmed while telnet objs remain on the wheel.
+ */
+    time_t now;
+    time_t t;
+    List slot;
+    int n;
+    obj_t *telnet;
+
+    probeTimer = -1;
+
+    if (time(&now) == (time_t) -1) {
+        log_err(errno, "time() failed");
+    }
+    t = MAX(probeTick + 1, now - TELNET_PROBE_WHEEL_SIZE + 1);
+    for (; t <= now; t++) {
+        /*
+         *  Only the objs in the slot at the start of the pass are checked
+         *    since an obj may be placed back into the same slot.
+         */
+        slot = probeWheel[t % TELNET_PROBE_WHEEL_SIZE];
+        for (n = list_count(slot); n > 0; n--) {
+            telnet = list_dequeue(slot);
+            check_telnet_probe(telnet, now);
+        }
+    }
+    probeTick = now;
+
+    if ((probeCount > 0) && (probeTimer < 0)) {
+        probeTimer = tpoll_timeout_relative(tp_global,
+            (callback_f) check_telnet_probes, NULL, 1000);
+    }
+    (void) arg;                         /* suppress unused-parameter warning */
+    return;
+}
+
+
+static void check_telnet_probe(obj_t *telnet, time_t now)
+{
+/*  Checks the liveness of the (telnet) obj taken off the probe wheel at
+ *    time (now), and places it back on the wheel for its next check.
+ *  A telnet NOP is sent once the connection has been idle for the probe
+ *    interval.  A failed path is then detected by the TCP stack when the
+ *    probe goes unacknowledged (eg, via TCP_USER_TIMEOUT).  If a reply
+ *    timeout is specified, a telnet AYT is sent instead; if no data is read
+ *    within the reply timeout, the connection is dropped and reestablished.
+ */
+    telnet_obj_t *auxp = &telnet->aux->telnet;
+    time_t tLast;
+    time_t tNext;
+
+    assert(is_telnet_obj(telnet));
+
+    if ((auxp->state != CONMAN_TELNET_UP) || (auxp->opts.probeSecs <= 0)) {
+        auxp->gotProbeWheel = 0;
+        probeCount--;
+        return;
+    }
+    if (auxp->timeCheck > now) {
+        schedule_telnet_probe(telnet, auxp->timeCheck);
+        return;
+    }
+    if ((auxp->opts.replySecs > 0) && (auxp->timeProbe > auxp->timeLastRead)) {
+        if (now >= auxp->timeProbe + auxp->opts.replySecs) {
+            log_msg(LOG_NOTICE,
+                "Console [%s] failed to answer liveness probe within %d secs",
+                telnet->name, auxp->opts.replySecs);
+            auxp->gotProbeWheel = 0;
+            probeCount--;
+            disconnect_telnet_obj(telnet);
+            return;
+        }
+        tNext = auxp->timeProbe + auxp->opts.replySecs;
+    }
+    else {
+        tLast = MAX(auxp->timeLastRead, auxp->timeProbe);
+        if (now >= tLast + auxp->opts.probeSecs) {
+            send_telnet_cmd(telnet, (auxp->opts.replySecs > 0) ? AYT : NOP, -1);
+            auxp->timeProbe = now;
+            tNext = now + ((auxp->opts.replySecs > 0)
+                ? auxp->opts.replySecs : auxp->opts.probeSecs);
+        }
+        else {
+            tNext = tLast + auxp->opts.probeSecs;
+        }
+    }
+    schedule_telnet_probe(telnet, MAX(tNext, now + 1));
+    return;
+}
+
+
 static int process_telnet_cmd(obj_t *telnet, int cmd, int opt)
 {
 /*  Processes the given telnet cmd received from the (telnet) console.
@@ -508,7 +875,7 @@ static int process_telnet_cmd(obj_t *telnet, int cmd, int opt)
 
     assert(is_telnet_obj(telnet));
     assert(telnet->fd >= 0);
-    assert(telnet->aux.telnet.state == CONMAN_TELNET_UP);
+    assert(telnet->aux->telnet.state == CONMAN_TELNET_UP);
 
     if (!TELCMD_OK(cmd)) {
         log_msg(LOG_DEBUG,
@@ -211,11 +211,11 @@ obj_t * create_test_obj(server_conf_t *conf, char *name,
         return(NULL);
     }
     test = create_obj(conf, name, -1, CONMAN_OBJ_TEST);
-    test->aux.test.opts = *opts;
-    test->aux.test.logfile = NULL;
-    test->aux.test.timer = -1;
-    test->aux.test.numLeft = 0;
-    test->aux.test.lastChar = TEST_CONSOLE_FIRST_CHAR;
+    test->aux->test.opts = *opts;
+    test->aux->test.logfile = NULL;
+    test->aux->test.timer = -1;
+    test->aux->test.numLeft = 0;
+    test->aux->test.lastChar = TEST_CONSOLE_FIRST_CHAR;
     /*
      *  Add obj to the master conf->objs list.
      */
@@ -237,8 +237,8 @@ int open_test_obj(obj_t *test)
     assert(test != NULL);
     assert(is_test_obj(test));
 
-    auxp = &test->aux.test;
-    opts = &test->aux.test.opts;
+    auxp = &test->aux->test;
+    opts = &test->aux->test.opts;
 
     if (auxp->timer >= 0) {
         (void) tpoll_timeout_cancel(tp_global, auxp->timer);
@@ -288,16 +288,14 @@ int read_test_obj(obj_t *test)
     unsigned char buf[(OBJ_BUF_SIZE / 2) - 1];
     int n = 0;
     int m;
-    ListIterator i;
-    obj_t *reader;
     int delay;
     int interval;
 
     assert(test != NULL);
     assert(is_test_obj(test));
 
-    auxp = &test->aux.test;
-    opts = &test->aux.test.opts;
+    auxp = &test->aux->test;
+    opts = &test->aux->test.opts;
 
     if (auxp->timer >= 0) {
         (void) tpoll_timeout_cancel(tp_global, auxp->timer);
@@ -321,17 +319,7 @@ int read_test_obj(obj_t *test)
         }
         auxp->numLeft -= n;
 
-        i = list_iterator_create(test->readers);
-        while ((reader = list_next(i))) {
-
-            if (is_logfile_obj(reader)) {
-                write_log_data(reader, buf, n);
-            }
-            else {
-                write_obj_data(reader, buf, n, 0);
-            }
-        }
-        list_iterator_destroy(i);
+        write_readers_data(test, buf, n);
     }
     /*  Schedule the next timer.
      */
@@ -0,0 +1,262 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>                  /* include before socket.h for bsd */
+#include <sys/socket.h>
+#include "common.h"
+#include "log.h"
+#include "server.h"
+#include "util-str.h"
+#include "util.h"
+
+
+static const char * get_tls_error(char *buf, size_t len);
+
+
+void create_tls_context(server_conf_t *conf)
+{
+/*  Creates the TLS context used to encrypt client connections if a
+ *    certificate has been specified in the configuration.
+ *  Clients are offered TLS 1.3 session tickets so a repeated connection
+ *    can resume the session instead of performing a full handshake.
+ *  Where the kernel supports it, the record layer of each connection is
+ *    offloaded to kTLS once the handshake completes.
+ */
+    SSL_CTX *ctx;
+    const char *keyFile;
+    char buf[MAX_LINE];
+
+    assert(conf != NULL);
+
+    if (!conf->tlsCertFile) {
+        if (conf->tlsKeyFile) {
+            log_msg(LOG_WARNING, "Ignoring TLSKEY without TLSCERT");
+        }
+        if (conf->enableTLSRequire) {
+            log_err(0, "TLSREQUIRE requires a TLSCERT to be specified");
+        }
+        return;
+    }
+    if (!(ctx = SSL_CTX_new(TLS_server_method()))) {
+        log_err(0, "Unable to create TLS context: %s",
+            get_tls_error(buf, sizeof(buf)));
+    }
+    (void) SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    (void) SSL_CTX_set_options(ctx,
+        SSL_OP_IGNORE_UNEXPECTED_EOF | SSL_OP_NO_RENEGOTIATION);
+#ifdef SSL_OP_ENABLE_KTLS
+    (void) SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif /* SSL_OP_ENABLE_KTLS */
+    (void) SSL_CTX_set_mode(ctx,
+        SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    if (!SSL_CTX_set_session_id_context(ctx,
+            (const unsigned char *) TLS_SESSION_ID_CONTEXT,
+            strlen(TLS_SESSION_ID_CONTEXT))) {
+        log_err(0, "Unable to set TLS session context: %s",
+            get_tls_error(buf, sizeof(buf)));
+    }
+    if (SSL_CTX_use_certificate_chain_file(ctx, conf->tlsCertFile) != 1) {
+        log_err(0, "Unable to load TLS certificate \"%s\": %s",
+            conf->tlsCertFile, get_tls_error(buf, sizeof(buf)));
+    }
+    keyFile = (conf->tlsKeyFile ? conf->tlsKeyFile : conf->tlsCertFile);
+    if (SSL_CTX_use_PrivateKey_file(ctx, keyFile, SSL_FILETYPE_PEM) != 1) {
+        log_err(0, "Unable to load TLS private key \"%s\": %s",
+            keyFile, get_tls_error(buf, sizeof(buf)));
+    }
+    if (SSL_CTX_check_private_key(ctx) != 1) {
+        log_err(0, "TLS private key \"%s\" does not match certificate: %s",
+            keyFile, get_tls_error(buf, sizeof(buf)));
+    }
+    conf->tlsCtx = ctx;
+    DPRINTF((5, "Created TLS context for certificate \"%s\".\n",
+        conf->tlsCertFile));
+    return;
+}
+
+
+void destroy_tls_context(server_conf_t *conf)
+{
+/*  Destroys the TLS context, if any.
+ */
+    assert(conf != NULL);
+
+    if (conf->tlsCtx) {
+        SSL_CTX_free(conf->tlsCtx);
+        conf->tlsCtx = NULL;
+    }
+    return;
+}
+
+
+int accept_tls_client(server_conf_t *conf, req_t *req)
+{
+/*  Checks whether the client on the (still blocking) socket of (req) has
+ *    begun its connection with a TLS handshake, and completes it if so.
+ *  Since the ConMan protocol is initiated by the client, its first byte
+ *    distinguishes a TLS ClientHello from a plaintext greeting.
+ *  Returns 0 if the connection may proceed, or -1 on error.
+ */
+    unsigned char c;
+    int n;
+    int rc;
+    char buf[MAX_LINE];
+
+    assert(conf != NULL);
+    assert(req != NULL);
+    assert(req->sd >= 0);
+    assert(req->ssl == NULL);
+
+    while ((n = recv(req->sd, &c, sizeof(c), MSG_PEEK)) < 0) {
+        if (errno == EINTR) {
+            continue;
+        }
+        log_msg(LOG_NOTICE, "Unable to read greeting from <%s:%d>: %s",
+            req->fqdn, req->port, strerror(errno));
+        return(-1);
+    }
+    if (n == 0) {
+        log_msg(LOG_NOTICE, "Connection terminated by <%s:%d>",
+            req->fqdn, req->port);
+        return(-1);
+    }
+    if (c != TLS_RECORD_HANDSHAKE) {
+        return(0);
+    }
+    if (!conf->tlsCtx) {
+        log_msg(LOG_NOTICE,
+            "Rejected TLS connection from <%s:%d>: no TLSCERT configured",
+            req->fqdn, req->port);
+        return(-1);
+    }
+    if (!(req->ssl = SSL_new(conf->tlsCtx))) {
+        log_msg(LOG_WARNING, "Unable to create TLS session for <%s:%d>: %s",
+            req->fqdn, req->port, get_tls_error(buf, sizeof(buf)));
+        return(-1);
+    }
+    if (SSL_set_fd(req->ssl, req->sd) != 1) {
+        log_msg(LOG_WARNING, "Unable to attach TLS session to <%s:%d>: %s",
+            req->fqdn, req->port, get_tls_error(buf, sizeof(buf)));
+        return(-1);
+    }
+    for (;;) {
+        ERR_clear_error();
+        errno = 0;
+        if ((rc = SSL_accept(req->ssl)) == 1) {
+            break;
+        }
+        if ((SSL_get_error(req->ssl, rc) == SSL_ERROR_SYSCALL)
+                && (errno == EINTR)) {
+            continue;
+        }
+        log_msg(LOG_NOTICE, "Unable to establish TLS with <%s:%d>: %s",
+            req->fqdn, req->port, get_tls_error(buf, sizeof(buf)));
+        return(-1);
+    }
+    req->enableTLS = 1;
+
+    DPRINTF((5, "Established %s (%s%s) with <%s:%d>.\n",
+        SSL_get_version(req->ssl), SSL_get_cipher_name(req->ssl),
+        (SSL_session_reused(req->ssl) ? ", resumed" : ""),
+        req->fqdn, req->port));
+    return(0);
+}
+
+
+tls_obj_t * create_tls_obj(obj_t *client)
+{
+/*  Creates the state for writing the data stream of the (client) obj
+ *    out through its TLS session.
+ *  If the kernel has taken over the record layer, data can be written to
+ *    and read from the socket directly, bypassing the staging buffer.
+ *  Returns the new tls obj.
+ */
+    tls_obj_t *tls;
+    SSL *ssl;
+
+    assert(is_client_obj(client));
+    assert(client->aux->client.req != NULL);
+    assert(client->aux->client.req->ssl != NULL);
+
+    ssl = client->aux->client.req->ssl;
+
+    if (!(tls = malloc(sizeof(tls_obj_t)))) {
+        out_of_memory();
+    }
+    tls->bufInPtr = tls->bufOutPtr = tls->buf;
+    tls->isKtlsSend = (BIO_get_ktls_send(SSL_get_wbio(ssl)) > 0);
+    tls->isKtlsRecv = (BIO_get_ktls_recv(SSL_get_rbio(ssl)) > 0);
+
+    DPRINTF((10, "Opened TLS for [%s]: ktls-send=%d ktls-recv=%d.\n",
+        client->name, tls->isKtlsSend, tls->isKtlsRecv));
+    return(tls);
+}
+
+
+void destroy_tls_obj(tls_obj_t *tls)
+{
+/*  Destroys the TLS state of an encrypted client stream.
+ *  The TLS session itself belongs to the client's request.
+ */
+    assert(tls != NULL);
+
+    free(tls);
+    return;
+}
+
+
+static const char * get_tls_error(char *buf, size_t len)
+{
+/*  Writes a description of the most recent TLS error into (buf) of length
+ *    (len), falling back to the system error if OpenSSL did not record one.
+ *  Returns a ptr to the NUL-terminated string (buf).
+ */
+    unsigned long e;
+
+    assert(buf != NULL);
+    assert(len > 0);
+
+    if ((e = ERR_get_error()) != 0) {
+        ERR_error_string_n(e, buf, len);
+    }
+    else if (errno != 0) {
+        strlcpy(buf, strerror(errno), len);
+    }
+    else {
+        strlcpy(buf, "connection closed during handshake", len);
+    }
+    return(buf);
+}
@@ -122,7 +122,7 @@ obj_t * create_unixsock_obj(server_conf_t *conf, char *name, char *dev,
             break;
         }
         if (is_unixsock_obj(unixsock)
-                && !strcmp(unixsock->aux.unixsock.dev, dev)) {
+                && !strcmp(unixsock->aux->unixsock.dev, dev)) {
             if ((errbuf != NULL) && (errlen > 0)) {
                 snprintf(errbuf, errlen,
                     "console [%s] specifies duplicate device \"%s\"",
@@ -136,22 +136,22 @@ obj_t * create_unixsock_obj(server_conf_t *conf, char *name, char *dev,
         return(NULL);
     }
     unixsock = create_obj(conf, name, -1, CONMAN_OBJ_UNIXSOCK);
-    unixsock->aux.unixsock.dev = create_string(dev);
-    unixsock->aux.unixsock.logfile = NULL;
-    unixsock->aux.unixsock.timer = -1;
-    unixsock->aux.unixsock.state = CONMAN_UNIXSOCK_DOWN;
-    unixsock->aux.unixsock.delay = UNIXSOCK_MIN_TIMEOUT;
+    unixsock->aux->unixsock.dev = create_string(dev);
+    unixsock->aux->unixsock.logfile = NULL;
+    unixsock->aux->unixsock.timer = -1;
+    unixsock->aux->unixsock.state = CONMAN_UNIXSOCK_DOWN;
+    unixsock->aux->unixsock.delay = UNIXSOCK_MIN_TIMEOUT;
     /*
      *  Add obj to the master conf->objs list.
      */
     list_append(conf->objs, unixsock);
 
-    rv = inevent_add(unixsock->aux.unixsock.dev,
+    rv = inevent_add(unixsock->aux->unixsock.dev,
         (inevent_cb_f) open_unixsock_obj, unixsock);
     if (rv < 0) {
         log_msg(LOG_INFO,
             "Console [%s] unable to register device \"%s\" for inotify events",
-            unixsock->name, unixsock->aux.unixsock.dev);
+            unixsock->name, unixsock->aux->unixsock.dev);
     }
     return(unixsock);
 }
@@ -167,7 +167,7 @@ int open_unixsock_obj(obj_t *unixsock)
     assert(unixsock != NULL);
     assert(is_unixsock_obj(unixsock));
 
-    if (unixsock->aux.unixsock.state == CONMAN_UNIXSOCK_UP) {
+    if (unixsock->aux->unixsock.state == CONMAN_UNIXSOCK_UP) {
         rc = disconnect_unixsock_obj(unixsock);
     }
     else {
@@ -205,10 +205,10 @@ static int connect_unixsock_obj(obj_t *unixsock)
 
     assert(unixsock != NULL);
     assert(is_unixsock_obj(unixsock));
-    assert(unixsock->aux.unixsock.state != CONMAN_UNIXSOCK_UP);
-    assert(strlen(unixsock->aux.unixsock.dev) <= max_unixsock_dev_strlen());
+    assert(unixsock->aux->unixsock.state != CONMAN_UNIXSOCK_UP);
+    assert(strlen(unixsock->aux->unixsock.dev) <= max_unixsock_dev_strlen());
 
-    auxp = &(unixsock->aux.unixsock);
+    auxp = &(unixsock->aux->unixsock);
 
     if (auxp->timer >= 0) {
         (void) tpoll_timeout_cancel(tp_global, auxp->timer);
@@ -276,7 +276,8 @@ static int connect_unixsock_obj(obj_t *unixsock)
 
     /*  Notify linked objs when transitioning into an UP state.
      */
-    write_notify_msg(unixsock, LOG_INFO, "Console [%s] connected to \"%s\"",
+    write_notify_event(unixsock, CONMAN_SINK_CONNECT, LOG_INFO,
+        "Console [%s] connected to \"%s\"",
         unixsock->name, auxp->dev);
     DPRINTF((9, "Opened [%s] unixsock: fd=%d dev=%s.\n",
             unixsock->name, unixsock->fd, auxp->dev));
@@ -296,7 +297,7 @@ static int disconnect_unixsock_obj(obj_t *unixsock)
     assert(unixsock != NULL);
     assert(is_unixsock_obj(unixsock));
 
-    auxp = &(unixsock->aux.unixsock);
+    auxp = &(unixsock->aux->unixsock);
 
     if (auxp->timer >= 0) {
         (void) tpoll_timeout_cancel(tp_global, auxp->timer);
@@ -314,7 +315,7 @@ static int disconnect_unixsock_obj(obj_t *unixsock)
      */
     if (auxp->state == CONMAN_UNIXSOCK_UP) {
         auxp->state = CONMAN_UNIXSOCK_DOWN;
-        write_notify_msg(unixsock, LOG_INFO,
+        write_notify_event(unixsock, CONMAN_SINK_DISCONNECT, LOG_INFO,
             "Console [%s] disconnected from \"%s\"",
             unixsock->name, auxp->dev);
     }
@@ -341,7 +342,7 @@ static void reset_unixsock_delay(obj_t *unixsock)
     assert(unixsock != NULL);
     assert(is_unixsock_obj(unixsock));
 
-    auxp = &(unixsock->aux.unixsock);
+    auxp = &(unixsock->aux->unixsock);
 
     /*  Reset the timer ID since this routine is only invoked by a timer.
      */
@@ -0,0 +1,747 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "list.h"
+#include "log.h"
+#include "server.h"
+#include "tpoll.h"
+#include "util.h"
+#include "util-file.h"
+#include "util-str.h"
+#include "wrapper.h"
+
+
+/*  If the Workers option is enabled, the daemon started by the user becomes
+ *    a supervisor that partitions the consoles across worker procs by a hash
+ *    of each console's name.  Every worker is an exec of the daemon with the
+ *    same cmdline; the CONMAN_WORKER env var gives it its index along with
+ *    the fd of its control socket.  A worker parses the same config, but only
+ *    creates the consoles (and logfiles) it owns.  The supervisor creates no
+ *    consoles; it records their names for its console registry, and owns the
+ *    listening socket and the pidfile.
+ *  The supervisor processes each client's greeting & request.  It answers a
+ *    QUERY itself.  If the request's consoles are owned by a single worker,
+ *    the client's socket is passed to that worker via SCM_RIGHTS along with
+ *    the client's info & request line; the worker then processes the request
+ *    as if the client had connected directly.  A request spanning multiple
+ *    workers (or a TLS client, whose session cannot be passed) is instead
+ *    relayed by the supervisor over a socketpair to each worker involved.
+ *  A worker that terminates is respawned with an increasing delay if it
+ *    keeps terminating shortly after being started.  A worker terminates
+ *    itself if its supervisor goes away.
+ *  The console names are only modified while the config is parsed, so they
+ *    are not locked.  Each worker's control socket is protected by a mutex
+ *    since it is written by client threads and replaced by the mux thread.
+ */
+
+typedef struct worker {                 /* WORKER PROC:                      */
+    int              index;             /*  index of worker in partition     */
+    int              fd;                /*  control socket, or -1 if down    */
+    pid_t            pid;               /*  pid of worker proc, or -1        */
+    time_t           tStart;            /*  time at which proc was exec'd    */
+    int              timer;             /*  timer id for respawn, or -1      */
+    int              delay;             /*  secs 'til next respawn attempt   */
+    int              numSpawns;         /*  num times proc has been spawned  */
+    pthread_mutex_t  lock;              /*  lock protecting fd               */
+} worker_t;
+
+typedef enum worker_flag {              /* CLIENT HANDOFF FLAGS:             */
+    CONMAN_WORKER_COMPRESS = 0x01,      /*  client output is compressed      */
+    CONMAN_WORKER_FRAMED   = 0x02,      /*  client input is framed           */
+    CONMAN_WORKER_SPAN     = 0x04       /*  request spans worker procs       */
+} worker_flag_t;
+
+#define WORKER_ENV_NAME "CONMAN_WORKER"
+#define WORKER_MSG_FIELDS 8
+
+static unsigned hash_worker_name(const char *name);
+static int find_worker_exec_path(server_conf_t *conf, char *argv[]);
+static int spawn_worker(worker_t *w);
+static void respawn_worker(worker_t *w);
+static void handle_worker_exit(worker_t *w);
+static void recv_worker_clients(server_conf_t *conf);
+static int create_worker_client(server_conf_t *conf,
+    int sd, char *msg, int len);
+static int compare_worker_console_names(const char **p1, const char **p2);
+
+extern tpoll_t tp_global;               /* defined in server.c */
+extern char **environ;
+
+static worker_t *workers = NULL;
+static int numWorkers = 0;
+static char workerPath[PATH_MAX];
+static char *workerCwd = NULL;
+static char **workerArgv = NULL;
+static char **workerEnv = NULL;
+static int workerEnvIndex = -1;
+static char workerEnvStr[64];
+
+static char **consoles = NULL;
+static int numConsoles = 0;
+static int maxConsoles = 0;
+
+
+int get_worker_index(server_conf_t *conf, const char *name)
+{
+/*  Returns the index of the worker proc owning the console (name).
+ */
+    assert(conf->numWorkers > 0);
+    assert(name != NULL);
+
+    return(hash_worker_name(name) % conf->numWorkers);
+}
+
+
+void add_worker_console(const char *name)
+{
+/*  Adds the console (name) to the supervisor's list of worker consoles
+ *    from which its console registry is published.
+ */
+    assert(name != NULL);
+
+    if (numConsoles == maxConsoles) {
+        maxConsoles = (maxConsoles > 0) ? maxConsoles * 2 : 1024;
+        consoles = realloc(consoles, maxConsoles * sizeof(*consoles));
+        if (!consoles) {
+            out_of_memory();
+        }
+    }
+    consoles[numConsoles++] = create_string(name);
+    return;
+}
+
+
+const char * find_duplicate_worker_console(void)
+{
+/*  Sorts the supervisor's list of worker consoles in order to check it for
+ *    duplicates once the config has been parsed.
+ *  Returns the first duplicate console name, or NULL if none is found.
+ */
+    int k;
+
+    qsort(consoles, numConsoles, sizeof(*consoles),
+        (int (*)(const void *, const void *)) compare_worker_console_names);
+
+    for (k = 1; k < numConsoles; k++) {
+        if (!strcmp(consoles[k - 1], consoles[k])) {
+            return(consoles[k]);
+        }
+    }
+    return(NULL);
+}
+
+
+int is_worker_console(server_conf_t *conf, const char *name)
+{
+/*  Returns true if the console (name) is owned by this worker proc.
+ */
+    assert(conf->workerIndex >= 0);
+
+    return(get_worker_index(conf, name) == conf->workerIndex);
+}
+
+
+int get_num_worker_consoles(void)
+{
+/*  Returns the number of consoles in the supervisor's list.
+ */
+    return(numConsoles);
+}
+
+
+const char * get_worker_console(int index)
+{
+/*  Returns the name of the console at (index) in the supervisor's list.
+ *    The name is retained until the daemon exits.
+ */
+    assert((index >= 0) && (index < numConsoles));
+
+    return(consoles[index]);
+}
+
+
+void init_worker(server_conf_t *conf)
+{
+/*  Initializes this proc as a worker if it was spawned by a supervisor.
+ *  This must be called before the config is processed.
+ */
+    char *p;
+    int index, count, fd, spawns;
+
+    if (!(p = getenv(WORKER_ENV_NAME))) {
+        return;
+    }
+    if ((sscanf(p, "%d:%d:%d:%d", &index, &count, &fd, &spawns) != 4)
+            || (count <= 0) || (count > WORKER_MAX_PROCS)
+            || (index < 0) || (index >= count) || (fd < 0) || (spawns < 0)) {
+        log_err(0, "Invalid %s value \"%s\"", WORKER_ENV_NAME, p);
+    }
+    conf->numWorkers = count;
+    conf->workerIndex = index;
+    conf->workerFd = fd;
+    set_fd_closed_on_exec(fd);
+    set_fd_nonblocking(fd);
+    tpoll_set(conf->tp, fd, POLLIN);
+
+    /*  The supervisor has already displayed the configuration, and the
+     *    console logs have already been truncated if this worker is being
+     *    respawned.
+     */
+    conf->enableVerbose = 0;
+    if (spawns > 0) {
+        conf->enableZeroLogs = 0;
+    }
+    return;
+}
+
+
+void start_workers(server_conf_t *conf, char *argv[])
+{
+/*  Spawns the worker procs if this proc is a supervisor.
+ *  Each worker is exec'd with the supervisor's (argv).
+ */
+    int n;
+    int i;
+
+    if ((conf->numWorkers <= 0) || (conf->workerIndex >= 0)) {
+        return;
+    }
+    if (find_worker_exec_path(conf, argv) < 0) {
+        log_err(0, "Unable to determine pathname of \"%s\"", argv[0]);
+    }
+    workerCwd = conf->cwd;
+    workerArgv = argv;
+
+    /*  The env for each worker is preformatted here since the worker must be
+     *    exec'd without allocating memory between the fork and exec.
+     */
+    for (n = 0; environ[n] != NULL; n++) {;}
+    if (!(workerEnv = malloc((n + 2) * sizeof(char *)))) {
+        out_of_memory();
+    }
+    memcpy(workerEnv, environ, n * sizeof(char *));
+    workerEnvIndex = n;
+    workerEnv[n] = workerEnvStr;
+    workerEnv[n + 1] = NULL;
+
+    numWorkers = conf->numWorkers;
+    if (!(workers = malloc(numWorkers * sizeof(worker_t)))) {
+        out_of_memory();
+    }
+    for (i = 0; i < numWorkers; i++) {
+        workers[i].index = i;
+        workers[i].fd = -1;
+        workers[i].pid = -1;
+        workers[i].tStart = 0;
+        workers[i].timer = -1;
+        workers[i].delay = 0;
+        workers[i].numSpawns = 0;
+        x_pthread_mutex_init(&workers[i].lock, NULL);
+    }
+    for (i = 0; i < numWorkers; i++) {
+        respawn_worker(&workers[i]);
+    }
+    return;
+}
+
+
+void signal_workers(int signum)
+{
+/*  Sends the signal (signum) to each running worker proc.
+ */
+    int i;
+
+    for (i = 0; i < numWorkers; i++) {
+        if ((workers[i].fd >= 0) && (workers[i].pid > 0)) {
+            (void) kill(workers[i].pid, signum);
+        }
+    }
+    return;
+}
+
+
+void stop_workers(void)
+{
+/*  Terminates the worker procs and closes their control sockets.
+ */
+    worker_t *w;
+    int i;
+
+    for (i = 0; i < numWorkers; i++) {
+        w = &workers[i];
+        if (w->timer >= 0) {
+            (void) tpoll_timeout_cancel(tp_global, w->timer);
+            w->timer = -1;
+        }
+        x_pthread_mutex_lock(&w->lock);
+        if (w->fd >= 0) {
+            (void) kill(w->pid, SIGTERM);
+            tpoll_clear(tp_global, w->fd, POLLIN);
+            (void) close(w->fd);
+            w->fd = -1;
+        }
+        x_pthread_mutex_unlock(&w->lock);
+    }
+    return;
+}
+
+
+int dispatch_worker_io(server_conf_t *conf)
+{
+/*  Handles I/O on the worker control sockets after a poll.
+ *  A supervisor only reads from a control socket to detect a worker's
+ *    termination; a worker reads the clients handed off by its supervisor.
+ *  Returns the number of control sockets with events.
+ */
+    int n = 0;
+    int i;
+
+    if (conf->workerIndex >= 0) {
+        if ((conf->workerFd >= 0) && (tpoll_is_set(conf->tp,
+                conf->workerFd, POLLIN | POLLHUP | POLLERR) > 0)) {
+            recv_worker_clients(conf);
+            n++;
+        }
+        return(n);
+    }
+    for (i = 0; i < numWorkers; i++) {
+        if ((workers[i].fd >= 0) && (tpoll_is_set(conf->tp,
+                workers[i].fd, POLLIN | POLLHUP | POLLERR) > 0)) {
+            handle_worker_exit(&workers[i]);
+            n++;
+        }
+    }
+    return(n);
+}
+
+
+int send_worker_client(int index, int sd, req_t *req,
+    const char *request, int isSpan)
+{
+/*  Passes the client socket (sd) for request (req) to worker (index) along
+ *    with the client's info and its original (request) line.
+ *  If (isSpan) is true, the request spans multiple workers and is relayed
+ *    by the supervisor, which then compresses the output itself.
+ *  Returns 0 on success, or -1 on error (with errno set).
+ */
+    worker_t *w;
+    char *msg;
+    int len;
+    int flags;
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } ctl;
+    int n;
+
+    assert((index >= 0) && (index < numWorkers));
+    assert(sd >= 0);
+    assert(request != NULL);
+
+    flags = 0;
+    if (req->enableCompress && !isSpan) {
+        flags |= CONMAN_WORKER_COMPRESS;
+    }
+    if (req->enableFramed) {
+        flags |= CONMAN_WORKER_FRAMED;
+    }
+    if (isSpan) {
+        flags |= CONMAN_WORKER_SPAN;
+    }
+    /*  The message is a sequence of NUL-terminated fields.
+     */
+    if (!(msg = malloc(WORKER_MSG_SIZE))) {
+        out_of_memory();
+    }
+    len = snprintf(msg, WORKER_MSG_SIZE, "%d%c%s%c%s%c%s%c%s%c%s%c%d%c%s",
+        req->port, 0, req->ip, 0, req->fqdn, 0, req->host, 0, req->user, 0,
+        (req->tty ? req->tty : ""), 0, flags, 0, request);
+    if ((len < 0) || (len >= WORKER_MSG_SIZE)) {
+        free(msg);
+        errno = EMSGSIZE;
+        return(-1);
+    }
+    iov.iov_base = msg;
+    iov.iov_len = len + 1;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctl.buf;
+    mh.msg_controllen = sizeof(ctl.buf);
+    cmsg = CMSG_FIRSTHDR(&mh);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &sd, sizeof(int));
+
+    w = &workers[index];
+    x_pthread_mutex_lock(&w->lock);
+    if (w->fd < 0) {
+        errno = ECONNREFUSED;
+        n = -1;
+    }
+    else {
+        while (((n = sendmsg(w->fd, &mh, MSG_NOSIGNAL)) < 0)
+                && (errno == EINTR)) {;}
+    }
+    x_pthread_mutex_unlock(&w->lock);
+    free(msg);
+    return((n < 0) ? -1 : 0);
+}
+
+
+static unsigned hash_worker_name(const char *name)
+{
+/*  Returns the FNV-1a hash of the console (name).
+ */
+    const unsigned char *p;
+    unsigned h = 2166136261U;
+
+    for (p = (const unsigned char *) name; *p != '\0'; p++) {
+        h ^= *p;
+        h *= 16777619U;
+    }
+    return(h);
+}
+
+
+static int find_worker_exec_path(server_conf_t *conf, char *argv[])
+{
+/*  Sets workerPath to the absolute pathname of this executable.
+ *  Returns 0 on success, or -1 on error.
+ */
+    ssize_t n;
+    int rc;
+
+    n = readlink("/proc/self/exe", workerPath, sizeof(workerPath) - 1);
+    if (n > 0) {
+        workerPath[n] = '\0';
+        return(0);
+    }
+    if (!strchr(argv[0], '/')) {
+        return(-1);
+    }
+    if (argv[0][0] == '/') {
+        rc = strlcpy(workerPath, argv[0], sizeof(workerPath));
+    }
+    else {
+        rc = snprintf(workerPath, sizeof(workerPath), "%s/%s",
+            conf->cwd, argv[0]);
+    }
+    if ((rc < 0) || ((size_t) rc >= sizeof(workerPath))) {
+        return(-1);
+    }
+    return(0);
+}
+
+
+static int spawn_worker(worker_t *w)
+{
+/*  Spawns the worker proc (w), connected to the supervisor by a new
+ *    control socket.
+ *  Returns 0 if the worker is spawned, or -1 on error.
+ */
+    int sv[2];
+    int size = WORKER_MSG_SIZE;
+    pid_t pid;
+
+    assert(w->fd < 0);
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+        log_msg(LOG_WARNING, "Unable to create worker %d control socket: %s",
+            w->index, strerror(errno));
+        return(-1);
+    }
+    set_fd_closed_on_exec(sv[0]);
+    set_fd_closed_on_exec(sv[1]);
+
+    /*  Ensure the largest request fits in a single message.
+     */
+    if ((setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) < 0)
+            || (setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF,
+                &size, sizeof(size)) < 0)) {
+        log_msg(LOG_WARNING,
+            "Unable to set worker %d control socket buffer size: %s",
+            w->index, strerror(errno));
+    }
+    snprintf(workerEnvStr, sizeof(workerEnvStr), "%s=%d:%d:%d:%d",
+        WORKER_ENV_NAME, w->index, numWorkers, sv[1], w->numSpawns);
+    assert(workerEnv[workerEnvIndex] == workerEnvStr);
+
+    begin_mux_phase("fork", NULL);
+    pid = fork();
+    if (pid != 0) {
+        end_mux_phase();
+    }
+    if (pid < 0) {
+        log_msg(LOG_WARNING, "Unable to fork worker %d: %s",
+            w->index, strerror(errno));
+        (void) close(sv[0]);
+        (void) close(sv[1]);
+        return(-1);
+    }
+    else if (pid == 0) {
+        /*
+         *  Only async-signal-safe functions may be called here since
+         *    other threads may have held locks at the time of the fork.
+         */
+        if ((fcntl(sv[1], F_SETFD, 0) < 0) || (chdir(workerCwd) < 0)) {
+            _exit(127);
+        }
+        execve(workerPath, workerArgv, workerEnv);
+        _exit(127);
+    }
+    (void) close(sv[1]);
+
+    x_pthread_mutex_lock(&w->lock);
+    w->fd = sv[0];
+    x_pthread_mutex_unlock(&w->lock);
+    w->pid = pid;
+    if (time(&w->tStart) == (time_t) -1) {
+        log_err(errno, "time() failed");
+    }
+    w->numSpawns++;
+    tpoll_set(tp_global, w->fd, POLLIN);
+
+    log_msg(LOG_INFO, "Started worker %d (pid %d)", w->index, (int) pid);
+    return(0);
+}
+
+
+static void respawn_worker(worker_t *w)
+{
+/*  Spawns the worker proc (w), setting a timer to try again on error.
+ */
+    w->timer = -1;
+
+    if (spawn_worker(w) < 0) {
+        w->delay = (w->delay == 0)
+            ? WORKER_MIN_TIMEOUT
+            : MIN(w->delay * 2, WORKER_MAX_TIMEOUT);
+        w->timer = tpoll_timeout_relative(tp_global,
+            (callback_f) respawn_worker, w, w->delay * 1000);
+    }
+    return;
+}
+
+
+static void handle_worker_exit(worker_t *w)
+{
+/*  Handles the termination of the worker proc (w), detected by EOF on its
+ *    control socket, and schedules it to be respawned.  The respawn delay
+ *    is reset if the worker had been running for a while; o/w, it backs off
+ *    to protect against spinning on a worker that terminates at startup.
+ */
+    char c;
+    int n;
+    time_t tNow;
+    char *delta_str;
+
+    n = recv(w->fd, &c, sizeof(c), MSG_DONTWAIT);
+    if ((n > 0) || ((n < 0) && ((errno == EINTR) || (errno == EAGAIN)
+            || (errno == EWOULDBLOCK)))) {
+        return;
+    }
+    if (time(&tNow) == (time_t) -1) {
+        log_err(errno, "time() failed");
+    }
+    delta_str = create_time_delta_string(w->tStart, tNow);
+    log_msg(LOG_WARNING, "Worker %d (pid %d) terminated after %s",
+        w->index, (int) w->pid, delta_str);
+    free(delta_str);
+
+    x_pthread_mutex_lock(&w->lock);
+    tpoll_clear(tp_global, w->fd, POLLIN);
+    (void) close(w->fd);
+    w->fd = -1;
+    x_pthread_mutex_unlock(&w->lock);
+    w->pid = -1;
+
+    if (tNow - w->tStart >= MIN_CONNECT_SECS) {
+        w->delay = 0;
+    }
+    else {
+        w->delay = (w->delay == 0)
+            ? WORKER_MIN_TIMEOUT
+            : MIN(w->delay * 2, WORKER_MAX_TIMEOUT);
+    }
+    w->timer = tpoll_timeout_relative(tp_global,
+        (callback_f) respawn_worker, w, w->delay * 1000);
+    return;
+}
+
+
+static void recv_worker_clients(server_conf_t *conf)
+{
+/*  Receives the clients handed off by the supervisor on the control socket.
+ *  If the supervisor has gone away, this worker terminates itself.
+ */
+    static char *msg = NULL;
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } ctl;
+    int n;
+    int sd;
+
+    if (!msg && !(msg = malloc(WORKER_MSG_SIZE + 1))) {
+        out_of_memory();
+    }
+    for (;;) {
+        iov.iov_base = msg;
+        iov.iov_len = WORKER_MSG_SIZE;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = ctl.buf;
+        mh.msg_controllen = sizeof(ctl.buf);
+
+        n = recvmsg(conf->workerFd, &mh, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                return;
+            }
+            log_msg(LOG_WARNING, "Unable to read from supervisor: %s",
+                strerror(errno));
+        }
+        if (n <= 0) {
+            log_msg(LOG_NOTICE, "Supervisor closed worker control socket");
+            tpoll_clear(conf->tp, conf->workerFd, POLLIN);
+            (void) close(conf->workerFd);
+            conf->workerFd = -1;
+            (void) kill(getpid(), SIGTERM);
+            return;
+        }
+        sd = -1;
+        cmsg = CMSG_FIRSTHDR(&mh);
+        if ((cmsg != NULL) && (cmsg->cmsg_level == SOL_SOCKET)
+                && (cmsg->cmsg_type == SCM_RIGHTS)
+                && (cmsg->cmsg_len == CMSG_LEN(sizeof(int)))) {
+            memcpy(&sd, CMSG_DATA(cmsg), sizeof(int));
+        }
+        if (sd < 0) {
+            log_msg(LOG_WARNING, "Received client from supervisor without fd");
+            continue;
+        }
+        set_fd_closed_on_exec(sd);
+        msg[n] = '\0';
+        if (create_worker_client(conf, sd, msg, n) < 0) {
+            log_msg(LOG_WARNING, "Received invalid client from supervisor");
+            (void) close(sd);
+        }
+    }
+}
+
+
+static int create_worker_client(server_conf_t *conf,
+    int sd, char *msg, int len)
+{
+/*  Creates a thread to process the client socket (sd) handed off by the
+ *    supervisor, where (msg) of length (len) contains the client's info.
+ *  Returns 0 on success, or -1 if the message is invalid.
+ */
+    char *fields[WORKER_MSG_FIELDS];
+    char *p;
+    int n;
+    int flags;
+    req_t *req;
+    client_arg_t *args;
+    pthread_t tid;
+    int rc;
+
+    for (n = 0, p = msg; (n < WORKER_MSG_FIELDS) && (p < msg + len); n++) {
+        fields[n] = p;
+        p += strlen(p) + 1;
+    }
+    if ((n != WORKER_MSG_FIELDS) || (*fields[3] == '\0')
+            || (*fields[4] == '\0')) {
+        return(-1);
+    }
+    flags = atoi(fields[6]);
+
+    req = create_req();
+    req->sd = sd;
+    req->port = atoi(fields[0]);
+    req->ip = create_string(fields[1]);
+    req->fqdn = create_string(fields[2]);
+    req->host = create_string(fields[3]);
+    req->user = create_string(fields[4]);
+    req->tty = (*fields[5] != '\0') ? create_string(fields[5]) : NULL;
+#if WITH_ZLIB
+    req->enableCompress = !!(flags & CONMAN_WORKER_COMPRESS);
+#endif /* WITH_ZLIB */
+    req->enableFramed = !!(flags & CONMAN_WORKER_FRAMED);
+    req->enableSpan = !!(flags & CONMAN_WORKER_SPAN);
+
+    if (!(args = malloc(sizeof(client_arg_t)))) {
+        out_of_memory();
+    }
+    args->sd = sd;
+    args->conf = conf;
+    args->req = req;
+    args->request = create_string(fields[7]);
+
+    if ((rc = pthread_create(&tid, NULL,
+            (PthreadFunc) process_client, args)) != 0) {
+        log_err(rc, "Unable to create new thread");
+    }
+    return(0);
+}
+
+
+static int compare_worker_console_names(const char **p1, const char **p2)
+{
+/*  Used by qsort() to sort the worker console names in ASCII order,
+ *    which places any duplicate names next to each other.
+ */
+    return(strcmp(*p1, *p2));
+}
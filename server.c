@@ -93,6 +93,8 @@ int main(int argc, char *argv[])
     int fd = -1;
     pid_t pgid = -1;
     server_conf_t *conf;
+    const char *name;
+    int workerIndex;
     int log_priority = LOG_INFO;
     char ** const environ_bak = environ;
 
@@ -105,7 +107,8 @@ int main(int argc, char *argv[])
     tp_global = conf->tp;
 
     process_cmdline(conf, argc, argv);
-    if (!conf->enableForeground) {
+    init_worker(conf);
+    if (!conf->enableForeground && (conf->workerIndex < 0)) {
         begin_daemonize(&fd, &pgid);
     }
     process_config(conf);
@@ -118,14 +121,30 @@ int main(int argc, char *argv[])
     if (conf->enableVerbose) {
         display_configuration(conf);
     }
-    if (list_is_empty(conf->objs)) {
+    if ((conf->workerIndex < 0) && list_is_empty(conf->objs)
+            && (get_num_worker_consoles() == 0)) {
         log_err(0, "Configuration \"%s\" has no consoles defined",
             conf->confFileName);
     }
+    if ((conf->workerIndex < 0)
+            && (name = find_duplicate_worker_console())) {
+        log_err(0, "Configuration \"%s\" specifies duplicate console [%s]",
+            conf->confFileName, name);
+    }
+    if (conf->timerSlackMsecs > 0) {
+        tpoll_set_slack(conf->tp, conf->timerSlackMsecs);
+    }
     if (conf->tStampMinutes > 0) {
         schedule_timestamp(conf);
     }
-    create_listen_socket(conf);
+    /*  A worker receives its clients from the supervisor.
+     */
+    if (conf->workerIndex < 0) {
+#if WITH_OPENSSL
+        create_tls_context(conf);
+#endif /* WITH_OPENSSL */
+        create_listen_socket(conf);
+    }
 
     if (!conf->enableForeground) {
         if (conf->syslogFacility > 0) {
@@ -140,14 +159,21 @@ int main(int argc, char *argv[])
         end_daemonize(fd);
     }
 
-    log_msg(LOG_NOTICE, "Starting ConMan daemon %s (pid %d)",
-        VERSION, (int) getpid());
+    if (conf->workerIndex >= 0) {
+        log_msg(LOG_NOTICE, "Starting ConMan worker %d of %d (pid %d)",
+            conf->workerIndex, conf->numWorkers, (int) getpid());
+    }
+    else {
+        log_msg(LOG_NOTICE, "Starting ConMan daemon %s (pid %d)",
+            VERSION, (int) getpid());
+    }
 
 #if WITH_FREEIPMI
     ipmi_init(conf->numIpmiObjs);
 #endif /* WITH_FREEIPMI */
 
     setup_nofile_limit(conf);
+    start_workers(conf, argv);
     open_objs(conf);
     mux_io(conf);
 
@@ -155,6 +181,8 @@ int main(int argc, char *argv[])
     ipmi_fini();
 #endif /* WITH_FREEIPMI */
 
+    stop_workers();
+    workerIndex = conf->workerIndex;
     destroy_server_conf(conf);
 
     if (pgid > 0) {
@@ -163,8 +191,14 @@ int main(int argc, char *argv[])
                 pgid, strerror(errno));
         }
     }
-    log_msg(LOG_NOTICE, "Stopping ConMan daemon %s (pid %d)",
-        VERSION, (int) getpid());
+    if (workerIndex >= 0) {
+        log_msg(LOG_NOTICE, "Stopping ConMan worker %d (pid %d)",
+            workerIndex, (int) getpid());
+    }
+    else {
+        log_msg(LOG_NOTICE, "Stopping ConMan daemon %s (pid %d)",
+            VERSION, (int) getpid());
+    }
 
     free(environ);
     environ = environ_bak;
@@ -499,6 +533,9 @@ static void display_configuration(server_conf_t *conf)
         }
     }
     list_iterator_destroy(i);
+    if (conf->numWorkers > 0) {
+        n = get_num_worker_consoles();
+    }
 
     fprintf(stderr, "\nStarting ConMan daemon %s (pid %d)\n",
         VERSION, (int) getpid());
@@ -513,6 +550,10 @@ static void display_configuration(server_conf_t *conf)
         fprintf(stderr, " KeepAlive");
         gotOptions++;
     }
+    if (conf->enableLatency) {
+        fprintf(stderr, " Latency");
+        gotOptions++;
+    }
     if (conf->logFileName) {
         fprintf(stderr, " LogFile");
         gotOptions++;
@@ -521,10 +562,22 @@ static void display_configuration(server_conf_t *conf)
         fprintf(stderr, " LoopBack");
         gotOptions++;
     }
+    if (conf->numPipeThreads > 0) {
+        fprintf(stderr, " Pipeline=%d", conf->numPipeThreads);
+        gotOptions++;
+    }
     if (conf->resetCmd) {
         fprintf(stderr, " ResetCmd");
         gotOptions++;
     }
+    if (conf->sinkName) {
+        fprintf(stderr, " Sink");
+        gotOptions++;
+    }
+    if (conf->stallMsecs > 0) {
+        fprintf(stderr, " StallTime=%dms", conf->stallMsecs);
+        gotOptions++;
+    }
     if (conf->syslogFacility >= 0) {
         fprintf(stderr, " SysLog");
         gotOptions++;
@@ -533,10 +586,22 @@ static void display_configuration(server_conf_t *conf)
         fprintf(stderr, " TCP-Wrappers");
         gotOptions++;
     }
+    if (conf->timerSlackMsecs > 0) {
+        fprintf(stderr, " TimerSlack=%dms", conf->timerSlackMsecs);
+        gotOptions++;
+    }
     if (conf->tStampMinutes > 0) {
         fprintf(stderr, " TimeStamp=%dm", conf->tStampMinutes);
         gotOptions++;
     }
+    if (conf->tlsCertFile) {
+        fprintf(stderr, " TLS%s", (conf->enableTLSRequire ? "=Required" : ""));
+        gotOptions++;
+    }
+    if (conf->numWorkers > 0) {
+        fprintf(stderr, " Workers=%d", conf->numWorkers);
+        gotOptions++;
+    }
     if (conf->enableZeroLogs) {
         fprintf(stderr, " ZeroLogs");
         gotOptions++;
@@ -607,6 +672,7 @@ static void timestamp_logfiles(server_conf_t *conf)
     char buf[MAX_LINE];
     int gotLogs = 0;
 
+    begin_mux_phase("timestamp", NULL);
     now = create_long_time_string(0);
     i = list_iterator_create(conf->objs);
     while ((logfile = list_next(i))) {
@@ -614,7 +680,7 @@ static void timestamp_logfiles(server_conf_t *conf)
             continue;
         }
         snprintf(buf, sizeof(buf), "%sConsole [%s] log at %s%s",
-            CONMAN_MSG_PREFIX, logfile->aux.logfile.console->name,
+            CONMAN_MSG_PREFIX, logfile->aux->logfile.console->name,
             now, CONMAN_MSG_SUFFIX);
         strcpy(&buf[sizeof(buf) - 3], "\r\n");
         write_obj_data(logfile, buf, strlen(buf), 1);
@@ -628,6 +694,7 @@ static void timestamp_logfiles(server_conf_t *conf)
     if (gotLogs) {
         schedule_timestamp(conf);
     }
+    end_mux_phase();
     return;
 }
 
@@ -723,6 +790,11 @@ static void open_objs(server_conf_t *conf)
     ListIterator i;
     obj_t *obj;
 
+    init_stall_detector(conf);
+    init_pipeline(conf);
+    init_latency(conf);
+    init_sink(conf);
+
     i = list_iterator_create(conf->objs);
     while ((obj = list_next(i))) {
         if (is_console_obj(obj)) {
@@ -731,6 +803,9 @@ static void open_objs(server_conf_t *conf)
         reopen_obj(obj);
     }
     list_iterator_destroy(i);
+
+    init_reset_cmds(conf);
+    publish_console_registry(conf);
     return;
 }
 
@@ -744,15 +819,20 @@ static void mux_io(server_conf_t *conf)
     int n;
     obj_t *obj;
     int inevent_fd;
+    int pipeline_fd;
     int rvr, rvw;
+    int rv;
 
     assert(conf->tp != NULL);
-    assert(!list_is_empty(conf->objs));
 
     inevent_fd = inevent_get_fd();
     if (inevent_fd >= 0) {
         tpoll_set(conf->tp, inevent_get_fd(), POLLIN);
     }
+    pipeline_fd = get_pipeline_fd();
+    if (pipeline_fd >= 0) {
+        tpoll_set(conf->tp, pipeline_fd, POLLIN);
+    }
     i = list_iterator_create(conf->objs);
 
     while (!done) {
@@ -762,10 +842,27 @@ static void mux_io(server_conf_t *conf)
              *  FIXME: A reconfig should pro'ly resurrect "downed" serial objs
              *    and reset reconnect timers of "downed" telnet objs.
              */
+            begin_mux_phase("reconfig", NULL);
             log_msg(LOG_NOTICE, "Performing reconfig on signal=%d", reconfig);
+            signal_workers(reconfig);
             reopen_logfiles(conf);
+            log_stall_records();
+            log_latency_stats(conf);
+            log_mem_stats(conf);
+            log_sink_stats();
             reconfig = 0;
+            end_mux_phase();
         }
+        /*  POLLOUT interest for objs written to while dispatching I/O is
+         *    updated in a single batch before polling.
+         */
+        apply_obj_events();
+
+        /*  Console state changes made while dispatching I/O are published
+         *    in a single registry snapshot before polling.
+         */
+        refresh_console_registry(conf);
+
         while ((n = tpoll(conf->tp, -1)) < 0) {
             if (errno != EINTR) {
                 log_err(errno, "Unable to multiplex I/O");
@@ -774,16 +871,43 @@ static void mux_io(server_conf_t *conf)
                 break;
             }
         }
+        /*  Each operation performed while dispatching I/O is marked for the
+         *    stall detector so a stall can be attributed to the obj at fault.
+         */
+        begin_mux_phase("dispatch", NULL);
+        defer_obj_events();
         if ((n > 0) &&
                 (tpoll_is_set(conf->tp, conf->ld, POLLIN) > 0)) {
             n--;
+            begin_mux_phase("accept", NULL);
             accept_client(conf);
+            end_mux_phase();
         }
         if ((inevent_fd >= 0) &&
                 (n > 0) &&
                 (tpoll_is_set(conf->tp, inevent_fd, POLLIN) > 0)) {
             n--;
+            begin_mux_phase("inevent", NULL);
             inevent_process();
+            end_mux_phase();
+        }
+        if ((pipeline_fd >= 0) &&
+                (n > 0) &&
+                (tpoll_is_set(conf->tp, pipeline_fd, POLLIN) > 0)) {
+            n--;
+            begin_mux_phase("pipeline", NULL);
+            process_pipeline_results();
+            end_mux_phase();
+        }
+        if ((n > 0) && (conf->numWorkers > 0)) {
+            begin_mux_phase("worker", NULL);
+            n -= dispatch_worker_io(conf);
+            end_mux_phase();
+        }
+        if ((n > 0) && (conf->sinkName != NULL)) {
+            begin_mux_phase("sink", NULL);
+            n -= dispatch_sink_io(conf);
+            end_mux_phase();
         }
         /*  If read_from_obj() or write_to_obj() returns -1,
          *    the obj's buffer has been flushed.  If it is a console obj,
@@ -799,15 +923,26 @@ static void mux_io(server_conf_t *conf)
             if ((rvr > 0) || (rvw > 0)) {
                 n--;
             }
-            if ((rvr > 0) && (read_from_obj(obj) < 0)) {
-                list_delete(i);
-                continue;
+            if (rvr > 0) {
+                begin_mux_phase("read", obj);
+                rv = read_from_obj(obj);
+                end_mux_phase();
+                if (rv < 0) {
+                    list_delete(i);
+                    continue;
+                }
             }
-            if ((rvw > 0) && (write_to_obj(obj) < 0)) {
-                list_delete(i);
-                continue;
+            if (rvw > 0) {
+                begin_mux_phase("write", obj);
+                rv = write_to_obj(obj);
+                end_mux_phase();
+                if (rv < 0) {
+                    list_delete(i);
+                    continue;
+                }
             }
         }
+        end_mux_phase();
     }
     log_msg(LOG_NOTICE, "Exiting on signal=%d", done);
     list_iterator_destroy(i);
@@ -835,7 +970,7 @@ static void open_daemon_logfile(server_conf_t *conf)
     /*  Only truncate logfile at startup if needed.
      */
     if (once) {
-        if (conf->enableZeroLogs) {
+        if (conf->enableZeroLogs && (conf->workerIndex < 0)) {
             mode = "w";
         }
         once = 0;
@@ -881,7 +1016,9 @@ static void open_daemon_logfile(server_conf_t *conf)
             conf->logFileName, strerror(errno));
         goto err;
     }
-    if (get_write_lock(fd) < 0) {
+    /*  The supervisor holds the lock on behalf of its workers.
+     */
+    if ((conf->workerIndex < 0) && (get_write_lock(fd) < 0)) {
         log_msg(LOG_WARNING, "Unable to lock daemon logfile \"%s\"",
             conf->logFileName);
         goto err;
@@ -975,6 +1112,11 @@ static void accept_client(server_conf_t *conf)
     }
     DPRINTF((5, "Accepted new client on fd=%d.\n", sd));
 
+    /*  Prevent the fd from leaking into worker procs respawned while the
+     *    request is being processed.
+     */
+    set_fd_closed_on_exec(sd);
+
     /*  While the listen fd is non-blocking, new fds that are accept()d from
      *    it can be either blocking or non-blocking depending on the platform.
      *  The current model spawns a thread to handle a new client with
@@ -998,6 +1140,8 @@ static void accept_client(server_conf_t *conf)
     }
     args->sd = sd;
     args->conf = conf;
+    args->req = NULL;
+    args->request = NULL;
 
     if ((rc = pthread_create(&tid, NULL,
       (PthreadFunc) process_client, args)) != 0) {
@@ -33,15 +33,21 @@
 #  include <ipmiconsole.h>
 #endif /* HAVE_IPMICONSOLE_H */
 
+#if WITH_ZLIB
+#  include <zlib.h>
+#endif /* WITH_ZLIB */
+
 #include <sys/types.h>                  /* include before in.h for bsd */
 #include <netinet/in.h>                 /* for struct sockaddr_in            */
 #include <pthread.h>                    /* for pthread_mutex_t               */
+#include <regex.h>                      /* for regex_t                       */
 #include <stdio.h>                      /* for FILE                          */
 #include <termios.h>                    /* for struct termios, speed_t       */
 #include <time.h>                       /* for time_t                        */
 #include <unistd.h>                     /* for pid_t                         */
 #include "common.h"
 #include "list.h"
+#include "mux.h"
 #include "tpoll.h"
 
 
@@ -49,13 +55,37 @@
 #define DEFAULT_LOGOPT_SANITIZE         0
 #define DEFAULT_LOGOPT_TIMESTAMP        0
 
+#define DEFAULT_EXEC_TIMEOUT            60
+
+#define DEFAULT_RESET_BATCH             1
+#define DEFAULT_RESET_MAX               32
+
 #define DEFAULT_SEROPT_BPS              B9600
 #define DEFAULT_SEROPT_DATABITS         8
 #define DEFAULT_SEROPT_PARITY           0
 #define DEFAULT_SEROPT_STOPBITS         1
 
+#define COALESCE_FLUSH_MSECS            1000
+#define COALESCE_HASH_SIZE              1024
+#define COALESCE_LINE_SIZE              MAX_LINE
+#define COALESCE_MAX_RESULTS            1024
+
+#define CONSOLE_HISTORY_LINES           512
+#define CONSOLE_HISTORY_SIZE            (OBJ_BUF_SIZE / 2)
+
+#define EXEC_MAX_RESULTS                1024
+#define EXEC_WINDOW_SIZE                MAX_BUF_SIZE
+
+#define HELPER_MAX_TIMEOUT              1800
+#define HELPER_MIN_TIMEOUT              15
+
 #define MIN_CONNECT_SECS                60
 
+#define MUX_CONNECT_TIMEOUT             300
+#define MUX_MAX_FRAME_LEN               MAX_BUF_SIZE
+#define MUX_MAX_TIMEOUT                 1800
+#define MUX_MIN_TIMEOUT                 15
+
 #if WITH_FREEIPMI
 #define IPMI_ENGINE_CONSOLES_PER_THREAD 128
 #define IPMI_MAX_USER_LEN               IPMI_MAX_USER_NAME_LENGTH
@@ -66,19 +96,64 @@
 #define IPMI_MIN_TIMEOUT                60
 #endif /* WITH_FREEIPMI */
 
+#define LATENCY_HIST_BINS               240
+#define LATENCY_HIST_SUB_BINS           8
+#define LATENCY_MAX_MARKS               16
+#define LATENCY_MAX_TYPES               10
+
+#define PIPE_LANE_MAX_BYTES             (OBJ_BUF_SIZE * 16)
+#define PIPE_LANE_THROTTLE_BYTES        (OBJ_BUF_SIZE * 4)
+#define PIPE_MAX_THREADS                64
+
 #define PROCESS_MAX_TIMEOUT             1800
 #define PROCESS_MIN_TIMEOUT             60
 
+#define RESET_CMD_BATCH_LEN             (MAX_BUF_SIZE / 2)
+#define RESET_CMD_POLL_MSECS            200
 #define RESET_CMD_TIMEOUT               60
 
 #define RESOLVE_RETRY_TIMEOUT           1800
 
+#define SCREEN_COLS                     80
+#define SCREEN_MAX_PARAMS               16
+#define SCREEN_ROWS                     24
+
+#define SINK_BUF_SIZE                   (4 * 1024 * 1024)
+#define SINK_CHUNK_SIZE                 4096
+#define SINK_LOG_INTERVAL               60
+#define SINK_MAX_TIMEOUT                60
+#define SINK_MIN_TIMEOUT                1
+#define SINK_RECORD_SIZE                (8 * SINK_CHUNK_SIZE)
+
+#define STALL_CHECK_MSECS               250
+#define STALL_LOG_INTERVAL              10
+#define STALL_MAX_DEPTH                 8
+#define STALL_NAME_LEN                  64
+#define STALL_RING_SIZE                 32
+
 #define TELNET_MAX_TIMEOUT              1800
 #define TELNET_MIN_TIMEOUT              15
+#define TELNET_PROBE_WHEEL_SIZE         64
+
+#if WITH_OPENSSL
+#define TLS_BUF_SIZE                    (OBJ_BUF_SIZE / 2)
+#define TLS_RECORD_HANDSHAKE            0x16
+#define TLS_SESSION_ID_CONTEXT          "conmand"
+#endif /* WITH_OPENSSL */
 
 #define UNIXSOCK_MAX_TIMEOUT            60
 #define UNIXSOCK_MIN_TIMEOUT            1
 
+#define WORKER_MAX_PROCS                256
+#define WORKER_MAX_TIMEOUT              60
+#define WORKER_MIN_TIMEOUT              1
+#define WORKER_MSG_SIZE                 (MAX_SOCK_LINE + (4 * MAX_LINE))
+
+#if WITH_ZLIB
+#define ZLIB_BUF_SIZE                   (OBJ_BUF_SIZE + 1024)
+#define ZLIB_COMPRESS_LEVEL             Z_DEFAULT_COMPRESSION
+#endif /* WITH_ZLIB */
+
 
 enum obj_type {                         /* type of auxiliary obj             */
     CONMAN_OBJ_CLIENT   = 0x01,
@@ -89,12 +164,126 @@ enum obj_type {                         /* type of auxiliary obj             */
     CONMAN_OBJ_UNIXSOCK = 0x20,
     CONMAN_OBJ_IPMI     = 0x40,
     CONMAN_OBJ_TEST     = 0x80,
+    CONMAN_OBJ_HELPER   = 0x100,
+    CONMAN_OBJ_MUX      = 0x200,
     CONMAN_OBJ_LAST_ENTRY
 };
 
+enum sink_event {                       /* console event written to sink     */
+    CONMAN_SINK_NONE,
+    CONMAN_SINK_CONNECT,
+    CONMAN_SINK_DISCONNECT
+};
+
+enum console_state {                    /* console state in registry         */
+    CONMAN_CONSOLE_UNKNOWN,
+    CONMAN_CONSOLE_DOWN,
+    CONMAN_CONSOLE_UP
+};
+
+#if WITH_ZLIB
+typedef struct zlib_obj {               /* CLIENT COMPRESSION DATA:          */
+    z_stream         strm;              /*  deflate stream state             */
+    unsigned char    buf[ZLIB_BUF_SIZE];/*  deflated data to be written      */
+    unsigned char   *bufInPtr;          /*  ptr for data deflated in to buf  */
+    unsigned char   *bufOutPtr;         /*  ptr for data written out to fd   */
+    unsigned         gotFlush:1;        /*  true if sync flush is incomplete */
+} zlib_obj_t;
+#endif /* WITH_ZLIB */
+
+#if WITH_OPENSSL
+typedef struct tls_obj {                /* CLIENT ENCRYPTION DATA:           */
+    unsigned char    buf[TLS_BUF_SIZE]; /*  plaintext staged for SSL_write() */
+    unsigned char   *bufInPtr;          /*  ptr for data copied in to buf    */
+    unsigned char   *bufOutPtr;         /*  ptr for data encrypted out to fd */
+    unsigned         isKtlsRecv:1;      /*  true if kernel decrypts input    */
+    unsigned         isKtlsSend:1;      /*  true if kernel encrypts output   */
+} tls_obj_t;
+#endif /* WITH_OPENSSL */
+
+typedef struct coalesce_group {        /* COALESCED OUTPUT LINE:            */
+    struct coalesce_group *next;        /*  next group in hash chain         */
+    unsigned         hash;              /*  hash of line                     */
+    int              len;               /*  length of line                   */
+    int              count;             /*  num consoles having output line  */
+    unsigned char   *members;           /*  bitmap of member indices         */
+    char            *line;              /*  line of output (not NUL-term'd)  */
+} coalesce_group_t;
+
+typedef struct coalesce_member {        /* COALESCED MONITOR CONSOLE:        */
+    struct coalesce *co;                /*  monitor to which member belongs  */
+    struct base_obj *console;           /*  console obj being monitored      */
+    int              index;             /*  index into bitmap & members list */
+    int              prefixLen;         /*  len of name before trailing int  */
+    int              width;             /*  num digits in trailing int, or 0 */
+    unsigned long    num;               /*  value of trailing int            */
+    int              len;               /*  num bytes of partial line in buf */
+    unsigned         isIdle:1;          /*  true if no output since flush    */
+    char             buf[COALESCE_LINE_SIZE];     /* partial line of output  */
+} coalesce_member_t;
+
+typedef struct coalesce {               /* COALESCED MONITOR:                */
+    struct base_obj *client;            /*  client obj receiving output      */
+    coalesce_member_t *members;         /*  array of members in name order   */
+    int              numMembers;        /*  number of members                */
+    coalesce_group_t *hash[COALESCE_HASH_SIZE];   /* groups hashed by line   */
+    List             groups;            /*  groups in order of first output  */
+    List             results;           /*  result strs awaiting buf space   */
+    char            *set;               /*  buf for formatting console sets  */
+    int              setLen;            /*  size of set buf                  */
+    int              timer;             /*  timer id for starting & flushing */
+    int              numDropped;        /*  num results dropped due to space */
+    unsigned         isStarted:1;       /*  true if members have been linked */
+} coalesce_t;
+
+typedef struct exec_step {              /* EXECUTE SCRIPT STEP:              */
+    step_type_t      type;              /*  type of step                     */
+    char            *str;               /*  unescaped send str or expect re  */
+    int              len;               /*  length of send str               */
+    int              val;               /*  capture flag or timeout secs     */
+    regex_t          regex;             /*  compiled expect regex            */
+} exec_step_t;
+
+typedef struct exec_job {               /* EXECUTE SCRIPT JOB:               */
+    struct base_obj *client;            /*  client obj receiving results     */
+    exec_step_t     *steps;             /*  array of script steps            */
+    int              numSteps;          /*  number of script steps           */
+    List             runs;              /*  list of per-console exec_run_t's */
+    List             results;           /*  result strs awaiting buf space   */
+    int              timer;             /*  timer id for starting runs       */
+    int              numDone;           /*  num runs completed or failed     */
+    int              numFailed;         /*  num runs failed                  */
+    int              numDropped;        /*  num captured lines dropped       */
+    unsigned         isStarted:1;       /*  true if runs have been started   */
+    unsigned         isFinished:1;      /*  true if all results were written */
+} exec_job_t;
+
+typedef struct exec_run {               /* EXECUTE SCRIPT RUN (per console): */
+    exec_job_t      *job;               /*  job to which this run belongs    */
+    struct base_obj *console;           /*  console obj running the script   */
+    int              step;              /*  index of current script step     */
+    int              timeout;           /*  secs to wait on expect, or 0     */
+    int              timer;             /*  timer id for expect timeout      */
+    int              len;               /*  num bytes of output in buf       */
+    unsigned         isCapturing:1;     /*  true if returning matched output */
+    unsigned         isDone:1;          /*  true if run completed or failed  */
+    char             buf[EXEC_WINDOW_SIZE + 1];   /* NUL-term'd output window */
+} exec_run_t;
+
 typedef struct client_obj {             /* CLIENT AUX OBJ DATA:              */
     req_t           *req;               /*  client request info              */
+#if WITH_ZLIB
+    zlib_obj_t      *zlib;              /*  deflate state if compressing     */
+#endif /* WITH_ZLIB */
+#if WITH_OPENSSL
+    tls_obj_t       *tls;               /*  tls state if encrypting, or NULL */
+#endif /* WITH_OPENSSL */
+    coalesce_t      *coalesce;          /*  coalesced monitor, or NULL       */
+    exec_job_t      *exec;              /*  script job if executing, or NULL */
     time_t           timeLastRead;      /*  time last data was read from fd  */
+    int              frameLeft;         /*  bytes left in frame being rcvd   */
+    int              frameHdrLen;       /*  bytes of frame hdr rcvd thus far */
+    unsigned char    frameHdr[CONMAN_FRAME_HDR_LEN]; /*  frame hdr rcvd  */
     unsigned         gotEscape:1;       /*  true if last char rcvd was esc   */
     unsigned         gotSuspend:1;      /*  true if suspending client output */
 } client_obj_t;
@@ -112,15 +301,85 @@ typedef enum logfile_line_state {       /* log CR/LF newline state (2 bits)  */
     CONMAN_LOG_LINE_LF
 } log_line_state_t;
 
+typedef enum filter_ansi_state {        /* ANSI escape seq state (3 bits)    */
+    CONMAN_ANSI_NONE,
+    CONMAN_ANSI_ESC,                    /*  got ESC                          */
+    CONMAN_ANSI_INTER,                  /*  got ESC + intermediate byte(s)   */
+    CONMAN_ANSI_CSI,                    /*  got ESC [                        */
+    CONMAN_ANSI_STR,                    /*  got ESC ] (or other string seq)  */
+    CONMAN_ANSI_STR_ESC                 /*  got ESC within a string seq      */
+} filter_ansi_state_t;
+
+typedef int (*filter_flush_f)(void *arg, const void *buf, int len);
+
+typedef struct filter {                 /* OUTPUT FILTER STATE:              */
+    int (*process)(struct filter *, const unsigned char *, int,
+        filter_flush_f, void *);        /*  variant specialized for opts     */
+    unsigned         opts:4;            /*  CONMAN_FILTER_* options          */
+    unsigned         lineState:2;       /*  log_line_state_t CR/LF state     */
+    unsigned         ansiState:3;       /*  filter_ansi_state_t esc state    */
+} filter_t;
+
+typedef struct latency latency_t;       /* INGEST-TO-DRAIN LATENCY STATE     */
+
+typedef struct ingest {                 /* INGESTED CHUNK TIMESTAMP:         */
+    unsigned long    usecs;             /*  monotonic usecs when chunk read  */
+    int              type;              /*  console type index, -1 if unset  */
+} ingest_t;
+
+typedef struct pipe_lane pipe_lane_t;   /* POST-PROCESSING PIPELINE LANE     */
+
+typedef int (*pipe_stage_f)(void *arg, const void *src, int len, int isInfo,
+    filter_flush_f flush, void *flushArg);
+
 typedef struct logfile_obj {            /* LOGFILE AUX OBJ DATA:             */
     struct base_obj *console;           /*  con obj ref for name expansion   */
     char            *fmtName;           /*  name with conversion specifiers  */
     logopt_t         opts;              /*  local options                    */
-    unsigned         gotProcessing:1;   /*  true if input processing req'd   */
+    filter_t         filter;            /*  output processing state          */
+    pipe_lane_t     *lane;              /*  pipeline lane, or NULL if inline */
     unsigned         gotTruncate:1;     /*  true if ZeroLogs is enabled      */
-    unsigned         lineState:2;       /*  log_line_state_t CR/LF state     */
 } logfile_obj_t;
 
+typedef enum helper_connect_state {     /* helper connection state (1 bit)   */
+    CONMAN_HELPER_DOWN,
+    CONMAN_HELPER_UP
+} helper_state_t;
+
+typedef struct helper_obj {             /* HELPER AUX OBJ DATA:              */
+    char           **argv;              /*  NULL-term'd ary of ptrs to strs  */
+    char            *prog;              /*  reference to basename of argv[0] */
+    struct base_obj **sessions;         /*  ary of mux objs indexed by id    */
+    int              numSessions;       /*  num of mux objs served by helper */
+    int              timer;             /*  timer id for repeated attempts   */
+    int              delay;             /*  secs 'til next reconnect attempt */
+    pid_t            pid;               /*  pid of forked process            */
+    time_t           tStart;            /*  time at which process was exec'd */
+    char            *msg;               /*  buf for CLOSE frame reason str   */
+    int              msgLen;            /*  num bytes of reason str in msg   */
+    int              hdrLen;            /*  num bytes of frame hdr read      */
+    int              numLeft;           /*  num bytes of frame payload left  */
+    unsigned char    hdr[MUX_HDR_LEN];  /*  hdr of frame being read          */
+    unsigned         state:1;           /*  helper_state_t conn state        */
+} helper_obj_t;
+
+typedef enum mux_connect_state {        /* mux session state (2 bits)        */
+    CONMAN_MUX_DOWN,
+    CONMAN_MUX_PENDING,
+    CONMAN_MUX_UP
+} mux_state_t;
+
+typedef struct mux_obj {                /* MUX AUX OBJ DATA:                 */
+    struct base_obj *helper;            /*  helper obj serving this session  */
+    char           **argv;              /*  NULL-term'd ary of session args  */
+    struct base_obj *logfile;           /*  log obj ref for console replay   */
+    int              id;                /*  session id within helper         */
+    int              timer;             /*  timer id for reopen or timeout   */
+    int              delay;             /*  secs 'til next reopen attempt    */
+    time_t           tStart;            /*  time at which session was opened */
+    unsigned         state:2;           /*  mux_state_t session state        */
+} mux_obj_t;
+
 typedef enum process_connect_state {    /* process connection state (1 bit)  */
     CONMAN_PROCESS_DOWN,
     CONMAN_PROCESS_UP
@@ -158,15 +417,29 @@ typedef enum telnet_connect_state {     /* state of n/w connection (2 bits)  */
     CONMAN_TELNET_UP
 } telnet_state_t;
 
+typedef struct telnet_opt {             /* TELNET OBJ OPTIONS:               */
+    int              probeSecs;         /*  idle secs before probing, or 0   */
+    int              replySecs;         /*  secs to await AYT reply, or 0    */
+    int              userTimeout;       /*  TCP_USER_TIMEOUT secs, or 0      */
+    int              keepIdle;          /*  TCP_KEEPIDLE secs, or 0          */
+    int              keepIntvl;         /*  TCP_KEEPINTVL secs, or 0         */
+    int              keepCount;         /*  TCP_KEEPCNT probes, or 0         */
+} telnetopt_t;
+
 typedef struct telnet_obj {             /* TELNET AUX OBJ DATA:              */
     char            *host;              /*  remote telnetd host name (or ip) */
     int              port;              /*  remote telnetd port number       */
+    telnetopt_t      opts;              /*  telnet obj options               */
     struct base_obj *logfile;           /*  log obj ref for console replay   */
     int              timer;             /*  timer id for reconnects          */
     int              delay;             /*  secs 'til next reconnect attempt */
     int              iac;               /*  -1, or last char if in IAC seq   */
+    time_t           timeLastRead;      /*  time last data was read from fd  */
+    time_t           timeProbe;         /*  time of unanswered probe, or 0   */
+    time_t           timeCheck;         /*  time of next liveness check      */
     unsigned         state:2;           /*  telnet_state_t of n/w connection */
     unsigned         enableKeepAlive:1; /*  true if using TCP keep-alive     */
+    unsigned         gotProbeWheel:1;   /*  true if on liveness probe wheel  */
 } telnet_obj_t;
 
 typedef enum unixsock_connect_state {   /* socket connection state (1 bit)   */
@@ -232,7 +505,9 @@ typedef struct test_obj {               /* TEST AUX OBJ DATA:                */
 
 typedef union aux_obj {
     client_obj_t     client;
+    helper_obj_t     helper;
     logfile_obj_t    logfile;
+    mux_obj_t        mux;
     process_obj_t    process;
     serial_obj_t     serial;
     telnet_obj_t     telnet;
@@ -243,24 +518,88 @@ typedef union aux_obj {
     test_obj_t       test;
 } aux_obj_t;
 
+typedef enum screen_state {              /* VT100 escape seq parser state     */
+    CONMAN_SCREEN_NORMAL,
+    CONMAN_SCREEN_ESC,
+    CONMAN_SCREEN_CSI,
+    CONMAN_SCREEN_OSC,
+    CONMAN_SCREEN_OSC_ESC,
+    CONMAN_SCREEN_SKIP
+} screen_state_t;
+
+typedef struct screen {                 /* CONSOLE SCREEN MODEL:             */
+    unsigned char    chars[SCREEN_ROWS][SCREEN_COLS];   /* char grid         */
+    unsigned short   attrs[SCREEN_ROWS][SCREEN_COLS];   /* SGR attr grid     */
+    int              row;               /*  cursor row                       */
+    int              col;               /*  cursor column                    */
+    int              top;               /*  first row of scrolling region    */
+    int              bottom;            /*  last row of scrolling region     */
+    int              savedRow;          /*  cursor row saved by DECSC        */
+    int              savedCol;          /*  cursor column saved by DECSC     */
+    unsigned short   attr;              /*  current SGR attributes           */
+    unsigned short   savedAttr;         /*  SGR attributes saved by DECSC    */
+    screen_state_t   state;             /*  escape seq parser state          */
+    int              numParams;         /*  num CSI params parsed            */
+    int              params[SCREEN_MAX_PARAMS];   /* CSI params              */
+    unsigned         isPrivate:1;       /*  true if CSI has private marker   */
+    unsigned         isWrapPending:1;   /*  true if next char wraps the line */
+} screen_t;
+
+typedef struct history {                /* CONSOLE OUTPUT HISTORY:           */
+    unsigned char   *buf;               /*  circular-buf, or NULL until used */
+    unsigned long long offset;          /*  stream offset of next byte read  */
+    unsigned        *lines;             /*  ring of line starts, or NULL     */
+    unsigned long long numLines;        /*  num line starts ever indexed     */
+    List             filters;           /*  client output filters (filter_t) */
+    List             coalesce;          /*  coalesced monitor members        */
+    List             execs;             /*  script runs matching output      */
+    screen_t        *screen;            /*  screen model, or NULL until used */
+    unsigned         enableScreen:1;    /*  true if modeling console screen  */
+    pthread_mutex_t  lock;              /*  lock protecting history & links  */
+} history_t;
+
+/*  The fields examined on each pass of mux_io() and the obj state checks are
+ *    grouped at the start of the obj to share a cache line.  The circular-buf
+ *    and auxiliary obj data are allocated separately, and the fields that are
+ *    only touched while servicing the obj (buf lock, reset cmd) are placed at
+ *    the end; otherwise, scanning the master objs list strides across each
+ *    obj's 16KB buf and ~100-byte aux union.
+ */
 typedef struct base_obj {               /* BASE OBJ:                         */
-    char            *name;              /*  obj name                         */
     int              fd;                /*  file descriptor                  */
-    unsigned char    buf[OBJ_BUF_SIZE]; /*  circular-buf to be written to fd */
+    unsigned         type;              /*  enum obj_type of auxiliary obj   */
+    unsigned         gotBufWrap:1;      /*  true if circular-buf has wrapped */
+    unsigned         gotEOF:1;          /*  true if obj got EOF on last read */
+    unsigned         gotPollOut:1;      /*  true if POLLOUT update is queued */
+    unsigned         gotResetQueued:1;  /*  true if console reset is queued  */
     unsigned char   *bufInPtr;          /*  ptr for data written in to buf   */
     unsigned char   *bufOutPtr;         /*  ptr for data written out to fd   */
-    pthread_mutex_t  bufLock;           /*  lock protecting access to buf    */
     List             readers;           /*  list of objs that read from me   */
     List             writers;           /*  list of objs that write to me    */
+    history_t       *history;           /*  console output history, or NULL  */
+    latency_t       *latency;           /*  client/logfile latency, or NULL  */
+    char            *name;              /*  obj name                         */
+    unsigned char   *buf;               /*  circular-buf to be written to fd */
+    aux_obj_t       *aux;               /*  auxiliary obj data union         */
     char            *resetCmdRef;       /*  console reset cmd string ref     */
     pid_t            resetCmdPid;       /*  console reset cmd active pid     */
-    int              resetCmdTimer;     /*  console reset cmd timer id       */
-    unsigned         type;              /*  enum obj_type of auxiliary obj   */
-    unsigned         gotBufWrap:1;      /*  true if circular-buf has wrapped */
-    unsigned         gotEOF:1;          /*  true if obj got EOF on last read */
-    aux_obj_t        aux;               /*  auxiliary obj data union         */
+    pthread_mutex_t  bufLock;           /*  lock protecting access to buf    */
 } obj_t;
 
+typedef struct registry_entry {         /* CONSOLE REGISTRY ENTRY:           */
+    char            *name;              /*  console name (retained til exit) */
+    unsigned         type;              /*  enum obj_type, or 0 if remote    */
+    unsigned         state;             /*  enum console_state at publishing */
+    obj_t           *console;           /*  console obj, or NULL if remote   */
+} registry_entry_t;
+
+typedef struct registry {               /* CONSOLE REGISTRY SNAPSHOT:        */
+    int              refCount;          /*  num refs held (under lock)       */
+    unsigned         generation;        /*  num snapshots published before   */
+    int              numConsoles;       /*  num entries in consoles array    */
+    registry_entry_t *consoles;         /* entries sorted by console name   */
+} registry_t;
+
 typedef struct server_conf {
     char            *confFileName;      /* configuration file name           */
     char            *coreDumpDir;       /* dir where core dumps are written  */
@@ -272,10 +611,24 @@ typedef struct server_conf {
     FILE            *logFilePtr;        /* msg log file ptr, !closed at exit */
     int              logFileLevel;      /* level at which to log msg to file */
     int              numOpenFiles;      /* rlimit for number of open files   */
+    int              numPipeThreads;    /* num pipeline threads, 0 if inline */
+    int              numWorkers;        /* num worker procs, 0 if disabled   */
+    int              workerIndex;       /* index of this worker proc, or -1  */
+    int              workerFd;          /* worker control socket, or -1      */
     char            *pidFileName;       /* file to which pid is written      */
+    char            *sinkName;          /* sink FIFO or socket, or NULL      */
     char            *resetCmd;          /* cmd to invoke for reset esc-seq   */
+    char            *tlsCertFile;       /* TLS certificate chain file (PEM)  */
+    char            *tlsKeyFile;        /* TLS private key file (PEM)        */
+#if WITH_OPENSSL
+    SSL_CTX         *tlsCtx;            /* TLS context, or NULL if disabled  */
+#endif /* WITH_OPENSSL */
+    int              resetBatch;        /* max consoles per ResetCmd batch   */
+    int              resetMax;          /* max concurrent ResetCmd processes */
+    int              stallMsecs;        /* msecs mux thread busy for a stall */
     int              syslogFacility;    /* syslog facility or -1 if disabled */
     int              throwSignal;       /* signal num to send running daemon */
+    int              timerSlackMsecs;   /* msecs timers may be coalesced by  */
     int              tStampMinutes;     /* minutes 'tween logfile timestamps */
     time_t           tStampNext;        /* time next stamp written to logs   */
     int              fd;                /* configuration file descriptor     */
@@ -286,6 +639,7 @@ typedef struct server_conf {
     char            *globalLogName;     /* global log name (must contain &)  */
     logopt_t         globalLogOpts;     /* global opts for logfile objects   */
     seropt_t         globalSerOpts;     /* global opts for serial objects    */
+    telnetopt_t      globalTelnetOpts;  /* global opts for telnet objects    */
 #if WITH_FREEIPMI
     ipmiopt_t        globalIpmiOpts;    /* global opts for ipmi objects      */
     int              numIpmiObjs;       /* number of ipmi consoles in config */
@@ -293,8 +647,11 @@ typedef struct server_conf {
     test_opt_t       globalTestOpts;    /* global opts for test objs         */
     unsigned         enableCoreDump:1;  /* true if core dumps are enabled    */
     unsigned         enableKeepAlive:1; /* true if using TCP keep-alive      */
+    unsigned         enableLatency:1;   /* true if recording output latency  */
     unsigned         enableLoopBack:1;  /* true if only listening on loopback*/
+    unsigned         enableScreen:1;    /* true if modeling console screens  */
     unsigned         enableTCPWrap:1;   /* true if TCP-Wrappers is enabled   */
+    unsigned         enableTLSRequire:1;/* true if plaintext clients refused */
     unsigned         enableVerbose:1;   /* true if verbose output requested  */
     unsigned         enableZeroLogs:1;  /* true if console logs are zero'd   */
     unsigned         enableForeground:1;/* true if daemon should not fork    */
@@ -303,6 +660,8 @@ typedef struct server_conf {
 typedef struct client_args {
     int              sd;                /* socket descriptor of new client   */
     server_conf_t   *conf;              /* server's configuration            */
+    req_t           *req;               /* req handed off by supervisor      */
+    char            *request;           /* request line from supervisor      */
 } client_arg_t;
 
 
@@ -326,6 +685,11 @@ typedef struct client_args {
  *  - readers list is empty
  *  - writers list contains exactly one console object
  *
+ *  HELPER objects:
+ *  - readers and writers lists are empty; instead, its MUX console objects
+ *    write input into its circular write-buffer as frames, and the frames
+ *    read from its file descriptor are demultiplexed to those objects
+ *
  *  R/O CLIENT objects:
  *  - readers list is empty
  *  - writers list contains exactly one console object
@@ -348,11 +712,14 @@ typedef struct client_args {
     CONMAN_OBJ_TELNET   |     \
     CONMAN_OBJ_UNIXSOCK |     \
     CONMAN_OBJ_IPMI     |     \
-    CONMAN_OBJ_TEST           \
+    CONMAN_OBJ_TEST     |     \
+    CONMAN_OBJ_MUX            \
   )
 #define is_client_obj(OBJ)   (OBJ->type == CONMAN_OBJ_CLIENT)
+#define is_helper_obj(OBJ)   (OBJ->type == CONMAN_OBJ_HELPER)
 #define is_ipmi_obj(OBJ)     (OBJ->type == CONMAN_OBJ_IPMI)
 #define is_logfile_obj(OBJ)  (OBJ->type == CONMAN_OBJ_LOGFILE)
+#define is_mux_obj(OBJ)      (OBJ->type == CONMAN_OBJ_MUX)
 #define is_process_obj(OBJ)  (OBJ->type == CONMAN_OBJ_PROCESS)
 #define is_serial_obj(OBJ)   (OBJ->type == CONMAN_OBJ_SERIAL)
 #define is_telnet_obj(OBJ)   (OBJ->type == CONMAN_OBJ_TELNET)
@@ -372,10 +739,74 @@ void process_cmdline(server_conf_t *conf, int argc, char *argv[]);
 void process_config(server_conf_t *conf);
 
 
+/*  server-coalesce.c
+ */
+coalesce_t * create_coalesce(req_t *req);
+
+void destroy_coalesce(coalesce_t *co);
+
+void start_coalesce(coalesce_t *co, obj_t *client);
+
+void cancel_coalesce(coalesce_t *co);
+
+void write_coalesce_data(obj_t *console, const void *src, int len);
+
+void flush_coalesce_results(coalesce_t *co);
+
+
 /*  server-esc.c
  */
 int process_client_escapes(obj_t *client, void *src, int len);
 
+int process_client_frames(obj_t *client, void *src, int len);
+
+
+/*  server-exec.c
+ */
+exec_job_t * create_exec_job(req_t *req, char *errbuf, int errlen);
+
+void destroy_exec_job(exec_job_t *job);
+
+void start_exec_job(exec_job_t *job, obj_t *client);
+
+void cancel_exec_job(exec_job_t *job);
+
+void write_exec_data(obj_t *console, const void *src, int len);
+
+void flush_exec_results(exec_job_t *job);
+
+
+/*  server-filter.c
+ */
+void init_filter(filter_t *filter, unsigned opts);
+
+int filter_data(filter_t *filter, const void *src, int len,
+    filter_flush_f flush, void *arg);
+
+int write_filtered_obj_data(obj_t *obj, filter_t *filter,
+    const void *src, int len);
+
+void write_filtered_readers_data(obj_t *console, const void *src, int len);
+
+
+/*  server-history.c
+ */
+history_t * create_history(void);
+
+void destroy_history(history_t *hist);
+
+void write_history_data(history_t *hist, const void *src, int len);
+
+unsigned long long find_history_start(history_t *hist);
+
+unsigned long long find_history_offset(history_t *hist,
+    unsigned long long offset);
+
+unsigned long long find_history_lines(history_t *hist, int n);
+
+int write_history_to_obj(history_t *hist, unsigned long long *offset_p,
+    obj_t *dst);
+
 
 /* server-ipmi.c
  */
@@ -402,6 +833,33 @@ int send_ipmi_break(obj_t *ipmi);
 #endif /* WITH_FREEIPMI */
 
 
+/*  server-latency.c
+ */
+void init_latency(server_conf_t *conf);
+
+latency_t * create_latency(void);
+
+void destroy_latency(latency_t *lat);
+
+int get_latency_mem_size(void);
+
+void begin_ingest(obj_t *console);
+
+void end_ingest(void);
+
+void get_ingest(ingest_t *ingest);
+
+void set_ingest(const ingest_t *ingest);
+
+void mark_latency(obj_t *obj, int len);
+
+void record_latency(obj_t *obj, int len, int isLost);
+
+void log_latency_stats(server_conf_t *conf);
+
+void log_obj_latency(obj_t *obj);
+
+
 /*  server-logfile.c
  */
 int parse_logfile_opts(logopt_t *opts, const char *str,
@@ -416,13 +874,21 @@ obj_t * get_console_logfile_obj(obj_t *console);
 
 int write_log_data(obj_t *log, const void *src, int len);
 
+int enable_logfile_pipeline(obj_t *logfile);
+
+
+/*  server-mem.c
+ */
+void log_mem_stats(server_conf_t *conf);
+
 
 /*  server-obj.c
  */
 obj_t * create_obj(server_conf_t *conf, char *name,
     int fd, enum obj_type type);
 
-obj_t * create_client_obj(server_conf_t *conf, req_t *req);
+obj_t * create_client_obj(server_conf_t *conf, req_t *req,
+    exec_job_t *job, coalesce_t *co);
 
 void destroy_obj(obj_t *obj);
 
@@ -432,10 +898,15 @@ int format_obj_string(char *buf, int buflen, obj_t *obj, const char *fmt);
 
 int compare_objs(obj_t *obj1, obj_t *obj2);
 
+int compare_obj_names(const char *name1, const char *name2);
+
 int find_obj(obj_t *obj, obj_t *key);
 
 int write_notify_msg(obj_t *console, int priority, char *fmt, ...);
 
+int write_notify_event(obj_t *console, enum sink_event event,
+    int priority, char *fmt, ...);
+
 void notify_console_objs(obj_t *console, char *msg);
 
 void link_objs(obj_t *src, obj_t *dst);
@@ -448,11 +919,58 @@ int shutdown_obj(obj_t *obj);
 
 int read_from_obj(obj_t *obj);
 
+void write_readers_data(obj_t *obj, const void *src, int len);
+
 int write_obj_data(obj_t *obj, const void *src, int len, int isInfo);
 
+int get_obj_buf_avail(obj_t *obj);
+
+void defer_obj_events(void);
+
+void apply_obj_events(void);
+
 int write_to_obj(obj_t *obj);
 
 
+/*  server-mux.c
+ */
+int is_mux_dev(const char *dev, const char *cwd,
+    const char *exec_path, char **path_ref);
+
+obj_t * create_mux_obj(server_conf_t *conf, char *name, char *path,
+    List args, char *errbuf, int errlen);
+
+int open_helper_obj(obj_t *helper);
+
+int open_mux_obj(obj_t *mux);
+
+int process_helper_frames(obj_t *helper, const void *src, int len);
+
+int write_mux_data(obj_t *mux, const void *src, int len);
+
+int send_mux_break(obj_t *mux);
+
+
+/*  server-pipe.c
+ */
+void init_pipeline(server_conf_t *conf);
+
+int get_pipeline_fd(void);
+
+pipe_lane_t * create_pipe_lane(obj_t *console, obj_t *dst,
+    pipe_stage_f stage, filter_flush_f deliver, void *arg);
+
+void destroy_pipe_lane(pipe_lane_t *lane);
+
+int submit_pipe_data(pipe_lane_t *lane, const void *src, int len, int isInfo);
+
+int throttle_pipe_lane(pipe_lane_t *lane);
+
+void process_pipeline_results(void);
+
+void flush_pipe_lane(pipe_lane_t *lane);
+
+
 /*  server-process.c
  */
 int is_process_dev(const char *dev, const char *cwd,
@@ -464,6 +982,30 @@ obj_t * create_process_obj(server_conf_t *conf, char *name, List args,
 int open_process_obj(obj_t *process);
 
 
+/*  server-screen.c
+ */
+void destroy_screen(screen_t *screen);
+
+void write_screen_data(history_t *hist, const void *src, int len);
+
+int write_screen_to_obj(history_t *hist, obj_t *dst);
+
+
+/*  server-sink.c
+ */
+void init_sink(server_conf_t *conf);
+
+void write_sink_data(obj_t *console, const void *src, int len);
+
+void write_sink_event(obj_t *console, enum sink_event event, const char *msg);
+
+int dispatch_sink_io(server_conf_t *conf);
+
+void log_sink_stats(void);
+
+int get_sink_mem_size(void);
+
+
 /*  server-serial.c
  */
 int is_serial_dev(const char *dev, const char *cwd, char **path_ref);
@@ -479,17 +1021,55 @@ obj_t * create_serial_obj(server_conf_t *conf, char *name,
 int open_serial_obj(obj_t *serial);
 
 
+/*  server-registry.c
+ */
+void publish_console_registry(server_conf_t *conf);
+
+void invalidate_console_registry(void);
+
+void refresh_console_registry(server_conf_t *conf);
+
+registry_t * get_console_registry(void);
+
+void put_console_registry(registry_t *reg);
+
+
+/*  server-reset.c
+ */
+void init_reset_cmds(server_conf_t *conf);
+
+void queue_reset_cmd(obj_t *console, obj_t *client);
+
+void run_reset_cmds(void);
+
+
 /*  server-sock.c
  */
 void process_client(client_arg_t *args);
 
 
+/*  server-stall.c
+ */
+void init_stall_detector(server_conf_t *conf);
+
+void begin_mux_phase(const char *op, obj_t *obj);
+
+void end_mux_phase(void);
+
+void log_stall_records(void);
+
+
 /*  server-telnet.c
  */
 int is_telnet_dev(const char *dev, char **host_ref, int *port_ref);
 
+int init_telnet_opts(telnetopt_t *opts);
+
+int parse_telnet_opts(
+    telnetopt_t *opts, const char *str, char *errbuf, int errlen);
+
 obj_t * create_telnet_obj(server_conf_t *conf, char *name,
-    char *host, int port, char *errbuf, int errlen);
+    char *host, int port, telnetopt_t *opts, char *errbuf, int errlen);
 
 int open_telnet_obj(obj_t *telnet);
 
@@ -515,6 +1095,23 @@ int open_test_obj(obj_t *test);
 int read_test_obj(obj_t *test);
 
 
+/*  server-tls.c
+ */
+#if WITH_OPENSSL
+
+void create_tls_context(server_conf_t *conf);
+
+void destroy_tls_context(server_conf_t *conf);
+
+int accept_tls_client(server_conf_t *conf, req_t *req);
+
+tls_obj_t * create_tls_obj(obj_t *client);
+
+void destroy_tls_obj(tls_obj_t *tls);
+
+#endif /* WITH_OPENSSL */
+
+
 /*  server-unixsock.c
  */
 int is_unixsock_dev(const char *dev, const char *cwd, char **path_ref);
@@ -525,4 +1122,32 @@ obj_t * create_unixsock_obj(server_conf_t *conf, char *name, char *dev,
 int open_unixsock_obj(obj_t *unixsock);
 
 
+/*  server-worker.c
+ */
+int get_worker_index(server_conf_t *conf, const char *name);
+
+void add_worker_console(const char *name);
+
+const char * find_duplicate_worker_console(void);
+
+int is_worker_console(server_conf_t *conf, const char *name);
+
+int get_num_worker_consoles(void);
+
+const char * get_worker_console(int index);
+
+void init_worker(server_conf_t *conf);
+
+void start_workers(server_conf_t *conf, char *argv[]);
+
+void signal_workers(int signum);
+
+void stop_workers(void);
+
+int dispatch_worker_io(server_conf_t *conf);
+
+int send_worker_client(int index, int sd, req_t *req,
+    const char *request, int isSpan);
+
+
 #endif /* !_SERVER_H */
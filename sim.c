@@ -0,0 +1,2211 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#ifndef _XOPEN_SOURCE
+#  define _XOPEN_SOURCE 600             /* for posix_openpt() et al */
+#endif /* !_XOPEN_SOURCE */
+
+#include <sys/types.h>                  /* include before in.h for bsd */
+#include <netinet/in.h>                 /* include before telnet.h for bsd */
+#include <arpa/inet.h>
+#include <arpa/telnet.h>
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "list.h"
+#include "log.h"
+#include "tpoll.h"
+#include "util-file.h"
+#include "util-str.h"
+#include "util.h"
+
+
+/*  conmansim: a scale simulator for terminal servers and BMCs.
+ *
+ *  Runs thousands of fake console endpoints in a single process so the
+ *    daemon can be exercised at scale without the hardware: telnet servers
+ *    (with IAC option negotiation), raw TCP ports, Unix domain sockets, and
+ *    pty pairs standing in for serial devices.  Each endpoint generates
+ *    output according to a profile, and can be made to flap, read its input
+ *    slowly, or refuse connections.  A matching conman.conf is written out
+ *    before the endpoints are serviced.
+ *
+ *  In benchmark mode (-b), conmansim also starts the daemon on the generated
+ *    conman.conf, waits for it to connect to the endpoints, optionally
+ *    attaches monitor clients, and after a settling period reports the
+ *    daemon's RSS, anonymous memory, & open fds (in total and per console),
+ *    along with the CPU time it consumed while settling.  Since the daemon
+ *    polls every obj on each pass of its mux loop, the CPU time per console
+ *    measures the cost of dispatching I/O across that many objs.
+ *    The daemon is then sent a SIGHUP so it logs its own accounting of the
+ *    memory owned by each of its subsystems, and is terminated.  Server
+ *    directives given with -S (e.g., "latency=on") are added to the
+ *    conman.conf so daemon configurations can be compared on equal footing.
+ */
+
+#define SIM_DEFAULT_HOST        "127.0.0.1"
+#define SIM_DEFAULT_PORT        17000
+#define SIM_TICK_MSECS          50
+#define SIM_BUF_SIZE            4096
+#define SIM_SLOW_RCVBUF         4096
+#define SIM_DEFAULT_LINE_LEN    72
+#define SIM_DEFAULT_PERIOD      10
+#define SIM_DEFAULT_FLAP_DOWN   5
+#define SIM_OPT_BITS            256
+#define SIM_DEFAULT_DAEMON_PORT 16999
+#define SIM_BENCH_CONNECT_SECS  300
+#define SIM_BENCH_SETTLE_SECS   5
+#define SIM_BENCH_LOG_MSECS     1000
+
+#define SIM_OPT_IS_SET(a,o)     ((a)[(o) / 8] & (1 << ((o) % 8)))
+#define SIM_OPT_SET(a,o)        ((a)[(o) / 8] |= (1 << ((o) % 8)))
+#define SIM_OPT_CLR(a,o)        ((a)[(o) / 8] &= ~(1 << ((o) % 8)))
+
+
+typedef enum sim_type {
+    SIM_TYPE_TELNET,
+    SIM_TYPE_RAW,
+    SIM_TYPE_UNIX,
+    SIM_TYPE_PTY
+} sim_type_t;
+
+typedef enum sim_profile {
+    SIM_PROFILE_IDLE,                   /* no output                         */
+    SIM_PROFILE_ECHO,                   /* echo input back                   */
+    SIM_PROFILE_LINES,                  /* numbered lines at 'rate' lines/s  */
+    SIM_PROFILE_FLOOD,                  /* lines at 'rate' bytes/s (0 = max) */
+    SIM_PROFILE_BURST,                  /* 'rate' lines every 'period' secs  */
+    SIM_PROFILE_BOOT,                   /* boot log when up, then login/echo */
+    SIM_PROFILE_SCRIPT                  /* script file lines at 'rate'/s     */
+} sim_profile_t;
+
+typedef enum sim_bench_state {
+    SIM_BENCH_NONE,                     /* not benchmarking                  */
+    SIM_BENCH_CONNECT,                  /* awaiting daemon connections       */
+    SIM_BENCH_SETTLE,                   /* awaiting daemon to settle         */
+    SIM_BENCH_LOG,                      /* awaiting daemon to log its stats  */
+    SIM_BENCH_DONE
+} sim_bench_state_t;
+
+typedef enum sim_iac_state {
+    SIM_IAC_DATA,
+    SIM_IAC_CMD,
+    SIM_IAC_OPT,
+    SIM_IAC_SB,
+    SIM_IAC_SB_IAC
+} sim_iac_state_t;
+
+typedef struct sim_spec {
+    sim_type_t      type;
+    int             count;              /* number of endpoints               */
+    char           *prefix;             /* console name prefix               */
+    sim_profile_t   profile;
+    int             rate;               /* lines/sec (bytes/sec for flood)   */
+    int             len;                /* line length                       */
+    int             period;             /* secs between bursts               */
+    int             flapUp;             /* mean secs up before flapping      */
+    int             flapDown;           /* secs down when flapping           */
+    int             refusePct;          /* percent of connections refused    */
+    int             slowBps;            /* input read rate (0 = unlimited)   */
+    char          **script;             /* script lines (NULL-terminated)    */
+    int             numScript;
+} sim_spec_t;
+
+typedef struct sim_ep {
+    sim_spec_t     *spec;
+    char           *name;               /* console name                      */
+    char           *path;               /* unix socket path or pty link      */
+    int             port;               /* tcp port                          */
+    int             ld;                 /* listening socket                  */
+    int             fd;                 /* connection or pty master          */
+    long            msFlap;             /* time of next flap transition      */
+    long            msBurst;            /* time of next burst                */
+    double          outCredit;          /* lines (or bytes) owed to output   */
+    double          inCredit;           /* bytes that may be read            */
+    unsigned long   seq;                /* sequence number of next line      */
+    int             scriptPos;          /* next script/boot line             */
+    int             bufLen;             /* pending output in buf             */
+    int             bufOff;             /* offset of next byte to write      */
+    unsigned char   buf[SIM_BUF_SIZE];
+    unsigned char   iacCmd;
+    sim_iac_state_t iacState;
+    unsigned char   optLocal[SIM_OPT_BITS / 8];     /* opts we WILL do       */
+    unsigned char   optRemote[SIM_OPT_BITS / 8];    /* opts peer WILL do     */
+    unsigned        isDown:1;           /* in a flap down period             */
+    unsigned        isHungUp:1;         /* pty slave is not open             */
+    unsigned        isBooted:1;         /* boot log has been sent            */
+} sim_ep_t;
+
+typedef struct sim_conf {
+    char           *host;               /* address tcp endpoints bind to     */
+    int             port;               /* first tcp port                    */
+    char           *dir;                /* dir for unix sockets & pty links  */
+    char           *confFileName;       /* file for generated conman.conf    */
+    unsigned int    seed;
+    int             stormSecs;          /* secs between reconnect storms     */
+    List            specs;
+    sim_ep_t       *eps;
+    int             numEps;
+    tpoll_t         tp;
+    long            msLast;             /* time of last tick                 */
+    long            msStorm;            /* time of next reconnect storm      */
+    unsigned long   numAccepts;
+    unsigned long   numRefusals;
+    unsigned long   numDrops;
+    unsigned long   numBytesIn;
+    unsigned long   numBytesOut;
+    char           *daemon;             /* conmand to benchmark, or NULL     */
+    int             daemonPort;         /* port on which conmand listens     */
+    pid_t           daemonPid;          /* pid of conmand being benchmarked  */
+    List            serverOpts;         /* extra server KEY=VAL directives   */
+    int             numClients;         /* num monitor clients to attach     */
+    int            *clients;            /* client sockets connected to it    */
+    sim_bench_state_t benchState;
+    long            msBench;            /* time of next benchmark step       */
+    long            msSettle;           /* time at which settling began      */
+    long            cpuSettle;          /* conmand cpu ticks when settling   */
+    unsigned        isDirCreated:1;
+    unsigned        enableLogs:1;
+    unsigned        enableVerbose:1;
+} sim_conf_t;
+
+
+static sim_conf_t * create_sim_conf(void);
+static void destroy_sim_conf(sim_conf_t *conf);
+static void process_cmdline(sim_conf_t *conf, int argc, char *argv[]);
+static void display_sim_help(char *prog);
+static sim_spec_t * parse_spec(sim_conf_t *conf, const char *str);
+static void destroy_spec(sim_spec_t *spec);
+static void read_script(sim_spec_t *spec, const char *file);
+static void setup_nofile_limit(sim_conf_t *conf);
+static void create_eps(sim_conf_t *conf);
+static void write_conf(sim_conf_t *conf);
+static void start_daemon(sim_conf_t *conf);
+static void stop_daemon(sim_conf_t *conf);
+static void bench(sim_conf_t *conf);
+static void attach_clients(sim_conf_t *conf);
+static void read_client(sim_conf_t *conf, int j);
+static void report_bench(sim_conf_t *conf);
+static long get_proc_kbytes(pid_t pid, const char *key);
+static int get_proc_fds(pid_t pid);
+static long get_proc_cpu_ticks(pid_t pid);
+static void exit_handler(int signum);
+static void storm_handler(int signum);
+static void stats_handler(int signum);
+static void display_stats(sim_conf_t *conf);
+static void mux_io(sim_conf_t *conf);
+static void tick(sim_conf_t *conf);
+static long get_msecs(void);
+static long get_flap_msecs(sim_spec_t *spec);
+static int open_ep(sim_conf_t *conf, sim_ep_t *ep);
+static void close_ep(sim_conf_t *conf, sim_ep_t *ep);
+static void drop_ep(sim_conf_t *conf, sim_ep_t *ep);
+static int open_tcp_listener(sim_conf_t *conf, sim_ep_t *ep);
+static int open_unix_listener(sim_conf_t *conf, sim_ep_t *ep);
+static int open_pty(sim_conf_t *conf, sim_ep_t *ep);
+static void accept_ep(sim_conf_t *conf, sim_ep_t *ep);
+static void read_ep(sim_conf_t *conf, sim_ep_t *ep);
+static void write_ep(sim_conf_t *conf, sim_ep_t *ep);
+static int is_ep_connected(sim_ep_t *ep);
+static int is_pty_hung_up(sim_ep_t *ep);
+static void fill_ep(sim_ep_t *ep);
+static int put_line(sim_ep_t *ep, const char *line);
+static int put_data(sim_ep_t *ep, const unsigned char *src, int len);
+static void put_telnet_cmd(sim_ep_t *ep, int cmd, int opt);
+static int process_telnet_input(sim_ep_t *ep, unsigned char *buf, int len);
+static void process_telnet_opt(sim_ep_t *ep, int cmd, int opt);
+
+
+static const char *sim_type_strs[] = {
+    "telnet", "raw", "unix", "pty", NULL
+};
+
+static const char *sim_profile_strs[] = {
+    "idle", "echo", "lines", "flood", "burst", "boot", "script", NULL
+};
+
+static const char *sim_boot_log[] = {
+    "\033[2J\033[H",
+    "BIOS Version 2.17.1042  Copyright (C) 1985-2016 American Megatrends, Inc.",
+    "CPU: Intel(R) Xeon(R) CPU E5-2695 v4 @ 2.10GHz",
+    "Memory Test: 131072M OK",
+    "",
+    "\033[1mPress <F2> to enter SETUP, <F12> Network Boot\033[0m",
+    "",
+    "Booting from Hard Disk...",
+    "[    0.000000] Linux version 3.10.0 (mockbuild@sim) #1 SMP",
+    "[    0.000000] Command line: ro console=tty0 console=ttyS0,115200n8",
+    "[    0.120913] smpboot: CPU0: Intel(R) Xeon(R) CPU E5-2695 v4",
+    "[    1.443521] Serial: 8250/16550 driver, 4 ports, IRQ sharing enabled",
+    "[    1.462180] serial8250: ttyS0 at I/O 0x3f8 (irq = 4) is a 16550A",
+    "[    3.817265] EXT4-fs (sda1): mounted filesystem with ordered data mode",
+    "[  \033[32mOK\033[0m  ] Started Journal Service.",
+    "[  \033[32mOK\033[0m  ] Reached target Local File Systems.",
+    "[  \033[32mOK\033[0m  ] Started OpenSSH server daemon.",
+    "[  \033[32mOK\033[0m  ] Reached target Multi-User System.",
+    "",
+    NULL
+};
+
+
+static volatile sig_atomic_t done = 0;
+static volatile sig_atomic_t storm = 0;
+static volatile sig_atomic_t stats = 0;
+static long msEpoch = 0;
+
+
+int main(int argc, char *argv[])
+{
+    sim_conf_t *conf;
+
+    log_set_file(stderr, LOG_NOTICE, 0);
+
+    conf = create_sim_conf();
+    process_cmdline(conf, argc, argv);
+    if (conf->enableVerbose) {
+        log_set_file(stderr, LOG_INFO, 0);
+    }
+    srandom(conf->seed);
+    setup_nofile_limit(conf);
+
+    posix_signal(SIGHUP, storm_handler);
+    posix_signal(SIGINT, exit_handler);
+    posix_signal(SIGPIPE, SIG_IGN);
+    posix_signal(SIGTERM, exit_handler);
+    posix_signal(SIGUSR1, stats_handler);
+
+    create_eps(conf);
+    write_conf(conf);
+
+    log_msg(LOG_NOTICE, "Simulating %d endpoint%s (pid %d, seed %u)",
+        conf->numEps, (conf->numEps == 1 ? "" : "s"), (int) getpid(),
+        conf->seed);
+
+    if (conf->daemon) {
+        start_daemon(conf);
+    }
+    mux_io(conf);
+
+    display_stats(conf);
+    stop_daemon(conf);
+    destroy_sim_conf(conf);
+    return(0);
+}
+
+
+static sim_conf_t * create_sim_conf(void)
+{
+/*  Creates a new sim configuration with the default settings.
+ */
+    sim_conf_t *conf;
+
+    if (!(conf = malloc(sizeof(sim_conf_t)))) {
+        out_of_memory();
+    }
+    memset(conf, 0, sizeof(*conf));
+    conf->host = create_string(SIM_DEFAULT_HOST);
+    conf->port = SIM_DEFAULT_PORT;
+    conf->daemonPort = SIM_DEFAULT_DAEMON_PORT;
+    conf->daemonPid = -1;
+    conf->seed = (unsigned int) time(NULL) ^ (unsigned int) getpid();
+    if (!(conf->specs = list_create((ListDelF) destroy_spec))) {
+        out_of_memory();
+    }
+    if (!(conf->serverOpts = list_create((ListDelF) destroy_string))) {
+        out_of_memory();
+    }
+    if (!(conf->tp = tpoll_create(0))) {
+        log_err(0, "Unable to create tpoll object");
+    }
+    return(conf);
+}
+
+
+static void destroy_sim_conf(sim_conf_t *conf)
+{
+/*  Closes all endpoints, removing any files created on their behalf,
+ *    and destroys the sim configuration.
+ */
+    char *p;
+    int i;
+
+    assert(conf != NULL);
+
+    for (i = 0; i < conf->numClients; i++) {
+        if (conf->clients && (conf->clients[i] >= 0)) {
+            (void) close(conf->clients[i]);
+        }
+    }
+    free(conf->clients);
+
+    for (i = 0; i < conf->numEps; i++) {
+        close_ep(conf, &conf->eps[i]);
+        if (conf->enableLogs && conf->isDirCreated) {
+            p = create_format_string("%s/%s.log", conf->dir,
+                conf->eps[i].name);
+            (void) unlink(p);
+            destroy_string(p);
+        }
+        destroy_string(conf->eps[i].name);
+        destroy_string(conf->eps[i].path);
+    }
+    free(conf->eps);
+
+    if (conf->isDirCreated && (rmdir(conf->dir) < 0)) {
+        log_msg(LOG_WARNING, "Unable to remove directory \"%s\": %s",
+            conf->dir, strerror(errno));
+    }
+    list_destroy(conf->specs);
+    list_destroy(conf->serverOpts);
+    tpoll_destroy(conf->tp);
+    destroy_string(conf->host);
+    destroy_string(conf->dir);
+    destroy_string(conf->confFileName);
+    destroy_string(conf->daemon);
+    free(conf);
+    return;
+}
+
+
+static void process_cmdline(sim_conf_t *conf, int argc, char *argv[])
+{
+    int c;
+    int i;
+
+    opterr = 0;
+    while ((c = getopt(argc, argv, "a:b:c:d:hH:lp:P:r:s:S:v")) != -1) {
+        switch(c) {
+        case 'a':
+            if ((conf->numClients = atoi(optarg)) < 0) {
+                log_err(0, "CMDLINE: invalid number of clients \"%s\"",
+                    optarg);
+            }
+            break;
+        case 'b':
+            destroy_string(conf->daemon);
+            conf->daemon = create_string(optarg);
+            break;
+        case 'c':
+            destroy_string(conf->confFileName);
+            conf->confFileName = create_string(optarg);
+            break;
+        case 'd':
+            destroy_string(conf->dir);
+            conf->dir = create_string(optarg);
+            break;
+        case 'h':
+            display_sim_help(argv[0]);
+            exit(0);
+        case 'H':
+            destroy_string(conf->host);
+            conf->host = create_string(optarg);
+            break;
+        case 'l':
+            conf->enableLogs = 1;
+            break;
+        case 'p':
+            if (((conf->port = atoi(optarg)) <= 0) || (conf->port > 65535)) {
+                log_err(0, "CMDLINE: invalid port \"%s\"", optarg);
+            }
+            break;
+        case 'P':
+            if (((conf->daemonPort = atoi(optarg)) <= 0)
+                    || (conf->daemonPort > 65535)) {
+                log_err(0, "CMDLINE: invalid port \"%s\"", optarg);
+            }
+            break;
+        case 'r':
+            if ((conf->stormSecs = atoi(optarg)) <= 0) {
+                log_err(0, "CMDLINE: invalid storm interval \"%s\"", optarg);
+            }
+            break;
+        case 's':
+            conf->seed = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'S':
+            if (!strchr(optarg, '=')) {
+                log_err(0, "CMDLINE: invalid server directive \"%s\"",
+                    optarg);
+            }
+            list_append(conf->serverOpts, create_string(optarg));
+            break;
+        case 'v':
+            conf->enableVerbose = 1;
+            break;
+        case '?':                       /* invalid option */
+            log_err(0, "CMDLINE: invalid option \"%c\"", optopt);
+            break;
+        default:
+            log_err(0, "CMDLINE: option \"%c\" not implemented", c);
+            break;
+        }
+    }
+    for (i = optind; i < argc; i++) {
+        list_append(conf->specs, parse_spec(conf, argv[i]));
+    }
+    if (list_is_empty(conf->specs)) {
+        log_err(0, "CMDLINE: no endpoints specified (see \"-h\")");
+    }
+    if (conf->daemon && !conf->confFileName) {
+        log_err(0, "CMDLINE: benchmark requires a conf file (see \"-c\")");
+    }
+    if (conf->numClients && !conf->daemon) {
+        log_err(0, "CMDLINE: clients require a benchmark (see \"-b\")");
+    }
+    return;
+}
+
+
+static void display_sim_help(char *prog)
+{
+    char *opt_fmt = "  %-12s %s\n";
+
+    printf("Usage: %s [OPTION]... SPEC...\n", prog);
+    printf("\n");
+    printf(opt_fmt, "-a NUM", "Attach NUM monitor clients to conmand.");
+    printf(opt_fmt, "-b PROG", "Benchmark the memory & CPU used by conmand"
+        " PROG.");
+    printf(opt_fmt, "-c FILE", "Write conman.conf consoles to FILE [stdout].");
+    printf(opt_fmt, "-d DIR", "Create unix sockets & pty links in DIR.");
+    printf(opt_fmt, "-h", "Display this help.");
+    printf(opt_fmt, "-H ADDR", "Bind TCP endpoints to ADDR ["
+        SIM_DEFAULT_HOST "].");
+    printf(opt_fmt, "-l", "Log each console to a file in DIR.");
+    printf(opt_fmt, "-p PORT", "Assign TCP ports starting at PORT.");
+    printf(opt_fmt, "-P PORT", "Run the benchmarked conmand on PORT.");
+    printf(opt_fmt, "-r SECS", "Drop all connections every SECS seconds.");
+    printf(opt_fmt, "-s SEED", "Seed the random number generator.");
+    printf(opt_fmt, "-S KEY=VAL", "Add a server KEY=VAL directive to FILE.");
+    printf(opt_fmt, "-v", "Be verbose.");
+    printf("\n");
+    printf("SPEC is TYPE[:COUNT][,KEY=VAL]... where TYPE is telnet, raw, unix,"
+        " or pty.\n");
+    printf(opt_fmt, "profile=STR", "idle, echo, lines, flood, burst, boot,"
+        " or script:FILE [lines]");
+    printf(opt_fmt, "rate=NUM", "Lines/sec (bytes/sec for flood; 0=max).");
+    printf(opt_fmt, "len=NUM", "Length of generated lines.");
+    printf(opt_fmt, "period=SECS", "Seconds between bursts.");
+    printf(opt_fmt, "flap=UP/DOWN", "Go down for DOWN secs after ~UP secs.");
+    printf(opt_fmt, "refuse=PCT", "Reset PCT percent of new connections.");
+    printf(opt_fmt, "slow=BPS", "Read console input at BPS bytes/sec.");
+    printf(opt_fmt, "name=STR", "Prefix console names with STR [TYPE].");
+    printf("\n");
+    printf("Send SIGHUP to drop all connections; send SIGUSR1 for stats.\n");
+    printf("With -b, results are written to stdout; with -v, conmand also logs"
+        " its own\nmemory accounting by subsystem.\n");
+    printf("\n");
+    return;
+}
+
+
+static sim_spec_t * parse_spec(sim_conf_t *conf, const char *str)
+{
+/*  Parses the endpoint specification 'str' of the form
+ *    "<type>[:<count>][,<key>=<val>]...".
+ *  Returns a new spec; exits on error.
+ */
+    sim_spec_t *spec;
+    char *buf;
+    char *tok;
+    char *ptr;
+    char *key;
+    char *val;
+    char *p;
+    int i;
+
+    assert(conf != NULL);
+    assert(str != NULL);
+
+    if (!(spec = malloc(sizeof(sim_spec_t)))) {
+        out_of_memory();
+    }
+    memset(spec, 0, sizeof(*spec));
+    spec->count = 1;
+    spec->profile = SIM_PROFILE_LINES;
+    spec->rate = -1;
+    spec->len = SIM_DEFAULT_LINE_LEN;
+    spec->period = SIM_DEFAULT_PERIOD;
+    spec->flapDown = SIM_DEFAULT_FLAP_DOWN;
+
+    buf = create_string(str);
+    if (!(tok = strtok_r(buf, ",", &ptr))) {
+        log_err(0, "CMDLINE: empty endpoint spec");
+    }
+    if ((p = strchr(tok, ':'))) {
+        *p++ = '\0';
+        if ((spec->count = atoi(p)) <= 0) {
+            log_err(0, "CMDLINE: invalid count \"%s\" in \"%s\"", p, str);
+        }
+    }
+    for (i = 0; sim_type_strs[i]; i++) {
+        if (!strcmp(tok, sim_type_strs[i])) {
+            break;
+        }
+    }
+    if (!sim_type_strs[i]) {
+        log_err(0, "CMDLINE: invalid endpoint type \"%s\"", tok);
+    }
+    spec->type = i;
+
+    while ((tok = strtok_r(NULL, ",", &ptr))) {
+        key = tok;
+        if (!(val = strchr(tok, '='))) {
+            log_err(0, "CMDLINE: missing value for \"%s\" in \"%s\"",
+                key, str);
+        }
+        *val++ = '\0';
+        if (!strcmp(key, "profile")) {
+            if (!strncmp(val, "script:", 7)) {
+                spec->profile = SIM_PROFILE_SCRIPT;
+                read_script(spec, val + 7);
+                continue;
+            }
+            for (i = 0; sim_profile_strs[i]; i++) {
+                if (!strcmp(val, sim_profile_strs[i])) {
+                    break;
+                }
+            }
+            if (!sim_profile_strs[i] || (i == SIM_PROFILE_SCRIPT)) {
+                log_err(0, "CMDLINE: invalid profile \"%s\"", val);
+            }
+            spec->profile = i;
+        }
+        else if (!strcmp(key, "rate")) {
+            if ((spec->rate = atoi(val)) < 0) {
+                log_err(0, "CMDLINE: invalid rate \"%s\"", val);
+            }
+        }
+        else if (!strcmp(key, "len")) {
+            if (((spec->len = atoi(val)) <= 0)
+                    || (spec->len > SIM_BUF_SIZE / 2)) {
+                log_err(0, "CMDLINE: invalid line length \"%s\"", val);
+            }
+        }
+        else if (!strcmp(key, "period")) {
+            if ((spec->period = atoi(val)) <= 0) {
+                log_err(0, "CMDLINE: invalid period \"%s\"", val);
+            }
+        }
+        else if (!strcmp(key, "flap")) {
+            spec->flapUp = atoi(val);
+            if ((p = strchr(val, '/'))) {
+                spec->flapDown = atoi(p + 1);
+            }
+            if ((spec->flapUp <= 0) || (spec->flapDown <= 0)) {
+                log_err(0, "CMDLINE: invalid flap \"%s\"", val);
+            }
+        }
+        else if (!strcmp(key, "refuse")) {
+            spec->refusePct = atoi(val);
+            if ((spec->refusePct < 0) || (spec->refusePct > 100)) {
+                log_err(0, "CMDLINE: invalid refusal percentage \"%s\"", val);
+            }
+        }
+        else if (!strcmp(key, "slow")) {
+            if ((spec->slowBps = atoi(val)) <= 0) {
+                log_err(0, "CMDLINE: invalid read rate \"%s\"", val);
+            }
+        }
+        else if (!strcmp(key, "name")) {
+            destroy_string(spec->prefix);
+            spec->prefix = create_string(val);
+        }
+        else {
+            log_err(0, "CMDLINE: invalid key \"%s\" in \"%s\"", key, str);
+        }
+    }
+    if (!spec->prefix) {
+        spec->prefix = create_string(sim_type_strs[spec->type]);
+    }
+    if (spec->rate < 0) {
+        spec->rate = (spec->profile == SIM_PROFILE_FLOOD) ? 0
+                   : (spec->profile == SIM_PROFILE_BURST) ? 100
+                   : (spec->profile == SIM_PROFILE_BOOT) ? 20 : 1;
+    }
+    if ((spec->rate == 0) && (spec->profile != SIM_PROFILE_FLOOD)
+            && (spec->profile != SIM_PROFILE_IDLE)
+            && (spec->profile != SIM_PROFILE_ECHO)) {
+        log_err(0, "CMDLINE: rate must be positive for \"%s\"", str);
+    }
+    free(buf);
+    return(spec);
+}
+
+
+static void destroy_spec(sim_spec_t *spec)
+{
+    int i;
+
+    if (!spec) {
+        return;
+    }
+    for (i = 0; i < spec->numScript; i++) {
+        destroy_string(spec->script[i]);
+    }
+    free(spec->script);
+    destroy_string(spec->prefix);
+    free(spec);
+    return;
+}
+
+
+static void read_script(sim_spec_t *spec, const char *file)
+{
+/*  Reads the lines of the script 'file' into 'spec'.
+ *  Each line is sent verbatim (with a CR/LF termination) in turn, and
+ *    the script repeats once the last line has been sent.
+ */
+    FILE *fp;
+    char line[SIM_BUF_SIZE / 2];
+    char *p;
+    int n = 0;
+
+    if (!(fp = fopen(file, "r"))) {
+        log_err(errno, "Unable to open script \"%s\"", file);
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        if ((p = strpbrk(line, "\r\n"))) {
+            *p = '\0';
+        }
+        if (spec->numScript >= n) {
+            n = (n > 0) ? n * 2 : 64;
+            if (!(spec->script = realloc(spec->script, n * sizeof(char *)))) {
+                out_of_memory();
+            }
+        }
+        spec->script[spec->numScript++] = create_string(line);
+    }
+    if (ferror(fp)) {
+        log_err(errno, "Unable to read script \"%s\"", file);
+    }
+    (void) fclose(fp);
+    if (spec->numScript == 0) {
+        log_err(0, "Script \"%s\" is empty", file);
+    }
+    return;
+}
+
+
+static void setup_nofile_limit(sim_conf_t *conf)
+{
+/*  Raises the NOFILE limit to the maximum (hard) limit, since each endpoint
+ *    holds up to two descriptors.
+ */
+    struct rlimit limit;
+    ListIterator i;
+    sim_spec_t *spec;
+    long n = 16;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0) {
+        log_err(errno, "Unable to get open file limit");
+    }
+    limit.rlim_cur = limit.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &limit) < 0) {
+        log_err(errno, "Unable to set open file limit to %ld",
+            (long) limit.rlim_cur);
+    }
+    i = list_iterator_create(conf->specs);
+    while ((spec = list_next(i))) {
+        n += (long) spec->count * ((spec->type == SIM_TYPE_PTY) ? 1 : 2);
+    }
+    list_iterator_destroy(i);
+
+    if ((limit.rlim_cur != RLIM_INFINITY) && (n > (long) limit.rlim_cur)) {
+        log_err(0, "Need %ld open files but the limit is %ld",
+            n, (long) limit.rlim_cur);
+    }
+    return;
+}
+
+
+static void create_eps(sim_conf_t *conf)
+{
+/*  Creates and opens the endpoints described by the specs.
+ */
+    ListIterator i;
+    sim_spec_t *spec;
+    sim_ep_t *ep;
+    int needDir = 0;
+    int port;
+    int width;
+    int j;
+
+    i = list_iterator_create(conf->specs);
+    while ((spec = list_next(i))) {
+        conf->numEps += spec->count;
+        if ((spec->type == SIM_TYPE_UNIX) || (spec->type == SIM_TYPE_PTY)) {
+            needDir = 1;
+        }
+    }
+    if (conf->enableLogs) {
+        needDir = 1;
+    }
+    if (!(conf->eps = malloc(conf->numEps * sizeof(sim_ep_t)))) {
+        out_of_memory();
+    }
+    memset(conf->eps, 0, conf->numEps * sizeof(sim_ep_t));
+
+    if (needDir) {
+        if (!conf->dir) {
+            conf->dir = create_format_string("/tmp/conmansim.%d",
+                (int) getpid());
+        }
+        if (mkdir(conf->dir, S_IRWXU) == 0) {
+            conf->isDirCreated = 1;
+        }
+        else if (errno != EEXIST) {
+            log_err(errno, "Unable to create directory \"%s\"", conf->dir);
+        }
+    }
+    msEpoch = get_msecs();
+    conf->msLast = 0;
+    conf->msStorm = conf->stormSecs * 1000L;
+    port = conf->port;
+    ep = conf->eps;
+
+    list_iterator_reset(i);
+    while ((spec = list_next(i))) {
+        width = snprintf(NULL, 0, "%d", spec->count);
+        for (j = 1; j <= spec->count; j++, ep++) {
+            ep->spec = spec;
+            ep->ld = ep->fd = -1;
+            ep->name = create_format_string("%s%0*d",
+                spec->prefix, width, j);
+            if ((spec->type == SIM_TYPE_TELNET)
+                    || (spec->type == SIM_TYPE_RAW)) {
+                if (port > 65535) {
+                    log_err(0, "Exhausted TCP ports at [%s]", ep->name);
+                }
+                ep->port = port++;
+            }
+            else {
+                ep->path = create_format_string("%s/%s", conf->dir, ep->name);
+            }
+            /*  Stagger flaps and bursts so they are not synchronized
+             *    across endpoints (use -r or SIGHUP for that).
+             */
+            if (spec->flapUp > 0) {
+                ep->msFlap = get_flap_msecs(spec);
+            }
+            ep->msBurst = random() % (spec->period * 1000L);
+
+            if (open_ep(conf, ep) < 0) {
+                log_err(0, "Unable to create endpoint [%s]", ep->name);
+            }
+        }
+    }
+    list_iterator_destroy(i);
+    return;
+}
+
+
+static void write_conf(sim_conf_t *conf)
+{
+/*  Writes a console directive for each endpoint to the conf file
+ *    (or stdout).
+ */
+    FILE *fp;
+    sim_ep_t *ep;
+    char *tstr;
+    ListIterator li;
+    char *opt;
+    int i;
+
+    if (!conf->confFileName) {
+        fp = stdout;
+    }
+    else if (!(fp = fopen(conf->confFileName, "w"))) {
+        log_err(errno, "Unable to open \"%s\"", conf->confFileName);
+    }
+    tstr = create_long_time_string(0);
+    fprintf(fp, "##\n");
+    fprintf(fp, "# Generated by conmansim (pid %d) on %s.\n",
+        (int) getpid(), tstr);
+    fprintf(fp, "# Raw TCP endpoints ignore telnet negotiation.\n");
+    fprintf(fp, "##\n");
+    free(tstr);
+
+    if (conf->daemon) {
+        fprintf(fp, "server port=%d\n", conf->daemonPort);
+    }
+    if (conf->enableLogs) {
+        fprintf(fp, "server logdir=\"%s\"\n", conf->dir);
+        fprintf(fp, "global log=\"%%N.log\"\n");
+    }
+    li = list_iterator_create(conf->serverOpts);
+    while ((opt = list_next(li))) {
+        fprintf(fp, "server %s\n", opt);
+    }
+    list_iterator_destroy(li);
+
+    for (i = 0; i < conf->numEps; i++) {
+        ep = &conf->eps[i];
+        switch (ep->spec->type) {
+        case SIM_TYPE_TELNET:
+            /* fall-thru */
+        case SIM_TYPE_RAW:
+            fprintf(fp, "console name=\"%s\" dev=\"%s:%d\"\n",
+                ep->name, conf->host, ep->port);
+            break;
+        case SIM_TYPE_UNIX:
+            fprintf(fp, "console name=\"%s\" dev=\"unix:%s\"\n",
+                ep->name, ep->path);
+            break;
+        case SIM_TYPE_PTY:
+            fprintf(fp, "console name=\"%s\" dev=\"%s\"\n",
+                ep->name, ep->path);
+            break;
+        }
+    }
+    if ((fflush(fp) != 0) || ferror(fp)) {
+        log_err(errno, "Unable to write conman.conf");
+    }
+    if ((fp != stdout) && (fclose(fp) != 0)) {
+        log_err(errno, "Unable to close \"%s\"", conf->confFileName);
+    }
+    return;
+}
+
+
+static void start_daemon(sim_conf_t *conf)
+{
+/*  Starts the conmand being benchmarked in the foreground on the generated
+ *    conman.conf.
+ */
+    pid_t pid;
+
+    if ((pid = fork()) < 0) {
+        log_err(errno, "Unable to fork \"%s\"", conf->daemon);
+    }
+    else if (pid == 0) {
+        if (conf->enableVerbose) {
+            execl(conf->daemon, conf->daemon, "-F", "-v",
+                "-c", conf->confFileName, (char *) NULL);
+        }
+        else {
+            execl(conf->daemon, conf->daemon, "-F",
+                "-c", conf->confFileName, (char *) NULL);
+        }
+        log_err(errno, "Unable to exec \"%s\"", conf->daemon);
+    }
+    log_msg(LOG_NOTICE, "Benchmarking \"%s\" (pid %d)",
+        conf->daemon, (int) pid);
+    conf->daemonPid = pid;
+    conf->benchState = SIM_BENCH_CONNECT;
+    conf->msBench = get_msecs() + (SIM_BENCH_CONNECT_SECS * 1000L);
+    return;
+}
+
+
+static void stop_daemon(sim_conf_t *conf)
+{
+/*  Terminates the conmand being benchmarked, if running.
+ */
+    if (conf->daemonPid <= 0) {
+        return;
+    }
+    if (kill(conf->daemonPid, SIGTERM) < 0) {
+        log_msg(LOG_WARNING, "Unable to terminate conmand (pid %d): %s",
+            (int) conf->daemonPid, strerror(errno));
+    }
+    else if (waitpid(conf->daemonPid, NULL, 0) < 0) {
+        log_msg(LOG_WARNING, "Unable to wait for conmand (pid %d): %s",
+            (int) conf->daemonPid, strerror(errno));
+    }
+    conf->daemonPid = -1;
+    return;
+}
+
+
+static void bench(sim_conf_t *conf)
+{
+/*  Advances the benchmark: once conmand has connected to every endpoint
+ *    (or the connect timeout expires), the clients are attached; once the
+ *    daemon has settled, its usage is reported and it is signalled to log
+ *    its own memory accounting before the benchmark ends.
+ */
+    long ms;
+    int numUp = 0;
+    int i;
+
+    if (waitpid(conf->daemonPid, NULL, WNOHANG) == conf->daemonPid) {
+        log_msg(LOG_ERR, "conmand (pid %d) exited during benchmark",
+            (int) conf->daemonPid);
+        conf->daemonPid = -1;
+        conf->benchState = SIM_BENCH_DONE;
+        done = 1;
+        return;
+    }
+    ms = get_msecs();
+    switch (conf->benchState) {
+    case SIM_BENCH_CONNECT:
+        for (i = 0; i < conf->numEps; i++) {
+            if (is_ep_connected(&conf->eps[i])) {
+                numUp++;
+            }
+        }
+        if ((numUp < conf->numEps) && (ms < conf->msBench)) {
+            break;
+        }
+        log_msg(LOG_NOTICE, "conmand connected to %d/%d endpoint%s",
+            numUp, conf->numEps, (conf->numEps == 1 ? "" : "s"));
+        attach_clients(conf);
+        conf->benchState = SIM_BENCH_SETTLE;
+        conf->msBench = ms + (SIM_BENCH_SETTLE_SECS * 1000L);
+        conf->msSettle = ms;
+        conf->cpuSettle = get_proc_cpu_ticks(conf->daemonPid);
+        break;
+    case SIM_BENCH_SETTLE:
+        if (ms < conf->msBench) {
+            break;
+        }
+        report_bench(conf);
+        if (kill(conf->daemonPid, SIGHUP) < 0) {
+            log_msg(LOG_WARNING, "Unable to signal conmand (pid %d): %s",
+                (int) conf->daemonPid, strerror(errno));
+        }
+        conf->benchState = SIM_BENCH_LOG;
+        conf->msBench = ms + SIM_BENCH_LOG_MSECS;
+        break;
+    case SIM_BENCH_LOG:
+        if (ms < conf->msBench) {
+            break;
+        }
+        conf->benchState = SIM_BENCH_DONE;
+        done = 1;
+        break;
+    default:
+        break;
+    }
+    return;
+}
+
+
+static void attach_clients(sim_conf_t *conf)
+{
+/*  Attaches the monitor clients to conmand, distributing them round-robin
+ *    across the consoles.  Each client's greeting & request are sent
+ *    together; the daemon reads them a line at a time.
+ */
+    struct sockaddr_in addr;
+    char buf[SIM_BUF_SIZE];
+    int numUp = 0;
+    int sd;
+    int n;
+    int j;
+
+    if (conf->numClients == 0) {
+        return;
+    }
+    if (!(conf->clients = malloc(conf->numClients * sizeof(int)))) {
+        out_of_memory();
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(conf->daemonPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (j = 0; j < conf->numClients; j++) {
+        conf->clients[j] = -1;
+        if ((sd = socket(PF_INET, SOCK_STREAM, 0)) < 0) {
+            log_msg(LOG_WARNING, "Unable to create client socket: %s",
+                strerror(errno));
+            continue;
+        }
+        set_fd_closed_on_exec(sd);
+        if (connect(sd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+            log_msg(LOG_WARNING, "Unable to connect client to port %d: %s",
+                conf->daemonPort, strerror(errno));
+            (void) close(sd);
+            continue;
+        }
+        n = snprintf(buf, sizeof(buf), "HELLO USER='conmansim' TTY='sim%d'\n"
+            "MONITOR OPTION=QUIET CONSOLE='%s'\n",
+            j + 1, conf->eps[j % conf->numEps].name);
+        if (write_n(sd, buf, n) < 0) {
+            log_msg(LOG_WARNING, "Unable to send client request: %s",
+                strerror(errno));
+            (void) close(sd);
+            continue;
+        }
+        set_fd_nonblocking(sd);
+        conf->clients[j] = sd;
+        tpoll_set(conf->tp, sd, POLLIN);
+        numUp++;
+    }
+    log_msg(LOG_NOTICE, "Attached %d/%d client%s to conmand",
+        numUp, conf->numClients, (conf->numClients == 1 ? "" : "s"));
+    return;
+}
+
+
+static void read_client(sim_conf_t *conf, int j)
+{
+/*  Reads & discards the output sent by conmand to client 'j'.
+ */
+    unsigned char buf[SIM_BUF_SIZE];
+    int sd = conf->clients[j];
+    ssize_t n;
+
+    n = read(sd, buf, sizeof(buf));
+    if (n > 0) {
+        return;
+    }
+    if ((n < 0) && ((errno == EINTR) || (errno == EAGAIN)
+            || (errno == EWOULDBLOCK))) {
+        return;
+    }
+    log_msg(LOG_WARNING, "Client %d disconnected by conmand%s%s", j + 1,
+        (n < 0 ? ": " : ""), (n < 0 ? strerror(errno) : ""));
+    tpoll_clear(conf->tp, sd, POLLIN);
+    (void) close(sd);
+    conf->clients[j] = -1;
+    return;
+}
+
+
+static void report_bench(sim_conf_t *conf)
+{
+/*  Writes a line to stdout reporting the memory & fds used by conmand,
+ *    in total and per console, and the CPU time it used while settling
+ *    (as a percentage of a CPU, and in usecs per second per console).
+ */
+    char buf[SIM_BUF_SIZE] = "";
+    ListIterator i;
+    sim_spec_t *spec;
+    char *opt;
+    long rss, anon;
+    long cpu;
+    double secs, cpuSecs;
+    int numFds;
+    int numClients = 0;
+    double n;
+    int j;
+
+    i = list_iterator_create(conf->specs);
+    while ((spec = list_next(i))) {
+        append_format_string(buf, sizeof(buf), "%s%d %s",
+            (*buf ? " + " : ""), spec->count, sim_type_strs[spec->type]);
+    }
+    list_iterator_destroy(i);
+    for (j = 0; conf->clients && (j < conf->numClients); j++) {
+        if (conf->clients[j] >= 0) {
+            numClients++;
+        }
+    }
+    append_format_string(buf, sizeof(buf), " console%s, %s, %d client%s",
+        (conf->numEps == 1 ? "" : "s"),
+        (conf->enableLogs ? "logs" : "no logs"),
+        numClients, (numClients == 1 ? "" : "s"));
+    i = list_iterator_create(conf->serverOpts);
+    while ((opt = list_next(i))) {
+        append_format_string(buf, sizeof(buf), ", %s", opt);
+    }
+    list_iterator_destroy(i);
+    append_format_string(buf, sizeof(buf), ":");
+
+    n = (conf->numEps > 0) ? conf->numEps : 1;
+    rss = get_proc_kbytes(conf->daemonPid, "VmRSS:");
+    anon = get_proc_kbytes(conf->daemonPid, "RssAnon:");
+    numFds = get_proc_fds(conf->daemonPid);
+    if (rss >= 0) {
+        append_format_string(buf, sizeof(buf), " rss=%ldKB (%.1fKB/console)",
+            rss, rss / n);
+    }
+    if (anon >= 0) {
+        append_format_string(buf, sizeof(buf), " anon=%ldKB (%.1fKB/console)",
+            anon, anon / n);
+    }
+    if (numFds >= 0) {
+        append_format_string(buf, sizeof(buf), " fds=%d (%.2f/console)",
+            numFds, numFds / n);
+    }
+    cpu = get_proc_cpu_ticks(conf->daemonPid);
+    secs = (get_msecs() - conf->msSettle) / 1000.0;
+    if ((cpu >= 0) && (conf->cpuSettle >= 0) && (secs > 0)) {
+        cpuSecs = (double) (cpu - conf->cpuSettle) / sysconf(_SC_CLK_TCK);
+        append_format_string(buf, sizeof(buf),
+            " cpu=%.1f%% (%.2fus/s/console)",
+            cpuSecs * 100.0 / secs, cpuSecs * 1e6 / secs / n);
+    }
+    printf("conmand: %s\n", buf);
+    if (fflush(stdout) != 0) {
+        log_err(errno, "Unable to write benchmark results");
+    }
+    return;
+}
+
+
+static long get_proc_kbytes(pid_t pid, const char *key)
+{
+/*  Returns the value (in kilobytes) of the field 'key' in the status of
+ *    process 'pid', or -1 if unavailable.
+ */
+    char path[64];
+    char line[256];
+    FILE *fp;
+    size_t len = strlen(key);
+    long n = -1;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", (int) pid);
+    if (!(fp = fopen(path, "r"))) {
+        return(-1);
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, key, len) == 0) {
+            n = strtol(line + len, NULL, 10);
+            break;
+        }
+    }
+    (void) fclose(fp);
+    return(n);
+}
+
+
+static int get_proc_fds(pid_t pid)
+{
+/*  Returns the number of file descriptors open by process 'pid',
+ *    or -1 if unavailable.
+ */
+    char path[64];
+    DIR *dp;
+    struct dirent *dep;
+    int n = 0;
+
+    snprintf(path, sizeof(path), "/proc/%d/fd", (int) pid);
+    if (!(dp = opendir(path))) {
+        return(-1);
+    }
+    while ((dep = readdir(dp))) {
+        if (dep->d_name[0] != '.') {
+            n++;
+        }
+    }
+    (void) closedir(dp);
+    return(n);
+}
+
+
+static long get_proc_cpu_ticks(pid_t pid)
+{
+/*  Returns the user + system CPU time (in clock ticks) consumed by
+ *    process 'pid', or -1 if unavailable.
+ */
+    char path[64];
+    char line[1024];
+    FILE *fp;
+    char *p;
+    unsigned long utime, stime;
+    long n = -1;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+    if (!(fp = fopen(path, "r"))) {
+        return(-1);
+    }
+    /*  The comm field may contain spaces, so fields are counted from the
+     *    last ')'.  The utime & stime fields are the 12th & 13th after it.
+     */
+    if (fgets(line, sizeof(line), fp) && (p = strrchr(line, ')'))
+            && (sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u"
+                " %lu %lu", &utime, &stime) == 2)) {
+        n = (long) (utime + stime);
+    }
+    (void) fclose(fp);
+    return(n);
+}
+
+
+static void exit_handler(int signum)
+{
+    done = 1;
+    return;
+}
+
+
+static void storm_handler(int signum)
+{
+    storm = 1;
+    return;
+}
+
+
+static void stats_handler(int signum)
+{
+    stats = 1;
+    return;
+}
+
+
+static void display_stats(sim_conf_t *conf)
+{
+    int i;
+    int numUp = 0;
+
+    for (i = 0; i < conf->numEps; i++) {
+        if (is_ep_connected(&conf->eps[i])) {
+            numUp++;
+        }
+    }
+    log_msg(LOG_NOTICE, "%d/%d connected; %lu accepted, %lu refused,"
+        " %lu dropped; %lu bytes in, %lu bytes out",
+        numUp, conf->numEps, conf->numAccepts, conf->numRefusals,
+        conf->numDrops, conf->numBytesIn, conf->numBytesOut);
+    return;
+}
+
+
+static void mux_io(sim_conf_t *conf)
+{
+/*  Services the endpoints until signalled to exit.
+ */
+    sim_ep_t *ep;
+    long ms;
+    int n;
+    int i;
+
+    while (!done) {
+
+        if (storm) {
+            storm = 0;
+            log_msg(LOG_NOTICE, "Dropping all connections");
+            for (i = 0; i < conf->numEps; i++) {
+                if (is_ep_connected(&conf->eps[i])) {
+                    conf->numDrops++;
+                    drop_ep(conf, &conf->eps[i]);
+                }
+            }
+        }
+        if (stats) {
+            stats = 0;
+            display_stats(conf);
+        }
+        ms = SIM_TICK_MSECS - ((get_msecs() - msEpoch) - conf->msLast);
+        if (ms <= 0) {
+            tick(conf);
+            if (conf->benchState != SIM_BENCH_NONE) {
+                bench(conf);
+            }
+            continue;
+        }
+        if ((n = tpoll(conf->tp, ms)) < 0) {
+            if (errno != EINTR) {
+                log_err(errno, "Unable to multiplex I/O");
+            }
+            continue;
+        }
+        else if (n == 0) {
+            continue;
+        }
+        for (i = 0; i < conf->numEps; i++) {
+            ep = &conf->eps[i];
+            if ((ep->ld >= 0) && tpoll_is_set(conf->tp, ep->ld, POLLIN)) {
+                accept_ep(conf, ep);
+            }
+            if (ep->fd < 0) {
+                continue;
+            }
+            if (tpoll_is_set(conf->tp, ep->fd, POLLIN | POLLHUP | POLLERR)) {
+                read_ep(conf, ep);
+            }
+            if ((ep->fd >= 0) && tpoll_is_set(conf->tp, ep->fd, POLLOUT)) {
+                write_ep(conf, ep);
+            }
+        }
+        for (i = 0; conf->clients && (i < conf->numClients); i++) {
+            if ((conf->clients[i] >= 0) && tpoll_is_set(conf->tp,
+                    conf->clients[i], POLLIN | POLLHUP | POLLERR)) {
+                read_client(conf, i);
+            }
+        }
+    }
+    return;
+}
+
+
+static void tick(sim_conf_t *conf)
+{
+/*  Advances the simulation: transitions flapping endpoints, replenishes
+ *    the output and input credits, and generates output.
+ */
+    long ms;
+    long msDiff;
+    sim_ep_t *ep;
+    sim_spec_t *spec;
+    double max;
+    int i;
+
+    ms = get_msecs() - msEpoch;
+    msDiff = ms - conf->msLast;
+    conf->msLast = ms;
+
+    if ((conf->stormSecs > 0) && (ms >= conf->msStorm)) {
+        conf->msStorm = ms + conf->stormSecs * 1000L;
+        storm = 1;
+    }
+    for (i = 0; i < conf->numEps; i++) {
+        ep = &conf->eps[i];
+        spec = ep->spec;
+
+        /*  A flapping pty is hung up and replaced but stays silent while
+         *    down, since the daemon does not retry opening a serial device
+         *    that has disappeared; other endpoints stop listening.
+         */
+        if ((spec->flapUp > 0) && (ms >= ep->msFlap)) {
+            if (!ep->isDown) {
+                log_msg(LOG_INFO, "Flapping [%s] down for %ds",
+                    ep->name, spec->flapDown);
+                if (is_ep_connected(ep)) {
+                    conf->numDrops++;
+                }
+                if (spec->type == SIM_TYPE_PTY) {
+                    drop_ep(conf, ep);
+                }
+                else {
+                    close_ep(conf, ep);
+                }
+                ep->isDown = 1;
+                ep->msFlap = ms + spec->flapDown * 1000L;
+            }
+            else {
+                log_msg(LOG_INFO, "Flapping [%s] up", ep->name);
+                ep->isDown = 0;
+                if ((spec->type == SIM_TYPE_PTY) && (ep->fd >= 0)) {
+                    ep->isBooted = 0;
+                    ep->scriptPos = 0;
+                    ep->outCredit = 0;
+                }
+                else if (open_ep(conf, ep) < 0) {
+                    ep->isDown = 1;
+                }
+                ep->msFlap = ms + (ep->isDown ? spec->flapDown * 1000L :
+                    get_flap_msecs(spec));
+            }
+        }
+        if ((ep->fd < 0) || ep->isDown) {
+            continue;
+        }
+        /*  A pty master is not polled while hung-up (since it would poll
+         *    as ready continuously), so it is rechecked each tick.
+         */
+        if (ep->isHungUp) {
+            if (is_pty_hung_up(ep)) {
+                continue;
+            }
+            /*  Output is held until the next tick since the daemon may
+             *    flush the line when it sets the serial options.
+             */
+            log_msg(LOG_INFO, "Daemon opened [%s]", ep->name);
+            ep->isHungUp = 0;
+            ep->outCredit = 0;
+            tpoll_set(conf->tp, ep->fd, POLLIN);
+            continue;
+        }
+        if (spec->slowBps > 0) {
+            ep->inCredit += (double) spec->slowBps * msDiff / 1000.0;
+            if (ep->inCredit > spec->slowBps) {
+                ep->inCredit = spec->slowBps;
+            }
+            if (ep->inCredit >= 1.0) {
+                tpoll_set(conf->tp, ep->fd, POLLIN);
+            }
+        }
+        switch (spec->profile) {
+        case SIM_PROFILE_BURST:
+            if (ms >= ep->msBurst) {
+                ep->msBurst = ms + spec->period * 1000L;
+                ep->outCredit += spec->rate;
+            }
+            break;
+        case SIM_PROFILE_FLOOD:
+            if (spec->rate == 0) {
+                break;
+            }
+            /* fall-thru */
+        case SIM_PROFILE_LINES:
+            /* fall-thru */
+        case SIM_PROFILE_BOOT:
+            /* fall-thru */
+        case SIM_PROFILE_SCRIPT:
+            /*  Credit is capped at a second's worth so output is not
+             *    released in one burst after the endpoint has backed up.
+             */
+            ep->outCredit += (double) spec->rate * msDiff / 1000.0;
+            max = (spec->rate > 1) ? spec->rate : 1;
+            if (ep->outCredit > max) {
+                ep->outCredit = max;
+            }
+            break;
+        default:
+            break;
+        }
+        fill_ep(ep);
+        if (ep->bufOff < ep->bufLen) {
+            tpoll_set(conf->tp, ep->fd, POLLOUT);
+        }
+    }
+    return;
+}
+
+
+static long get_msecs(void)
+{
+/*  Returns the current time in milliseconds.
+ */
+    struct timeval tv;
+
+    if (gettimeofday(&tv, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    return((tv.tv_sec * 1000L) + (tv.tv_usec / 1000L));
+}
+
+
+static long get_flap_msecs(sim_spec_t *spec)
+{
+/*  Returns a random up-time in milliseconds for a flapping endpoint
+ *    of 'spec', between half and one and a half times the mean.
+ */
+    assert(spec->flapUp > 0);
+
+    return((spec->flapUp * 500L) + (random() % (spec->flapUp * 1000L)) + 1);
+}
+
+
+static int open_ep(sim_conf_t *conf, sim_ep_t *ep)
+{
+/*  Opens the endpoint 'ep' for connections.
+ *  Returns 0 on success, or -1 on error.
+ */
+    ep->isBooted = 0;
+    ep->scriptPos = 0;
+    ep->outCredit = 0;
+
+    switch (ep->spec->type) {
+    case SIM_TYPE_TELNET:
+        /* fall-thru */
+    case SIM_TYPE_RAW:
+        return(open_tcp_listener(conf, ep));
+    case SIM_TYPE_UNIX:
+        return(open_unix_listener(conf, ep));
+    case SIM_TYPE_PTY:
+        return(open_pty(conf, ep));
+    }
+    return(-1);
+}
+
+
+static void close_ep(sim_conf_t *conf, sim_ep_t *ep)
+{
+/*  Closes the endpoint 'ep' along with any connection to it,
+ *    so subsequent connections are refused.
+ */
+    if (ep->spec->type != SIM_TYPE_PTY) {
+        drop_ep(conf, ep);
+    }
+
+    if (ep->ld >= 0) {
+        tpoll_clear(conf->tp, ep->ld, POLLIN);
+        if (close(ep->ld) < 0) {
+            log_msg(LOG_WARNING, "Unable to close [%s] listener: %s",
+                ep->name, strerror(errno));
+        }
+        ep->ld = -1;
+    }
+    if (ep->fd >= 0) {
+        tpoll_clear(conf->tp, ep->fd, POLLIN | POLLOUT);
+        (void) close(ep->fd);
+        ep->fd = -1;
+    }
+    if (ep->path && (unlink(ep->path) < 0) && (errno != ENOENT)) {
+        log_msg(LOG_WARNING, "Unable to remove \"%s\": %s",
+            ep->path, strerror(errno));
+    }
+    return;
+}
+
+
+static void drop_ep(sim_conf_t *conf, sim_ep_t *ep)
+{
+/*  Drops the connection to the endpoint 'ep' (if any).
+ *  A pty is hung up by replacing it with a new pair, since the daemon
+ *    holds the slave open.  The new pair is linked in place before the
+ *    old master is closed so the daemon's reopen finds it.
+ */
+    int fd;
+
+    if (!is_ep_connected(ep)) {
+        return;
+    }
+    ep->bufLen = ep->bufOff = 0;
+    ep->inCredit = 0;
+    fd = ep->fd;
+    tpoll_clear(conf->tp, fd, POLLIN | POLLOUT);
+    ep->fd = -1;
+
+    if ((ep->spec->type == SIM_TYPE_PTY) && (open_pty(conf, ep) < 0)) {
+        log_msg(LOG_WARNING, "Unable to reopen [%s]", ep->name);
+    }
+    (void) close(fd);
+    return;
+}
+
+
+static int open_tcp_listener(sim_conf_t *conf, sim_ep_t *ep)
+{
+    struct sockaddr_in addr;
+    const int on = 1;
+    int ld;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(ep->port);
+    if (inet_pton(AF_INET, conf->host, &addr.sin_addr) <= 0) {
+        log_err(0, "Invalid IPv4 address \"%s\"", conf->host);
+    }
+    if ((ld = socket(PF_INET, SOCK_STREAM, 0)) < 0) {
+        log_msg(LOG_WARNING, "Unable to create [%s] socket: %s",
+            ep->name, strerror(errno));
+        return(-1);
+    }
+    set_fd_nonblocking(ld);
+    set_fd_closed_on_exec(ld);
+    if (setsockopt(ld, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0) {
+        log_msg(LOG_WARNING, "Unable to set SO_REUSEADDR on [%s]: %s",
+            ep->name, strerror(errno));
+    }
+    if (bind(ld, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        log_msg(LOG_WARNING, "Unable to bind [%s] to %s:%d: %s",
+            ep->name, conf->host, ep->port, strerror(errno));
+        (void) close(ld);
+        return(-1);
+    }
+    if (listen(ld, 8) < 0) {
+        log_msg(LOG_WARNING, "Unable to listen on [%s]: %s",
+            ep->name, strerror(errno));
+        (void) close(ld);
+        return(-1);
+    }
+    ep->ld = ld;
+    tpoll_set(conf->tp, ep->ld, POLLIN);
+    return(0);
+}
+
+
+static int open_unix_listener(sim_conf_t *conf, sim_ep_t *ep)
+{
+    struct sockaddr_un addr;
+    int ld;
+    int n;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    n = strlcpy(addr.sun_path, ep->path, sizeof(addr.sun_path));
+    if ((size_t) n >= sizeof(addr.sun_path)) {
+        log_err(0, "Socket path \"%s\" exceeds %d-byte limit",
+            ep->path, (int) sizeof(addr.sun_path) - 1);
+    }
+    if ((ld = socket(PF_UNIX, SOCK_STREAM, 0)) < 0) {
+        log_msg(LOG_WARNING, "Unable to create [%s] socket: %s",
+            ep->name, strerror(errno));
+        return(-1);
+    }
+    set_fd_nonblocking(ld);
+    set_fd_closed_on_exec(ld);
+    (void) unlink(ep->path);
+    if (bind(ld, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        log_msg(LOG_WARNING, "Unable to bind [%s] to \"%s\": %s",
+            ep->name, ep->path, strerror(errno));
+        (void) close(ld);
+        return(-1);
+    }
+    if (listen(ld, 8) < 0) {
+        log_msg(LOG_WARNING, "Unable to listen on [%s]: %s",
+            ep->name, strerror(errno));
+        (void) close(ld);
+        return(-1);
+    }
+    ep->ld = ld;
+    tpoll_set(conf->tp, ep->ld, POLLIN);
+    return(0);
+}
+
+
+static int open_pty(sim_conf_t *conf, sim_ep_t *ep)
+{
+/*  Opens a new pty pair for 'ep', linking its path to the slave device
+ *    for the daemon to open as a serial device.
+ */
+    int fd;
+    int sd;
+    char *name;
+    char *tmp;
+    struct termios tty;
+
+    if ((fd = posix_openpt(O_RDWR | O_NOCTTY)) < 0) {
+        log_msg(LOG_WARNING, "Unable to open [%s] pty: %s",
+            ep->name, strerror(errno));
+        return(-1);
+    }
+    if ((grantpt(fd) < 0) || (unlockpt(fd) < 0) || !(name = ptsname(fd))) {
+        log_msg(LOG_WARNING, "Unable to unlock [%s] pty: %s",
+            ep->name, strerror(errno));
+        (void) close(fd);
+        return(-1);
+    }
+    /*  Put the line in raw mode before the daemon opens the slave, lest the
+     *    line discipline echo output back to the master in the meantime.
+     *    Opening the slave also ensures the master polls as hung-up until
+     *    the daemon opens it, since a slave that has never been opened
+     *    does not.
+     */
+    if ((sd = open(name, O_RDWR | O_NOCTTY)) < 0) {
+        log_msg(LOG_WARNING, "Unable to open [%s] pty \"%s\": %s",
+            ep->name, name, strerror(errno));
+        (void) close(fd);
+        return(-1);
+    }
+    if (tcgetattr(sd, &tty) == 0) {
+        tty.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP
+            | INLCR | IGNCR | ICRNL | IXON);
+        tty.c_oflag &= ~OPOST;
+        tty.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+        tty.c_cflag &= ~(CSIZE | PARENB);
+        tty.c_cflag |= CS8;
+        (void) tcsetattr(sd, TCSANOW, &tty);
+    }
+    (void) close(sd);
+
+    tmp = create_format_string("%s.tmp", ep->path);
+    (void) unlink(tmp);
+    if ((symlink(name, tmp) < 0) || (rename(tmp, ep->path) < 0)) {
+        log_msg(LOG_WARNING, "Unable to link \"%s\" to \"%s\": %s",
+            ep->path, name, strerror(errno));
+        (void) unlink(tmp);
+        destroy_string(tmp);
+        (void) close(fd);
+        return(-1);
+    }
+    destroy_string(tmp);
+    set_fd_nonblocking(fd);
+    set_fd_closed_on_exec(fd);
+    ep->fd = fd;
+    ep->isHungUp = 1;
+    return(0);
+}
+
+
+static void accept_ep(sim_conf_t *conf, sim_ep_t *ep)
+{
+/*  Accepts a new connection on the listening socket of 'ep',
+ *    replacing any existing connection.
+ */
+    int sd;
+    struct linger l;
+    int n;
+
+    if ((sd = accept(ep->ld, NULL, NULL)) < 0) {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)
+                && (errno != ECONNABORTED)) {
+            log_msg(LOG_WARNING, "Unable to accept [%s] connection: %s",
+                ep->name, strerror(errno));
+        }
+        return;
+    }
+    if ((ep->spec->refusePct > 0) && (random() % 100 < ep->spec->refusePct)) {
+        /*  An abortive close sends a RST, as a terminal server does when
+         *    its port is in use.
+         */
+        l.l_onoff = 1;
+        l.l_linger = 0;
+        (void) setsockopt(sd, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+        (void) close(sd);
+        conf->numRefusals++;
+        log_msg(LOG_INFO, "Refused connection to [%s]", ep->name);
+        return;
+    }
+    if (ep->fd >= 0) {
+        log_msg(LOG_INFO, "Replacing connection to [%s]", ep->name);
+        conf->numDrops++;
+        drop_ep(conf, ep);
+    }
+    set_fd_nonblocking(sd);
+    set_fd_closed_on_exec(sd);
+    if (ep->spec->slowBps > 0) {
+        n = SIM_SLOW_RCVBUF;
+        if (setsockopt(sd, SOL_SOCKET, SO_RCVBUF, &n, sizeof(n)) < 0) {
+            log_msg(LOG_WARNING, "Unable to set SO_RCVBUF on [%s]: %s",
+                ep->name, strerror(errno));
+        }
+    }
+    ep->fd = sd;
+    ep->bufLen = ep->bufOff = 0;
+    ep->iacState = SIM_IAC_DATA;
+    memset(ep->optLocal, 0, sizeof(ep->optLocal));
+    memset(ep->optRemote, 0, sizeof(ep->optRemote));
+    conf->numAccepts++;
+    log_msg(LOG_INFO, "Accepted connection to [%s]", ep->name);
+
+    /*  Offer to echo and suppress go-ahead, as a terminal server does.
+     */
+    if (ep->spec->type == SIM_TYPE_TELNET) {
+        SIM_OPT_SET(ep->optLocal, TELOPT_ECHO);
+        put_telnet_cmd(ep, WILL, TELOPT_ECHO);
+        SIM_OPT_SET(ep->optLocal, TELOPT_SGA);
+        put_telnet_cmd(ep, WILL, TELOPT_SGA);
+    }
+    fill_ep(ep);
+    tpoll_set(conf->tp, ep->fd, POLLIN);
+    if (ep->bufOff < ep->bufLen) {
+        tpoll_set(conf->tp, ep->fd, POLLOUT);
+    }
+    return;
+}
+
+
+static void read_ep(sim_conf_t *conf, sim_ep_t *ep)
+{
+/*  Reads console input from the connection to 'ep', echoing it back
+ *    if the profile calls for it.
+ */
+    unsigned char buf[SIM_BUF_SIZE / 2];
+    int len = sizeof(buf);
+    int n;
+
+    if (ep->spec->slowBps > 0) {
+        if (ep->inCredit < 1.0) {
+            tpoll_clear(conf->tp, ep->fd, POLLIN);
+            return;
+        }
+        len = MIN(len, (int) ep->inCredit);
+    }
+again:
+    if ((n = read(ep->fd, buf, len)) < 0) {
+        if (errno == EINTR) {
+            goto again;
+        }
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            return;
+        }
+        /*  A pty master reads EIO once the slave has been closed.
+         */
+        if ((ep->spec->type == SIM_TYPE_PTY) && (errno == EIO)) {
+            log_msg(LOG_INFO, "Daemon closed [%s]", ep->name);
+            ep->isHungUp = 1;
+            ep->bufLen = ep->bufOff = 0;
+            tpoll_clear(conf->tp, ep->fd, POLLIN | POLLOUT);
+            return;
+        }
+        log_msg(LOG_INFO, "Unable to read from [%s]: %s",
+            ep->name, strerror(errno));
+        drop_ep(conf, ep);
+        return;
+    }
+    if (n == 0) {
+        log_msg(LOG_INFO, "Connection to [%s] closed", ep->name);
+        drop_ep(conf, ep);
+        return;
+    }
+    conf->numBytesIn += n;
+    if (ep->spec->slowBps > 0) {
+        ep->inCredit -= n;
+    }
+    if (ep->spec->type == SIM_TYPE_TELNET) {
+        n = process_telnet_input(ep, buf, n);
+    }
+    if ((ep->spec->profile == SIM_PROFILE_ECHO)
+            || ((ep->spec->profile == SIM_PROFILE_BOOT) && ep->isBooted)) {
+        (void) put_data(ep, buf, n);
+    }
+    if (ep->bufOff < ep->bufLen) {
+        tpoll_set(conf->tp, ep->fd, POLLOUT);
+    }
+    return;
+}
+
+
+static void write_ep(sim_conf_t *conf, sim_ep_t *ep)
+{
+/*  Writes pending output to the connection to 'ep'.
+ */
+    int n;
+
+    if (ep->isHungUp) {
+        tpoll_clear(conf->tp, ep->fd, POLLOUT);
+        return;
+    }
+    fill_ep(ep);
+    if (ep->bufOff >= ep->bufLen) {
+        tpoll_clear(conf->tp, ep->fd, POLLOUT);
+        return;
+    }
+again:
+    n = write(ep->fd, ep->buf + ep->bufOff, ep->bufLen - ep->bufOff);
+    if (n < 0) {
+        if (errno == EINTR) {
+            goto again;
+        }
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            return;
+        }
+        if ((ep->spec->type == SIM_TYPE_PTY) && (errno == EIO)) {
+            ep->isHungUp = 1;
+            ep->bufLen = ep->bufOff = 0;
+            tpoll_clear(conf->tp, ep->fd, POLLIN | POLLOUT);
+            return;
+        }
+        log_msg(LOG_INFO, "Unable to write to [%s]: %s",
+            ep->name, strerror(errno));
+        drop_ep(conf, ep);
+        return;
+    }
+    conf->numBytesOut += n;
+    ep->bufOff += n;
+    if (ep->bufOff >= ep->bufLen) {
+        ep->bufOff = ep->bufLen = 0;
+        fill_ep(ep);
+        if (ep->bufLen == 0) {
+            tpoll_clear(conf->tp, ep->fd, POLLOUT);
+        }
+    }
+    return;
+}
+
+
+static int is_ep_connected(sim_ep_t *ep)
+{
+/*  Returns true if the daemon is connected to 'ep'.
+ */
+    if (ep->fd < 0) {
+        return(0);
+    }
+    if (ep->spec->type == SIM_TYPE_PTY) {
+        return(!ep->isHungUp);
+    }
+    return(1);
+}
+
+
+static int is_pty_hung_up(sim_ep_t *ep)
+{
+/*  Returns true if the slave of the pty 'ep' is not open.
+ */
+    struct pollfd pfd;
+
+    assert(ep->spec->type == SIM_TYPE_PTY);
+
+    pfd.fd = ep->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) < 0) {
+        return(1);
+    }
+    return((pfd.revents & POLLHUP) ? 1 : 0);
+}
+
+
+static void fill_ep(sim_ep_t *ep)
+{
+/*  Generates output for 'ep' according to its profile,
+ *    as much as its credit and buffer space allow.
+ */
+    sim_spec_t *spec = ep->spec;
+    char line[SIM_BUF_SIZE / 2 + 1];
+    int n;
+    int i;
+
+    if (!is_ep_connected(ep)) {
+        return;
+    }
+    for (;;) {
+        switch (spec->profile) {
+        case SIM_PROFILE_FLOOD:
+            if ((spec->rate > 0) && (ep->outCredit < spec->len + 2)) {
+                return;
+            }
+            break;
+        case SIM_PROFILE_LINES:
+            /* fall-thru */
+        case SIM_PROFILE_BURST:
+            /* fall-thru */
+        case SIM_PROFILE_SCRIPT:
+            if (ep->outCredit < 1.0) {
+                return;
+            }
+            break;
+        case SIM_PROFILE_BOOT:
+            if (ep->isBooted || (ep->outCredit < 1.0)) {
+                return;
+            }
+            break;
+        default:
+            return;
+        }
+        switch (spec->profile) {
+        case SIM_PROFILE_SCRIPT:
+            if (put_line(ep, spec->script[ep->scriptPos]) < 0) {
+                return;
+            }
+            ep->scriptPos = (ep->scriptPos + 1) % spec->numScript;
+            ep->outCredit -= 1.0;
+            break;
+        case SIM_PROFILE_BOOT:
+            if (!sim_boot_log[ep->scriptPos]) {
+                n = snprintf(line, sizeof(line), "\r\n%s login: ", ep->name);
+                if (put_data(ep, (unsigned char *) line, n) < 0) {
+                    return;
+                }
+                ep->isBooted = 1;
+                return;
+            }
+            if (put_line(ep, sim_boot_log[ep->scriptPos]) < 0) {
+                return;
+            }
+            ep->scriptPos++;
+            ep->outCredit -= 1.0;
+            break;
+        default:
+            /*  Numbered lines padded to the line length with a rotating
+             *    pattern so a reader can check them for loss or corruption.
+             */
+            n = snprintf(line, sizeof(line), "%s %08lu ", ep->name, ep->seq);
+            for (i = n; i < spec->len; i++) {
+                line[i] = 0x21 + ((ep->seq + i) % 94);
+            }
+            line[MAX(n, spec->len)] = '\0';
+            if (put_line(ep, line) < 0) {
+                return;
+            }
+            ep->seq++;
+            ep->outCredit -= (spec->profile == SIM_PROFILE_FLOOD) ?
+                (double) strlen(line) + 2 : 1.0;
+            if (ep->outCredit < 0) {
+                ep->outCredit = 0;
+            }
+            break;
+        }
+    }
+}
+
+
+static int put_line(sim_ep_t *ep, const char *line)
+{
+/*  Appends 'line' with a CR/LF termination to the output of 'ep'.
+ *  Returns 0 on success, or -1 if there is insufficient space.
+ */
+    int n = strlen(line);
+    int avail;
+
+    avail = sizeof(ep->buf) - ep->bufLen - 2;
+    if ((ep->spec->type == SIM_TYPE_TELNET) ? (n * 2 > avail) : (n > avail)) {
+        return(-1);
+    }
+    (void) put_data(ep, (const unsigned char *) line, n);
+    (void) put_data(ep, (const unsigned char *) "\r\n", 2);
+    return(0);
+}
+
+
+static int put_data(sim_ep_t *ep, const unsigned char *src, int len)
+{
+/*  Appends 'len' bytes of 'src' to the output of 'ep',
+ *    escaping IAC chars on telnet endpoints.
+ *  Returns the number of bytes appended, or -1 if 'src' was truncated.
+ */
+    const unsigned char *p;
+    int isTelnet = (ep->spec->type == SIM_TYPE_TELNET);
+
+    if ((ep->bufOff > 0) && (ep->bufOff == ep->bufLen)) {
+        ep->bufOff = ep->bufLen = 0;
+    }
+    else if ((ep->bufOff > 0)
+            && ((size_t) ep->bufLen + len * 2 > sizeof(ep->buf))) {
+        memmove(ep->buf, ep->buf + ep->bufOff, ep->bufLen - ep->bufOff);
+        ep->bufLen -= ep->bufOff;
+        ep->bufOff = 0;
+    }
+    for (p = src; p < src + len; p++) {
+        if ((size_t) ep->bufLen + ((isTelnet && (*p == IAC)) ? 2 : 1)
+                > sizeof(ep->buf)) {
+            return(-1);
+        }
+        if (isTelnet && (*p == IAC)) {
+            ep->buf[ep->bufLen++] = IAC;
+        }
+        ep->buf[ep->bufLen++] = *p;
+    }
+    return(len);
+}
+
+
+static void put_telnet_cmd(sim_ep_t *ep, int cmd, int opt)
+{
+/*  Appends the telnet 'cmd' (with 'opt' if >= 0) to the output of 'ep'.
+ *  Commands are dropped if the output buffer is full.
+ */
+    if ((size_t) ep->bufLen + 3 > sizeof(ep->buf)) {
+        return;
+    }
+    ep->buf[ep->bufLen++] = IAC;
+    ep->buf[ep->bufLen++] = cmd;
+    if (opt >= 0) {
+        ep->buf[ep->bufLen++] = opt;
+    }
+    return;
+}
+
+
+static int process_telnet_input(sim_ep_t *ep, unsigned char *buf, int len)
+{
+/*  Processes telnet commands in the 'len' bytes of 'buf' from the daemon,
+ *    removing them in-place.
+ *  Returns the number of data bytes remaining in 'buf'.
+ */
+    unsigned char *src = buf;
+    unsigned char *dst = buf;
+    unsigned char c;
+
+    while (src < buf + len) {
+        c = *src++;
+        switch (ep->iacState) {
+        case SIM_IAC_DATA:
+            if (c == IAC) {
+                ep->iacState = SIM_IAC_CMD;
+            }
+            else {
+                *dst++ = c;
+            }
+            break;
+        case SIM_IAC_CMD:
+            ep->iacState = SIM_IAC_DATA;
+            switch (c) {
+            case IAC:
+                *dst++ = c;
+                break;
+            case DO:
+                /* fall-thru */
+            case DONT:
+                /* fall-thru */
+            case WILL:
+                /* fall-thru */
+            case WONT:
+                ep->iacCmd = c;
+                ep->iacState = SIM_IAC_OPT;
+                break;
+            case SB:
+                ep->iacState = SIM_IAC_SB;
+                break;
+            case AYT:
+                (void) put_data(ep, (const unsigned char *) "\r\n[Yes]\r\n", 9);
+                break;
+            case BREAK:
+                log_msg(LOG_INFO, "Received BREAK on [%s]", ep->name);
+                break;
+            default:                    /* NOP, etc. */
+                break;
+            }
+            break;
+        case SIM_IAC_OPT:
+            ep->iacState = SIM_IAC_DATA;
+            process_telnet_opt(ep, ep->iacCmd, c);
+            break;
+        case SIM_IAC_SB:
+            if (c == IAC) {
+                ep->iacState = SIM_IAC_SB_IAC;
+            }
+            break;
+        case SIM_IAC_SB_IAC:
+            ep->iacState = (c == SE) ? SIM_IAC_DATA : SIM_IAC_SB;
+            break;
+        }
+    }
+    return(dst - buf);
+}
+
+
+static void process_telnet_opt(sim_ep_t *ep, int cmd, int opt)
+{
+/*  Processes the telnet option negotiation 'cmd' for 'opt' in the manner
+ *    of a terminal server: it will echo, suppress go-ahead, and transmit
+ *    binary, and will accept binary and suppress go-ahead from the peer.
+ *  Only changes of state are acknowledged in order to avoid loops.
+ */
+    switch (cmd) {
+    case DO:
+        if ((opt == TELOPT_ECHO) || (opt == TELOPT_SGA)
+                || (opt == TELOPT_BINARY)) {
+            if (!SIM_OPT_IS_SET(ep->optLocal, opt)) {
+                SIM_OPT_SET(ep->optLocal, opt);
+                put_telnet_cmd(ep, WILL, opt);
+            }
+        }
+        else {
+            put_telnet_cmd(ep, WONT, opt);
+        }
+        break;
+    case DONT:
+        if (SIM_OPT_IS_SET(ep->optLocal, opt)) {
+            SIM_OPT_CLR(ep->optLocal, opt);
+            put_telnet_cmd(ep, WONT, opt);
+        }
+        break;
+    case WILL:
+        if ((opt == TELOPT_SGA) || (opt == TELOPT_BINARY)) {
+            if (!SIM_OPT_IS_SET(ep->optRemote, opt)) {
+                SIM_OPT_SET(ep->optRemote, opt);
+                put_telnet_cmd(ep, DO, opt);
+            }
+        }
+        else {
+            put_telnet_cmd(ep, DONT, opt);
+        }
+        break;
+    case WONT:
+        if (SIM_OPT_IS_SET(ep->optRemote, opt)) {
+            SIM_OPT_CLR(ep->optRemote, opt);
+            put_telnet_cmd(ep, DONT, opt);
+        }
+        break;
+    }
+    return;
+}
@@ -0,0 +1,80 @@
+#!/bin/sh
+##
+# Runs a send/expect script (-x) over a compressed (-z) client connection
+#   and checks that the results are displayed as text.
+#
+# Usage: exec-compress.sh [BUILDDIR]
+##
+
+BUILDDIR=${1:-.}
+CONMAN="$BUILDDIR/conman"
+CONMAND="$BUILDDIR/conmand"
+PORT=${CONMAN_TEST_PORT:-17890}
+TMPDIR=`mktemp -d "${TMPDIR:-/tmp}/conman-test.XXXXXX"` || exit 1
+PID=
+
+cleanup()
+{
+  test -n "$PID" && kill "$PID" 2>/dev/null && wait "$PID" 2>/dev/null
+  rm -rf "$TMPDIR"
+}
+trap cleanup 0
+trap 'exit 1' 1 2 15
+
+fail()
+{
+  echo "FAIL: $*"
+  test -f "$TMPDIR/out" && sed -n '1,20p' "$TMPDIR/out" | cat -v
+  test -f "$TMPDIR/log" && cat "$TMPDIR/log"
+  exit 1
+}
+
+"$CONMAN" -V 2>&1 | grep -i zlib >/dev/null || {
+  echo "SKIP: conman built without zlib"; exit 0; }
+
+cat >"$TMPDIR/console.sh" <<'EOT'
+#!/bin/sh
+while :; do
+  i=0
+  while test $i -lt 100; do echo "line $i of output"; i=`expr $i + 1`; done
+  sleep 1
+done
+EOT
+chmod 755 "$TMPDIR/console.sh"
+
+cat >"$TMPDIR/conman.conf" <<EOT
+console name="c1" dev="$TMPDIR/console.sh"
+EOT
+
+cat >"$TMPDIR/script" <<'EOT'
+timeout 10
+capture on
+expect "line 99 of output"
+EOT
+
+"$CONMAND" -F -c "$TMPDIR/conman.conf" -p "$PORT" \
+  -P "$TMPDIR/pid" >"$TMPDIR/log" 2>&1 &
+PID=$!
+
+n=0
+until "$CONMAN" -d "127.0.0.1:$PORT" -q c1 2>/dev/null | grep c1 >/dev/null
+do
+  kill -0 "$PID" 2>/dev/null || fail "conmand exited"
+  n=`expr $n + 1`
+  test $n -gt 50 && fail "conmand did not start"
+  sleep 0.1
+done
+
+"$CONMAN" -d "127.0.0.1:$PORT" -z -x "$TMPDIR/script" c1 \
+  >"$TMPDIR/out" 2>&1 || fail "conman exited with status $?"
+
+grep "^c1: line 99 of output" "$TMPDIR/out" >/dev/null \
+  || fail "captured output not found"
+grep "Script completed on 1 of 1 console" "$TMPDIR/out" >/dev/null \
+  || fail "script completion not found"
+if LC_ALL=C grep -v '^[[:print:][:space:]]*$' "$TMPDIR/out" >/dev/null; then
+  fail "output is not text"
+fi
+
+echo "PASS: exec-compress"
+exit 0
@@ -0,0 +1,199 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+/*  filter-bench: compares each specialized output filter variant against
+ *    the generic routine that tests the filter options on every byte.
+ *
+ *  The filter source is included directly so its static variants can be
+ *    called.  Each variant & the generic routine filter the same console-like
+ *    input (CR/LF-terminated lines with occasional ANSI sequences, control
+ *    chars, and 8-bit chars); they are timed in alternation over several
+ *    rounds, and the best round of each is reported.  Process CPU time is
+ *    measured to reduce the effect of other load on the machine.
+ *
+ *  Usage: filter-bench [ROUNDS]
+ */
+
+#include "server-filter.c"
+
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_BUF_SIZE          (1024 * 1024)
+#define BENCH_PASSES            20
+#define BENCH_DEFAULT_ROUNDS    7
+
+typedef int (*bench_filter_f)(filter_t *, const unsigned char *, int,
+    filter_flush_f, void *);
+
+typedef struct bench_variant {
+    const char      *name;
+    unsigned         opts;
+} bench_variant_t;
+
+static void fill_bench_buf(unsigned char *buf, int len);
+static double time_bench_filter(bench_filter_f process, unsigned opts,
+    const unsigned char *buf, int len);
+static int sink_bench_data(void *arg, const void *buf, int len);
+static double get_bench_secs(void);
+
+static const bench_variant_t bench_variants[] = {
+    { "crlf",               CONMAN_FILTER_NEWLINE },
+    { "sanitize",           CONMAN_FILTER_SANITIZE },
+    { "timestamp",          CONMAN_FILTER_TIMESTAMP },
+    { "sanitize+timestamp",
+        CONMAN_FILTER_SANITIZE | CONMAN_FILTER_TIMESTAMP },
+    { NULL,                 0 }
+};
+
+static unsigned long bench_sum = 0;
+
+
+int main(int argc, char *argv[])
+{
+    static unsigned char buf[BENCH_BUF_SIZE];
+    const bench_variant_t *v;
+    filter_t filter;
+    int rounds = BENCH_DEFAULT_ROUNDS;
+    int i;
+    double t, tBest, tGeneric, tGenericBest;
+    double mb;
+
+    if ((argc > 1) && ((rounds = atoi(argv[1])) <= 0)) {
+        fprintf(stderr, "Usage: %s [ROUNDS]\n", argv[0]);
+        exit(1);
+    }
+    fill_bench_buf(buf, sizeof(buf));
+    mb = (double) BENCH_PASSES * sizeof(buf) / (1024 * 1024);
+
+    printf("%-20s %14s %14s %8s\n",
+        "variant", "specialized", "generic", "speedup");
+    for (v = bench_variants; v->name; v++) {
+        init_filter(&filter, v->opts);
+        tBest = tGenericBest = 0;
+        for (i = 0; i < rounds; i++) {
+            t = time_bench_filter(filter.process, v->opts, buf, sizeof(buf));
+            tGeneric = time_bench_filter(filter_data_generic, v->opts,
+                buf, sizeof(buf));
+            if ((i == 0) || (t < tBest)) {
+                tBest = t;
+            }
+            if ((i == 0) || (tGeneric < tGenericBest)) {
+                tGenericBest = tGeneric;
+            }
+        }
+        printf("%-20s %9.1f MB/s %9.1f MB/s %7.2fx\n", v->name,
+            mb / tBest, mb / tGenericBest, tGenericBest / tBest);
+    }
+    return(bench_sum == 0);
+}
+
+
+static void fill_bench_buf(unsigned char *buf, int len)
+{
+/*  Fills the buffer (buf) of length (len) with lines of console output.
+ */
+    static const char *ansi[] = { "\033[1m", "\033[0m", "\033[2J\033[H" };
+    unsigned char *p = buf;
+    unsigned char *q = buf + len;
+    int col = 0;
+    int r;
+    const char *s;
+
+    srand(1);
+    while (p < q) {
+        r = rand() % 1000;
+        if (col >= 72) {
+            *p++ = '\r';
+            if (p < q) {
+                *p++ = '\n';
+            }
+            col = 0;
+            continue;
+        }
+        if (r < 5) {
+            for (s = ansi[r % 3]; *s && (p < q); s++) {
+                *p++ = *s;
+            }
+        }
+        else if (r < 10) {
+            *p++ = (r < 8) ? 0x07 : 0xB0;
+        }
+        else {
+            *p++ = 0x20 + (r % 0x5F);
+        }
+        col++;
+    }
+    return;
+}
+
+
+static double time_bench_filter(bench_filter_f process, unsigned opts,
+    const unsigned char *buf, int len)
+{
+/*  Returns the secs taken by (process) to filter the buffer (buf) of
+ *    length (len) BENCH_PASSES times using the filter options (opts).
+ */
+    filter_t filter;
+    double t0;
+    int i;
+
+    init_filter(&filter, opts);
+    t0 = get_bench_secs();
+    for (i = 0; i < BENCH_PASSES; i++) {
+        process(&filter, buf, len, sink_bench_data, &bench_sum);
+    }
+    return(get_bench_secs() - t0);
+}
+
+
+static int sink_bench_data(void *arg, const void *buf, int len)
+{
+/*  Consumes filtered data (buf) of length (len), summing its length
+ *    into (arg) so the filtering cannot be optimized away.
+ */
+    *((unsigned long *) arg) += len + ((const unsigned char *) buf)[0];
+    return(len);
+}
+
+
+static double get_bench_secs(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) < 0) {
+        perror("clock_gettime");
+        exit(1);
+    }
+    return(ts.tv_sec + (ts.tv_nsec / 1e9));
+}
+
+
+/*  The filter writes into objs only via write_filtered_obj_data(),
+ *    which is not benchmarked.
+ */
+int write_obj_data(obj_t *obj, const void *src, int len, int isInfo)
+{
+    return(len);
+}
@@ -35,6 +35,7 @@
 #include <string.h>
 #include <sys/resource.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 #include "bool.h"
 #include "log.h"
@@ -66,6 +67,12 @@
  *  O(log n) for insertion, deletion, and dispatch; or hashed timing wheels
  *  [Varghese and Lauck 1996] which can be as efficient as O(1) for insertion,
  *  deletion, and dispatch.
+ *
+ *  Timer expiration times are kept on the monotonic clock (when available)
+ *  so stepping the time of day (eg, by NTP) neither bunches up timers nor
+ *  stalls them.  With timer slack, the wakeup for the next timer is deferred
+ *  to the next multiple of the slack on that clock so timers expiring near
+ *  each other are dispatched together (much like round_jiffies() in Linux).
  */
 
 
@@ -90,6 +97,7 @@ struct tpoll {
     int              max_fd;            /* max fd in array in use            */
     _tpoll_timer_t   timers_active;     /* sorted list of active timers      */
     int              timers_next_id;    /* next id to be assigned to a timer */
+    int              timers_slack;      /* msecs timer wakeups may be delayed*/
     pthread_mutex_t  mutex;             /* locking primitive                 */
     bool             is_blocked;        /* flag set when blocking on poll()  */
     bool             is_realloced;      /* flag set after fd_array[] realloc */
@@ -118,8 +126,13 @@ static void _tpoll_signal_recv (tpoll_t tp);
 
 static int _tpoll_grow (tpoll_t tp, int num_fds_req);
 
+static int _tpoll_timeout_insert (tpoll_t tp, callback_f cb, void *arg,
+    const struct timeval *tvp);
+
 static void _tpoll_get_timeval (struct timeval *tvp, int ms);
 
+static void _tpoll_get_wakeup (tpoll_t tp, struct timeval *tvp);
+
 static int _tpoll_diff_timeval (struct timeval *tvp1, struct timeval *tvp0);
 
 
@@ -149,6 +162,7 @@ tpoll_create (int n)
     }
     tp->fd_pipe[ 0 ] = tp->fd_pipe[ 1 ] = -1;
     tp->timers_active = NULL;
+    tp->timers_slack = 0;
     tp->is_blocked = false;
     tp->is_realloced = false;
     tp->is_signaled = false;
@@ -436,54 +450,25 @@ tpoll_timeout_absolute (tpoll_t tp, callback_f cb, void *arg,
 /*  Sets an "absolute" timer event for the tpoll object [tp] specifying when
  *    the timer should expire.  At expiration time [tvp], the callback
  *    function [cb] will be invoked with the argument [arg].
+ *  The time of day [tvp] is converted to an interval when the timer is set;
+ *    if the time of day is subsequently stepped, the timer expires after
+ *    that interval regardless.
  *  Returns a timer ID > 0 for use with tpoll_timeout_cancel(), or -1 on error.
  */
-    _tpoll_timer_t  t;
-    _tpoll_timer_t *t_ptr;
-    int             rc;
-    int             e;
+    struct timeval tv_now;
+    struct timeval tv;
+    int            ms;
 
-    if (!tp) {
-        errno = EINVAL;
-        return (-1);
-    }
-    if (!cb) {
-        errno = EINVAL;
-        return (-1);
-    }
     if (!tvp) {
         errno = EINVAL;
         return (-1);
     }
-    if (!(t = malloc (sizeof (struct tpoll_timer)))) {
-        return (-1);
-    }
-    t->fnc = cb;
-    t->arg = arg;
-    t->tv = *tvp;
-
-    if ((e = pthread_mutex_lock (&tp->mutex)) != 0) {
-        log_err (errno = e, "Unable to lock tpoll mutex");
-    }
-    rc = t->id = tp->timers_next_id++;
-    if (tp->timers_next_id <= 0) {
-        tp->timers_next_id = 1;
+    if (gettimeofday (&tv_now, NULL) < 0) {
+        log_err (errno, "Unable to get time of day");
     }
-    t_ptr = &tp->timers_active;
-    while (*t_ptr && !timercmp (tvp, &(*t_ptr)->tv, <)) {
-        t_ptr = &((*t_ptr)->next);
-    }
-    if (*t_ptr == tp->timers_active) {
-        _tpoll_signal_send (tp);
-    }
-    t->next = *t_ptr;
-    *t_ptr = t;
-
-    DPRINTF((22, "tpoll timer set id=%d.\n", t->id));
-    if ((e = pthread_mutex_unlock (&tp->mutex)) != 0) {
-        log_err (errno = e, "Unable to unlock tpoll mutex");
-    }
-    return (rc);
+    ms = _tpoll_diff_timeval ((struct timeval *) tvp, &tv_now);
+    _tpoll_get_timeval (&tv, ms);
+    return (_tpoll_timeout_insert (tp, cb, arg, &tv));
 }
 
 
@@ -498,7 +483,7 @@ tpoll_timeout_relative (tpoll_t tp, callback_f cb, void *arg, int ms)
     struct timeval tv;
 
     _tpoll_get_timeval (&tv, ms);
-    return (tpoll_timeout_absolute (tp, cb, arg, &tv));
+    return (_tpoll_timeout_insert (tp, cb, arg, &tv));
 }
 
 
@@ -549,6 +534,39 @@ tpoll_timeout_cancel (tpoll_t tp, int id)
 }
 
 
+int
+tpoll_set_slack (tpoll_t tp, int ms)
+{
+/*  Sets the timer slack for the tpoll object [tp] to [ms] milliseconds.
+ *    Timers may be dispatched up to [ms] milliseconds after they expire
+ *    in order to dispatch timers expiring near each other in one wakeup.
+ *    A slack of 0 dispatches each timer as soon as it expires. (default)
+ *  Returns 0 on success, or -1 on error.
+ */
+    int e;
+
+    if (!tp) {
+        errno = EINVAL;
+        return (-1);
+    }
+    if (ms < 0) {
+        errno = EINVAL;
+        return (-1);
+    }
+    if ((e = pthread_mutex_lock (&tp->mutex)) != 0) {
+        log_err (errno = e, "Unable to lock tpoll mutex");
+    }
+    tp->timers_slack = ms;
+    _tpoll_signal_send (tp);
+
+    DPRINTF((22, "tpoll timer slack set to %dms.\n", ms));
+    if ((e = pthread_mutex_unlock (&tp->mutex)) != 0) {
+        log_err (errno = e, "Unable to unlock tpoll mutex");
+    }
+    return (0);
+}
+
+
 int
 tpoll (tpoll_t tp, int ms)
 {
@@ -567,6 +585,7 @@ tpoll (tpoll_t tp, int ms)
  */
     struct timeval  tv_timeout;
     struct timeval  tv_now;
+    struct timeval  tv_wakeup;
     _tpoll_timer_t  t;
     int             timeout;
     int             ms_diff;
@@ -626,21 +645,23 @@ tpoll (tpoll_t tp, int ms)
         }
         else {
             _tpoll_get_timeval (&tv_now, 0);
-
+            if (tp->timers_active) {
+                _tpoll_get_wakeup (tp, &tv_wakeup);
+            }
             if (ms < 0) {
                 assert (tp->timers_active != NULL);
                 ms_diff =
-                    _tpoll_diff_timeval (&tp->timers_active->tv, &tv_now);
+                    _tpoll_diff_timeval (&tv_wakeup, &tv_now);
             }
             else if (!tp->timers_active) {
                 assert (ms > 0);
                 ms_diff =
                     _tpoll_diff_timeval (&tv_timeout, &tv_now);
             }
-            else if (!timercmp (&tp->timers_active->tv, &tv_timeout, >)) {
+            else if (!timercmp (&tv_wakeup, &tv_timeout, >)) {
                 assert (ms > 0);
                 ms_diff =
-                    _tpoll_diff_timeval (&tp->timers_active->tv, &tv_now);
+                    _tpoll_diff_timeval (&tv_wakeup, &tv_now);
             }
             else {
                 assert (ms > 0);
@@ -703,6 +724,61 @@ tpoll (tpoll_t tp, int ms)
  *  Internal Functions
  *****************************************************************************/
 
+static int
+_tpoll_timeout_insert (tpoll_t tp, callback_f cb, void *arg,
+    const struct timeval *tvp)
+{
+/*  Inserts a timer event into the tpoll object [tp] to invoke the callback
+ *    function [cb] with the argument [arg] at time [tvp] on tpoll's clock.
+ *  Returns a timer ID > 0 for use with tpoll_timeout_cancel(), or -1 on error.
+ */
+    _tpoll_timer_t  t;
+    _tpoll_timer_t *t_ptr;
+    int             rc;
+    int             e;
+
+    if (!tp) {
+        errno = EINVAL;
+        return (-1);
+    }
+    if (!cb) {
+        errno = EINVAL;
+        return (-1);
+    }
+    assert (tvp != NULL);
+
+    if (!(t = malloc (sizeof (struct tpoll_timer)))) {
+        return (-1);
+    }
+    t->fnc = cb;
+    t->arg = arg;
+    t->tv = *tvp;
+
+    if ((e = pthread_mutex_lock (&tp->mutex)) != 0) {
+        log_err (errno = e, "Unable to lock tpoll mutex");
+    }
+    rc = t->id = tp->timers_next_id++;
+    if (tp->timers_next_id <= 0) {
+        tp->timers_next_id = 1;
+    }
+    t_ptr = &tp->timers_active;
+    while (*t_ptr && !timercmp (tvp, &(*t_ptr)->tv, <)) {
+        t_ptr = &((*t_ptr)->next);
+    }
+    if (*t_ptr == tp->timers_active) {
+        _tpoll_signal_send (tp);
+    }
+    t->next = *t_ptr;
+    *t_ptr = t;
+
+    DPRINTF((22, "tpoll timer set id=%d.\n", t->id));
+    if ((e = pthread_mutex_unlock (&tp->mutex)) != 0) {
+        log_err (errno = e, "Unable to unlock tpoll mutex");
+    }
+    return (rc);
+}
+
+
 static void
 _tpoll_init (tpoll_t tp, tpoll_zero_t how)
 {
@@ -870,14 +946,27 @@ _tpoll_grow (tpoll_t tp, int num_fds_req)
 static void
 _tpoll_get_timeval (struct timeval *tvp, int ms)
 {
-/*  Sets [tvp] to the current time.
+/*  Sets [tvp] to the current time on tpoll's clock, which is the monotonic
+ *    clock if available, or the time of day otherwise.
  *  If [ms] > 0, adds the number of milliseconds [ms] to [tvp].
  */
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+#endif /* HAVE_CLOCK_GETTIME && CLOCK_MONOTONIC */
+
     assert (tvp != NULL);
 
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC)
+    if (clock_gettime (CLOCK_MONOTONIC, &ts) < 0) {
+        log_err (errno, "Unable to get monotonic time");
+    }
+    tvp->tv_sec = ts.tv_sec;
+    tvp->tv_usec = ts.tv_nsec / 1000;
+#else /* !HAVE_CLOCK_GETTIME || !CLOCK_MONOTONIC */
     if (gettimeofday (tvp, NULL) < 0) {
         log_err (0, "Unable to get time of day");
     }
+#endif /* !HAVE_CLOCK_GETTIME || !CLOCK_MONOTONIC */
     if (ms > 0) {
         tvp->tv_sec += ms / 1000;
         tvp->tv_usec += (ms % 1000) * 1000;
@@ -890,6 +979,32 @@ _tpoll_get_timeval (struct timeval *tvp, int ms)
 }
 
 
+static void
+_tpoll_get_wakeup (tpoll_t tp, struct timeval *tvp)
+{
+/*  Sets [tvp] to the time at which to wake up for the next timer to expire.
+ *  With timer slack, this is rounded up to the next multiple of the slack.
+ *  This routine assumes the [tp] mutex is already locked.
+ */
+    long long us;
+    long long slack;
+
+    assert (tp != NULL);
+    assert (tp->timers_active != NULL);
+    assert (tvp != NULL);
+
+    *tvp = tp->timers_active->tv;
+    if (tp->timers_slack > 1) {
+        slack = (long long) tp->timers_slack * 1000;
+        us = ((long long) tvp->tv_sec * 1000000) + tvp->tv_usec;
+        us = ((us + slack - 1) / slack) * slack;
+        tvp->tv_sec = us / 1000000;
+        tvp->tv_usec = us % 1000000;
+    }
+    return;
+}
+
+
 static int
 _tpoll_diff_timeval (struct timeval *tvp1, struct timeval *tvp0)
 {
@@ -900,9 +1015,7 @@ _tpoll_diff_timeval (struct timeval *tvp1, struct timeval *tvp0)
     int            ms;
 
     if (!tvp0 || !tvp1) {
-        if (gettimeofday (&tv, NULL) < 0) {
-            log_err (0, "Unable to get time of day");
-        }
+        _tpoll_get_timeval (&tv, 0);
         if (!tvp0) {
             tvp0 = &tv;
         }
@@ -76,6 +76,8 @@ int tpoll_timeout_relative (tpoll_t tp, callback_f cb, void *arg, int ms);
 
 int tpoll_timeout_cancel (tpoll_t tp, int id);
 
+int tpoll_set_slack (tpoll_t tp, int ms);
+
 int tpoll (tpoll_t tp, int ms);
 
 